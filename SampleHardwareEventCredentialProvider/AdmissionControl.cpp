@@ -0,0 +1,95 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+
+#include "AdmissionControl.h"
+
+// One connection, in the thousandths the buckets count in.
+#define TOKEN_COST  1000
+
+CAdmissionControl::CAdmissionControl()
+{
+    ZeroMemory(_rgBuckets, sizeof(_rgBuckets));
+    ZeroMemory(&_counters, sizeof(_counters));
+    SetRateLimit(DEFAULT_ADMISSION_RATE, DEFAULT_ADMISSION_BURST);
+}
+
+// Existing buckets keep what they have, capped at the new burst on their next refill.
+void CAdmissionControl::SetRateLimit(DWORD dwPerSecond, DWORD dwBurst)
+{
+    // dwPerSecond connections a second is dwPerSecond thousandths a millisecond.
+    _dwRate = dwPerSecond;
+    _dwBurst = (dwBurst > 0 ? dwBurst : 1) * TOKEN_COST;
+}
+
+// Finds dwAddress's bucket, or makes one for it with a full burst of tokens.
+CAdmissionControl::BUCKET* CAdmissionControl::_Find(DWORD dwAddress, ULONGLONG ullNow)
+{
+    // Fibonacci hashing: the top bits of the product are well mixed even when the
+    // addresses differ only in their last octet.
+    DWORD iHome = (DWORD)(((ULONGLONG)dwAddress * 0x9E3779B97F4A7C15ull) >> 54) & (ADMISSION_TABLE_SIZE - 1);
+
+    BUCKET* pVictim = NULL;
+    for (DWORD i = 0; i < ADMISSION_MAX_PROBE; i++)
+    {
+        BUCKET* pBucket = &_rgBuckets[(iHome + i) & (ADMISSION_TABLE_SIZE - 1)];
+        if (pBucket->dwAddress == dwAddress)
+        {
+            return pBucket;
+        }
+        if (pBucket->dwAddress == 0)
+        {
+            // Sources are never removed, so nothing we're looking for lies past a gap.
+            pVictim = pBucket;
+            break;
+        }
+        if (pVictim == NULL || pBucket->ullLastRefill < pVictim->ullLastRefill)
+        {
+            pVictim = pBucket;
+        }
+    }
+
+    if (pVictim->dwAddress != 0)
+    {
+        _counters.cRecycled++;
+    }
+    pVictim->dwAddress = dwAddress;
+    pVictim->dwTokens = _dwBurst;
+    pVictim->ullLastRefill = ullNow;
+    return pVictim;
+}
+
+//
+// Returns whether a connection from dwAddress (IPv4, network order) should be taken now,
+// charging its bucket if so.
+//
+BOOL CAdmissionControl::Admit(DWORD dwAddress, ULONGLONG ullNow)
+{
+    BUCKET* pBucket = _Find(dwAddress, ullNow);
+
+    ULONGLONG ullElapsed = ullNow - pBucket->ullLastRefill;
+    ULONGLONG ullTokens = pBucket->dwTokens + ullElapsed * _dwRate;
+    pBucket->dwTokens = (DWORD)((ullTokens < _dwBurst) ? ullTokens : _dwBurst);
+    pBucket->ullLastRefill = ullNow;
+
+    if (pBucket->dwTokens < TOKEN_COST)
+    {
+        _counters.cRateLimited++;
+        return FALSE;
+    }
+
+    pBucket->dwTokens -= TOKEN_COST;
+    _counters.cAdmitted++;
+    return TRUE;
+}
+
+void CAdmissionControl::GetCounters(ADMISSION_COUNTERS* pCounters)
+{
+    *pCounters = _counters;
+}
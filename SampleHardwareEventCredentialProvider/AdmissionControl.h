@@ -0,0 +1,62 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Decides whether the listener should take a new connection from a given source
+// address, so that one sender opening connections as fast as it can doesn't crowd out
+// everyone else. Each source has a token bucket: a connection costs one token, and
+// tokens come back at a steady rate up to a burst limit.
+//
+// The buckets live in a fixed-size open-addressing table, probed at most
+// ADMISSION_MAX_PROBE slots from the address's home slot, so a decision takes constant
+// time and memory doesn't grow with the number of sources. When every slot in the
+// probe window is taken, the one idle the longest is reused; a source that has been
+// quiet that long would have a full bucket anyway.
+
+#pragma once
+
+#include "PlatformCompat.h"
+
+#define ADMISSION_TABLE_SIZE    1024    // Must be a power of two.
+#define ADMISSION_MAX_PROBE     8
+
+// Connections per second each source may open, sustained, and how many it may open
+// at once after being quiet.
+#define DEFAULT_ADMISSION_RATE  20
+#define DEFAULT_ADMISSION_BURST 40
+
+struct ADMISSION_COUNTERS
+{
+    DWORD   cAdmitted;
+    DWORD   cRateLimited;       // Turned away because their source was out of tokens.
+    DWORD   cRecycled;          // Buckets reused for a new source.
+};
+
+class CAdmissionControl
+{
+  public:
+    CAdmissionControl();
+
+    void SetRateLimit(DWORD dwPerSecond, DWORD dwBurst);
+    BOOL Admit(DWORD dwAddress, ULONGLONG ullNow);
+    void GetCounters(ADMISSION_COUNTERS* pCounters);
+
+  private:
+    struct BUCKET
+    {
+        DWORD       dwAddress;      // IPv4, network order. Zero marks an empty slot.
+        DWORD       dwTokens;       // In thousandths of a connection.
+        ULONGLONG   ullLastRefill;
+    };
+
+    BUCKET* _Find(DWORD dwAddress, ULONGLONG ullNow);
+
+    BUCKET              _rgBuckets[ADMISSION_TABLE_SIZE];
+    DWORD               _dwRate;        // Tokens (thousandths) regained per millisecond.
+    DWORD               _dwBurst;       // Most tokens (thousandths) a bucket holds.
+    ADMISSION_COUNTERS  _counters;
+};
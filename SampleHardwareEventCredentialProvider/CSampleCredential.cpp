@@ -8,13 +8,17 @@
 //
 //
 
+#ifdef _WIN32
 #ifndef WIN32_NO_STATUS
 #include <ntstatus.h>
 #define WIN32_NO_STATUS
 #endif
-#include <unknwn.h>
+#endif
 #include "CSampleCredential.h"
 #include "guid.h"
+#include "SerializationCache.h"
+#include "StageTimings.h"
+#include "TraceLog.h"
 
 
 // CSampleCredential ////////////////////////////////////////////////////////
@@ -28,6 +32,8 @@ CSampleCredential::CSampleCredential():
     ZeroMemory(_rgCredProvFieldDescriptors, sizeof(_rgCredProvFieldDescriptors));
     ZeroMemory(_rgFieldStatePairs, sizeof(_rgFieldStatePairs));
     ZeroMemory(_rgFieldStrings, sizeof(_rgFieldStrings));
+    ZeroMemory(_wszComputerName, sizeof(_wszComputerName));
+    _pszQualifiedUserName = NULL;
 }
 
 CSampleCredential::~CSampleCredential()
@@ -46,12 +52,11 @@ CSampleCredential::~CSampleCredential()
             // TODO: Determine how to handle count error here.
         }
     }
-    for (int i = 0; i < ARRAYSIZE(_rgFieldStrings); i++)
+    for (DWORD i = 0; i < ARRAYSIZE(_rgFieldStrings); i++)
     {
         CoTaskMemFree(_rgFieldStrings[i]);
         CoTaskMemFree(_rgCredProvFieldDescriptors[i].pszLabel);
     }
-    CoTaskMemFree(_pszUserSid);
     CoTaskMemFree(_pszQualifiedUserName);
     DllRelease();
 }
@@ -76,18 +81,19 @@ HRESULT CSampleCredential::Initialize(
         hr = FieldDescriptorCopy(rgcpfd[i], &_rgCredProvFieldDescriptors[i]);
     }
 
-    // Initialize the String value of all the fields.
+    // Initialize the String value of all the fields. The username shown on the tile
+    // comes from our slot instead, once the roster has filled it in.
     if (SUCCEEDED(hr))
     {
-        hr = SHStrDupW(L"Administrator", &_rgFieldStrings[SFI_USERNAME]);
+        hr = SHStrDupW(UTF16(""), &_rgFieldStrings[SFI_USERNAME]);
     }
     if (SUCCEEDED(hr))
     {
-        hr = SHStrDupW(L"", &_rgFieldStrings[SFI_PASSWORD]);
+        hr = SHStrDupW(UTF16(""), &_rgFieldStrings[SFI_PASSWORD]);
     }
     if (SUCCEEDED(hr))
     {
-        hr = SHStrDupW(L"Submit", &_rgFieldStrings[SFI_SUBMIT_BUTTON]);
+        hr = SHStrDupW(UTF16("Submit"), &_rgFieldStrings[SFI_SUBMIT_BUTTON]);
     }
 
     return S_OK;
@@ -98,6 +104,7 @@ HRESULT CSampleCredential::Advise(
     ICredentialProviderCredentialEvents* pcpce
     )
 {
+    CTraceScope trace("credential", "Advise");
     if (_pCredProvCredentialEvents != NULL)
     {
         _pCredProvCredentialEvents->Release();
@@ -111,6 +118,7 @@ HRESULT CSampleCredential::Advise(
 // LogonUI calls this to tell us to release the callback.
 HRESULT CSampleCredential::UnAdvise()
 {
+    CTraceScope trace("credential", "UnAdvise");
     if (_pCredProvCredentialEvents)
     {
         _pCredProvCredentialEvents->Release();
@@ -127,6 +135,7 @@ HRESULT CSampleCredential::UnAdvise()
 // selected, you would do it here.
 HRESULT CSampleCredential::SetSelected(BOOL* pbAutoLogon)  
 {
+    CTraceScope trace("credential", "SetSelected");
     *pbAutoLogon = TRUE;  
     return S_OK;
 }
@@ -136,6 +145,7 @@ HRESULT CSampleCredential::SetSelected(BOOL* pbAutoLogon)
 // is to clear out the password field.
 HRESULT CSampleCredential::SetDeselected()
 {
+    CTraceScope trace("credential", "SetDeselected");
     HRESULT hr = S_OK;
     if (_rgFieldStrings[SFI_PASSWORD])
     {
@@ -147,7 +157,7 @@ HRESULT CSampleCredential::SetDeselected()
             SecureZeroMemory(_rgFieldStrings[SFI_PASSWORD], lenPassword * sizeof(*_rgFieldStrings[SFI_PASSWORD]));
         
             CoTaskMemFree(_rgFieldStrings[SFI_PASSWORD]);
-            hr = SHStrDupW(L"", &_rgFieldStrings[SFI_PASSWORD]);
+            hr = SHStrDupW(UTF16(""), &_rgFieldStrings[SFI_PASSWORD]);
         }
 
         if (SUCCEEDED(hr) && _pCredProvCredentialEvents)
@@ -196,7 +206,17 @@ HRESULT CSampleCredential::GetStringValue(
     {
         // Make a copy of the string and return that. The caller
         // is responsible for freeing it.
-        hr = SHStrDupW(_rgFieldStrings[dwFieldID], ppwsz);
+        if (dwFieldID == SFI_USERNAME)
+        {
+            CREDENTIAL_SNAPSHOT snapshot;
+            _slot.Read(&snapshot);
+            hr = SHStrDupW(snapshot.wszUser, ppwsz);
+            SecureZeroMemory(&snapshot, sizeof(snapshot));
+        }
+        else
+        {
+            hr = SHStrDupW(_rgFieldStrings[dwFieldID], ppwsz);
+        }
     }
     else
     {
@@ -364,68 +384,159 @@ HRESULT CSampleCredential::GetSerialization(
     CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon
     )
 {
+    CTraceScope trace("credential", "GetSerialization");
     UNREFERENCED_PARAMETER(ppwszOptionalStatusText);
     UNREFERENCED_PARAMETER(pcpsiOptionalStatusIcon);
 
-    KERB_INTERACTIVE_LOGON kil;
-    ZeroMemory(&kil, sizeof(kil));
+    CStageTimer timer(PS_GET_SERIALIZATION);
+    HRESULT hr = S_OK;
 
-    HRESULT hr;
+    // The computer name can't change while we're loaded, so we only ask for it once.
+    if (_wszComputerName[0] == 0)
+    {
+        DWORD cch = ARRAYSIZE(_wszComputerName);
+        if (!GetComputerNameW(_wszComputerName, &cch))
+        {
+            DWORD dwErr = GetLastError();
+            hr = HRESULT_FROM_WIN32(dwErr);
+            _wszComputerName[0] = 0;
+        }
+    }
 
-    WCHAR wsz[MAX_COMPUTERNAME_LENGTH+1];
-    DWORD cch = ARRAYSIZE(wsz);
-    if (GetComputerNameW(wsz, &cch))
+    if (SUCCEEDED(hr))
     {
         PWSTR pwzProtectedPassword;
-        _rgFieldStrings[SFI_PASSWORD] =  _pszPassword;
-        _rgFieldStrings[SFI_USERNAME] = _pszUserSid;
-
-        hr = ProtectIfNecessaryAndCopyPassword(_rgFieldStrings[SFI_PASSWORD], _cpus, &pwzProtectedPassword);
+        PWSTR pwzUsername = _rgFieldStrings[SFI_USERNAME];
+        PWSTR pwzPassword = _rgFieldStrings[SFI_PASSWORD];
+
+        // Take our own copy of whatever was pushed last, so the listener is free to
+        // replace it while we're packing this one.
+        CREDENTIAL_SNAPSHOT snapshot;
+        _slot.Read(&snapshot);
+        BOOL fPushed = (snapshot.wszUser[0] != 0);
+        if (fPushed)
+        {
+            pwzUsername = snapshot.wszUser;
+            pwzPassword = snapshot.wszPassword;
+        }
 
-        if (SUCCEEDED(hr))
+        // If this user was pushed with this password before, we've already got the
+        // serialization and needn't protect or pack anything.
+        CSerializationCache* pCache = CSerializationCache::GetShared();
+        ULONGLONG ullNow = GetTickCount64();
+        ULONG ulAuthPackage;
+        hr = S_FALSE;
+        if (fPushed)
         {
-            KERB_INTERACTIVE_UNLOCK_LOGON kiul;
+            hr = pCache->Lookup(pwzUsername, pwzPassword, _cpus, ullNow,
+                &pcpcs->rgbSerialization, &pcpcs->cbSerialization, &ulAuthPackage);
+        }
 
-            // Initialize kiul with weak references to our credential.
-            hr = KerbInteractiveUnlockLogonInit(wsz, _rgFieldStrings[SFI_USERNAME], pwzProtectedPassword, _cpus, &kiul);
+        if (hr == S_FALSE)
+        {
+            // Everything we need along the way comes out of our arena; only the packed
+            // serialization we hand to LogonUI is allocated on its own.
+            //
+            // The password was normally protected on the worker as soon as it was pushed;
+            // if that didn't happen, or went wrong, we protect it here as we always did.
+            hr = S_FALSE;
+            if (fPushed)
+            {
+                DWORD cchMax = (DWORD)(_arena.GetAvailable() / sizeof(WCHAR));
+                pwzProtectedPassword = (PWSTR)_arena.Alloc(cchMax * sizeof(WCHAR));
+                if (pwzProtectedPassword != NULL)
+                {
+                    DWORD cchProtected;
+                    hr = _protected.Take(snapshot.dwSequence, DEFAULT_PROTECTION_WAIT_MS,
+                        pwzProtectedPassword, cchMax, &cchProtected);
+                    // Keep only what the protected password needs; if there's nothing to
+                    // take, give it all back for the fallback below.
+                    _arena.Trim(pwzProtectedPassword, (hr == S_OK) ? (cchProtected + 1) * sizeof(WCHAR) : 0);
+                }
+            }
+            if (hr != S_OK)
+            {
+                hr = ProtectIfNecessaryAndCopyPassword(pwzPassword, _cpus, &_arena, &pwzProtectedPassword);
+            }
 
             if (SUCCEEDED(hr))
             {
                 // We use KERB_INTERACTIVE_UNLOCK_LOGON in both unlock and logon scenarios.  It contains a
                 // KERB_INTERACTIVE_LOGON to hold the creds plus a LUID that is filled in for us by Winlogon
-                // as necessary.
-                hr = KerbInteractiveUnlockLogonPack(kiul, &pcpcs->rgbSerialization, &pcpcs->cbSerialization);
+                // as necessary.  It's measured and packed in one pass, straight from our strings.
+                {
+                    CStageTimer timerPack(PS_PACK);
+                    hr = KerbInteractiveUnlockLogonPackStrings(_wszComputerName, pwzUsername, pwzProtectedPassword, _cpus,
+                        &pcpcs->rgbSerialization, &pcpcs->cbSerialization);
+                }
 
                 if (SUCCEEDED(hr))
                 {
-                    ULONG ulAuthPackage;
                     hr = RetrieveNegotiateAuthPackage(&ulAuthPackage);
                     if (SUCCEEDED(hr))
                     {
-                        pcpcs->ulAuthenticationPackage = ulAuthPackage;
-                        pcpcs->clsidCredentialProvider = CLSID_CSampleProvider;
- 
-                        // At this point the credential has created the serialized credential used for logon
-                        // By setting this to CPGSR_RETURN_CREDENTIAL_FINISHED we are letting logonUI know
-                        // that we have all the information we need and it should attempt to submit the 
-                        // serialized credential.
-                        *pcpgsr = CPGSR_RETURN_CREDENTIAL_FINISHED;
+                        if (fPushed)
+                        {
+                            pCache->Insert(pwzUsername, pwzPassword, _cpus, ullNow,
+                                pcpcs->rgbSerialization, pcpcs->cbSerialization, ulAuthPackage);
+                        }
+                    }
+                    else
+                    {
+                        SecureZeroMemory(pcpcs->rgbSerialization, pcpcs->cbSerialization);
+                        CoTaskMemFree(pcpcs->rgbSerialization);
+                        pcpcs->rgbSerialization = NULL;
                     }
                 }
             }
 
-            CoTaskMemFree(pwzProtectedPassword);
-       
+            _arena.Reset();
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            pcpcs->ulAuthenticationPackage = ulAuthPackage;
+            pcpcs->clsidCredentialProvider = CLSID_CSampleProvider;
+
+            // At this point the credential has created the serialized credential used for logon
+            // By setting this to CPGSR_RETURN_CREDENTIAL_FINISHED we are letting logonUI know
+            // that we have all the information we need and it should attempt to submit the 
+            // serialized credential.
+            *pcpgsr = CPGSR_RETURN_CREDENTIAL_FINISHED;
         }
+
+        SecureZeroMemory(&snapshot, sizeof(snapshot));
     }
-    else
+
+    return hr;
+}
+
+// Called by the provider, on one of the listener's workers, each time a password is
+// pushed to this tile: starts protecting it on the protection worker, so
+// GetSerialization doesn't have to.
+HRESULT CSampleCredential::ProtectAsync(CProtectionWorker* pWorker)
+{
+    // Passwords aren't protected for CredUI; see ProtectIfNecessaryAndCopyPassword.
+    if (CPUS_CREDUI == _cpus)
     {
-        DWORD dwErr = GetLastError();
-        hr = HRESULT_FROM_WIN32(dwErr);
+        return S_FALSE;
     }
 
+    CREDENTIAL_SNAPSHOT snapshot;
+    _slot.Read(&snapshot);
+
+    _protected.Expect(snapshot.dwSequence);
+    HRESULT hr = pWorker->Submit(this, &_protected, &snapshot);
+    if (FAILED(hr))
+    {
+        // Don't leave GetSerialization waiting for something that isn't coming.
+        _protected.Clear();
+    }
+
+    SecureZeroMemory(&snapshot, sizeof(snapshot));
     return hr;
 }
+
 struct REPORT_RESULT_STATUS_INFO
 {
     NTSTATUS ntsStatus;
@@ -436,8 +547,8 @@ struct REPORT_RESULT_STATUS_INFO
 
 static const REPORT_RESULT_STATUS_INFO s_rgLogonStatusInfo[] =
 {
-    { STATUS_LOGON_FAILURE, STATUS_SUCCESS, L"Incorrect password or username.", CPSI_ERROR, },
-    { STATUS_ACCOUNT_RESTRICTION, STATUS_ACCOUNT_DISABLED, L"The account is disabled.", CPSI_WARNING },
+    { STATUS_LOGON_FAILURE, STATUS_SUCCESS, UTF16("Incorrect password or username."), CPSI_ERROR, },
+    { STATUS_ACCOUNT_RESTRICTION, STATUS_ACCOUNT_DISABLED, UTF16("The account is disabled."), CPSI_WARNING },
 };
 
 // ReportResult is completely optional.  Its purpose is to allow a credential to customize the string
@@ -451,6 +562,7 @@ HRESULT CSampleCredential::ReportResult(
     CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon
     )
 {
+    CTraceScope trace("credential", "ReportResult");
     *ppwszOptionalStatusText = NULL;
     *pcpsiOptionalStatusIcon = CPSI_NONE;
 
@@ -479,7 +591,7 @@ HRESULT CSampleCredential::ReportResult(
     {
         if (_pCredProvCredentialEvents)
         {
-            _pCredProvCredentialEvents->SetFieldString(this, SFI_PASSWORD, L"");
+            _pCredProvCredentialEvents->SetFieldString(this, SFI_PASSWORD, UTF16(""));
         }
     }
 
@@ -488,8 +600,3 @@ HRESULT CSampleCredential::ReportResult(
     return S_OK;
 }
 
-void CSampleCredential::SetUserName(PWSTR username, PWSTR password) {
-    _pszUserSid = username;
-    _pszPassword = password;
-}
-
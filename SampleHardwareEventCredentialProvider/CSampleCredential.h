@@ -15,25 +15,26 @@
 
 #pragma once
 
-#include <windows.h>
-#include <strsafe.h>
-#include <shlguid.h>
+#include "ProviderCompat.h"
 #include "helpers.h"
-#include "dll.h"
+#include "Dll.h"
 #include "resource.h"
+#include "CredentialRoster.h"
 
-class CSampleCredential : public ICredentialProviderCredential
+class CSampleCredential : public ICredentialProviderCredential, public IRosterTile
 {
     public:
     // IUnknown
+    // Tiles are released by the listener's workers as well as by LogonUI, so the count is
+    // kept with interlocked operations.
     STDMETHOD_(ULONG, AddRef)()
     {
-        return _cRef++;
+        return InterlockedIncrement(&_cRef);
     }
     
     STDMETHOD_(ULONG, Release)()
     {
-        LONG cRef = _cRef--;
+        LONG cRef = InterlockedDecrement(&_cRef);
         if (!cRef)
         {
             delete this;
@@ -104,7 +105,13 @@ class CSampleCredential : public ICredentialProviderCredential
                        const FIELD_STATE_PAIR* rgfsp);
     CSampleCredential();
     virtual ~CSampleCredential();
-    void SetUserName(PWSTR,PWSTR);
+
+    // IRosterTile
+    void AddRefTile() { AddRef(); }
+    void ReleaseTile() { Release(); }
+    CCredentialSlot* GetSlot() { return &_slot; }
+
+    HRESULT ProtectAsync(CProtectionWorker* pWorker);
 
   private:
     LONG                                  _cRef;
@@ -123,8 +130,10 @@ class CSampleCredential : public ICredentialProviderCredential
                                                                                         // different from the name of 
                                                                                         // the field held in 
                                                                                         // _rgCredProvFieldDescriptors.
-    PWSTR                                   _pszUserSid;
     PWSTR                                   _pszQualifiedUserName;                          // The user name that's used to pack the authentication buffer
-    PWSTR                                   _pszPassword;                          // The user name that's used to pack the authentication buffer
+    CCredentialSlot                         _slot;                                          // This tile's user and password, as pushed.
+    CScratchArena                           _arena;                                         // Scratch space for GetSerialization.
+    CProtectedPassword                      _protected;                                     // The pushed password, protected ahead of time.
+    WCHAR                                   _wszComputerName[MAX_COMPUTERNAME_LENGTH + 1];  // Looked up on first use.
     ICredentialProviderCredentialEvents* _pCredProvCredentialEvents;
 };
@@ -16,10 +16,16 @@
 // Otherwise, the tile asks the user to connect first.
 //
 
-#include <credentialprovider.h>
 #include "CSampleCredential.h"
 #include "SocketListener.h"
 #include "guid.h"
+#include "SerializationCache.h"
+#include "Utf8.h"
+#include "StageTimings.h"
+#include "TraceLog.h"
+
+// Naming a file in this value turns tracing on. See TraceLog.h.
+#define TRACE_REGISTRY_VALUE    "TraceFile"
 
 // CSampleProvider ////////////////////////////////////////////////////////
 
@@ -30,22 +36,50 @@ CSampleProvider::CSampleProvider():
 
     _pcpe = NULL;
     _pCommandWindow = NULL;
-    _pCredential = NULL;
     _pMessageCredential = NULL;
+    ZeroMemory(&_view, sizeof(_view));
+    _fViewConnected = FALSE;
+    _fViewTaken = FALSE;
+    _roster.SetFactory(this);
+
+    // If the worker can't start, GetSerialization protects passwords itself.
+    _protectionWorker.Start(&_credProtector);
+
+    // Trace everything LogonUI asks of us, if we've been asked to.
+    char szTraceFile[MAX_PATH];
+    DWORD cbTraceFile = sizeof(szTraceFile);
+    if (RegGetValueA(HKEY_LOCAL_MACHINE, PROVIDER_REGISTRY_KEY, TRACE_REGISTRY_VALUE, RRF_RT_REG_SZ, NULL,
+        szTraceFile, &cbTraceFile) == ERROR_SUCCESS)
+    {
+        CTraceLog::GetShared()->Start(szTraceFile);
+    }
 
 }
 
 CSampleProvider::~CSampleProvider()
 {
-    if (_pCredential != NULL)
+    // Stop the listener first, so nothing is added to the roster while we empty it.
+    if (_pCommandWindow != NULL)
     {
-        _pCredential->Release();
-        _pCredential = NULL;
+        delete _pCommandWindow;
     }
 
-    if (_pCommandWindow != NULL)
+    // The worker holds references to tiles with protections outstanding.
+    _protectionWorker.Stop();
+
+    CCredentialRoster::FreeView(&_view);
+    _roster.Clear();
+
+    if (_pMessageCredential != NULL)
     {
-        delete _pCommandWindow;
+        _pMessageCredential->Release();
+        _pMessageCredential = NULL;
+    }
+
+    // Keep tracing, in case LogonUI makes another of us, but write out what we have.
+    if (CTraceLog::IsEnabled())
+    {
+        CTraceLog::GetShared()->Flush();
     }
 
     DllRelease();
@@ -55,13 +89,71 @@ CSampleProvider::~CSampleProvider()
 // tells the infrastructure that it needs to re-enumerate the credentials.
 void CSampleProvider::OnConnectStatusChanged()
 {
+    CTraceScope trace("provider", "OnConnectStatusChanged");
+    CStageTimer timer(PS_CONNECT_STATUS);
     if (_pcpe != NULL)
     {   
-        _pCredential->SetUserName(_pszUserSid,_pszPassword);
+        CStageTimer timerChanged(PS_CREDENTIALS_CHANGED);
         _pcpe->CredentialsChanged(_upAdviseContext);
     }
 }
 
+// Called by the SocketListener with a pushed UTF-8 username and password. The user gets
+// a tile of their own; if they already have one, its password is replaced (and the old
+// one wiped) in place.
+HRESULT CSampleProvider::SetCredential(const char* pszUser, const char* pszPassword)
+{
+    CTraceScope trace("provider", "SetCredential");
+    IRosterTile* pTile;
+    HRESULT hr = _roster.Upsert(pszUser, pszPassword, &pTile);
+    if (SUCCEEDED(hr))
+    {
+        // Every tile in the roster is one of ours (see CreateTile).
+        static_cast<CSampleCredential*>(pTile)->ProtectAsync(&_protectionWorker);
+        pTile->ReleaseTile();
+    }
+    return hr;
+}
+
+// Called by the SocketListener when a user's tile should go away.
+HRESULT CSampleProvider::RemoveCredential(const char* pszUser)
+{
+    CTraceScope trace("provider", "RemoveCredential");
+    // Whatever we packed for this user mustn't be handed out again.
+    WCHAR wszUser[PROFILE_MAX_FIELD + 1];
+    size_t cchUser;
+    if (SUCCEEDED(Utf8ToUtf16(pszUser, strlen(pszUser), wszUser, ARRAYSIZE(wszUser), &cchUser)))
+    {
+        CSerializationCache::GetShared()->Invalidate(wszUser);
+    }
+
+    return _roster.Remove(pszUser);
+}
+
+// Called by the roster, on one of the listener's workers, for each user it hasn't seen before.
+HRESULT CSampleProvider::CreateTile(IRosterTile** ppTile)
+{
+    HRESULT hr;
+    CSampleCredential* pCredential = new CSampleCredential();
+    if (pCredential != NULL)
+    {
+        hr = pCredential->Initialize(_cpus, s_rgCredProvFieldDescriptors, s_rgFieldStatePairs);
+        if (SUCCEEDED(hr))
+        {
+            *ppTile = pCredential;
+        }
+        else
+        {
+            pCredential->Release();
+        }
+    }
+    else
+    {
+        hr = E_OUTOFMEMORY;
+    }
+    return hr;
+}
+
 // SetUsageScenario is the provider's cue that it's going to be asked for tiles
 // in a subsequent call.
 HRESULT CSampleProvider::SetUsageScenario(
@@ -69,6 +161,7 @@ HRESULT CSampleProvider::SetUsageScenario(
     DWORD dwFlags
     )
 {
+    CTraceScope trace("provider", "SetUsageScenario");
     UNREFERENCED_PARAMETER(dwFlags);
     HRESULT hr;
 
@@ -80,50 +173,37 @@ HRESULT CSampleProvider::SetUsageScenario(
     case CPUS_UNLOCK_WORKSTATION:       
         _cpus = cpus;
 
-        // Create the CSampleCredential (for connected scenarios), the CMessageCredential
-        // (for disconnected scenarios), and the SocketListener (to detect commands, such
-        // as the connect/disconnect here).  We can get SetUsageScenario multiple times
-        // (for example, cancel back out to the CAD screen, and then hit CAD again), 
-        // but there's no point in recreating our creds, since they're the same all the
-        // time
+        // Create the CMessageCredential (for disconnected scenarios) and the SocketListener
+        // (to detect commands, such as the connect/disconnect here). The CSampleCredentials
+        // (for connected scenarios) are made by the roster as users are pushed to us. We
+        // can get SetUsageScenario multiple times (for example, cancel back out to the CAD
+        // screen, and then hit CAD again), but there's no point in recreating our creds,
+        // since they're the same all the time
         
-        if (!_pCredential && !_pMessageCredential && !_pCommandWindow)
+        if (!_pMessageCredential && !_pCommandWindow)
         {
             // For the locked case, a more advanced credprov might only enumerate tiles for the 
             // user whose owns the locked session, since those are the only creds that will work
-            _pCredential = new CSampleCredential();
-            if (_pCredential != NULL)
+            _pMessageCredential = new CMessageCredential();
+            if (_pMessageCredential)
             {
-                _pMessageCredential = new CMessageCredential();
-                if (_pMessageCredential)
+                // The CMessageCredential needs field descriptors and a message.
+                hr = _pMessageCredential->Initialize(s_rgMessageCredProvFieldDescriptors, s_rgMessageFieldStatePairs, UTF16("Please connect"));
+                if (SUCCEEDED(hr))
                 {
+                    // The SocketListener needs a pointer to us so it can let us know when
+                    // to re-enumerate credentials. It starts pushing users to us straight
+                    // away, so it comes last.
                     _pCommandWindow = new SocketListener();
                     if (_pCommandWindow != NULL)
                     {
-                        // Initialize each of the object we've just created. 
-                        // - The SocketListener needs a pointer to us so it can let us know 
-                        // when to re-enumerate credentials.
-                        // - The CSampleCredential needs field descriptors.
-                        // - The CMessageCredential needs field descriptors and a message.
                         hr = _pCommandWindow->Initialize(this);
-                        if (SUCCEEDED(hr))
-                        {
-                            hr = _pCredential->Initialize(_cpus, s_rgCredProvFieldDescriptors, s_rgFieldStatePairs);
-                            if (SUCCEEDED(hr))
-                            {
-                                hr = _pMessageCredential->Initialize(s_rgMessageCredProvFieldDescriptors, s_rgMessageFieldStatePairs, L"Please connect");
-                            }
-                        }
                     }
                     else
                     {
                         hr = E_OUTOFMEMORY;
                     }
                 }
-                else
-                {
-                    hr = E_OUTOFMEMORY;
-                }
             }
             else
             {
@@ -137,11 +217,7 @@ HRESULT CSampleProvider::SetUsageScenario(
                     delete _pCommandWindow;
                     _pCommandWindow = NULL;
                 }
-                if (_pCredential != NULL)
-                {
-                    _pCredential->Release();
-                    _pCredential = NULL;
-                }
+                _roster.Clear();
                 if (_pMessageCredential != NULL)
                 {
                     _pMessageCredential->Release();
@@ -202,6 +278,7 @@ HRESULT CSampleProvider::Advise(
     UINT_PTR upAdviseContext
     )
 {
+    CTraceScope trace("provider", "Advise");
     if (_pcpe != NULL)
     {
         _pcpe->Release();
@@ -215,6 +292,7 @@ HRESULT CSampleProvider::Advise(
 // Called by LogonUI when the ICredentialProviderEvents callback is no longer valid.
 HRESULT CSampleProvider::UnAdvise()
 {
+    CTraceScope trace("provider", "UnAdvise");
     if (_pcpe != NULL)
     {
         _pcpe->Release();
@@ -223,15 +301,44 @@ HRESULT CSampleProvider::UnAdvise()
     return S_OK;
 }
 
+// Decides what LogonUI's next enumeration shows: the users' tiles if we're connected
+// and have any, otherwise the message tile. The field descriptors and the credentials
+// both follow this decision rather than the live state, so they can't disagree if the
+// listener connects, disconnects or changes the roster partway through.
+HRESULT CSampleProvider::_TakeView()
+{
+    HRESULT hr = S_OK;
+    _fViewConnected = FALSE;
+    if (_pCommandWindow->GetConnectedStatus())
+    {
+        hr = _roster.Refresh(&_view);
+        if (SUCCEEDED(hr))
+        {
+            _fViewConnected = (_view.cTiles > 0);
+            hr = S_OK;
+        }
+    }
+    _fViewTaken = SUCCEEDED(hr);
+    return hr;
+}
+
 // Called by LogonUI to determine the number of fields in your tiles. We return the number
 // of fields to be displayed on our active tile, which depends on our connected state. The
 // "connected" CSampleCredential has SFI_NUM_FIELDS fields, whereas the "disconnected" 
-// CMessageCredential has SMFI_NUM_FIELDS fields.
+// CMessageCredential has SMFI_NUM_FIELDS fields. LogonUI asks this first when it
+// enumerates, so this is where we take the view the rest of the enumeration uses.
 HRESULT CSampleProvider::GetFieldDescriptorCount(
     DWORD* pdwCount
     )
 {
-    if (_pCommandWindow->GetConnectedStatus())
+    CTraceScope trace("provider", "GetFieldDescriptorCount");
+    HRESULT hr = _TakeView();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    if (_fViewConnected)
     {
         *pdwCount = SFI_NUM_FIELDS;
     }
@@ -252,7 +359,7 @@ HRESULT CSampleProvider::GetFieldDescriptorAt(
 {    
     HRESULT hr;
 
-    if (_pCommandWindow->GetConnectedStatus())
+    if (_fViewConnected)
     {
         // Verify dwIndex is a valid field.
         if ((dwIndex < SFI_NUM_FIELDS) && ppcpfd)
@@ -280,10 +387,11 @@ HRESULT CSampleProvider::GetFieldDescriptorAt(
     return hr;
 }
 
-// We only use one tile at any given time since the system can either be "connected" or 
-// "disconnected". If we decided that there were multiple valid ways to be connected with
-// different sets of credentials, we would provide a combobox in the "connected" tile so
-// that the user could pick which one they want to use.
+// When we're "disconnected", or connected but nobody has been pushed to us yet, we show
+// a single message tile. Otherwise we show one tile per user that has been pushed to
+// us, with the most recent one as the default. We use the view GetFieldDescriptorCount
+// took, so the tiles match the fields it described; if LogonUI went straight to the
+// count, we take one now. The roster is only recopied if it has changed since.
 // The last cred prov used gets to select the default user tile
 HRESULT CSampleProvider::GetCredentialCount(
     DWORD* pdwCount,
@@ -291,10 +399,28 @@ HRESULT CSampleProvider::GetCredentialCount(
     BOOL* pbAutoLogonWithDefault
     )
 {
+    CTraceScope trace("provider", "GetCredentialCount");
+    HRESULT hr = S_OK;
+
     *pdwCount = 1;
     *pdwDefault = 0;
     *pbAutoLogonWithDefault = FALSE;
-    return S_OK;
+
+    // GetCredentialAt answers from the same view, so it agrees with us even if the
+    // listener changes our state in the middle of an enumeration.
+    if (!_fViewTaken)
+    {
+        hr = _TakeView();
+    }
+    _fViewTaken = FALSE;
+
+    if (SUCCEEDED(hr) && _fViewConnected)
+    {
+        *pdwCount = _view.cTiles;
+        *pdwDefault = _view.iDefault;
+    }
+
+    return hr;
 }
 
 // Returns the credential at the index specified by dwIndex. This function is called
@@ -305,19 +431,25 @@ HRESULT CSampleProvider::GetCredentialAt(
     ICredentialProviderCredential** ppcpc
     )
 {
+    CTraceScope trace("provider", "GetCredentialAt");
     HRESULT hr;
     // Make sure the parameters are valid.
-    if ((dwIndex == 0) && ppcpc)
+    if (ppcpc && _fViewConnected)
     {
-        if (_pCommandWindow->GetConnectedStatus())
+        if (dwIndex < _view.cTiles)
         {
-            hr = _pCredential->QueryInterface(IID_ICredentialProviderCredential, reinterpret_cast<void**>(ppcpc));
+            CSampleCredential* pCredential = static_cast<CSampleCredential*>(_view.rgpTiles[dwIndex]);
+            hr = pCredential->QueryInterface(IID_ICredentialProviderCredential, reinterpret_cast<void**>(ppcpc));
         }
         else
         {
-            hr = _pMessageCredential->QueryInterface(IID_ICredentialProviderCredential, reinterpret_cast<void**>(ppcpc));
+            hr = E_INVALIDARG;
         }
     }
+    else if ((dwIndex == 0) && ppcpc)
+    {
+        hr = _pMessageCredential->QueryInterface(IID_ICredentialProviderCredential, reinterpret_cast<void**>(ppcpc));
+    }
     else
     {
         hr = E_INVALIDARG;
@@ -10,21 +10,23 @@
 
 #pragma once
 
-#include <credentialprovider.h>
-#include <windows.h>
-#include <strsafe.h>
+#include "ProviderCompat.h"
 
 #include "SocketListener.h"
 #include "CSampleCredential.h"
 #include "MessageCredential.h"
 #include "helpers.h"
+#include "CredentialRoster.h"
+
+// Our settings live under our entry in the credential providers key.
+#define PROVIDER_REGISTRY_KEY   "SOFTWARE\\Microsoft\\Windows\\CurrentVersion\\Authentication\\Credential Providers\\{75A22DF0-B81D-46ed-B119-CD30507BD615}"
 
 // Forward references for classes used here.
 class SocketListener;
 class CSampleCredential;
 class CMessageCredential;
 
-class CSampleProvider : public ICredentialProvider
+class CSampleProvider : public ICredentialProvider, public IRosterTileFactory
 {
   public:
     // IUnknown
@@ -65,36 +67,45 @@ class CSampleProvider : public ICredentialProvider
     IFACEMETHODIMP SetUsageScenario(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, DWORD dwFlags);
     IFACEMETHODIMP SetSerialization(const CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs);
 
-    IFACEMETHODIMP Advise(__in ICredentialProviderEvents* pcpe, UINT_PTR upAdviseContext);
+    IFACEMETHODIMP Advise(_In_ ICredentialProviderEvents* pcpe, UINT_PTR upAdviseContext);
     IFACEMETHODIMP UnAdvise();
 
-    IFACEMETHODIMP GetFieldDescriptorCount(__out DWORD* pdwCount);
-    IFACEMETHODIMP GetFieldDescriptorAt(DWORD dwIndex,  __deref_out CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR** ppcpfd);
+    IFACEMETHODIMP GetFieldDescriptorCount(_Out_ DWORD* pdwCount);
+    IFACEMETHODIMP GetFieldDescriptorAt(DWORD dwIndex,  _Outptr_ CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR** ppcpfd);
 
-    IFACEMETHODIMP GetCredentialCount(__out DWORD* pdwCount,
-                                      __out DWORD* pdwDefault,
-                                      __out BOOL* pbAutoLogonWithDefault);
+    IFACEMETHODIMP GetCredentialCount(_Out_ DWORD* pdwCount,
+                                      _Out_ DWORD* pdwDefault,
+                                      _Out_ BOOL* pbAutoLogonWithDefault);
     IFACEMETHODIMP GetCredentialAt(DWORD dwIndex, 
-                                   __out ICredentialProviderCredential** ppcpc);
+                                   _Out_ ICredentialProviderCredential** ppcpc);
 
-    friend HRESULT CSampleProvider_CreateInstance(REFIID riid, __deref_out void** ppv);
+    friend HRESULT CSampleProvider_CreateInstance(REFIID riid, _Outptr_ void** ppv);
 
 public:
     void OnConnectStatusChanged();
-    PWSTR                                   _pszUserSid;
-    PWSTR                                   _pszPassword;
+    HRESULT SetCredential(const char* pszUser, const char* pszPassword);
+    HRESULT RemoveCredential(const char* pszUser);
+
+    // IRosterTileFactory
+    HRESULT CreateTile(IRosterTile** ppTile);
 
   protected:
     CSampleProvider();
-    __override ~CSampleProvider();
+    virtual ~CSampleProvider();
     
 private:
+    HRESULT _TakeView();
 
     SocketListener              *_pCommandWindow;       // Emulates external events.
     LONG                        _cRef;                  // Reference counter.
-    CSampleCredential           *_pCredential;          // Our "connected" credential.
     CMessageCredential          *_pMessageCredential;   // Our "disconnected" credential.
     ICredentialProviderEvents   *_pcpe;                    // Used to tell our owner to re-enumerate credentials.
     UINT_PTR                    _upAdviseContext;       // Used to tell our owner who we are when asking to 
+    CCredentialRoster           _roster;                // One "connected" credential per pushed user.
+    ROSTER_VIEW                 _view;                  // The tiles LogonUI is currently enumerating.
+    BOOL                        _fViewConnected;        // Whether that enumeration is of _view.
+    BOOL                        _fViewTaken;            // Whether _view was taken for this enumeration.
     CREDENTIAL_PROVIDER_USAGE_SCENARIO      _cpus;
+    CCredProtector              _credProtector;         // How pushed passwords are protected...
+    CProtectionWorker           _protectionWorker;      // ...ahead of GetSerialization.
 };
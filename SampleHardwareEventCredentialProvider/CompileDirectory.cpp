@@ -0,0 +1,90 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// An offline tool for building the compiled credential directory, run through rundll32
+// so that it ships inside the provider dll:
+//
+//   rundll32 SampleHardwareEventCredentialProvider.dll,CompileCredentialDirectory <db> <out>
+//
+// Either path may be quoted. If none are given, the provider's default paths are used.
+
+#include <windows.h>
+#include <stdio.h>
+#include "CredentialStore.h"
+#include "CredentialDirectory.h"
+
+#pragma warning(disable : 4996)
+
+#define DEFAULT_ACCOUNT_DB "D:\\5samples\\AccountDB\\accountInfo.db"
+#define DEFAULT_ACCOUNT_DIR "D:\\5samples\\AccountDB\\accountInfo.cdir"
+
+// Splits the next (possibly quoted) argument off the front of *ppsz, in place.
+static char* _NextArgument(char** ppsz)
+{
+    char* psz = *ppsz;
+    while (*psz == ' ' || *psz == '\t')
+    {
+        psz++;
+    }
+    if (*psz == '\0')
+    {
+        *ppsz = psz;
+        return NULL;
+    }
+
+    char chEnd = ' ';
+    if (*psz == '"')
+    {
+        chEnd = '"';
+        psz++;
+    }
+
+    char* pszArg = psz;
+    while (*psz != '\0' && *psz != chEnd && !(chEnd == ' ' && *psz == '\t'))
+    {
+        psz++;
+    }
+    if (*psz != '\0')
+    {
+        *psz++ = '\0';
+    }
+    *ppsz = psz;
+    return pszArg;
+}
+
+extern "C" void CALLBACK CompileCredentialDirectory(HWND hwnd, HINSTANCE hinst, LPSTR pszCmdLine, int nCmdShow)
+{
+    UNREFERENCED_PARAMETER(hwnd);
+    UNREFERENCED_PARAMETER(hinst);
+    UNREFERENCED_PARAMETER(nCmdShow);
+
+    char* psz = pszCmdLine;
+    const char* pszDb = _NextArgument(&psz);
+    const char* pszOut = _NextArgument(&psz);
+    if (pszDb == NULL)
+    {
+        pszDb = DEFAULT_ACCOUNT_DB;
+    }
+    if (pszOut == NULL)
+    {
+        pszOut = DEFAULT_ACCOUNT_DIR;
+    }
+
+    CCredentialStore store;
+    HRESULT hr = store.Open(pszDb);
+    if (SUCCEEDED(hr))
+    {
+        hr = CredentialDirectoryCompile(&store, pszOut);
+        store.Close();
+    }
+
+    if (FAILED(hr))
+    {
+        printf("CompileCredentialDirectory failed: 0x%08lx\n", hr);
+    }
+}
@@ -0,0 +1,668 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+
+#include "CredentialDirectory.h"
+#include "CredentialStore.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+// The compiler aims for this many ids per bucket. Fewer means more seeds to store
+// but a faster build.
+#define IDS_PER_BUCKET  2
+
+// If no seed up to this one places a bucket, we give up (which in practice means the
+// table holds duplicate ids).
+#define MAX_SEED        0x100000
+
+//
+// A seeded 32-bit hash: FNV-1a with the seed folded into the offset basis, followed by
+// a finalizer so that nearby seeds give unrelated results.
+//
+static DWORD _DirectoryHash(const char* pch, size_t cch, DWORD dwSeed)
+{
+    DWORD h = 2166136261u ^ (dwSeed * 0x9E3779B9u);
+    for (size_t i = 0; i < cch; i++)
+    {
+        h ^= (BYTE)pch[i];
+        h *= 16777619u;
+    }
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
+
+// The CRC-32 lookup table, built by the compiler rather than on first use, so that
+// two threads opening directories at once can't race to fill it in.
+struct CRC32_TABLE
+{
+    DWORD rgdw[256];
+};
+
+static constexpr CRC32_TABLE _MakeCrc32Table()
+{
+    CRC32_TABLE table = {};
+    for (DWORD i = 0; i < 256; i++)
+    {
+        DWORD c = i;
+        for (int k = 0; k < 8; k++)
+        {
+            c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+        }
+        table.rgdw[i] = c;
+    }
+    return table;
+}
+
+static constexpr CRC32_TABLE c_crc32Table = _MakeCrc32Table();
+
+static DWORD _Crc32(const BYTE* pb, size_t cb)
+{
+    DWORD dwCrc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < cb; i++)
+    {
+        dwCrc = c_crc32Table.rgdw[(dwCrc ^ pb[i]) & 0xFF] ^ (dwCrc >> 8);
+    }
+    return dwCrc ^ 0xFFFFFFFFu;
+}
+
+// Orders two ids bytewise, a shorter id before a longer one that it starts. This is
+// the order the compiler writes slots in and the loader checks them against.
+static int _CompareIds(const char* pch1, size_t cch1, const char* pch2, size_t cch2)
+{
+    int iCompare = memcmp(pch1, pch2, (cch1 < cch2) ? cch1 : cch2);
+    if (iCompare == 0)
+    {
+        iCompare = (cch1 < cch2) ? -1 : ((cch1 > cch2) ? 1 : 0);
+    }
+    return iCompare;
+}
+
+// Compiler ////////////////////////////////////////////////////////////
+
+// What we know about a profile while compiling: its slot, plus where its bytes are.
+struct COMPILE_RECORD
+{
+    DIRECTORY_SLOT  slot;
+    DWORD           iBucket;
+};
+
+struct COMPILE_STATE
+{
+    COMPILE_RECORD  *rgRecords;
+    DWORD           cRecords;
+    DWORD           cRecordsAlloc;
+    char            *pchPool;
+    DWORD           cbPool;
+    DWORD           cbPoolAlloc;
+};
+
+static HRESULT _CollectProfile(void* pv, const char* pchId, size_t cchId, const char* pszUser, const char* pszPassword)
+{
+    COMPILE_STATE* pState = static_cast<COMPILE_STATE*>(pv);
+
+    size_t cbUser = strlen(pszUser);
+    size_t cbPassword = strlen(pszPassword);
+    if (cchId > 0xFFFF || cbUser > PROFILE_MAX_FIELD || cbPassword > PROFILE_MAX_FIELD)
+    {
+        // Same rule as CProfileIndex: a profile we couldn't hand out is left out.
+        return S_OK;
+    }
+
+    if (pState->cRecords == pState->cRecordsAlloc)
+    {
+        DWORD cAlloc = pState->cRecordsAlloc ? pState->cRecordsAlloc * 2 : 1024;
+        COMPILE_RECORD* rgNew = (COMPILE_RECORD*)realloc(pState->rgRecords, cAlloc * sizeof(COMPILE_RECORD));
+        if (rgNew == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        pState->rgRecords = rgNew;
+        pState->cRecordsAlloc = cAlloc;
+    }
+
+    size_t cbRecord = cchId + cbUser + cbPassword;
+    if (pState->cbPool + cbRecord > pState->cbPoolAlloc)
+    {
+        size_t cbAlloc = pState->cbPoolAlloc ? (size_t)pState->cbPoolAlloc * 2 : 65536;
+        while (cbAlloc < pState->cbPool + cbRecord)
+        {
+            cbAlloc *= 2;
+        }
+        if (cbAlloc > 0x7FFFFFFF)
+        {
+            return HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW);
+        }
+        char* pchNew = (char*)realloc(pState->pchPool, cbAlloc);
+        if (pchNew == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        pState->pchPool = pchNew;
+        pState->cbPoolAlloc = (DWORD)cbAlloc;
+    }
+
+    COMPILE_RECORD* pRecord = &pState->rgRecords[pState->cRecords++];
+    pRecord->slot.ibRecord = pState->cbPool;
+    pRecord->slot.cbId = (USHORT)cchId;
+    pRecord->slot.cbUser = (BYTE)cbUser;
+    pRecord->slot.cbPassword = (BYTE)cbPassword;
+    pRecord->iBucket = 0;
+
+    char* pch = pState->pchPool + pState->cbPool;
+    CopyMemory(pch, pchId, cchId);
+    CopyMemory(pch + cchId, pszUser, cbUser);
+    CopyMemory(pch + cchId + cbUser, pszPassword, cbPassword);
+    pState->cbPool += (DWORD)cbRecord;
+
+    return S_OK;
+}
+
+//
+// Finds a seed for every bucket such that each id lands in its own slot. Buckets are
+// placed largest first, since they're the hardest to fit. On success, rgdwSeeds holds
+// the seeds and rgiPositionOf[i] the hash position of record i.
+//
+static HRESULT _BuildPerfectHash(const COMPILE_STATE* pState, DWORD cBuckets, DWORD* rgdwSeeds, DWORD* rgiPositionOf)
+{
+    DWORD cRecords = pState->cRecords;
+    HRESULT hr = S_OK;
+
+    DWORD* rgcBucketSizes = (DWORD*)calloc(cBuckets, sizeof(DWORD));
+    DWORD* rgiBucketStart = (DWORD*)calloc(cBuckets + 1, sizeof(DWORD));
+    DWORD* rgiMembers = (DWORD*)malloc(cRecords * sizeof(DWORD));
+    DWORD* rgiOrder = (DWORD*)malloc(cBuckets * sizeof(DWORD));
+    BYTE* rgfTaken = (BYTE*)calloc(cRecords, 1);
+    DWORD* rgiTrial = (DWORD*)malloc(cRecords * sizeof(DWORD));
+
+    if (!rgcBucketSizes || !rgiBucketStart || !rgiMembers || !rgiOrder || !rgfTaken || !rgiTrial)
+    {
+        hr = E_OUTOFMEMORY;
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // Group the records by bucket.
+        for (DWORD i = 0; i < cRecords; i++)
+        {
+            rgcBucketSizes[pState->rgRecords[i].iBucket]++;
+        }
+        for (DWORD b = 0; b < cBuckets; b++)
+        {
+            rgiBucketStart[b + 1] = rgiBucketStart[b] + rgcBucketSizes[b];
+            rgiOrder[b] = b;
+        }
+        DWORD* rgiFill = rgiTrial;
+        CopyMemory(rgiFill, rgiBucketStart, cBuckets * sizeof(DWORD));
+        for (DWORD i = 0; i < cRecords; i++)
+        {
+            rgiMembers[rgiFill[pState->rgRecords[i].iBucket]++] = i;
+        }
+
+        std::sort(rgiOrder, rgiOrder + cBuckets, [rgcBucketSizes](DWORD b1, DWORD b2) {
+            return rgcBucketSizes[b1] > rgcBucketSizes[b2];
+        });
+    }
+
+    for (DWORD o = 0; SUCCEEDED(hr) && o < cBuckets; o++)
+    {
+        DWORD b = rgiOrder[o];
+        DWORD cMembers = rgcBucketSizes[b];
+        if (cMembers == 0)
+        {
+            // Sorted by size, so every remaining bucket is empty too.
+            break;
+        }
+
+        const DWORD* piMembers = rgiMembers + rgiBucketStart[b];
+        BOOL fPlaced = FALSE;
+        for (DWORD dwSeed = 1; !fPlaced && dwSeed < MAX_SEED; dwSeed++)
+        {
+            DWORD m;
+            for (m = 0; m < cMembers; m++)
+            {
+                const DIRECTORY_SLOT& slot = pState->rgRecords[piMembers[m]].slot;
+                DWORD iPosition = _DirectoryHash(pState->pchPool + slot.ibRecord, slot.cbId, dwSeed) % cRecords;
+                if (rgfTaken[iPosition])
+                {
+                    break;
+                }
+
+                // Claim it now so a later member of this bucket can't collide with it.
+                rgfTaken[iPosition] = 1;
+                rgiTrial[m] = iPosition;
+            }
+
+            if (m == cMembers)
+            {
+                rgdwSeeds[b] = dwSeed;
+                for (m = 0; m < cMembers; m++)
+                {
+                    rgiPositionOf[piMembers[m]] = rgiTrial[m];
+                }
+                fPlaced = TRUE;
+            }
+            else
+            {
+                while (m-- > 0)
+                {
+                    rgfTaken[rgiTrial[m]] = 0;
+                }
+            }
+        }
+
+        if (!fPlaced)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+    }
+
+    free(rgcBucketSizes);
+    free(rgiBucketStart);
+    free(rgiMembers);
+    free(rgiOrder);
+    free(rgfTaken);
+    free(rgiTrial);
+    return hr;
+}
+
+//
+// Compiles every profile in pStore into a directory file at pszPath, replacing any
+// file that's already there.
+//
+HRESULT CredentialDirectoryCompile(CCredentialStore* pStore, const char* pszPath)
+{
+    COMPILE_STATE state;
+    ZeroMemory(&state, sizeof(state));
+
+    HRESULT hr = pStore->EnumerateProfiles(_CollectProfile, &state);
+
+    DWORD cRecords = state.cRecords;
+    DWORD cBuckets = cRecords / IDS_PER_BUCKET + 1;
+    BYTE* pbImage = NULL;
+    size_t cbImage = 0;
+    DWORD* rgiPositionOf = NULL;
+    DWORD* rgiSorted = NULL;
+
+    if (SUCCEEDED(hr))
+    {
+        size_t cbSeeds = (size_t)cBuckets * sizeof(DWORD);
+        size_t cbSlotMap = (size_t)cRecords * sizeof(DWORD);
+        size_t cbSlots = (size_t)cRecords * sizeof(DIRECTORY_SLOT);
+        cbImage = sizeof(DIRECTORY_HEADER) + cbSeeds + cbSlotMap + cbSlots + state.cbPool;
+        if (cbImage > 0xFFFFFFFF)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW);
+        }
+        else
+        {
+            pbImage = (BYTE*)calloc(cbImage, 1);
+            rgiPositionOf = (DWORD*)malloc((cRecords + 1) * sizeof(DWORD));
+            rgiSorted = (DWORD*)malloc((cRecords + 1) * sizeof(DWORD));
+            if (pbImage == NULL || rgiPositionOf == NULL || rgiSorted == NULL)
+            {
+                hr = E_OUTOFMEMORY;
+            }
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        DIRECTORY_HEADER* pHeader = (DIRECTORY_HEADER*)pbImage;
+        pHeader->dwMagic = DIRECTORY_MAGIC;
+        pHeader->dwVersion = DIRECTORY_VERSION;
+        pHeader->cbFile = (DWORD)cbImage;
+        pHeader->cRecords = cRecords;
+        pHeader->cBuckets = cBuckets;
+        pHeader->ibSeeds = sizeof(DIRECTORY_HEADER);
+        pHeader->ibSlotMap = pHeader->ibSeeds + cBuckets * sizeof(DWORD);
+        pHeader->ibSlots = pHeader->ibSlotMap + cRecords * sizeof(DWORD);
+        pHeader->ibPool = pHeader->ibSlots + cRecords * sizeof(DIRECTORY_SLOT);
+        pHeader->cbPool = state.cbPool;
+
+        for (DWORD i = 0; i < cRecords; i++)
+        {
+            const DIRECTORY_SLOT& slot = state.rgRecords[i].slot;
+            state.rgRecords[i].iBucket = _DirectoryHash(state.pchPool + slot.ibRecord, slot.cbId, 0) % cBuckets;
+        }
+
+        // Slots go in id order, which also shows up any id the store holds twice.
+        for (DWORD i = 0; i < cRecords; i++)
+        {
+            rgiSorted[i] = i;
+        }
+        const COMPILE_STATE* pState = &state;
+        std::sort(rgiSorted, rgiSorted + cRecords, [pState](DWORD i1, DWORD i2) {
+            const DIRECTORY_SLOT& slot1 = pState->rgRecords[i1].slot;
+            const DIRECTORY_SLOT& slot2 = pState->rgRecords[i2].slot;
+            return _CompareIds(pState->pchPool + slot1.ibRecord, slot1.cbId,
+                pState->pchPool + slot2.ibRecord, slot2.cbId) < 0;
+        });
+        for (DWORD i = 1; SUCCEEDED(hr) && i < cRecords; i++)
+        {
+            const DIRECTORY_SLOT& slot1 = state.rgRecords[rgiSorted[i - 1]].slot;
+            const DIRECTORY_SLOT& slot2 = state.rgRecords[rgiSorted[i]].slot;
+            if (_CompareIds(state.pchPool + slot1.ibRecord, slot1.cbId, state.pchPool + slot2.ibRecord, slot2.cbId) == 0)
+            {
+                hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+            }
+        }
+
+        DWORD* rgdwSeeds = (DWORD*)(pbImage + pHeader->ibSeeds);
+        if (SUCCEEDED(hr))
+        {
+            hr = _BuildPerfectHash(&state, cBuckets, rgdwSeeds, rgiPositionOf);
+        }
+        if (SUCCEEDED(hr))
+        {
+            // Lay the slots and their strings out in id order, and point each hash
+            // position at its slot.
+            DWORD* rgiSlots = (DWORD*)(pbImage + pHeader->ibSlotMap);
+            DIRECTORY_SLOT* rgSlots = (DIRECTORY_SLOT*)(pbImage + pHeader->ibSlots);
+            char* pchPool = (char*)(pbImage + pHeader->ibPool);
+            DWORD ibRecord = 0;
+            for (DWORD iSlot = 0; iSlot < cRecords; iSlot++)
+            {
+                DWORD i = rgiSorted[iSlot];
+                const DIRECTORY_SLOT& slot = state.rgRecords[i].slot;
+                DWORD cbRecord = slot.cbId + slot.cbUser + slot.cbPassword;
+                rgSlots[iSlot] = slot;
+                rgSlots[iSlot].ibRecord = ibRecord;
+                CopyMemory(pchPool + ibRecord, state.pchPool + slot.ibRecord, cbRecord);
+                ibRecord += cbRecord;
+                rgiSlots[rgiPositionOf[i]] = iSlot;
+            }
+            pHeader->dwChecksum = _Crc32(pbImage + sizeof(DIRECTORY_HEADER), cbImage - sizeof(DIRECTORY_HEADER));
+
+            FILE* pFile = fopen(pszPath, "wb");
+            if (pFile != NULL)
+            {
+                if (fwrite(pbImage, 1, cbImage, pFile) != cbImage)
+                {
+                    hr = E_FAIL;
+                }
+                if (fclose(pFile) != 0)
+                {
+                    hr = E_FAIL;
+                }
+            }
+            else
+            {
+                hr = E_FAIL;
+            }
+        }
+    }
+
+    if (pbImage != NULL)
+    {
+        SecureZeroMemory(pbImage, cbImage);
+        free(pbImage);
+    }
+    if (state.pchPool != NULL)
+    {
+        SecureZeroMemory(state.pchPool, state.cbPoolAlloc);
+        free(state.pchPool);
+    }
+    free(state.rgRecords);
+    free(rgiPositionOf);
+    free(rgiSorted);
+
+    return hr;
+}
+
+// Loader //////////////////////////////////////////////////////////////
+
+CCredentialDirectory::CCredentialDirectory()
+{
+    _pbView = NULL;
+    _cbView = 0;
+    _pHeader = NULL;
+    _rgdwSeeds = NULL;
+    _rgiSlots = NULL;
+    _rgSlots = NULL;
+    _pchPool = NULL;
+#ifdef _WIN32
+    _hFile = INVALID_HANDLE_VALUE;
+    _hMapping = NULL;
+#endif
+}
+
+CCredentialDirectory::~CCredentialDirectory()
+{
+    Close();
+}
+
+BOOL CCredentialDirectory::IsOpen()
+{
+    return _pHeader != NULL;
+}
+
+//
+// Maps the directory at pszPath read-only and checks that it's intact. Nothing is
+// copied out of it; lookups read straight from the mapping.
+//
+HRESULT CCredentialDirectory::Open(const char* pszPath)
+{
+    Close();
+
+    HRESULT hr = S_OK;
+
+#ifdef _WIN32
+    _hFile = CreateFileA(pszPath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (_hFile == INVALID_HANDLE_VALUE)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        LARGE_INTEGER liSize;
+        if (GetFileSizeEx(_hFile, &liSize) && liSize.HighPart == 0)
+        {
+            _cbView = liSize.LowPart;
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        _hMapping = CreateFileMappingA(_hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (_hMapping != NULL)
+        {
+            _pbView = (const BYTE*)MapViewOfFile(_hMapping, FILE_MAP_READ, 0, 0, 0);
+        }
+        if (_pbView == NULL)
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+        }
+    }
+#else
+    int fd = open(pszPath, O_RDONLY);
+    if (fd < 0)
+    {
+        hr = HRESULT_FROM_WIN32(errno);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0 && (unsigned long long)st.st_size <= 0xFFFFFFFFull)
+        {
+            _cbView = (size_t)st.st_size;
+            void* pv = mmap(NULL, _cbView, PROT_READ, MAP_SHARED, fd, 0);
+            if (pv != MAP_FAILED)
+            {
+                _pbView = (const BYTE*)pv;
+            }
+            else
+            {
+                hr = HRESULT_FROM_WIN32(errno);
+            }
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+    }
+
+    // The mapping keeps the file alive; we don't need the descriptor.
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+#endif
+
+    if (SUCCEEDED(hr))
+    {
+        hr = _Validate();
+    }
+
+    if (FAILED(hr))
+    {
+        Close();
+    }
+
+    return hr;
+}
+
+// Checks the header against the file size, then the checksum, then that every hash
+// position names a slot and every slot points inside the pool, in id order.
+HRESULT CCredentialDirectory::_Validate()
+{
+    if (_cbView < sizeof(DIRECTORY_HEADER))
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    const DIRECTORY_HEADER* pHeader = (const DIRECTORY_HEADER*)_pbView;
+    if (pHeader->dwMagic != DIRECTORY_MAGIC ||
+        pHeader->dwVersion != DIRECTORY_VERSION ||
+        pHeader->cbFile != _cbView ||
+        pHeader->cBuckets == 0 ||
+        pHeader->ibSeeds != sizeof(DIRECTORY_HEADER) ||
+        (ULONGLONG)pHeader->ibSeeds + (ULONGLONG)pHeader->cBuckets * sizeof(DWORD) != pHeader->ibSlotMap ||
+        (ULONGLONG)pHeader->ibSlotMap + (ULONGLONG)pHeader->cRecords * sizeof(DWORD) != pHeader->ibSlots ||
+        (ULONGLONG)pHeader->ibSlots + (ULONGLONG)pHeader->cRecords * sizeof(DIRECTORY_SLOT) != pHeader->ibPool ||
+        (ULONGLONG)pHeader->ibPool + pHeader->cbPool != _cbView)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    if (_Crc32(_pbView + sizeof(DIRECTORY_HEADER), _cbView - sizeof(DIRECTORY_HEADER)) != pHeader->dwChecksum)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    const DWORD* rgiSlots = (const DWORD*)(_pbView + pHeader->ibSlotMap);
+    const DIRECTORY_SLOT* rgSlots = (const DIRECTORY_SLOT*)(_pbView + pHeader->ibSlots);
+    const char* pchPool = (const char*)(_pbView + pHeader->ibPool);
+    for (DWORD i = 0; i < pHeader->cRecords; i++)
+    {
+        if (rgiSlots[i] >= pHeader->cRecords ||
+            (ULONGLONG)rgSlots[i].ibRecord + rgSlots[i].cbId + rgSlots[i].cbUser + rgSlots[i].cbPassword > pHeader->cbPool ||
+            rgSlots[i].cbUser > PROFILE_MAX_FIELD ||
+            rgSlots[i].cbPassword > PROFILE_MAX_FIELD)
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+        if (i > 0 && _CompareIds(pchPool + rgSlots[i - 1].ibRecord, rgSlots[i - 1].cbId,
+            pchPool + rgSlots[i].ibRecord, rgSlots[i].cbId) >= 0)
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+    }
+
+    _pHeader = pHeader;
+    _rgdwSeeds = (const DWORD*)(_pbView + pHeader->ibSeeds);
+    _rgiSlots = rgiSlots;
+    _rgSlots = rgSlots;
+    _pchPool = pchPool;
+    return S_OK;
+}
+
+void CCredentialDirectory::Close()
+{
+#ifdef _WIN32
+    if (_pbView != NULL)
+    {
+        UnmapViewOfFile(_pbView);
+    }
+    if (_hMapping != NULL)
+    {
+        CloseHandle(_hMapping);
+        _hMapping = NULL;
+    }
+    if (_hFile != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(_hFile);
+        _hFile = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (_pbView != NULL)
+    {
+        munmap((void*)_pbView, _cbView);
+    }
+#endif
+    _pbView = NULL;
+    _cbView = 0;
+    _pHeader = NULL;
+    _rgdwSeeds = NULL;
+    _rgiSlots = NULL;
+    _rgSlots = NULL;
+    _pchPool = NULL;
+}
+
+HRESULT CCredentialDirectory::Lookup(const char* pchId, size_t cchId, PROFILE_RECORD* pRecord)
+{
+    if (_pHeader == NULL)
+    {
+        return E_FAIL;
+    }
+    if (_pHeader->cRecords == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+
+    DWORD iBucket = _DirectoryHash(pchId, cchId, 0) % _pHeader->cBuckets;
+    DWORD iPosition = _DirectoryHash(pchId, cchId, _rgdwSeeds[iBucket]) % _pHeader->cRecords;
+    const DIRECTORY_SLOT* pSlot = &_rgSlots[_rgiSlots[iPosition]];
+
+    // The perfect hash only guarantees known ids a slot of their own; anything else
+    // lands on somebody's slot, so the id has to be compared.
+    const char* pch = _pchPool + pSlot->ibRecord;
+    if (pSlot->cbId != cchId || memcmp(pch, pchId, cchId) != 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+
+    pch += pSlot->cbId;
+    CopyMemory(pRecord->szUser, pch, pSlot->cbUser);
+    pRecord->szUser[pSlot->cbUser] = '\0';
+    pch += pSlot->cbUser;
+    CopyMemory(pRecord->szPassword, pch, pSlot->cbPassword);
+    pRecord->szPassword[pSlot->cbPassword] = '\0';
+
+    return S_OK;
+}
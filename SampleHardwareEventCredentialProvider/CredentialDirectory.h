@@ -0,0 +1,88 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// A compiled credential directory is a read-only snapshot of the profile table
+// that can be memory-mapped and used as-is, with no parsing and no sqlite. It's
+// meant for offline machines that are shipped their accounts rather than
+// provisioned live. The file is laid out as:
+//
+//   DIRECTORY_HEADER
+//   DWORD              rgdwSeeds[cBuckets]     perfect hash displacements
+//   DWORD              rgiSlots[cRecords]      perfect hash position to slot
+//   DIRECTORY_SLOT     rgSlots[cRecords]       one per profile, sorted by id
+//   char               rgchPool[cbPool]        id, username, password, back to back,
+//                                              in the same order as the slots
+//
+// All integers are little-endian. A profile id is found by hashing it once to
+// pick a bucket, then again with that bucket's seed to pick a position, which
+// rgiSlots turns into a slot; the compiler chooses the seeds so that no two ids
+// share a position. Ids are sorted bytewise, a shorter id before a longer one that
+// it starts, so the slots (and the pool) can also be walked in key order.
+
+#pragma once
+
+#include "PlatformCompat.h"
+#include "ProfileIndex.h"
+
+class CCredentialStore;
+
+#define DIRECTORY_MAGIC     0x52494443      // "CDIR"
+#define DIRECTORY_VERSION   2
+
+struct DIRECTORY_HEADER
+{
+    DWORD   dwMagic;        // DIRECTORY_MAGIC
+    DWORD   dwVersion;      // DIRECTORY_VERSION
+    DWORD   cbFile;         // Size of the whole file.
+    DWORD   cRecords;       // Number of profiles, and of slots.
+    DWORD   cBuckets;       // Number of perfect hash seeds.
+    DWORD   ibSeeds;        // File offset of the seeds.
+    DWORD   ibSlotMap;      // File offset of the position-to-slot map.
+    DWORD   ibSlots;        // File offset of the slots.
+    DWORD   ibPool;         // File offset of the string pool.
+    DWORD   cbPool;         // Size of the string pool.
+    DWORD   dwChecksum;     // CRC-32 of everything after the header.
+};
+
+struct DIRECTORY_SLOT
+{
+    DWORD   ibRecord;       // Offset of the record in the string pool.
+    USHORT  cbId;           // Length of the id.
+    BYTE    cbUser;         // Length of the username.
+    BYTE    cbPassword;     // Length of the password.
+};
+
+HRESULT CredentialDirectoryCompile(CCredentialStore* pStore, const char* pszPath);
+
+class CCredentialDirectory : public IProfileSource
+{
+  public:
+    CCredentialDirectory();
+    ~CCredentialDirectory();
+
+    HRESULT Open(const char* pszPath);
+    void Close();
+    BOOL IsOpen();
+
+    HRESULT Lookup(const char* pchId, size_t cchId, PROFILE_RECORD* pRecord);
+
+  private:
+    HRESULT _Validate();
+
+    const BYTE              *_pbView;       // The mapped file.
+    size_t                  _cbView;        // Size of the mapped file.
+    const DIRECTORY_HEADER  *_pHeader;      // Points into _pbView.
+    const DWORD             *_rgdwSeeds;    // Points into _pbView.
+    const DWORD             *_rgiSlots;     // Points into _pbView.
+    const DIRECTORY_SLOT    *_rgSlots;      // Points into _pbView.
+    const char              *_pchPool;      // Points into _pbView.
+#ifdef _WIN32
+    HANDLE                  _hFile;
+    HANDLE                  _hMapping;
+#endif
+};
@@ -0,0 +1,965 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+#define WIN32_LEAN_AND_MEAN
+
+#include "CredentialListener.h"
+#include "SocketCompat.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define WAKE_ADDR htonl(INADDR_LOOPBACK)
+
+CCredentialListener::CCredentialListener()
+{
+    _pSink = NULL;
+    _pProfiles = NULL;
+    _fStop = FALSE;
+    _fStarted = FALSE;
+    _sListen = INVALID_SOCKET_T;
+    _sWake = INVALID_SOCKET_T;
+    _usWakePort = 0;
+    _cClients = 0;
+    _cchMaxLegacyField = PROFILE_MAX_FIELD;
+    _cWorkers = 0;
+    _cDone = 0;
+
+    for (DWORD i = 0; i < MAX_CLIENTS; i++)
+    {
+        _rgiClients[i] = i;
+    }
+
+    ZeroMemory(&_localClient, sizeof(_localClient));
+    _localClient.pListener = this;
+    _localClient.s = INVALID_SOCKET_T;
+    _localClient.mode = CM_FRAMED;
+}
+
+CCredentialListener::~CCredentialListener()
+{
+    Close();
+}
+
+// Creates the TCP socket we accept pushes on, plus a loopback UDP socket that is only
+// used to wake the event loop up when we're asked to stop. Both live until Close, so
+// a push never has to wait for the port to be rebound.
+HRESULT CCredentialListener::Open(const char* pszPort)
+{
+    int iResult;
+
+    struct addrinfo* result = NULL;
+    struct addrinfo hints;
+
+    HRESULT hr = SocketStartup();
+    if (FAILED(hr)) {
+        printf("WSAStartup failed with error: 0x%08x\n", (unsigned)hr);
+        return hr;
+    }
+    _fStarted = TRUE;
+
+    ZeroMemory(&hints, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+    hints.ai_flags = AI_PASSIVE;
+
+    // Resolve the server address and port
+    iResult = getaddrinfo(NULL, pszPort, &hints, &result);
+    if (iResult != 0) {
+        printf("getaddrinfo failed with error: %d\n", iResult);
+        return E_FAIL;
+    }
+
+    // Create a socket for connecting to server
+    _sListen = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (_sListen == INVALID_SOCKET_T) {
+        printf("socket failed with error: %d\n", SocketLastError());
+        freeaddrinfo(result);
+        return SocketLastErrorAsHResult();
+    }
+
+    // Setup the TCP listening socket
+    iResult = bind(_sListen, result->ai_addr, (int)result->ai_addrlen);
+    freeaddrinfo(result);
+    if (iResult == SOCKET_ERROR) {
+        printf("bind failed with error: %d\n", SocketLastError());
+        return SocketLastErrorAsHResult();
+    }
+
+    iResult = listen(_sListen, ACCEPT_BACKLOG);
+    if (iResult == SOCKET_ERROR) {
+        printf("listen failed with error: %d\n", SocketLastError());
+        return SocketLastErrorAsHResult();
+    }
+
+    // The accept loop must never block on a single client.
+    SocketSetNonBlocking(_sListen);
+
+    // Bind the wake socket to an ephemeral loopback port and remember where it lives so
+    // Stop can send it a datagram.
+    _sWake = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (_sWake == INVALID_SOCKET_T) {
+        printf("socket failed with error: %d\n", SocketLastError());
+        return SocketLastErrorAsHResult();
+    }
+
+    struct sockaddr_in saWake;
+    ZeroMemory(&saWake, sizeof(saWake));
+    saWake.sin_family = AF_INET;
+    saWake.sin_addr.s_addr = WAKE_ADDR;
+    saWake.sin_port = 0;
+    socklen_compat_t cbWake = sizeof(saWake);
+    if (bind(_sWake, (struct sockaddr*)&saWake, sizeof(saWake)) == SOCKET_ERROR ||
+        getsockname(_sWake, (struct sockaddr*)&saWake, &cbWake) == SOCKET_ERROR) {
+        printf("bind failed with error: %d\n", SocketLastError());
+        return SocketLastErrorAsHResult();
+    }
+    _usWakePort = saWake.sin_port;
+    SocketSetNonBlocking(_sWake);
+
+    return S_OK;
+}
+
+// Starts listening for status events on UDP port pszPort as well. Call after Open.
+HRESULT CCredentialListener::OpenEvents(const char* pszPort)
+{
+    return _events.Open(pszPort);
+}
+
+// Serves a local agent through the shared memory named pszName as well. Call after Open:
+// the agent rings the same loopback port Stop does to wake us.
+HRESULT CCredentialListener::OpenLocal(const char* pszName)
+{
+    if (_localClient.pParser == NULL)
+    {
+        _localClient.pParser = new CFrameParser();
+        if (_localClient.pParser == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        _localClient.pParser->SetMaxPayload(FRAME_MAX_PROVISION_PAYLOAD);
+    }
+    return _local.Create(pszName, _usWakePort);
+}
+
+void CCredentialListener::GetEventCounters(EVENT_CHANNEL_COUNTERS* pCounters)
+{
+    _events.GetCounters(pCounters);
+}
+
+// Gives us something to resolve FT_LOOKUP requests against. It must outlive Run.
+void CCredentialListener::SetProfileSource(IProfileSource* pSource)
+{
+    _pProfiles = pSource;
+}
+
+// Limits the usernames and passwords legacy senders may send, in bytes. Longer ones get
+// the sender disconnected. Can't be raised past PROFILE_MAX_FIELD.
+void CCredentialListener::SetMaxLegacyField(size_t cchMax)
+{
+    _cchMaxLegacyField = (cchMax < PROFILE_MAX_FIELD) ? cchMax : PROFILE_MAX_FIELD;
+}
+
+// Sets how many connections a second each source address may open, and how many it may
+// open in a burst. Call before Run.
+void CCredentialListener::SetRateLimit(DWORD dwPerSecond, DWORD dwBurst)
+{
+    _admission.SetRateLimit(dwPerSecond, dwBurst);
+}
+
+void CCredentialListener::GetAdmissionCounters(ADMISSION_COUNTERS* pCounters)
+{
+    _admission.GetCounters(pCounters);
+}
+
+// Sets how many worker threads Run hands reads to. Call before Run. With none, the
+// default, everything is done on the thread running Run.
+void CCredentialListener::SetWorkerCount(DWORD cWorkers)
+{
+    _cWorkers = (cWorkers < WORKER_POOL_MAX_WORKERS) ? cWorkers : WORKER_POOL_MAX_WORKERS;
+}
+
+void CCredentialListener::GetWorkerCounters(WORKER_POOL_COUNTERS* pCounters)
+{
+    _pool.GetCounters(pCounters);
+}
+
+// Asks Run to return. Safe to call from any thread.
+void CCredentialListener::Stop()
+{
+    _fStop = TRUE;
+    _Wake();
+}
+
+// Interrupts the event loop's wait. Safe to call from any thread.
+void CCredentialListener::_Wake()
+{
+    if (_sWake != INVALID_SOCKET_T)
+    {
+        struct sockaddr_in saWake;
+        ZeroMemory(&saWake, sizeof(saWake));
+        saWake.sin_family = AF_INET;
+        saWake.sin_addr.s_addr = WAKE_ADDR;
+        saWake.sin_port = _usWakePort;
+        sendto(_sWake, "", 1, 0, (struct sockaddr*)&saWake, sizeof(saWake));
+    }
+}
+
+// Closes every socket we own and balances our SocketStartup call. Run must have
+// returned before this is called.
+void CCredentialListener::Close()
+{
+    for (DWORD i = 0; i < _cClients; i++)
+    {
+        _FreeClient(_Client(i));
+    }
+    _cClients = 0;
+
+    if (_sListen != INVALID_SOCKET_T)
+    {
+        SocketClose(_sListen);
+        _sListen = INVALID_SOCKET_T;
+    }
+    if (_sWake != INVALID_SOCKET_T)
+    {
+        SocketClose(_sWake);
+        _sWake = INVALID_SOCKET_T;
+    }
+    _events.Close();
+    _local.Close();
+    if (_localClient.pParser != NULL)
+    {
+        delete _localClient.pParser;
+        _localClient.pParser = NULL;
+    }
+    free(_localClient.pbSend);
+    _localClient.pbSend = NULL;
+    _localClient.cbSend = 0;
+    _localClient.cbSendAlloc = 0;
+
+    if (_fStarted)
+    {
+        SocketCleanup();
+        _fStarted = FALSE;
+    }
+}
+
+// Returns the iClient'th connected sender.
+CLIENT_CONNECTION* CCredentialListener::_Client(DWORD iClient)
+{
+    return &_rgClients[_rgiClients[iClient]];
+}
+
+// Accepts the connections pending on the listening socket, up to ACCEPT_BATCH_MAX at a
+// time. A newcomer is closed straight away, rather than left to sit in the backlog, if
+// we're already serving MAX_CLIENTS senders or its source has used up its rate limit.
+void CCredentialListener::_AcceptClients()
+{
+    ULONGLONG ullNow = GetTickCount64();
+    for (DWORD cAccepted = 0; cAccepted < ACCEPT_BATCH_MAX; cAccepted++)
+    {
+        ULONGLONG ullStart = StageClock();
+        struct sockaddr_in saFrom;
+        socklen_compat_t cbFrom = sizeof(saFrom);
+        ZeroMemory(&saFrom, sizeof(saFrom));
+        socket_t ClientSocket = accept(_sListen, (struct sockaddr*)&saFrom, &cbFrom);
+        if (ClientSocket == INVALID_SOCKET_T) {
+            int iError = SocketLastError();
+            if (iError != SOCKET_EWOULDBLOCK) {
+                printf("accept failed with error: %d\n", iError);
+            }
+            break;
+        }
+
+        // A newcomer turned away for want of a slot doesn't spend any of its source's burst.
+        if (_cClients >= MAX_CLIENTS || !_admission.Admit(saFrom.sin_addr.s_addr, ullNow)) {
+            SocketClose(ClientSocket);
+            CStageTimings::GetShared()->Record(PS_ACCEPT, StageClock() - ullStart);
+            continue;
+        }
+
+        SocketSetNonBlocking(ClientSocket);
+
+        CLIENT_CONNECTION* pClient = _Client(_cClients++);
+        ZeroMemory(pClient, sizeof(*pClient));
+        pClient->pListener = this;
+        pClient->s = ClientSocket;
+        pClient->mode = CM_UNKNOWN;
+        pClient->fHaveMagic = FALSE;
+        pClient->fClosed = FALSE;
+        pClient->fHaveUser = FALSE;
+        pClient->cchField = 0;
+        pClient->pParser = NULL;
+        pClient->pbSend = NULL;
+        pClient->cbSend = 0;
+        pClient->cbSendAlloc = 0;
+        pClient->fBusy = FALSE;
+        pClient->fDone = FALSE;
+
+        CStageTimings::GetShared()->Record(PS_ACCEPT, StageClock() - ullStart);
+    }
+}
+
+// Closes a client's socket and releases everything it owns.
+void CCredentialListener::_FreeClient(CLIENT_CONNECTION* pClient)
+{
+    SocketClose(pClient->s);
+    SecureZeroMemory(pClient->szUser, sizeof(pClient->szUser));
+    SecureZeroMemory(pClient->szPassword, sizeof(pClient->szPassword));
+    if (pClient->pParser != NULL)
+    {
+        delete pClient->pParser;
+        pClient->pParser = NULL;
+    }
+    free(pClient->pbSend);
+    pClient->pbSend = NULL;
+    pClient->cbSend = 0;
+    pClient->cbSendAlloc = 0;
+}
+
+// Appends an FT_ACK for dwRequestId to the client's reply queue. Nothing is sent
+// until _FlushClient, so a batch of pipelined requests is answered with one send.
+HRESULT CCredentialListener::_QueueAck(CLIENT_CONNECTION* pClient, DWORD dwRequestId, HRESULT hrStatus)
+{
+    HRESULT hr = S_OK;
+
+    if (pClient->cbSend + FRAME_ACK_SIZE > pClient->cbSendAlloc)
+    {
+        DWORD cbAlloc = pClient->cbSendAlloc ? pClient->cbSendAlloc * 2 : FRAME_ACK_SIZE * 16;
+        if (cbAlloc > MAX_SEND_QUEUE)
+        {
+            cbAlloc = MAX_SEND_QUEUE;
+        }
+
+        if (pClient->cbSend + FRAME_ACK_SIZE <= cbAlloc)
+        {
+            BYTE* pbNew = (BYTE*)realloc(pClient->pbSend, cbAlloc);
+            if (pbNew)
+            {
+                pClient->pbSend = pbNew;
+                pClient->cbSendAlloc = cbAlloc;
+            }
+            else
+            {
+                hr = E_OUTOFMEMORY;
+            }
+        }
+        else
+        {
+            // The sender has stopped reading its replies.
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        FrameAckEncode(dwRequestId, hrStatus, pClient->pbSend + pClient->cbSend);
+        pClient->cbSend += FRAME_ACK_SIZE;
+    }
+
+    return hr;
+}
+
+// Writes as much of the client's reply queue as the socket will take without blocking.
+// Whatever's left is written when the poll loop sees the socket become writable.
+// Returns FALSE if the connection has failed.
+BOOL CCredentialListener::_FlushClient(CLIENT_CONNECTION* pClient)
+{
+    DWORD ib = 0;
+    while (ib < pClient->cbSend)
+    {
+        int iResult = (int)send(pClient->s, (const char*)pClient->pbSend + ib, (int)(pClient->cbSend - ib), 0);
+        if (iResult == SOCKET_ERROR) {
+            int iError = SocketLastError();
+            if (iError == SOCKET_EWOULDBLOCK) {
+                break;
+            }
+            printf("send failed with error: %d\n", iError);
+            return FALSE;
+        }
+        ib += iResult;
+    }
+
+    if (ib > 0)
+    {
+        memmove(pClient->pbSend, pClient->pbSend + ib, pClient->cbSend - ib);
+        pClient->cbSend -= ib;
+    }
+    return TRUE;
+}
+
+// Removes the iClient'th connected sender, moving the last one into its place in
+// _rgiClients so the connected senders stay first. Their slots don't move, since a
+// worker may be using one.
+void CCredentialListener::_CloseClient(DWORD iClient)
+{
+    _FreeClient(_Client(iClient));
+
+    _cClients--;
+    if (iClient != _cClients)
+    {
+        DWORD iSlot = _rgiClients[iClient];
+        _rgiClients[iClient] = _rgiClients[_cClients];
+        _rgiClients[_cClients] = iSlot;
+    }
+}
+
+// Called when a legacy sender's username or password is complete. Each is acknowledged
+// with "OK"; once we have both we hand them on, echo the username back and close the
+// connection. Returns FALSE once the client should be removed.
+BOOL CCredentialListener::_CompleteLegacyField(CLIENT_CONNECTION* pClient)
+{
+    if (send(pClient->s, "OK", 2, 0) == SOCKET_ERROR) {
+        printf("send failed with error: %d\n", SocketLastError());
+        return FALSE;
+    }
+
+    if (!pClient->fHaveUser)
+    {
+        pClient->fHaveUser = TRUE;
+        pClient->cchField = 0;
+        return TRUE;
+    }
+
+    _pSink->OnCredentialReceived(pClient->szUser, pClient->szPassword);
+    SecureZeroMemory(pClient->szPassword, sizeof(pClient->szPassword));
+    send(pClient->s, pClient->szUser, (int)strlen(pClient->szUser), 0);
+
+    // shutdown the connection since we're done
+    if (shutdown(pClient->s, SOCKET_SHUT_SEND) == SOCKET_ERROR) {
+        printf("shutdown failed with error: %d\n", SocketLastError());
+    }
+    return FALSE;
+}
+
+// Handles data from a legacy sender: a NUL-terminated username, then a password. Either
+// may arrive split over several reads, or both in the same one; each is scanned straight
+// into the connection's buffer as it comes, and is complete at its NUL. A password the
+// sender doesn't terminate is complete when it closes its end (see _ProcessRead). A
+// field longer than we allow gets the sender dropped rather than quietly truncated.
+// Returns FALSE once the client should be removed.
+BOOL CCredentialListener::_ServiceLegacyClient(CLIENT_CONNECTION* pClient, const char* pbData, int cbData)
+{
+    size_t ib = 0;
+    while (ib < (size_t)cbData)
+    {
+        char* pszField = pClient->fHaveUser ? pClient->szPassword : pClient->szUser;
+        size_t cchUsed;
+        HRESULT hr;
+        {
+            CStageTimer timer(PS_PARSE);
+            hr = LegacyFieldScan(pbData + ib, cbData - ib, pszField, _cchMaxLegacyField, &pClient->cchField, &cchUsed);
+        }
+        if (FAILED(hr)) {
+            printf("dropping legacy sender after an overlong field\n");
+            return FALSE;
+        }
+        ib += cchUsed;
+
+        if (hr == S_FALSE)
+        {
+            // The rest of the field is still to come.
+            return TRUE;
+        }
+        if (!_CompleteLegacyField(pClient))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Called by a client's CFrameParser for each complete frame it receives. Requests that
+// are well-framed but can't be carried out are answered with a failure FT_ACK and the
+// connection stays open; only a failure to queue the reply stops the parser.
+HRESULT CCredentialListener::_OnClientFrame(CLIENT_CONNECTION* pClient, const FRAME_HEADER& fh, const BYTE* pbPayload)
+{
+    HRESULT hrStatus;
+
+    switch (fh.bType)
+    {
+    case FT_CREDENTIAL:
+        {
+            CREDENTIAL_MESSAGE cm;
+            hrStatus = CredentialMessageDecode(pbPayload, fh.cbPayload, &cm);
+            if (SUCCEEDED(hrStatus))
+            {
+                char u[PROFILE_MAX_FIELD + 1];
+                char p[PROFILE_MAX_FIELD + 1];
+                if (cm.cbUser < ARRAYSIZE(u) && cm.cbPassword < ARRAYSIZE(p))
+                {
+                    CopyMemory(u, cm.pchUser, cm.cbUser);
+                    u[cm.cbUser] = '\0';
+                    CopyMemory(p, cm.pchPassword, cm.cbPassword);
+                    p[cm.cbPassword] = '\0';
+
+                    _pSink->OnCredentialReceived(u, p);
+                    SecureZeroMemory(p, sizeof(p));
+                }
+                else
+                {
+                    hrStatus = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+                }
+            }
+        }
+        break;
+
+    case FT_LOOKUP:
+        if (_pProfiles != NULL)
+        {
+            PROFILE_RECORD record;
+            {
+                CStageTimer timer(PS_LOOKUP);
+                hrStatus = _pProfiles->Lookup((const char*)pbPayload, fh.cbPayload, &record);
+            }
+            if (SUCCEEDED(hrStatus))
+            {
+                _pSink->OnCredentialReceived(record.szUser, record.szPassword);
+                SecureZeroMemory(&record, sizeof(record));
+            }
+        }
+        else
+        {
+            hrStatus = E_NOTIMPL;
+        }
+        break;
+
+    case FT_REVOKE:
+        {
+            char u[PROFILE_MAX_FIELD + 1];
+            if (fh.cbPayload > 0 && fh.cbPayload < ARRAYSIZE(u) && memchr(pbPayload, 0, fh.cbPayload) == NULL)
+            {
+                CopyMemory(u, pbPayload, fh.cbPayload);
+                u[fh.cbPayload] = '\0';
+                hrStatus = _pSink->OnCredentialRevoked(u);
+            }
+            else
+            {
+                hrStatus = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+            }
+        }
+        break;
+
+    case FT_PROVISION:
+        {
+            // Check the whole batch, and count it, before anything is applied.
+            DWORD cUpdates;
+            hrStatus = ProvisionMessageDecode(pbPayload, fh.cbPayload, NULL, 0, &cUpdates);
+            if (SUCCEEDED(hrStatus))
+            {
+                PROFILE_UPDATE* rgUpdates = (PROFILE_UPDATE*)malloc(cUpdates * sizeof(PROFILE_UPDATE));
+                if (rgUpdates != NULL)
+                {
+                    hrStatus = ProvisionMessageDecode(pbPayload, fh.cbPayload, rgUpdates, cUpdates, &cUpdates);
+                    if (SUCCEEDED(hrStatus))
+                    {
+                        hrStatus = _pSink->OnProfilesProvisioned(rgUpdates, cUpdates);
+                    }
+                    free(rgUpdates);
+                }
+                else
+                {
+                    hrStatus = E_OUTOFMEMORY;
+                }
+            }
+        }
+        break;
+
+    default:
+        // Tell newer senders we don't understand this request, but keep talking to them.
+        hrStatus = E_NOTIMPL;
+        break;
+    }
+
+    return _QueueAck(pClient, fh.dwRequestId, hrStatus);
+}
+
+// Services a readable client. What it sent is handed to a worker if we have one to
+// spare, and otherwise dealt with here and now. Returns FALSE once the client should
+// be removed.
+BOOL CCredentialListener::_ServiceClient(CLIENT_CONNECTION* pClient)
+{
+    // A FRAME_MAGIC held back from the last read goes in front of this one.
+    int cbHeld = pClient->fHaveMagic ? 1 : 0;
+    int iResult;
+    {
+        CStageTimer timer(PS_RECV);
+        iResult = (int)recv(pClient->s, pClient->rgbRecv + cbHeld, sizeof(pClient->rgbRecv) - cbHeld, 0);
+    }
+    if (iResult == 0) {
+        printf("Connection closing...\n");
+
+        // A legacy sender may leave its password unterminated and just close its end.
+        // Completing it hands the credential to the sink, so it's acted on like any
+        // other read: by a worker, if there is one.
+        if (pClient->mode != CM_LEGACY || !pClient->fHaveUser || pClient->cchField == 0)
+        {
+            return FALSE;
+        }
+        pClient->fClosed = TRUE;
+    }
+    if (iResult == SOCKET_ERROR) {
+        int iError = SocketLastError();
+        if (iError == SOCKET_EWOULDBLOCK) {
+            return TRUE;
+        }
+        printf("recv failed with error: %d\n", iError);
+        return FALSE;
+    }
+    pClient->cbRecv = iResult + cbHeld;
+
+    // The first two bytes a sender sends tell us which protocol it speaks. If all we have
+    // is FRAME_MAGIC, keep it until the next byte arrives.
+    if (pClient->mode == CM_UNKNOWN)
+    {
+        if (pClient->fHaveMagic)
+        {
+            pClient->rgbRecv[0] = (char)FRAME_MAGIC;
+            pClient->fHaveMagic = FALSE;
+        }
+        if ((BYTE)pClient->rgbRecv[0] == FRAME_MAGIC && pClient->cbRecv == 1)
+        {
+            pClient->fHaveMagic = TRUE;
+            pClient->cbRecv = 0;
+            return TRUE;
+        }
+        if ((BYTE)pClient->rgbRecv[0] == FRAME_MAGIC && (BYTE)pClient->rgbRecv[1] == FRAME_VERSION)
+        {
+            pClient->pParser = new CFrameParser();
+            if (pClient->pParser == NULL)
+            {
+                return FALSE;
+            }
+            pClient->pParser->SetMaxPayload(FRAME_MAX_PROVISION_PAYLOAD);
+            pClient->mode = CM_FRAMED;
+        }
+        else if ((BYTE)pClient->rgbRecv[0] == FRAME_MAGIC && ((BYTE)pClient->rgbRecv[1] & 0xC0) != 0x80)
+        {
+            // Neither a frame we understand nor the start of a UTF-8 username.
+            printf("dropping sender with an unknown frame version: %u\n", (unsigned)(BYTE)pClient->rgbRecv[1]);
+            return FALSE;
+        }
+        else
+        {
+            pClient->mode = CM_LEGACY;
+        }
+    }
+
+    if (_pool.IsRunning())
+    {
+        // Set first: the worker may be done before Submit returns.
+        pClient->fBusy = TRUE;
+        if (SUCCEEDED(_pool.Submit(_ProcessReadWorkItem, pClient)))
+        {
+            return TRUE;
+        }
+        pClient->fBusy = FALSE;
+    }
+
+    pClient->fKeep = _ProcessRead(pClient);
+    return _FinishRead(pClient);
+}
+
+// Acts on the read in pClient->rgbRecv. Called on a worker, or by _ServiceClient if
+// there isn't one. Returns FALSE once the client should be removed.
+BOOL CCredentialListener::_ProcessRead(CLIENT_CONNECTION* pClient)
+{
+    BOOL fKeep;
+    if (pClient->mode == CM_FRAMED)
+    {
+        HRESULT hr = _FeedClient(pClient, (const BYTE*)pClient->rgbRecv, pClient->cbRecv);
+        if (FAILED(hr)) {
+            printf("dropping sender after bad frame: 0x%08x\n", (unsigned)hr);
+        }
+        fKeep = SUCCEEDED(hr);
+    }
+    else
+    {
+        fKeep = _ServiceLegacyClient(pClient, pClient->rgbRecv, pClient->cbRecv);
+        if (fKeep && pClient->fClosed)
+        {
+            _CompleteLegacyField(pClient);
+            fKeep = FALSE;
+        }
+    }
+
+    SecureZeroMemory(pClient->rgbRecv, sizeof(pClient->rgbRecv));
+    pClient->cbRecv = 0;
+    return fKeep;
+}
+
+// Hands a framed sender's read to its parser, which carries out each request it
+// completes. The time that takes, less the requests themselves, is the parse stage.
+HRESULT CCredentialListener::_FeedClient(CLIENT_CONNECTION* pClient, const BYTE* pb, DWORD cb)
+{
+    ULONGLONG ullStart = StageClock();
+    CClientFrameHandler handler(this, pClient);
+    HRESULT hr = pClient->pParser->Feed(pb, cb, &handler);
+    CStageTimings::GetShared()->Record(PS_PARSE, StageClock() - ullStart - handler.GetHandledTime());
+    return hr;
+}
+
+// Called on the event loop's thread once a read has been acted on. Answers everything
+// it completed in one go. Returns FALSE once the client should be removed.
+BOOL CCredentialListener::_FinishRead(CLIENT_CONNECTION* pClient)
+{
+    return pClient->fKeep && _FlushClient(pClient);
+}
+
+// Runs on a worker. Acts on a client's read and tells the event loop it's done. Only
+// the first read to finish since the loop last looked needs to wake it.
+void CCredentialListener::_ProcessReadWorkItem(void* pv)
+{
+    CLIENT_CONNECTION* pClient = static_cast<CLIENT_CONNECTION*>(pv);
+    CCredentialListener* pThis = pClient->pListener;
+
+    pClient->fKeep = pThis->_ProcessRead(pClient);
+
+    DWORD iSlot = (DWORD)(pClient - pThis->_rgClients);
+    BOOL fWake;
+    {
+        std::lock_guard<std::mutex> guard(pThis->_lockDone);
+        pThis->_rgiDone[pThis->_cDone++] = iSlot;
+        fWake = (pThis->_cDone == 1);
+    }
+    if (fWake)
+    {
+        pThis->_Wake();
+    }
+}
+
+// Marks the clients whose reads the workers have finished, so the event loop can
+// answer them and start watching them again.
+void CCredentialListener::_CollectFinishedReads()
+{
+    std::lock_guard<std::mutex> guard(_lockDone);
+    for (DWORD i = 0; i < _cDone; i++)
+    {
+        CLIENT_CONNECTION* pClient = &_rgClients[_rgiDone[i]];
+        pClient->fBusy = FALSE;
+        pClient->fDone = TRUE;
+    }
+    _cDone = 0;
+}
+
+// Hands a batch of waiting status events to the sink.
+void CCredentialListener::_ReceiveEvents()
+{
+    EVENT_MESSAGE rgEvents[EVENT_BATCH_MAX];
+    DWORD cEvents;
+    if (SUCCEEDED(_events.Receive(GetTickCount64(), rgEvents, ARRAYSIZE(rgEvents), &cEvents)))
+    {
+        for (DWORD i = 0; i < cEvents; i++)
+        {
+            _pSink->OnStatusEvent(rgEvents[i].type);
+        }
+    }
+}
+
+// Handles what the local agent has written since we last looked, a CLIENT_RECV_BUFLEN
+// read at a time, and answers it. An agent that sends something we can't parse is
+// dropped, as a sender would be, once it has what replies we have room for, and must
+// connect again; a new agent starts afresh.
+void CCredentialListener::_ServiceLocal()
+{
+    CLIENT_CONNECTION* pClient = &_localClient;
+
+    if (_local.Accept() == S_OK)
+    {
+        pClient->pParser->Reset();
+        pClient->cbSend = 0;
+    }
+
+    for (DWORD cReads = 0; cReads < LOCAL_RECV_BATCH_MAX; cReads++)
+    {
+        DWORD cbRecv;
+        HRESULT hr = _local.Receive((BYTE*)pClient->rgbRecv, sizeof(pClient->rgbRecv), &cbRecv);
+        if (FAILED(hr) || cbRecv == 0)
+        {
+            break;
+        }
+
+        hr = _FeedClient(pClient, (const BYTE*)pClient->rgbRecv, cbRecv);
+        SecureZeroMemory(pClient->rgbRecv, cbRecv);
+        if (FAILED(hr)) {
+            printf("dropping local agent after bad frame: 0x%08x\n", (unsigned)hr);
+            _FlushLocal();
+            _local.Drop();
+            pClient->pParser->Reset();
+            pClient->cbSend = 0;
+            break;
+        }
+
+        // Make room for the next read's replies as we go.
+        _FlushLocal();
+    }
+}
+
+// Writes as much of the local agent's reply queue as its ring has room for. Returns
+// FALSE if there's some left over.
+BOOL CCredentialListener::_FlushLocal()
+{
+    CLIENT_CONNECTION* pClient = &_localClient;
+    DWORD cbSent = 0;
+    if (pClient->cbSend > 0 && SUCCEEDED(_local.Send(pClient->pbSend, pClient->cbSend, &cbSent)) && cbSent > 0)
+    {
+        memmove(pClient->pbSend, pClient->pbSend + cbSent, pClient->cbSend - cbSent);
+        pClient->cbSend -= cbSent;
+    }
+    return pClient->cbSend == 0;
+}
+
+// The event loop. We poll the listening socket, the wake socket, the event socket
+// and every connected client together, so any number of senders can be mid-push at the same time,
+// and check the local agent's ring each time round. A
+// client whose read is with a worker isn't polled until the worker is done with it,
+// and while the workers are full we stop reading from anyone. Returns once Stop is
+// called, after the workers have finished whatever they had.
+void CCredentialListener::Run(ICredentialSink* pSink)
+{
+    pollfd_t rgPoll[MAX_CLIENTS + 3];
+    DWORD rgiPoll[MAX_CLIENTS];     // Each connected client's entry in rgPoll, or 0.
+
+    _pSink = pSink;
+
+    if (_cWorkers > 0)
+    {
+        HRESULT hr = _pool.Start(_cWorkers, _cWorkers * LISTENER_QUEUE_PER_WORKER);
+        if (FAILED(hr)) {
+            printf("couldn't start workers, handling reads on the event loop: 0x%08x\n", (unsigned)hr);
+        }
+    }
+
+    while (!_fStop)
+    {
+        rgPoll[0].fd = _sListen;
+        rgPoll[0].events = POLLIN;
+        rgPoll[0].revents = 0;
+        rgPoll[1].fd = _sWake;
+        rgPoll[1].events = POLLIN;
+        rgPoll[1].revents = 0;
+
+        DWORD cPoll = 2;
+        DWORD iEventPoll = 0;
+        if (_events.IsOpen())
+        {
+            iEventPoll = cPoll++;
+            rgPoll[iEventPoll].fd = _events.GetSocket();
+            rgPoll[iEventPoll].events = POLLIN;
+            rgPoll[iEventPoll].revents = 0;
+        }
+
+        BOOL fSaturated = _pool.IsSaturated();
+        DWORD cClients = _cClients;
+        for (DWORD i = 0; i < cClients; i++)
+        {
+            CLIENT_CONNECTION* pClient = _Client(i);
+            short events = 0;
+            if (!pClient->fBusy)
+            {
+                events = (pClient->cbSend > 0) ? POLLOUT : 0;
+                if (!fSaturated)
+                {
+                    events |= POLLIN;
+                }
+            }
+
+            rgiPoll[i] = 0;
+            if (events != 0)
+            {
+                rgiPoll[i] = cPoll;
+                rgPoll[cPoll].fd = pClient->s;
+                rgPoll[cPoll].events = events;
+                rgPoll[cPoll].revents = 0;
+                cPoll++;
+            }
+        }
+
+        DWORD dwTimeout = _pSink->OnIdle();
+
+        // Don't go to sleep on the local agent if it has already written to us, or
+        // made room for replies we're waiting to write.
+        if (_local.IsOpen() && !_local.PrepareToWait(_localClient.cbSend > 0))
+        {
+            dwTimeout = 0;
+        }
+
+        int iResult = SocketPoll(rgPoll, cPoll, (dwTimeout == SINK_WAIT_FOREVER) ? -1 : (int)dwTimeout);
+        if (iResult == SOCKET_ERROR) {
+            if (SocketLastError() == SOCKET_EINTR) {
+                continue;
+            }
+            printf("poll failed with error: %d\n", SocketLastError());
+            break;
+        }
+
+        if (rgPoll[1].revents != 0)
+        {
+            char buf[16];
+            while (recv(_sWake, buf, sizeof(buf), 0) > 0)
+            {
+            }
+        }
+        _CollectFinishedReads();
+
+        if (_local.IsOpen())
+        {
+            _FlushLocal();
+            _ServiceLocal();
+        }
+
+        if (iEventPoll != 0 && rgPoll[iEventPoll].revents != 0)
+        {
+            _ReceiveEvents();
+        }
+
+        // Walk the clients backwards, since _CloseClient moves the last one down into
+        // the freed place.
+        for (DWORD i = cClients; i > 0; i--)
+        {
+            CLIENT_CONNECTION* pClient = _Client(i - 1);
+            BOOL fKeep = TRUE;
+            if (pClient->fDone)
+            {
+                pClient->fDone = FALSE;
+                fKeep = _FinishRead(pClient);
+            }
+            else if (rgiPoll[i - 1] != 0)
+            {
+                short revents = rgPoll[rgiPoll[i - 1]].revents;
+                if (revents & POLLOUT)
+                {
+                    fKeep = _FlushClient(pClient);
+                }
+                if (fKeep && (revents & ~POLLOUT))
+                {
+                    fKeep = _ServiceClient(pClient);
+                }
+            }
+
+            if (!fKeep)
+            {
+                _CloseClient(i - 1);
+            }
+        }
+
+        if (rgPoll[0].revents != 0)
+        {
+            _AcceptClients();
+        }
+    }
+
+    // Let the workers finish what they have; their clients are closed with the rest.
+    _pool.Stop();
+    _CollectFinishedReads();
+    for (DWORD i = 0; i < _cClients; i++)
+    {
+        _Client(i)->fDone = FALSE;
+    }
+}
@@ -0,0 +1,224 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// CCredentialListener is the platform-neutral half of SocketListener. It owns
+// the listening socket and the event loop, receives and parses pushes from
+// senders, and hands each complete credential to an ICredentialSink. It knows
+// nothing about the provider, so it builds and runs on POSIX systems as well.
+//
+// The loop's own thread only accepts, reads and writes. What a read contains is
+// worked out on a CWorkerPool, if the listener has been given workers: the frames
+// are parsed, looked up and handed to the sink there, and the replies are written
+// once the worker is done. Each sender has at most one read with the workers at a
+// time, so its requests are still carried out, and answered, in the order it sent
+// them; different senders' requests run side by side.
+//
+// The loop can also watch a CEventChannel for status events sent over UDP, and
+// serve one agent on the same machine over a CLocalTransport. The agent's frames are
+// handled on the loop's own thread as soon as they arrive, since an agent that went
+// to the trouble of sharing memory with us wants its answers without a hand-off.
+
+#pragma once
+
+#include "PlatformCompat.h"
+#include "CredentialProtocol.h"
+#include "ProfileIndex.h"
+#include "AdmissionControl.h"
+#include "WorkerPool.h"
+#include "EventChannel.h"
+#include "LocalTransport.h"
+#include "StageTimings.h"
+#include <atomic>
+#include <mutex>
+
+// The most senders we'll service at once. Further connections are closed as soon as
+// they're accepted.
+#define MAX_CLIENTS 62
+
+// How many connections the system may hold for us before we accept them. Kept short so
+// that in a connection storm newcomers are refused by the system straight away instead
+// of queuing behind the storm.
+#define ACCEPT_BACKLOG 16
+
+// The most connections we'll accept each time round the loop, so that a storm of them
+// can't keep us from servicing the senders we already have.
+#define ACCEPT_BATCH_MAX 32
+
+// The most reply bytes we'll hold for a framed sender that isn't reading them. A sender
+// that lets more pile up than this is disconnected.
+#define MAX_SEND_QUEUE (FRAME_ACK_SIZE * 4096)
+
+// The most bytes we read from a sender at a time.
+#define CLIENT_RECV_BUFLEN 1024
+
+// How many reads each worker may have queued before the loop stops reading from
+// senders until they catch up.
+#define LISTENER_QUEUE_PER_WORKER 4
+
+// The most reads we take from the local agent each time round the loop, so that it
+// can't keep us from servicing everyone else. Whatever's left is read next time.
+#define LOCAL_RECV_BATCH_MAX 16
+
+// OnIdle's answer when the sink has nothing scheduled.
+#define SINK_WAIT_FOREVER ((DWORD)-1)
+
+// Receives the credentials parsed by a CCredentialListener. OnIdle and OnStatusEvent
+// are called on the thread that is running CCredentialListener::Run. The rest are
+// called there too if
+// the listener has no workers; if it has, they're called on the workers, for several
+// senders at once, so they must be safe to call concurrently.
+class ICredentialSink
+{
+  public:
+    virtual ~ICredentialSink() {}
+    virtual void OnCredentialReceived(const char* pszUser, const char* pszPassword) = 0;
+
+    // Called when a sender withdraws a username it pushed earlier.
+    virtual HRESULT OnCredentialRevoked(const char* pszUser) { UNREFERENCED_PARAMETER(pszUser); return E_NOTIMPL; }
+
+    // Called with a batch of profiles to store for later badge lookups. The batch has
+    // been checked as a whole; it should be applied as a whole, or not at all.
+    virtual HRESULT OnProfilesProvisioned(const PROFILE_UPDATE* rgUpdates, DWORD cUpdates)
+    {
+        UNREFERENCED_PARAMETER(rgUpdates);
+        UNREFERENCED_PARAMETER(cUpdates);
+        return E_NOTIMPL;
+    }
+
+    // Called for each status event received on the event port, in the order they
+    // arrived, with duplicates and overtaken events already dropped.
+    virtual void OnStatusEvent(EVENT_TYPE type) { UNREFERENCED_PARAMETER(type); }
+
+    // Called each time round the loop, before it waits for the network. Returns the
+    // longest it may wait, in milliseconds, before calling again.
+    virtual DWORD OnIdle() { return SINK_WAIT_FOREVER; }
+};
+
+// Which protocol a connected sender is speaking. We can't tell until the first two bytes
+// arrive: framed senders always start with FRAME_MAGIC and then FRAME_VERSION. FRAME_MAGIC
+// alone isn't enough, as it's also the lead byte of a UTF-8 character a legacy username
+// could start with; but FRAME_VERSION can't follow it in UTF-8. FRAME_MAGIC followed by
+// anything else that can't, such as another version, gets the sender dropped.
+enum CONNECTION_MODE
+{
+    CM_UNKNOWN      = 0,
+    CM_LEGACY       = 1,    // A NUL-terminated username, then a password, each answered with
+                            // "OK". See _ServiceLegacyClient.
+    CM_FRAMED       = 2,    // Frames as described in CredentialProtocol.h.
+};
+
+class CCredentialListener;
+
+// Per-connection state for a sender that's part way through a push. While fBusy is
+// set, everything but fBusy belongs to the worker handling the sender's latest read.
+struct CLIENT_CONNECTION
+{
+    CCredentialListener *pListener; // The listener the sender is connected to.
+    socket_t        s;              // The client socket.
+    CONNECTION_MODE mode;           // The protocol the sender is speaking.
+    BOOL            fHaveMagic;     // CM_UNKNOWN: the sender has sent FRAME_MAGIC and nothing more yet.
+    BOOL            fClosed;        // The sender has closed its end; the read being handled is its last.
+    BOOL            fHaveUser;      // CM_LEGACY: whether we've received the username yet.
+    char            szUser[PROFILE_MAX_FIELD + 1];      // CM_LEGACY: the username, as far as we have it.
+    char            szPassword[PROFILE_MAX_FIELD + 1];  // CM_LEGACY: the password, as far as we have it.
+    size_t          cchField;       // CM_LEGACY: characters received of the field in progress.
+    CFrameParser    *pParser;       // CM_FRAMED: reassembles frames from the stream.
+    BYTE            *pbSend;        // CM_FRAMED: replies not yet written to the socket.
+    DWORD           cbSend;         // CM_FRAMED: number of valid bytes in pbSend.
+    DWORD           cbSendAlloc;    // CM_FRAMED: size of pbSend.
+    BOOL            fBusy;          // Whether a worker has rgbRecv. Event loop only.
+    BOOL            fDone;          // Whether the worker has finished with it. Event loop only.
+    BOOL            fKeep;          // The worker's verdict: whether to keep the connection.
+    int             cbRecv;         // Number of valid bytes in rgbRecv.
+    char            rgbRecv[CLIENT_RECV_BUFLEN];        // The read being handled.
+};
+
+class CCredentialListener
+{
+  public:
+    CCredentialListener();
+    ~CCredentialListener();
+
+    HRESULT Open(const char* pszPort);
+    HRESULT OpenEvents(const char* pszPort);
+    HRESULT OpenLocal(const char* pszName);
+    void Run(ICredentialSink* pSink);
+    void Stop();
+    void Close();
+    void SetProfileSource(IProfileSource* pSource);
+    void SetMaxLegacyField(size_t cchMax);
+    void SetRateLimit(DWORD dwPerSecond, DWORD dwBurst);
+    void GetAdmissionCounters(ADMISSION_COUNTERS* pCounters);
+    void SetWorkerCount(DWORD cWorkers);
+    void GetWorkerCounters(WORKER_POOL_COUNTERS* pCounters);
+    void GetEventCounters(EVENT_CHANNEL_COUNTERS* pCounters);
+
+  private:
+    // Hands the frames one client's parser finds back to the listener, along with the
+    // client they came from, and keeps track of how long carrying them out took.
+    class CClientFrameHandler : public IFrameHandler
+    {
+      public:
+        CClientFrameHandler(CCredentialListener* pListener, CLIENT_CONNECTION* pClient) :
+            _pListener(pListener), _pClient(pClient), _ullHandledNs(0) {}
+        HRESULT OnFrame(const FRAME_HEADER& fh, const BYTE* pbPayload)
+        {
+            ULONGLONG ullStart = StageClock();
+            HRESULT hr = _pListener->_OnClientFrame(_pClient, fh, pbPayload);
+            _ullHandledNs += StageClock() - ullStart;
+            return hr;
+        }
+        ULONGLONG GetHandledTime() { return _ullHandledNs; }
+
+      private:
+        CCredentialListener *_pListener;
+        CLIENT_CONNECTION   *_pClient;
+        ULONGLONG           _ullHandledNs;
+    };
+
+    CLIENT_CONNECTION* _Client(DWORD iClient);
+    void _AcceptClients();
+    void _Wake();
+    void _ReceiveEvents();
+    HRESULT _FeedClient(CLIENT_CONNECTION* pClient, const BYTE* pb, DWORD cb);
+    void _ServiceLocal();
+    BOOL _FlushLocal();
+    BOOL _ServiceClient(CLIENT_CONNECTION* pClient);
+    BOOL _ProcessRead(CLIENT_CONNECTION* pClient);
+    BOOL _FinishRead(CLIENT_CONNECTION* pClient);
+    void _CollectFinishedReads();
+    static void _ProcessReadWorkItem(void* pv);
+    HRESULT _OnClientFrame(CLIENT_CONNECTION* pClient, const FRAME_HEADER& fh, const BYTE* pbPayload);
+    BOOL _ServiceLegacyClient(CLIENT_CONNECTION* pClient, const char* pbData, int cbData);
+    BOOL _CompleteLegacyField(CLIENT_CONNECTION* pClient);
+    void _FreeClient(CLIENT_CONNECTION* pClient);
+    HRESULT _QueueAck(CLIENT_CONNECTION* pClient, DWORD dwRequestId, HRESULT hrStatus);
+    BOOL _FlushClient(CLIENT_CONNECTION* pClient);
+    void _CloseClient(DWORD iClient);
+
+    ICredentialSink             *_pSink;            // Where parsed credentials go.
+    IProfileSource              *_pProfiles;        // Resolves FT_LOOKUP ids, if we have one.
+    std::atomic<BOOL>           _fStop;             // Set when Run should return.
+    BOOL                        _fStarted;          // Whether we owe a SocketCleanup.
+    socket_t                    _sListen;           // The TCP socket we accept pushes on.
+    socket_t                    _sWake;             // Loopback UDP socket used to wake the loop.
+    USHORT                      _usWakePort;        // Port _sWake is bound to, network order.
+    CEventChannel               _events;            // Status events, if OpenEvents was called.
+    CLocalTransport             _local;             // The local agent's rings, if OpenLocal was called.
+    CLIENT_CONNECTION           _localClient;       // The local agent's parser and replies. Event loop only.
+    CLIENT_CONNECTION           _rgClients[MAX_CLIENTS];    // Connection slots. A sender keeps its slot while connected.
+    DWORD                       _rgiClients[MAX_CLIENTS];   // Slot numbers, connected senders' first.
+    DWORD                       _cClients;          // Number of connected senders.
+    size_t                      _cchMaxLegacyField; // Longest username or password a legacy sender may send.
+    CAdmissionControl           _admission;         // Per-source connection rate limits. Event loop only.
+    DWORD                       _cWorkers;          // How many workers Run starts.
+    CWorkerPool                 _pool;              // Handles reads, while Run is running.
+    std::mutex                  _lockDone;          // Guards _rgiDone and _cDone.
+    DWORD                       _rgiDone[MAX_CLIENTS];      // Slots whose reads the workers have finished.
+    DWORD                       _cDone;             // Number of entries in _rgiDone.
+};
@@ -0,0 +1,434 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+
+#include "CredentialProtocol.h"
+#include <stdlib.h>
+#include <string.h>
+
+static USHORT _ReadUShort(const BYTE* pb)
+{
+    return (USHORT)(pb[0] | (pb[1] << 8));
+}
+
+static DWORD _ReadDword(const BYTE* pb)
+{
+    return (DWORD)pb[0] | ((DWORD)pb[1] << 8) | ((DWORD)pb[2] << 16) | ((DWORD)pb[3] << 24);
+}
+
+static void _WriteDword(DWORD dw, BYTE* pb)
+{
+    pb[0] = (BYTE)dw;
+    pb[1] = (BYTE)(dw >> 8);
+    pb[2] = (BYTE)(dw >> 16);
+    pb[3] = (BYTE)(dw >> 24);
+}
+
+//
+// Writes fh to pb in wire format. pb must have room for FRAME_HEADER_SIZE bytes.
+//
+void FrameHeaderEncode(const FRAME_HEADER& fh, BYTE* pb)
+{
+    pb[0] = fh.bMagic;
+    pb[1] = fh.bVersion;
+    pb[2] = fh.bType;
+    pb[3] = fh.bFlags;
+    _WriteDword(fh.dwRequestId, pb + 4);
+    _WriteDword(fh.cbPayload, pb + 8);
+}
+
+//
+// Decodes a status event datagram, which must be cb bytes exactly: either a sequenced
+// event as described in CredentialProtocol.h or the legacy "ok", with or without a
+// terminating NUL.
+//
+HRESULT EventMessageDecode(const BYTE* pb, size_t cb, EVENT_MESSAGE* pem)
+{
+    if ((cb == 2 || (cb == 3 && pb[2] == 0)) && pb[0] == 'o' && pb[1] == 'k')
+    {
+        pem->type = ET_TOGGLE;
+        pem->fSequenced = FALSE;
+        pem->dwSenderId = 0;
+        pem->dwSequence = 0;
+        return S_OK;
+    }
+
+    if (cb != EVENT_DATAGRAM_SIZE || pb[0] != EVENT_MAGIC || pb[1] != EVENT_VERSION || pb[3] != 0 ||
+        pb[2] < ET_TOGGLE || pb[2] > ET_DUMP_TIMINGS)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    pem->type = (EVENT_TYPE)pb[2];
+    pem->fSequenced = TRUE;
+    pem->dwSenderId = _ReadDword(pb + 4);
+    pem->dwSequence = _ReadDword(pb + 8);
+    return S_OK;
+}
+
+//
+// Writes a sequenced event to pb, which must have room for EVENT_DATAGRAM_SIZE bytes.
+//
+void EventMessageEncode(const EVENT_MESSAGE& em, BYTE* pb)
+{
+    pb[0] = EVENT_MAGIC;
+    pb[1] = EVENT_VERSION;
+    pb[2] = (BYTE)em.type;
+    pb[3] = 0;
+    _WriteDword(em.dwSenderId, pb + 4);
+    _WriteDword(em.dwSequence, pb + 8);
+}
+
+//
+// Writes a complete FT_ACK frame to pb, which must have room for FRAME_ACK_SIZE bytes.
+//
+void FrameAckEncode(DWORD dwRequestId, HRESULT hrStatus, BYTE* pb)
+{
+    FRAME_HEADER fh;
+    fh.bMagic = FRAME_MAGIC;
+    fh.bVersion = FRAME_VERSION;
+    fh.bType = FT_ACK;
+    fh.bFlags = 0;
+    fh.dwRequestId = dwRequestId;
+    fh.cbPayload = FRAME_ACK_SIZE - FRAME_HEADER_SIZE;
+    FrameHeaderEncode(fh, pb);
+    _WriteDword((DWORD)hrStatus, pb + FRAME_HEADER_SIZE);
+}
+
+//
+// Splits an FT_CREDENTIAL payload into its username and password. No copies are made;
+// the strings in pcm point into pbPayload. Neither may contain a NUL, which would cut
+// it short once it's copied into a C string.
+//
+HRESULT CredentialMessageDecode(const BYTE* pbPayload, DWORD cbPayload, CREDENTIAL_MESSAGE* pcm)
+{
+    HRESULT hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+
+    if (cbPayload >= sizeof(USHORT))
+    {
+        USHORT cbUser = _ReadUShort(pbPayload);
+        DWORD ib = sizeof(USHORT);
+        if (cbPayload - ib >= (DWORD)cbUser + sizeof(USHORT))
+        {
+            pcm->pchUser = (const char*)pbPayload + ib;
+            pcm->cbUser = cbUser;
+            ib += cbUser;
+
+            USHORT cbPassword = _ReadUShort(pbPayload + ib);
+            ib += sizeof(USHORT);
+
+            // The password must run exactly to the end of the payload.
+            if (cbPayload - ib == cbPassword &&
+                memchr(pcm->pchUser, 0, cbUser) == NULL && memchr(pbPayload + ib, 0, cbPassword) == NULL)
+            {
+                pcm->pchPassword = (const char*)pbPayload + ib;
+                pcm->cbPassword = cbPassword;
+                hr = S_OK;
+            }
+        }
+    }
+
+    return hr;
+}
+
+// Reads one length-prefixed field of an FT_PROVISION payload at *pib, advancing past it.
+// The field must hold between cbMin and cbMax bytes, none of them NUL.
+static BOOL _ReadField(const BYTE* pbPayload, DWORD cbPayload, DWORD* pib, USHORT cbMin, USHORT cbMax,
+                      const char** ppch, USHORT* pcb)
+{
+    if (cbPayload - *pib < sizeof(USHORT))
+    {
+        return FALSE;
+    }
+    USHORT cb = _ReadUShort(pbPayload + *pib);
+    *pib += sizeof(USHORT);
+    if (cb < cbMin || cb > cbMax || cbPayload - *pib < cb || memchr(pbPayload + *pib, 0, cb) != NULL)
+    {
+        return FALSE;
+    }
+    *ppch = (const char*)pbPayload + *pib;
+    *pcb = cb;
+    *pib += cb;
+    return TRUE;
+}
+
+//
+// Splits an FT_PROVISION payload into its profiles. If rgUpdates is NULL, just checks the
+// payload and returns the number of profiles in *pcUpdates, so the caller can size the
+// array; otherwise fills in up to cUpdatesMax of them. No copies are made; the strings
+// point into pbPayload. The whole payload is checked either way, so a batch is never
+// half understood.
+//
+HRESULT ProvisionMessageDecode(const BYTE* pbPayload, DWORD cbPayload, PROFILE_UPDATE* rgUpdates, DWORD cUpdatesMax, DWORD* pcUpdates)
+{
+    if (cbPayload < sizeof(DWORD))
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    // Each profile takes at least eight bytes, which bounds the count before we trust it.
+    DWORD cUpdates = _ReadDword(pbPayload);
+    DWORD ib = sizeof(DWORD);
+    if (cUpdates == 0 || cUpdates > (cbPayload - ib) / 8)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    if (rgUpdates != NULL && cUpdates > cUpdatesMax)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+    }
+
+    for (DWORD i = 0; i < cUpdates; i++)
+    {
+        PROFILE_UPDATE update;
+        if (!_ReadField(pbPayload, cbPayload, &ib, 1, 0xFFFF, &update.pchId, &update.cchId) ||
+            !_ReadField(pbPayload, cbPayload, &ib, 1, PROFILE_MAX_FIELD, &update.pchUser, &update.cchUser) ||
+            !_ReadField(pbPayload, cbPayload, &ib, 0, PROFILE_MAX_FIELD, &update.pchPassword, &update.cchPassword))
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+        if (rgUpdates != NULL)
+        {
+            rgUpdates[i] = update;
+        }
+    }
+
+    // The last profile must run exactly to the end of the payload.
+    if (ib != cbPayload)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    *pcUpdates = cUpdates;
+    return S_OK;
+}
+
+//
+// Copies the string at pch (cch bytes received so far) onto the end of pszField, which
+// already holds *pcchField characters and has room for cchMax plus a null. Returns S_OK
+// once the terminating NUL has been found, S_FALSE if all cch bytes were taken without
+// finding it (so the field continues in the next read), or ERROR_INVALID_DATA if the
+// field runs past cchMax characters. *pcchUsed gets the number of bytes consumed,
+// terminator included, so any that follow can be scanned for the next field.
+//
+// The terminator is found with memchr, which never looks further than the field could
+// possibly extend, and pszField is null-terminated after every call.
+//
+HRESULT LegacyFieldScan(const char* pch, size_t cch, char* pszField, size_t cchMax, size_t* pcchField, size_t* pcchUsed)
+{
+    size_t cchRoom = cchMax - *pcchField;
+    size_t cchSearch = (cch < cchRoom + 1) ? cch : cchRoom + 1;
+    const char* pchEnd = (const char*)memchr(pch, '\0', cchSearch);
+
+    HRESULT hr;
+    size_t cchCopy;
+    if (pchEnd != NULL)
+    {
+        cchCopy = pchEnd - pch;
+        *pcchUsed = cchCopy + 1;
+        hr = S_OK;
+    }
+    else if (cch <= cchRoom)
+    {
+        cchCopy = cch;
+        *pcchUsed = cch;
+        hr = S_FALSE;
+    }
+    else
+    {
+        *pcchUsed = 0;
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    CopyMemory(pszField + *pcchField, pch, cchCopy);
+    *pcchField += cchCopy;
+    pszField[*pcchField] = '\0';
+    return hr;
+}
+
+// CFrameParser ////////////////////////////////////////////////////////
+
+CFrameParser::CFrameParser()
+{
+    _cbHeader = 0;
+    _fHaveHeader = FALSE;
+    _pbPayload = NULL;
+    _cbPayload = 0;
+    _cbPayloadAlloc = 0;
+    _cbMaxPayload = FRAME_DEFAULT_MAX_PAYLOAD;
+    ZeroMemory(&_fh, sizeof(_fh));
+}
+
+CFrameParser::~CFrameParser()
+{
+    Reset();
+}
+
+// Sets the largest FT_PROVISION payload we accept. Other frames are never allowed more
+// than FRAME_DEFAULT_MAX_PAYLOAD, so a sender can't make us hold a large buffer for one.
+void CFrameParser::SetMaxPayload(DWORD cbMaxPayload)
+{
+    _cbMaxPayload = cbMaxPayload;
+}
+
+// Throws away any partial frame and frees our payload buffer. Payloads carry
+// passwords, so the buffer is wiped first.
+void CFrameParser::Reset()
+{
+    if (_pbPayload != NULL)
+    {
+        SecureZeroMemory(_pbPayload, _cbPayloadAlloc);
+        free(_pbPayload);
+        _pbPayload = NULL;
+    }
+    _cbPayloadAlloc = 0;
+    _cbPayload = 0;
+    _cbHeader = 0;
+    _fHaveHeader = FALSE;
+}
+
+// Decodes and validates a complete header.
+HRESULT CFrameParser::_ParseHeader(const BYTE* pb)
+{
+    _fh.bMagic = pb[0];
+    _fh.bVersion = pb[1];
+    _fh.bType = pb[2];
+    _fh.bFlags = pb[3];
+    _fh.dwRequestId = _ReadDword(pb + 4);
+    _fh.cbPayload = _ReadDword(pb + 8);
+
+    DWORD cbMaxPayload = _cbMaxPayload;
+    if (FT_PROVISION != _fh.bType && cbMaxPayload > FRAME_DEFAULT_MAX_PAYLOAD)
+    {
+        cbMaxPayload = FRAME_DEFAULT_MAX_PAYLOAD;
+    }
+
+    HRESULT hr;
+    if (FRAME_MAGIC == _fh.bMagic &&
+        FRAME_VERSION == _fh.bVersion &&
+        0 == _fh.bFlags &&
+        _fh.cbPayload <= cbMaxPayload)
+    {
+        _fHaveHeader = TRUE;
+        hr = S_OK;
+    }
+    else
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    return hr;
+}
+
+// Makes sure _pbPayload can hold the payload of the current frame.
+HRESULT CFrameParser::_ReservePayload()
+{
+    HRESULT hr = S_OK;
+    if (_cbPayloadAlloc < _fh.cbPayload)
+    {
+        BYTE* pbNew = (BYTE*)malloc(_fh.cbPayload);
+        if (pbNew)
+        {
+            if (_pbPayload != NULL)
+            {
+                SecureZeroMemory(_pbPayload, _cbPayloadAlloc);
+                free(_pbPayload);
+            }
+            _pbPayload = pbNew;
+            _cbPayloadAlloc = _fh.cbPayload;
+        }
+        else
+        {
+            hr = E_OUTOFMEMORY;
+        }
+    }
+    return hr;
+}
+
+//
+// Consumes cb bytes from pb, calling pHandler->OnFrame for every frame they complete.
+// Parsing stops at the first malformed frame or handler failure, and that error is
+// returned; the stream can't be resynchronized after that, so the caller should drop
+// the connection.
+//
+HRESULT CFrameParser::Feed(const BYTE* pb, size_t cb, IFrameHandler* pHandler)
+{
+    HRESULT hr = S_OK;
+
+    while (SUCCEEDED(hr) && cb > 0)
+    {
+        if (!_fHaveHeader)
+        {
+            if (_cbHeader == 0 && cb >= FRAME_HEADER_SIZE)
+            {
+                // The whole header is here, so decode it in place.
+                hr = _ParseHeader(pb);
+                pb += FRAME_HEADER_SIZE;
+                cb -= FRAME_HEADER_SIZE;
+            }
+            else
+            {
+                size_t cbCopy = FRAME_HEADER_SIZE - _cbHeader;
+                if (cbCopy > cb)
+                {
+                    cbCopy = cb;
+                }
+                CopyMemory(_rgbHeader + _cbHeader, pb, cbCopy);
+                _cbHeader += (DWORD)cbCopy;
+                pb += cbCopy;
+                cb -= cbCopy;
+
+                if (_cbHeader == FRAME_HEADER_SIZE)
+                {
+                    _cbHeader = 0;
+                    hr = _ParseHeader(_rgbHeader);
+                }
+            }
+
+            if (SUCCEEDED(hr) && _fHaveHeader && _fh.cbPayload == 0)
+            {
+                _fHaveHeader = FALSE;
+                hr = pHandler->OnFrame(_fh, NULL);
+            }
+        }
+        else
+        {
+            DWORD cbNeeded = _fh.cbPayload - _cbPayload;
+            if (_cbPayload == 0 && cb >= cbNeeded)
+            {
+                // The whole payload is here; hand it over without copying it.
+                _fHaveHeader = FALSE;
+                hr = pHandler->OnFrame(_fh, pb);
+                pb += cbNeeded;
+                cb -= cbNeeded;
+            }
+            else
+            {
+                hr = _ReservePayload();
+                if (SUCCEEDED(hr))
+                {
+                    size_t cbCopy = (cb < cbNeeded) ? cb : cbNeeded;
+                    CopyMemory(_pbPayload + _cbPayload, pb, cbCopy);
+                    _cbPayload += (DWORD)cbCopy;
+                    pb += cbCopy;
+                    cb -= cbCopy;
+
+                    if (_cbPayload == _fh.cbPayload)
+                    {
+                        _fHaveHeader = FALSE;
+                        hr = pHandler->OnFrame(_fh, _pbPayload);
+                        SecureZeroMemory(_pbPayload, _cbPayload);
+                        _cbPayload = 0;
+                    }
+                }
+            }
+        }
+    }
+
+    return hr;
+}
@@ -0,0 +1,189 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// The framed wire protocol spoken by senders that push credentials to the
+// listener, and an incremental parser for it.
+//
+// Every message is a fixed FRAME_HEADER_SIZE-byte header followed by cbPayload
+// bytes of payload. All integers are little-endian.
+//
+//   offset  size  field
+//   0       1     bMagic       always FRAME_MAGIC; lets us tell framed senders
+//                              apart from legacy ones, which send plain text
+//   1       1     bVersion     FRAME_VERSION
+//   2       1     bType        one of FRAME_TYPE
+//   3       1     bFlags       reserved, must be zero
+//   4       4     dwRequestId  chosen by the sender, echoed in any reply
+//   8       4     cbPayload    at most the parser's payload limit
+//
+// A sender may write any number of frames back to back on one connection
+// without waiting for the previous one to be handled. Every request frame is
+// answered with an FT_ACK carrying the same dwRequestId, so a sender that keeps
+// its connection open can match replies to requests while more are in flight.
+// Replies are sent in the order the requests arrived.
+
+#pragma once
+
+#include "PlatformCompat.h"
+#include "ProfileIndex.h"
+
+#define FRAME_MAGIC             0xCF
+#define FRAME_VERSION           1
+#define FRAME_HEADER_SIZE       12
+
+// The largest payload we accept in anything but an FT_PROVISION frame, and in those
+// too unless the parser is told otherwise.
+#define FRAME_DEFAULT_MAX_PAYLOAD   4096
+
+// The largest FT_PROVISION payload the listener accepts, to leave room for batches of
+// ten thousand or so profiles.
+#define FRAME_MAX_PROVISION_PAYLOAD (1024 * 1024)
+
+enum FRAME_TYPE
+{
+    FT_CREDENTIAL       = 1,    // A username and password to make available for logon.
+    FT_LOOKUP           = 2,    // A badge/profile id, as raw bytes. We look it up in the
+                                // account database and make its account available.
+    FT_REVOKE           = 3,    // A username, UTF-8. Its account is no longer available.
+    FT_PROVISION        = 4,    // A batch of profiles to add to (or replace in) the account
+                                // database, all or none of them. See ProvisionMessageDecode.
+
+    FT_ACK              = 0x81, // Sent by us. The payload is the 4-byte HRESULT the
+                                // request identified by dwRequestId completed with.
+};
+
+// The size of an FT_ACK frame, header included.
+#define FRAME_ACK_SIZE          (FRAME_HEADER_SIZE + 4)
+
+struct FRAME_HEADER
+{
+    BYTE    bMagic;
+    BYTE    bVersion;
+    BYTE    bType;
+    BYTE    bFlags;
+    DWORD   dwRequestId;
+    DWORD   cbPayload;
+};
+
+// A decoded FT_CREDENTIAL payload. The strings point into the payload itself and are
+// NOT null-terminated. The payload is:
+//
+//   2 bytes   cbUser
+//   cbUser    username, UTF-8
+//   2 bytes   cbPassword
+//   cbPassword password, UTF-8
+struct CREDENTIAL_MESSAGE
+{
+    const char* pchUser;
+    USHORT      cbUser;
+    const char* pchPassword;
+    USHORT      cbPassword;
+};
+
+HRESULT CredentialMessageDecode(const BYTE* pbPayload, DWORD cbPayload, CREDENTIAL_MESSAGE* pcm);
+
+// An FT_PROVISION payload is a count followed by that many profiles:
+//
+//   4 bytes    cProfiles
+//   then, for each profile:
+//   2 bytes    cbId
+//   cbId       badge/profile id, raw bytes, at least one
+//   2 bytes    cbUser
+//   cbUser     username, UTF-8, at least one byte and at most PROFILE_MAX_FIELD
+//   2 bytes    cbPassword
+//   cbPassword password, UTF-8, at most PROFILE_MAX_FIELD
+HRESULT ProvisionMessageDecode(const BYTE* pbPayload, DWORD cbPayload, PROFILE_UPDATE* rgUpdates, DWORD cUpdatesMax, DWORD* pcUpdates);
+
+// Legacy (unframed) senders send NUL-terminated strings. This copies the next one out of
+// a read as it arrives, a piece at a time if need be. See CredentialProtocol.cpp.
+HRESULT LegacyFieldScan(const char* pch, size_t cch, char* pszField, size_t cchMax, size_t* pcchField, size_t* pcchUsed);
+
+// Status events arrive as UDP datagrams rather than over the TCP connection, each one
+// a complete EVENT_DATAGRAM_SIZE-byte message, little-endian like the frames:
+//
+//   offset  size  field
+//   0       1     bMagic       always EVENT_MAGIC
+//   1       1     bVersion     EVENT_VERSION
+//   2       1     bType        one of EVENT_TYPE
+//   3       1     bFlags       reserved, must be zero
+//   4       4     dwSenderId   chosen afresh each time the sender starts
+//   8       4     dwSequence   one more than the sender's previous event
+//
+// Datagrams can be lost, duplicated or reordered on the way. Each event carries the
+// whole state rather than a change to it (ET_TOGGLE excepted), so the receiver simply
+// ignores any that isn't newer than the last one it took from the same sender.
+//
+// The original sender's datagram, the two characters "ok", is still understood: it's
+// an ET_TOGGLE with no sequence number.
+#define EVENT_MAGIC             0xCE
+#define EVENT_VERSION           1
+#define EVENT_DATAGRAM_SIZE     12
+
+enum EVENT_TYPE
+{
+    ET_TOGGLE           = 1,    // Flip between connected and disconnected.
+    ET_CONNECTED        = 2,    // The device is present.
+    ET_DISCONNECTED     = 3,    // The device has gone.
+    ET_REFRESH          = 4,    // Nothing has changed, but have LogonUI look again.
+    ET_DUMP_TIMINGS     = 5,    // Print how long each stage of a push has been taking and the
+                                // listener's counters, and write out the trace, if one is
+                                // being kept. Only honoured from a loopback address.
+};
+
+struct EVENT_MESSAGE
+{
+    EVENT_TYPE  type;
+    BOOL        fSequenced;     // FALSE for "ok" datagrams, which have no sender or sequence.
+    DWORD       dwSenderId;
+    DWORD       dwSequence;
+};
+
+HRESULT EventMessageDecode(const BYTE* pb, size_t cb, EVENT_MESSAGE* pem);
+void EventMessageEncode(const EVENT_MESSAGE& em, BYTE* pb);
+
+void FrameHeaderEncode(const FRAME_HEADER& fh, BYTE* pb);
+void FrameAckEncode(DWORD dwRequestId, HRESULT hrStatus, BYTE* pb);
+
+// Implemented by whoever wants the frames a CFrameParser finds.
+class IFrameHandler
+{
+  public:
+    virtual ~IFrameHandler() {}
+
+    // pbPayload is only valid for the duration of the call. Return a failure to stop
+    // parsing; the parser will pass it back out of Feed.
+    virtual HRESULT OnFrame(const FRAME_HEADER& fh, const BYTE* pbPayload) = 0;
+};
+
+// Splits a byte stream into frames. Bytes can be fed in whatever pieces recv hands
+// us; each byte is examined once. A frame that arrives whole inside one piece is
+// handed to the handler straight out of the caller's buffer; only frames that
+// straddle pieces are copied into our own buffer.
+class CFrameParser
+{
+  public:
+    CFrameParser();
+    ~CFrameParser();
+
+    void SetMaxPayload(DWORD cbMaxPayload);
+    HRESULT Feed(const BYTE* pb, size_t cb, IFrameHandler* pHandler);
+    void Reset();
+
+  private:
+    HRESULT _ParseHeader(const BYTE* pb);
+    HRESULT _ReservePayload();
+
+    BYTE            _rgbHeader[FRAME_HEADER_SIZE];  // Header bytes received so far.
+    DWORD           _cbHeader;                      // Number of valid bytes in _rgbHeader.
+    FRAME_HEADER    _fh;                            // The parsed header, once we have it.
+    BOOL            _fHaveHeader;                   // Whether _fh is valid.
+    BYTE            *_pbPayload;                    // Payload bytes received so far.
+    DWORD           _cbPayload;                     // Number of valid bytes in _pbPayload.
+    DWORD           _cbPayloadAlloc;                // Size of _pbPayload.
+    DWORD           _cbMaxPayload;                  // FT_PROVISION frames with larger payloads are rejected.
+};
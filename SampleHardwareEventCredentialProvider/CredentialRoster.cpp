@@ -0,0 +1,378 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+
+#include "CredentialRoster.h"
+#include <stdlib.h>
+#include <string.h>
+
+// FNV-1a, as in CProfileIndex.
+static DWORD _HashUser(const char* pch, size_t cch)
+{
+    DWORD dwHash = 2166136261u;
+    for (size_t i = 0; i < cch; i++)
+    {
+        dwHash ^= (BYTE)pch[i];
+        dwHash *= 16777619u;
+    }
+    return dwHash;
+}
+
+CCredentialRoster::CCredentialRoster()
+{
+    _pFactory = NULL;
+    _rgEntries = NULL;
+    _cEntries = 0;
+    _cEntriesAlloc = 0;
+    _rgiBuckets = NULL;
+    _cBuckets = 0;
+    _dwGeneration = 0;
+    _iLastPushed = 0;
+}
+
+CCredentialRoster::~CCredentialRoster()
+{
+    Clear();
+    free(_rgEntries);
+    free(_rgiBuckets);
+}
+
+// Tells the roster how to make a tile for a user it hasn't seen before. The factory
+// must outlive the roster.
+void CCredentialRoster::SetFactory(IRosterTileFactory* pFactory)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    _pFactory = pFactory;
+}
+
+// Returns the bucket holding pszUser, or the empty bucket where it would go.
+DWORD* CCredentialRoster::_Find(const char* pszUser, DWORD cchUser, DWORD dwHash)
+{
+    DWORD dwMask = _cBuckets - 1;
+    for (DWORD i = dwHash & dwMask; ; i = (i + 1) & dwMask)
+    {
+        DWORD* piBucket = &_rgiBuckets[i];
+        if (*piBucket == 0)
+        {
+            return piBucket;
+        }
+        const ROSTER_ENTRY* pEntry = &_rgEntries[*piBucket - 1];
+        if (pEntry->dwHash == dwHash &&
+            pEntry->cchUser == cchUser &&
+            memcmp(pEntry->szUser, pszUser, cchUser) == 0)
+        {
+            return piBucket;
+        }
+    }
+}
+
+// Returns the bucket that points at entry iEntry, which must be indexed.
+DWORD* CCredentialRoster::_FindEntry(DWORD iEntry)
+{
+    DWORD dwMask = _cBuckets - 1;
+    for (DWORD i = _rgEntries[iEntry].dwHash & dwMask; ; i = (i + 1) & dwMask)
+    {
+        if (_rgiBuckets[i] == iEntry + 1)
+        {
+            return &_rgiBuckets[i];
+        }
+    }
+}
+
+// Empties a bucket, then walks the rest of its run and pulls back any entry that can
+// now sit closer to where it hashes to, so lookups never need tombstones.
+void CCredentialRoster::_Unindex(DWORD* piBucket)
+{
+    DWORD dwMask = _cBuckets - 1;
+    DWORD iHole = (DWORD)(piBucket - _rgiBuckets);
+    _rgiBuckets[iHole] = 0;
+
+    for (DWORD i = (iHole + 1) & dwMask; _rgiBuckets[i] != 0; i = (i + 1) & dwMask)
+    {
+        DWORD iHome = _rgEntries[_rgiBuckets[i] - 1].dwHash & dwMask;
+
+        // Move it if the hole lies between its home bucket and where it is now.
+        BOOL fMove = (iHole <= i) ? (iHome <= iHole || iHome > i) : (iHome <= iHole && iHome > i);
+        if (fMove)
+        {
+            _rgiBuckets[iHole] = _rgiBuckets[i];
+            _rgiBuckets[i] = 0;
+            iHole = i;
+        }
+    }
+}
+
+// Makes room for cEntries entries, keeping the index at most half full.
+HRESULT CCredentialRoster::_Reserve(DWORD cEntries)
+{
+    if (cEntries > _cEntriesAlloc)
+    {
+        DWORD cAlloc = _cEntriesAlloc ? _cEntriesAlloc * 2 : 16;
+        ROSTER_ENTRY* rgNew = (ROSTER_ENTRY*)realloc(_rgEntries, cAlloc * sizeof(ROSTER_ENTRY));
+        if (rgNew == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        _rgEntries = rgNew;
+        _cEntriesAlloc = cAlloc;
+    }
+
+    if (cEntries * 2 > _cBuckets)
+    {
+        DWORD cBuckets = _cBuckets ? _cBuckets : 32;
+        while (cEntries * 2 > cBuckets)
+        {
+            cBuckets *= 2;
+        }
+        DWORD* rgiNew = (DWORD*)calloc(cBuckets, sizeof(DWORD));
+        if (rgiNew == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        free(_rgiBuckets);
+        _rgiBuckets = rgiNew;
+        _cBuckets = cBuckets;
+
+        for (DWORD i = 0; i < _cEntries; i++)
+        {
+            *_Find(_rgEntries[i].szUser, _rgEntries[i].cchUser, _rgEntries[i].dwHash) = i + 1;
+        }
+    }
+
+    return S_OK;
+}
+
+//
+// Gives pszUser's tile the new password, making a tile for them first if they don't
+// have one. If ppTile isn't NULL, also returns the tile, referenced. Called on the
+// listener's workers.
+//
+HRESULT CCredentialRoster::Upsert(const char* pszUser, const char* pszPassword, IRosterTile** ppTile)
+{
+    size_t cchUser = strlen(pszUser);
+    if (cchUser == 0 || cchUser > PROFILE_MAX_FIELD)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    std::lock_guard<std::mutex> guard(_lock);
+
+    HRESULT hr = _Reserve(_cEntries + 1);
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    DWORD dwHash = _HashUser(pszUser, cchUser);
+    DWORD* piBucket = _Find(pszUser, (DWORD)cchUser, dwHash);
+    if (*piBucket != 0)
+    {
+        // Someone we already have a tile for: just replace their password. The tile
+        // array doesn't change, so views don't need recopying.
+        DWORD iEntry = *piBucket - 1;
+        CCredentialSlot* pSlot = _rgEntries[iEntry].pTile->GetSlot();
+        hr = pSlot->Set(pszUser, pszPassword);
+        if (FAILED(hr))
+        {
+            // A failed Set leaves the old password in place, but a tile with nothing in
+            // it has no business being shown.
+            if (pSlot->IsEmpty())
+            {
+                _RemoveEntry(piBucket);
+            }
+            return hr;
+        }
+        if (_iLastPushed != iEntry)
+        {
+            _iLastPushed = iEntry;
+            _dwGeneration++;
+        }
+        if (ppTile != NULL)
+        {
+            _rgEntries[iEntry].pTile->AddRefTile();
+            *ppTile = _rgEntries[iEntry].pTile;
+        }
+        return hr;
+    }
+
+    if (_pFactory == NULL)
+    {
+        return E_FAIL;
+    }
+
+    IRosterTile* pTile;
+    hr = _pFactory->CreateTile(&pTile);
+    if (SUCCEEDED(hr))
+    {
+        hr = pTile->GetSlot()->Set(pszUser, pszPassword);
+        if (SUCCEEDED(hr))
+        {
+            ROSTER_ENTRY* pEntry = &_rgEntries[_cEntries];
+            pEntry->dwHash = dwHash;
+            pEntry->cchUser = (DWORD)cchUser;
+            CopyMemory(pEntry->szUser, pszUser, cchUser + 1);
+            pEntry->pTile = pTile;
+            *piBucket = ++_cEntries;
+            _iLastPushed = _cEntries - 1;
+            _dwGeneration++;
+            if (ppTile != NULL)
+            {
+                pTile->AddRefTile();
+                *ppTile = pTile;
+            }
+        }
+        else
+        {
+            pTile->ReleaseTile();
+        }
+    }
+
+    return hr;
+}
+
+//
+// Drops pszUser's tile. Its password is wiped straight away, even though LogonUI may
+// hold on to the tile itself for a while yet.
+//
+HRESULT CCredentialRoster::Remove(const char* pszUser)
+{
+    size_t cchUser = strlen(pszUser);
+    if (cchUser > PROFILE_MAX_FIELD)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+
+    std::lock_guard<std::mutex> guard(_lock);
+
+    if (_cEntries == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+
+    DWORD* piBucket = _Find(pszUser, (DWORD)cchUser, _HashUser(pszUser, cchUser));
+    if (*piBucket == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+
+    _RemoveEntry(piBucket);
+    return S_OK;
+}
+
+// Drops the entry piBucket points at, wiping and releasing its tile. The caller holds
+// the lock.
+void CCredentialRoster::_RemoveEntry(DWORD* piBucket)
+{
+    DWORD iEntry = *piBucket - 1;
+    IRosterTile* pTile = _rgEntries[iEntry].pTile;
+    _Unindex(piBucket);
+
+    // Move the last entry down into the gap and point its bucket at the new position.
+    DWORD iLast = _cEntries - 1;
+    if (iEntry != iLast)
+    {
+        DWORD* piLast = _FindEntry(iLast);
+        _rgEntries[iEntry] = _rgEntries[iLast];
+        *piLast = iEntry + 1;
+    }
+    _cEntries--;
+
+    if (_iLastPushed == iEntry)
+    {
+        _iLastPushed = 0;
+    }
+    else if (_iLastPushed == iLast)
+    {
+        _iLastPushed = iEntry;
+    }
+    _dwGeneration++;
+
+    pTile->GetSlot()->Clear();
+    pTile->ReleaseTile();
+}
+
+// Drops every tile.
+void CCredentialRoster::Clear()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    for (DWORD i = 0; i < _cEntries; i++)
+    {
+        _rgEntries[i].pTile->GetSlot()->Clear();
+        _rgEntries[i].pTile->ReleaseTile();
+    }
+    if (_rgiBuckets != NULL)
+    {
+        ZeroMemory(_rgiBuckets, _cBuckets * sizeof(DWORD));
+    }
+    _cEntries = 0;
+    _iLastPushed = 0;
+    _dwGeneration++;
+}
+
+DWORD CCredentialRoster::GetCount()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return _cEntries;
+}
+
+//
+// Brings pView up to date with the roster. Returns S_FALSE, without touching the view,
+// if nothing has changed since it was last refreshed.
+//
+HRESULT CCredentialRoster::Refresh(ROSTER_VIEW* pView)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    if (pView->rgpTiles != NULL && pView->dwGeneration == _dwGeneration)
+    {
+        return S_FALSE;
+    }
+
+    // The roster holds its own reference on every current tile, so dropping the view's
+    // references first can't free one we're about to copy.
+    for (DWORD i = 0; i < pView->cTiles; i++)
+    {
+        pView->rgpTiles[i]->ReleaseTile();
+    }
+    pView->cTiles = 0;
+
+    if (_cEntries > pView->cTilesAlloc || pView->rgpTiles == NULL)
+    {
+        DWORD cAlloc = (_cEntries > 16) ? _cEntries : 16;
+        IRosterTile** rgpNew = (IRosterTile**)realloc(pView->rgpTiles, cAlloc * sizeof(IRosterTile*));
+        if (rgpNew == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        pView->rgpTiles = rgpNew;
+        pView->cTilesAlloc = cAlloc;
+    }
+
+    for (DWORD i = 0; i < _cEntries; i++)
+    {
+        _rgEntries[i].pTile->AddRefTile();
+        pView->rgpTiles[i] = _rgEntries[i].pTile;
+    }
+
+    pView->cTiles = _cEntries;
+    pView->dwGeneration = _dwGeneration;
+    pView->iDefault = _iLastPushed;
+    return S_OK;
+}
+
+void CCredentialRoster::FreeView(ROSTER_VIEW* pView)
+{
+    for (DWORD i = 0; i < pView->cTiles; i++)
+    {
+        pView->rgpTiles[i]->ReleaseTile();
+    }
+    free(pView->rgpTiles);
+    ZeroMemory(pView, sizeof(*pView));
+}
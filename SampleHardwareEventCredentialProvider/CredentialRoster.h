@@ -0,0 +1,97 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// The set of users that have been pushed to us, one tile each. The listener's workers
+// add, update and remove users as pushes arrive; LogonUI threads enumerate them.
+//
+// Tiles are kept in a dense array so enumerating them is a straight walk, with a
+// separate open-addressing index from username to array position so a push finds its
+// tile without scanning. Removing a user moves the last tile into its place, so nothing
+// is ever rebuilt.
+//
+// LogonUI asks for the count and then for each tile by position, and expects the two
+// to agree, so it doesn't enumerate the live array. Instead it keeps a ROSTER_VIEW: a
+// private, referenced copy of the tile pointers that Refresh only recopies when the
+// roster has changed since.
+
+#pragma once
+
+#include <mutex>
+#include "PlatformCompat.h"
+#include "ProfileIndex.h"
+#include "CredentialSlot.h"
+
+// Implemented by whatever the roster hands out for each user. Every tile is
+// referenced by the roster and by any views it appears in.
+class IRosterTile
+{
+  public:
+    virtual void AddRefTile() = 0;
+    virtual void ReleaseTile() = 0;
+    virtual CCredentialSlot* GetSlot() = 0;
+};
+
+// Makes new tiles. Called with the roster's lock held, so it mustn't call back in.
+class IRosterTileFactory
+{
+  public:
+    virtual HRESULT CreateTile(IRosterTile** ppTile) = 0;
+};
+
+struct ROSTER_ENTRY
+{
+    DWORD           dwHash;                             // Hash of szUser.
+    DWORD           cchUser;                            // Length of szUser.
+    char            szUser[PROFILE_MAX_FIELD + 1];      // The key, as pushed (UTF-8).
+    IRosterTile     *pTile;                             // Referenced.
+};
+
+// A LogonUI thread's private copy of the roster. Start with it zeroed and pass it to
+// CCredentialRoster::FreeView when done.
+struct ROSTER_VIEW
+{
+    IRosterTile     **rgpTiles;     // Referenced.
+    DWORD           cTiles;
+    DWORD           cTilesAlloc;
+    DWORD           dwGeneration;   // The roster generation this is a copy of.
+    DWORD           iDefault;       // The tile most recently pushed, if cTiles > 0.
+};
+
+class CCredentialRoster
+{
+  public:
+    CCredentialRoster();
+    ~CCredentialRoster();
+
+    void SetFactory(IRosterTileFactory* pFactory);
+
+    HRESULT Upsert(const char* pszUser, const char* pszPassword, IRosterTile** ppTile = NULL);
+    HRESULT Remove(const char* pszUser);
+    void Clear();
+    DWORD GetCount();
+
+    HRESULT Refresh(ROSTER_VIEW* pView);
+    static void FreeView(ROSTER_VIEW* pView);
+
+  private:
+    DWORD* _Find(const char* pszUser, DWORD cchUser, DWORD dwHash);
+    DWORD* _FindEntry(DWORD iEntry);
+    void _Unindex(DWORD* piBucket);
+    void _RemoveEntry(DWORD* piBucket);
+    HRESULT _Reserve(DWORD cEntries);
+
+    std::mutex          _lock;              // Guards everything below.
+    IRosterTileFactory  *_pFactory;
+    ROSTER_ENTRY        *_rgEntries;        // Dense; _cEntries are in use.
+    DWORD               _cEntries;
+    DWORD               _cEntriesAlloc;
+    DWORD               *_rgiBuckets;       // Entry index + 1, or 0 if empty.
+    DWORD               _cBuckets;          // A power of two, at least twice _cEntries.
+    DWORD               _dwGeneration;      // Bumped by every change to the set of tiles.
+    DWORD               _iLastPushed;       // The entry most recently upserted.
+};
@@ -0,0 +1,128 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+
+#include "CredentialSlot.h"
+#include "Utf8.h"
+#include <string.h>
+#include <thread>
+
+CCredentialSlot::CCredentialSlot()
+{
+    _dwSequence.store(0, std::memory_order_relaxed);
+    for (DWORD i = 0; i < SLOT_FIELD_WORDS; i++)
+    {
+        _rgdwUser[i].store(0, std::memory_order_relaxed);
+        _rgdwPassword[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+CCredentialSlot::~CCredentialSlot()
+{
+    Clear();
+}
+
+//
+// Replaces the slot's contents with the given UTF-8 username and password. Both are
+// converted before anything is published, so if either one can't be, the slot keeps
+// what it had.
+//
+HRESULT CCredentialSlot::Set(const char* pszUser, const char* pszPassword)
+{
+    WCHAR wszUser[SLOT_FIELD_WORDS * 2];
+    WCHAR wszPassword[SLOT_FIELD_WORDS * 2];
+    ZeroMemory(wszUser, sizeof(wszUser));
+    ZeroMemory(wszPassword, sizeof(wszPassword));
+
+    // Leave room for the null in the slot even when the field is as long as it gets.
+    HRESULT hr = Utf8ToUtf16(pszUser, strlen(pszUser), wszUser, PROFILE_MAX_FIELD + 1, NULL);
+    if (SUCCEEDED(hr))
+    {
+        hr = Utf8ToUtf16(pszPassword, strlen(pszPassword), wszPassword, PROFILE_MAX_FIELD + 1, NULL);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        _Publish(wszUser, wszPassword);
+    }
+
+    SecureZeroMemory(wszUser, sizeof(wszUser));
+    SecureZeroMemory(wszPassword, sizeof(wszPassword));
+    return hr;
+}
+
+void CCredentialSlot::Clear()
+{
+    WCHAR wszEmpty[SLOT_FIELD_WORDS * 2];
+    ZeroMemory(wszEmpty, sizeof(wszEmpty));
+    _Publish(wszEmpty, wszEmpty);
+}
+
+void CCredentialSlot::_Publish(const WCHAR* pwzUser, const WCHAR* pwzPassword)
+{
+    DWORD dwSequence = _dwSequence.load(std::memory_order_relaxed);
+    _dwSequence.store(dwSequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    for (DWORD i = 0; i < SLOT_FIELD_WORDS; i++)
+    {
+        DWORD dwUser;
+        DWORD dwPassword;
+        CopyMemory(&dwUser, pwzUser + i * 2, sizeof(DWORD));
+        CopyMemory(&dwPassword, pwzPassword + i * 2, sizeof(DWORD));
+        _rgdwUser[i].store(dwUser, std::memory_order_relaxed);
+        _rgdwPassword[i].store(dwPassword, std::memory_order_relaxed);
+    }
+
+    _dwSequence.store(dwSequence + 2, std::memory_order_release);
+}
+
+//
+// Copies a consistent view of the slot into pSnapshot. If a push lands while we're
+// copying we simply copy again; pushes are rare and short, so this hardly ever loops.
+//
+void CCredentialSlot::Read(CREDENTIAL_SNAPSHOT* pSnapshot) const
+{
+    for (;;)
+    {
+        DWORD dwBefore = _dwSequence.load(std::memory_order_acquire);
+        if (dwBefore & 1)
+        {
+            // The writer is mid-push; if it's been preempted, spinning won't help it.
+            std::this_thread::yield();
+            continue;
+        }
+
+        for (DWORD i = 0; i < SLOT_FIELD_WORDS; i++)
+        {
+            DWORD dwUser = _rgdwUser[i].load(std::memory_order_relaxed);
+            DWORD dwPassword = _rgdwPassword[i].load(std::memory_order_relaxed);
+            CopyMemory(pSnapshot->wszUser + i * 2, &dwUser, sizeof(DWORD));
+            CopyMemory(pSnapshot->wszPassword + i * 2, &dwPassword, sizeof(DWORD));
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_dwSequence.load(std::memory_order_relaxed) == dwBefore)
+        {
+            pSnapshot->dwSequence = dwBefore;
+            break;
+        }
+    }
+}
+
+// Whether the slot holds no username, as it does until the first Set and after Clear.
+BOOL CCredentialSlot::IsEmpty() const
+{
+    return (_rgdwUser[0].load(std::memory_order_acquire) & 0xFFFF) == 0;
+}
+
+DWORD CCredentialSlot::GetSequence() const
+{
+    return _dwSequence.load(std::memory_order_acquire);
+}
@@ -0,0 +1,59 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// The username and password most recently pushed to us, in the UTF-16 form the
+// credential hands to LogonUI. The provider owns one slot for its whole lifetime and
+// overwrites it in place on every push, so there's nothing to allocate or free, and
+// the old secret is wiped rather than left on the heap.
+//
+// The slot is written under the roster's lock, by one listener worker at a time, and
+// read by whichever LogonUI thread is serializing, so it's published with a sequence
+// lock: the writer makes the sequence odd, stores the new contents and makes it even
+// again; a reader copies the contents out and tries again if the sequence moved
+// underneath it. Readers never take a lock or make the writer wait, and can never
+// come away with half of one push and half of another.
+
+#pragma once
+
+#include <atomic>
+#include "PlatformCompat.h"
+#include "ProfileIndex.h"
+
+// The slot's contents are stored a DWORD (two characters) at a time.
+#define SLOT_FIELD_WORDS    ((PROFILE_MAX_FIELD + 2) / 2)
+
+// A reader's private copy of the slot.
+struct CREDENTIAL_SNAPSHOT
+{
+    DWORD   dwSequence;                             // Changes with every push.
+    WCHAR   wszUser[SLOT_FIELD_WORDS * 2];          // Null-terminated.
+    WCHAR   wszPassword[SLOT_FIELD_WORDS * 2];      // Null-terminated. Wipe when done.
+};
+
+class CCredentialSlot
+{
+  public:
+    CCredentialSlot();
+    ~CCredentialSlot();
+
+    // Only one thread at a time may call these.
+    HRESULT Set(const char* pszUser, const char* pszPassword);
+    void Clear();
+
+    // Any thread may call these at any time.
+    void Read(CREDENTIAL_SNAPSHOT* pSnapshot) const;
+    BOOL IsEmpty() const;
+    DWORD GetSequence() const;
+
+  private:
+    void _Publish(const WCHAR* pwzUser, const WCHAR* pwzPassword);
+
+    std::atomic<DWORD>  _dwSequence;                        // Odd while a write is under way.
+    std::atomic<DWORD>  _rgdwUser[SLOT_FIELD_WORDS];        // Null-terminated UTF-16.
+    std::atomic<DWORD>  _rgdwPassword[SLOT_FIELD_WORDS];    // Null-terminated UTF-16.
+};
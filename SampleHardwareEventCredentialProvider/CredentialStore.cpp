@@ -0,0 +1,456 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+
+#include "CredentialStore.h"
+#include "sqlite3.h"
+#include <stdio.h>
+#include <string.h>
+
+// sqlite result codes are all small positive numbers, so we fold them into HRESULTs
+// the same way Win32 error codes are.
+#define HRESULT_FROM_SQLITE(rc) HRESULT_FROM_WIN32(rc)
+
+CCredentialStore::CCredentialStore()
+{
+    _pDb = NULL;
+    _pLookupStmt = NULL;
+    _pScanStmt = NULL;
+    _pVersionStmt = NULL;
+    _pUpsertStmt = NULL;
+    _fIndexValid = FALSE;
+    _fIndexDirty = FALSE;
+    _iIndexedVersion = 0;
+    _ullLastCheck = 0;
+}
+
+CCredentialStore::~CCredentialStore()
+{
+    Close();
+}
+
+BOOL CCredentialStore::IsOpen()
+{
+    return _pDb != NULL;
+}
+
+HRESULT CCredentialStore::_Prepare(const char* pszSql, sqlite3_stmt** ppStmt)
+{
+    int rc = sqlite3_prepare_v3(_pDb, pszSql, -1, SQLITE_PREPARE_PERSISTENT, ppStmt, NULL);
+    if (rc != SQLITE_OK)
+    {
+        fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(_pDb));
+    }
+    return (rc == SQLITE_OK) ? S_OK : HRESULT_FROM_SQLITE(rc);
+}
+
+//
+// Opens the account database at pszPath and prepares our statements. The database is
+// switched to WAL mode so that lookups don't block behind whoever is provisioning it.
+//
+HRESULT CCredentialStore::Open(const char* pszPath)
+{
+    Close();
+
+    int rc = sqlite3_open_v2(pszPath, &_pDb, SQLITE_OPEN_READWRITE | SQLITE_OPEN_FULLMUTEX, NULL);
+    HRESULT hr = (rc == SQLITE_OK) ? S_OK : HRESULT_FROM_SQLITE(rc);
+
+    if (SUCCEEDED(hr))
+    {
+        char* zErrMsg = NULL;
+        rc = sqlite3_exec(_pDb, "PRAGMA journal_mode=WAL;", NULL, NULL, &zErrMsg);
+        if (rc != SQLITE_OK)
+        {
+            // Not fatal: the database still works in its existing journal mode.
+            fprintf(stderr, "SQL error: %s\n", zErrMsg);
+            sqlite3_free(zErrMsg);
+        }
+
+        hr = _Prepare("SELECT username, password FROM profile WHERE id = ?1;", &_pLookupStmt);
+        if (SUCCEEDED(hr))
+        {
+            hr = _Prepare("SELECT id, username, password FROM profile;", &_pScanStmt);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = _Prepare("PRAGMA data_version;", &_pVersionStmt);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = _Prepare("INSERT OR REPLACE INTO profile (id, username, password) VALUES (?1, ?2, ?3);", &_pUpsertStmt);
+        }
+        if (SUCCEEDED(hr))
+        {
+            sqlite3_update_hook(_pDb, _UpdateHook, this);
+
+            // If the table can't be loaded we fall back to querying sqlite directly.
+            _RebuildIndex();
+        }
+    }
+    else
+    {
+        fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(_pDb));
+    }
+
+    if (FAILED(hr))
+    {
+        Close();
+    }
+
+    return hr;
+}
+
+void CCredentialStore::Close()
+{
+    _index.Clear();
+    _fIndexValid = FALSE;
+    _fIndexDirty = FALSE;
+
+    sqlite3_finalize(_pLookupStmt);
+    _pLookupStmt = NULL;
+    sqlite3_finalize(_pScanStmt);
+    _pScanStmt = NULL;
+    sqlite3_finalize(_pVersionStmt);
+    _pVersionStmt = NULL;
+    sqlite3_finalize(_pUpsertStmt);
+    _pUpsertStmt = NULL;
+
+    sqlite3_close(_pDb);
+    _pDb = NULL;
+}
+
+// Copies a text column into a fixed-size field, failing if it doesn't fit.
+static HRESULT _CopyColumn(sqlite3_stmt* pStmt, int iCol, char* pszDest, size_t cchDest)
+{
+    const unsigned char* pszValue = sqlite3_column_text(pStmt, iCol);
+    int cb = sqlite3_column_bytes(pStmt, iCol);
+
+    HRESULT hr;
+    if (pszValue != NULL && (size_t)cb < cchDest)
+    {
+        CopyMemory(pszDest, pszValue, cb);
+        pszDest[cb] = '\0';
+        hr = S_OK;
+    }
+    else
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    return hr;
+}
+
+// Called by sqlite whenever a row is changed through our connection.
+void CCredentialStore::_UpdateHook(void* pv, int iOp, const char* pszDb, const char* pszTable, long long llRowId)
+{
+    UNREFERENCED_PARAMETER(iOp);
+    UNREFERENCED_PARAMETER(pszDb);
+    UNREFERENCED_PARAMETER(llRowId);
+
+    if (strcmp(pszTable, "profile") == 0)
+    {
+        static_cast<CCredentialStore*>(pv)->_fIndexDirty = TRUE;
+    }
+}
+
+// data_version changes whenever another connection commits to the database.
+HRESULT CCredentialStore::_QueryDataVersion(int* piVersion)
+{
+    HRESULT hr;
+    int rc = sqlite3_step(_pVersionStmt);
+    if (rc == SQLITE_ROW)
+    {
+        *piVersion = sqlite3_column_int(_pVersionStmt, 0);
+        hr = S_OK;
+    }
+    else
+    {
+        hr = HRESULT_FROM_SQLITE(rc);
+    }
+    sqlite3_reset(_pVersionStmt);
+    return hr;
+}
+
+//
+// Calls pfn for every row of the profile table, in no particular order. Rows with a
+// NULL column are skipped.
+//
+HRESULT CCredentialStore::EnumerateProfiles(PFN_PROFILE_CALLBACK pfn, void* pv)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return _EnumerateProfiles(pfn, pv);
+}
+
+HRESULT CCredentialStore::_EnumerateProfiles(PFN_PROFILE_CALLBACK pfn, void* pv)
+{
+    if (_pScanStmt == NULL)
+    {
+        return E_FAIL;
+    }
+
+    HRESULT hr = S_OK;
+    int rc;
+    while (SUCCEEDED(hr) && (rc = sqlite3_step(_pScanStmt)) == SQLITE_ROW)
+    {
+        const char* pchId = (const char*)sqlite3_column_text(_pScanStmt, 0);
+        int cchId = sqlite3_column_bytes(_pScanStmt, 0);
+        const char* pszUser = (const char*)sqlite3_column_text(_pScanStmt, 1);
+        const char* pszPassword = (const char*)sqlite3_column_text(_pScanStmt, 2);
+
+        if (pchId != NULL && pszUser != NULL && pszPassword != NULL)
+        {
+            hr = pfn(pv, pchId, cchId, pszUser, pszPassword);
+        }
+    }
+    if (SUCCEEDED(hr) && rc != SQLITE_DONE)
+    {
+        hr = HRESULT_FROM_SQLITE(rc);
+    }
+    sqlite3_reset(_pScanStmt);
+
+    return hr;
+}
+
+HRESULT CCredentialStore::_AddToIndex(void* pv, const char* pchId, size_t cchId, const char* pszUser, const char* pszPassword)
+{
+    HRESULT hr = static_cast<CProfileIndex*>(pv)->Add(pchId, cchId, pszUser, pszPassword);
+
+    // A profile whose fields are too long to hand out just stays unfindable, exactly as
+    // it would be through the database.
+    if (hr == HRESULT_FROM_WIN32(ERROR_INVALID_DATA))
+    {
+        hr = S_OK;
+    }
+    return hr;
+}
+
+// Reloads the whole profile table into _index.
+HRESULT CCredentialStore::_RebuildIndex()
+{
+    _index.Clear();
+    _fIndexValid = FALSE;
+    _fIndexDirty = FALSE;
+    _ullLastCheck = GetTickCount64();
+
+    HRESULT hr = _QueryDataVersion(&_iIndexedVersion);
+    if (SUCCEEDED(hr))
+    {
+        hr = _EnumerateProfiles(_AddToIndex, &_index);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        _fIndexValid = TRUE;
+    }
+    else
+    {
+        fprintf(stderr, "profile index rebuild failed: 0x%08x\n", (unsigned)hr);
+        _index.Clear();
+    }
+    return hr;
+}
+
+// Rebuilds the index if the table has changed since it was built.
+void CCredentialStore::_RefreshIndexIfStale()
+{
+    BOOL fStale = _fIndexDirty;
+
+    ULONGLONG ullNow = GetTickCount64();
+    if (!fStale && ullNow - _ullLastCheck >= PROFILE_INDEX_RECHECK_MS)
+    {
+        int iVersion = 0;
+        _ullLastCheck = ullNow;
+        fStale = SUCCEEDED(_QueryDataVersion(&iVersion)) && iVersion != _iIndexedVersion;
+    }
+
+    if (fStale)
+    {
+        _RebuildIndex();
+    }
+}
+
+//
+// Looks up the profile whose id is the cchId characters at pchId (which need not be
+// null-terminated). Returns S_OK and fills in pRecord if it exists, or
+// HRESULT_FROM_WIN32(ERROR_NOT_FOUND) if it doesn't.
+//
+HRESULT CCredentialStore::Lookup(const char* pchId, size_t cchId, PROFILE_RECORD* pRecord)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    if (_pDb == NULL)
+    {
+        return E_FAIL;
+    }
+
+    _RefreshIndexIfStale();
+
+    return _fIndexValid ? _index.Lookup(pchId, cchId, pRecord) : _LookupInDatabase(pchId, cchId, pRecord);
+}
+
+// The slow path, for when the index couldn't be built.
+HRESULT CCredentialStore::_LookupInDatabase(const char* pchId, size_t cchId, PROFILE_RECORD* pRecord)
+{
+    HRESULT hr;
+    int rc = sqlite3_bind_text(_pLookupStmt, 1, pchId, (int)cchId, SQLITE_STATIC);
+    if (rc == SQLITE_OK)
+    {
+        rc = sqlite3_step(_pLookupStmt);
+        if (rc == SQLITE_ROW)
+        {
+            hr = _CopyColumn(_pLookupStmt, 0, pRecord->szUser, ARRAYSIZE(pRecord->szUser));
+            if (SUCCEEDED(hr))
+            {
+                hr = _CopyColumn(_pLookupStmt, 1, pRecord->szPassword, ARRAYSIZE(pRecord->szPassword));
+            }
+        }
+        else if (rc == SQLITE_DONE)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+        }
+        else
+        {
+            hr = HRESULT_FROM_SQLITE(rc);
+        }
+    }
+    else
+    {
+        hr = HRESULT_FROM_SQLITE(rc);
+    }
+
+    // Leave the statement ready for the next lookup, and don't hold on to the caller's id.
+    sqlite3_reset(_pLookupStmt);
+    sqlite3_clear_bindings(_pLookupStmt);
+
+    if (FAILED(hr))
+    {
+        SecureZeroMemory(pRecord, sizeof(*pRecord));
+    }
+
+    return hr;
+}
+
+HRESULT CCredentialStore::_Exec(const char* pszSql)
+{
+    char* zErrMsg = NULL;
+    int rc = sqlite3_exec(_pDb, pszSql, NULL, NULL, &zErrMsg);
+    if (rc != SQLITE_OK)
+    {
+        fprintf(stderr, "SQL error: %s\n", zErrMsg);
+        sqlite3_free(zErrMsg);
+    }
+    return (rc == SQLITE_OK) ? S_OK : HRESULT_FROM_SQLITE(rc);
+}
+
+// Writes each profile through the upsert statement. The caller owns the transaction.
+HRESULT CCredentialStore::_WriteProfiles(const PROFILE_UPDATE* rgUpdates, DWORD cUpdates)
+{
+    HRESULT hr = S_OK;
+    for (DWORD i = 0; SUCCEEDED(hr) && i < cUpdates; i++)
+    {
+        const PROFILE_UPDATE* pUpdate = &rgUpdates[i];
+        int rc = sqlite3_bind_text(_pUpsertStmt, 1, pUpdate->pchId, pUpdate->cchId, SQLITE_STATIC);
+        if (rc == SQLITE_OK)
+        {
+            rc = sqlite3_bind_text(_pUpsertStmt, 2, pUpdate->pchUser, pUpdate->cchUser, SQLITE_STATIC);
+        }
+        if (rc == SQLITE_OK)
+        {
+            rc = sqlite3_bind_text(_pUpsertStmt, 3, pUpdate->pchPassword, pUpdate->cchPassword, SQLITE_STATIC);
+        }
+        if (rc == SQLITE_OK)
+        {
+            rc = sqlite3_step(_pUpsertStmt);
+            if (rc == SQLITE_DONE)
+            {
+                rc = SQLITE_OK;
+            }
+        }
+        if (rc != SQLITE_OK)
+        {
+            fprintf(stderr, "SQL error: %s\n", sqlite3_errmsg(_pDb));
+            hr = HRESULT_FROM_SQLITE(rc);
+        }
+        sqlite3_reset(_pUpsertStmt);
+    }
+
+    // Don't hold on to the caller's passwords.
+    sqlite3_clear_bindings(_pUpsertStmt);
+    return hr;
+}
+
+// Adds (or replaces) each profile in _index, as the database now has them.
+HRESULT CCredentialStore::_IndexProfiles(const PROFILE_UPDATE* rgUpdates, DWORD cUpdates)
+{
+    HRESULT hr = _index.Reserve(_index.GetCount() + cUpdates);
+    for (DWORD i = 0; SUCCEEDED(hr) && i < cUpdates; i++)
+    {
+        const PROFILE_UPDATE* pUpdate = &rgUpdates[i];
+        PROFILE_RECORD record;
+        CopyMemory(record.szUser, pUpdate->pchUser, pUpdate->cchUser);
+        record.szUser[pUpdate->cchUser] = '\0';
+        CopyMemory(record.szPassword, pUpdate->pchPassword, pUpdate->cchPassword);
+        record.szPassword[pUpdate->cchPassword] = '\0';
+
+        hr = _index.Add(pUpdate->pchId, pUpdate->cchId, record.szUser, record.szPassword);
+        SecureZeroMemory(&record, sizeof(record));
+    }
+    return hr;
+}
+
+//
+// Adds the profiles in rgUpdates to the database, replacing any with the same ids, in a
+// single transaction: either all of them are written or, on failure, none are. The
+// fields must already be within PROFILE_MAX_FIELD (ProvisionMessageDecode sees to that).
+//
+// The index is patched with the same profiles afterwards. If that fails part way, it's
+// simply rebuilt from the database on the next lookup.
+//
+HRESULT CCredentialStore::Provision(const PROFILE_UPDATE* rgUpdates, DWORD cUpdates)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    if (_pDb == NULL)
+    {
+        return E_FAIL;
+    }
+
+    // Bring the index up to date first, so that afterwards it differs from the database
+    // by exactly this batch.
+    _RefreshIndexIfStale();
+
+    // IMMEDIATE takes the write lock now, rather than failing part way through the batch
+    // if someone else is writing.
+    HRESULT hr = _Exec("BEGIN IMMEDIATE;");
+    if (SUCCEEDED(hr))
+    {
+        hr = _WriteProfiles(rgUpdates, cUpdates);
+        if (SUCCEEDED(hr))
+        {
+            hr = _Exec("COMMIT;");
+        }
+        if (FAILED(hr))
+        {
+            _Exec("ROLLBACK;");
+        }
+    }
+
+    if (SUCCEEDED(hr) && _fIndexValid)
+    {
+        // Our own commit doesn't move data_version, so the index stays current once it
+        // has the new rows; only the update hook's dirty flag needs clearing.
+        if (SUCCEEDED(_IndexProfiles(rgUpdates, cUpdates)))
+        {
+            _fIndexDirty = FALSE;
+        }
+        else
+        {
+            _fIndexDirty = TRUE;
+        }
+    }
+
+    return hr;
+}
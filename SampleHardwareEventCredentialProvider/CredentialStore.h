@@ -0,0 +1,78 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// CCredentialStore maps badge/profile ids to the account they unlock, using the
+// "profile" table of the sqlite account database:
+//
+//   CREATE TABLE profile (id TEXT PRIMARY KEY, username TEXT, password TEXT);
+//
+// The database is opened once and its statements are prepared once. The whole
+// table is also loaded into a CProfileIndex, so a lookup is normally a single
+// hash probe and never touches sqlite. The index is rebuilt whenever the table
+// changes: writes through our own connection are caught by an update hook, and
+// writes by other processes are caught by watching PRAGMA data_version, which
+// we check at most every PROFILE_INDEX_RECHECK_MS.
+//
+// Provision adds or replaces a batch of profiles in one transaction, and patches them
+// into the index rather than reloading it.
+//
+// Lookup, EnumerateProfiles and Provision may be called from several threads at once;
+// they take turns. Open and Close may not.
+
+#pragma once
+
+#include <mutex>
+#include "PlatformCompat.h"
+#include "ProfileIndex.h"
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+// How long a lookup may trust the index before checking whether another process has
+// changed the database underneath it.
+#define PROFILE_INDEX_RECHECK_MS 1000
+
+class CCredentialStore : public IProfileSource
+{
+  public:
+    CCredentialStore();
+    ~CCredentialStore();
+
+    HRESULT Open(const char* pszPath);
+    void Close();
+    BOOL IsOpen();
+
+    HRESULT Lookup(const char* pchId, size_t cchId, PROFILE_RECORD* pRecord);
+    HRESULT EnumerateProfiles(PFN_PROFILE_CALLBACK pfn, void* pv);
+    HRESULT Provision(const PROFILE_UPDATE* rgUpdates, DWORD cUpdates);
+
+  private:
+    HRESULT _Prepare(const char* pszSql, sqlite3_stmt** ppStmt);
+    HRESULT _EnumerateProfiles(PFN_PROFILE_CALLBACK pfn, void* pv);
+    HRESULT _LookupInDatabase(const char* pchId, size_t cchId, PROFILE_RECORD* pRecord);
+    HRESULT _Exec(const char* pszSql);
+    HRESULT _WriteProfiles(const PROFILE_UPDATE* rgUpdates, DWORD cUpdates);
+    HRESULT _IndexProfiles(const PROFILE_UPDATE* rgUpdates, DWORD cUpdates);
+    HRESULT _QueryDataVersion(int* piVersion);
+    HRESULT _RebuildIndex();
+    void _RefreshIndexIfStale();
+    static HRESULT _AddToIndex(void* pv, const char* pchId, size_t cchId, const char* pszUser, const char* pszPassword);
+    static void _UpdateHook(void* pv, int iOp, const char* pszDb, const char* pszTable, long long llRowId);
+
+    std::mutex      _lock;              // Held by Lookup, EnumerateProfiles and Provision.
+    sqlite3         *_pDb;              // Our connection to the account database.
+    sqlite3_stmt    *_pLookupStmt;      // SELECT username, password FROM profile WHERE id = ?
+    sqlite3_stmt    *_pScanStmt;        // SELECT id, username, password FROM profile
+    sqlite3_stmt    *_pVersionStmt;     // PRAGMA data_version
+    sqlite3_stmt    *_pUpsertStmt;      // INSERT OR REPLACE INTO profile VALUES (?, ?, ?)
+    CProfileIndex   _index;             // In-memory copy of the profile table.
+    BOOL            _fIndexValid;       // Whether _index can be used at all.
+    BOOL            _fIndexDirty;       // Set by _UpdateHook when we change the table ourselves.
+    int             _iIndexedVersion;   // The data_version _index was built from.
+    ULONGLONG       _ullLastCheck;      // When we last compared data_version.
+};
@@ -8,8 +8,7 @@
 //
 // Standard dll required functions and class factory implementation.
 
-#include <windows.h>
-#include <unknwn.h>
+#include "ProviderCompat.h"
 #include "Dll.h"
 #include "guid.h"
 
@@ -28,12 +27,12 @@ class CClassFactory : public IClassFactory
     // IUnknown
     STDMETHOD_(ULONG, AddRef)()
     {
-        return _cRef++;
+        return ++_cRef;
     }
     
     STDMETHOD_(ULONG, Release)()
     {
-        LONG cRef = _cRef--;
+        LONG cRef = --_cRef;
         if (!cRef)
         {
             delete this;
@@ -95,7 +94,7 @@ class CClassFactory : public IClassFactory
 
   private:
      CClassFactory() : _cRef(1) {}
-    ~CClassFactory(){}
+    virtual ~CClassFactory(){}
 
   private:
     LONG _cRef;
@@ -128,6 +127,7 @@ HRESULT CClassFactory_CreateInstance(REFCLSID rclsid, REFIID riid, void** ppv)
 
 // DLL Functions ///////////////////////////////////////////////////////////////////////
 
+#ifdef _WIN32
 BOOL WINAPI DllMain(
     HINSTANCE hinstDll,
     DWORD dwReason,
@@ -151,6 +151,7 @@ BOOL WINAPI DllMain(
     return TRUE;
 
 }
+#endif
 
 void DllAddRef()
 {
@@ -0,0 +1,186 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+#define WIN32_LEAN_AND_MEAN
+
+#include "EventChannel.h"
+#include "SocketCompat.h"
+#include <stdio.h>
+
+// Room for a few hundred events to pile up while the loop is busy elsewhere.
+#define EVENT_RECEIVE_BUFFER    (256 * 1024)
+
+CEventChannel::CEventChannel()
+{
+    _s = INVALID_SOCKET_T;
+    ZeroMemory(_rgSenders, sizeof(_rgSenders));
+    ZeroMemory(&_counters, sizeof(_counters));
+}
+
+CEventChannel::~CEventChannel()
+{
+    Close();
+}
+
+BOOL CEventChannel::IsOpen()
+{
+    return _s != INVALID_SOCKET_T;
+}
+
+socket_t CEventChannel::GetSocket()
+{
+    return _s;
+}
+
+//
+// Binds a non-blocking UDP socket to pszPort on every interface. The caller must
+// already have called SocketStartup.
+//
+HRESULT CEventChannel::Open(const char* pszPort)
+{
+    Close();
+
+    int iPort = atoi(pszPort);
+    if (iPort <= 0 || iPort > 0xFFFF)
+    {
+        return E_INVALIDARG;
+    }
+
+    _s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (_s == INVALID_SOCKET_T) {
+        printf("socket failed with error: %d\n", SocketLastError());
+        return SocketLastErrorAsHResult();
+    }
+
+    struct sockaddr_in saBind;
+    ZeroMemory(&saBind, sizeof(saBind));
+    saBind.sin_family = AF_INET;
+    saBind.sin_addr.s_addr = htonl(INADDR_ANY);
+    saBind.sin_port = htons((USHORT)iPort);
+    if (bind(_s, (struct sockaddr*)&saBind, sizeof(saBind)) == SOCKET_ERROR) {
+        printf("bind failed with error: %d\n", SocketLastError());
+        HRESULT hr = SocketLastErrorAsHResult();
+        Close();
+        return hr;
+    }
+
+    // Not fatal if refused; we'll just drop more of a burst.
+    int cbBuffer = EVENT_RECEIVE_BUFFER;
+    setsockopt(_s, SOL_SOCKET, SO_RCVBUF, (const char*)&cbBuffer, sizeof(cbBuffer));
+
+    SocketSetNonBlocking(_s);
+    return S_OK;
+}
+
+void CEventChannel::Close()
+{
+    if (_s != INVALID_SOCKET_T)
+    {
+        SocketClose(_s);
+        _s = INVALID_SOCKET_T;
+    }
+}
+
+//
+// Takes up to EVENT_BATCH_MAX waiting datagrams and returns, in the order they arrived,
+// the events among them that should be acted on: up to cMax of them in rgEvents, and
+// their number in *pcEvents. Returns S_FALSE if nothing was waiting. Anything left on
+// the socket keeps it readable for the next poll.
+//
+HRESULT CEventChannel::Receive(ULONGLONG ullNow, EVENT_MESSAGE* rgEvents, DWORD cMax, DWORD* pcEvents)
+{
+    *pcEvents = 0;
+
+    SOCKET_DATAGRAM rgDatagrams[EVENT_BATCH_MAX];
+    int cWanted = (int)((cMax < EVENT_BATCH_MAX) ? cMax : EVENT_BATCH_MAX);
+    for (int i = 0; i < cWanted; i++)
+    {
+        rgDatagrams[i].pb = _rgbDatagrams[i];
+        rgDatagrams[i].cbMax = EVENT_DATAGRAM_MAX;
+        rgDatagrams[i].cb = 0;
+    }
+
+    int cReceived = SocketRecvBatch(_s, rgDatagrams, cWanted);
+    if (cReceived == SOCKET_ERROR) {
+        printf("recv failed with error: %d\n", SocketLastError());
+        return SocketLastErrorAsHResult();
+    }
+    if (cReceived == 0)
+    {
+        return S_FALSE;
+    }
+
+    _counters.cBatches++;
+    _counters.cDatagrams += cReceived;
+
+    DWORD cEvents = 0;
+    for (int i = 0; i < cReceived; i++)
+    {
+        EVENT_MESSAGE em;
+        if (FAILED(EventMessageDecode((const BYTE*)rgDatagrams[i].pb, rgDatagrams[i].cb, &em)))
+        {
+            _counters.cMalformed++;
+        }
+        else if (em.type == ET_DUMP_TIMINGS && (ntohl(rgDatagrams[i].saFrom.sin_addr.s_addr) >> 24) != 127)
+        {
+            // We listen on every interface, but only a local tool gets to make us write
+            // out our timings.
+            _counters.cRefused++;
+        }
+        else if (em.fSequenced && !_IsNewest(rgDatagrams[i].saFrom.sin_addr.s_addr, em, ullNow))
+        {
+            _counters.cStale++;
+        }
+        else
+        {
+            rgEvents[cEvents++] = em;
+        }
+    }
+
+    _counters.cDelivered += cEvents;
+    *pcEvents = cEvents;
+    return S_OK;
+}
+
+void CEventChannel::GetCounters(EVENT_CHANNEL_COUNTERS* pCounters)
+{
+    *pCounters = _counters;
+}
+
+// Whether em is newer than anything we've taken from its sender, remembering it if so.
+// Sequence numbers are compared as serial numbers, so they may wrap.
+BOOL CEventChannel::_IsNewest(DWORD dwAddress, const EVENT_MESSAGE& em, ULONGLONG ullNow)
+{
+    EVENT_SENDER* pOldest = &_rgSenders[0];
+    for (DWORD i = 0; i < EVENT_MAX_SENDERS; i++)
+    {
+        EVENT_SENDER* pSender = &_rgSenders[i];
+        if (pSender->ullLastSeen != 0 && pSender->dwAddress == dwAddress && pSender->dwSenderId == em.dwSenderId)
+        {
+            if ((LONG)(em.dwSequence - pSender->dwSequence) <= 0)
+            {
+                return FALSE;
+            }
+            pSender->dwSequence = em.dwSequence;
+            pSender->ullLastSeen = ullNow;
+            return TRUE;
+        }
+        if (pSender->ullLastSeen < pOldest->ullLastSeen)
+        {
+            pOldest = pSender;
+        }
+    }
+
+    // Someone new, or someone we'd forgotten.
+    pOldest->dwAddress = dwAddress;
+    pOldest->dwSenderId = em.dwSenderId;
+    pOldest->dwSequence = em.dwSequence;
+    pOldest->ullLastSeen = ullNow ? ullNow : 1;
+    return TRUE;
+}
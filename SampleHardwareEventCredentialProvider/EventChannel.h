@@ -0,0 +1,75 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// CEventChannel receives status events (device connected, disconnected, ...) sent
+// as UDP datagrams; see EVENT_TYPE in CredentialProtocol.h. It binds its port once
+// and keeps it for its whole lifetime, and takes whatever datagrams have piled up a
+// batch at a time rather than one per wakeup.
+//
+// Each sender's events carry a sequence number. We remember the newest one taken from
+// each of the last EVENT_MAX_SENDERS senders and drop anything that isn't newer: a
+// duplicate, or one overtaken on the way by a later event that has already been
+// acted on. A sender that restarts picks a new sender id, so it starts afresh.
+//
+// The channel has no thread of its own; its owner polls GetSocket and calls Receive
+// when it's readable. All calls must come from the same thread.
+
+#pragma once
+
+#include "PlatformCompat.h"
+#include "CredentialProtocol.h"
+
+// How many senders' sequence numbers we remember. The one heard from least recently
+// is forgotten to make room for a new one.
+#define EVENT_MAX_SENDERS       16
+
+// The most datagrams Receive takes from the socket at a time.
+#define EVENT_BATCH_MAX         32
+
+// Anything longer than this can't be an event; it's received this far and discarded.
+#define EVENT_DATAGRAM_MAX      64
+
+struct EVENT_CHANNEL_COUNTERS
+{
+    DWORD   cDatagrams;     // Datagrams received.
+    DWORD   cBatches;       // Receives that found at least one datagram.
+    DWORD   cMalformed;     // Datagrams that weren't events.
+    DWORD   cStale;         // Duplicates, and events overtaken by newer ones.
+    DWORD   cDelivered;     // Events returned by Receive.
+    DWORD   cRefused;       // ET_DUMP_TIMINGS events that didn't come from this machine.
+};
+
+class CEventChannel
+{
+  public:
+    CEventChannel();
+    ~CEventChannel();
+
+    HRESULT Open(const char* pszPort);
+    void Close();
+    BOOL IsOpen();
+    socket_t GetSocket();
+    HRESULT Receive(ULONGLONG ullNow, EVENT_MESSAGE* rgEvents, DWORD cMax, DWORD* pcEvents);
+    void GetCounters(EVENT_CHANNEL_COUNTERS* pCounters);
+
+  private:
+    struct EVENT_SENDER
+    {
+        DWORD       dwAddress;      // IPv4 address, network order.
+        DWORD       dwSenderId;
+        DWORD       dwSequence;     // The newest sequence number taken from them.
+        ULONGLONG   ullLastSeen;    // 0 for an unused entry.
+    };
+
+    BOOL _IsNewest(DWORD dwAddress, const EVENT_MESSAGE& em, ULONGLONG ullNow);
+
+    socket_t                _s;
+    EVENT_SENDER            _rgSenders[EVENT_MAX_SENDERS];
+    EVENT_CHANNEL_COUNTERS  _counters;
+    char                    _rgbDatagrams[EVENT_BATCH_MAX][EVENT_DATAGRAM_MAX];
+};
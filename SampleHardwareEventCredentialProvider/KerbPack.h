@@ -0,0 +1,212 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// A packed KERB_INTERACTIVE_UNLOCK_LOGON, as WinLogon and LSA consume it, is the
+// structure itself followed by the domain, username and password, back to back and not
+// null-terminated, with each UNICODE_STRING's Buffer holding the string's byte offset
+// from the start of the structure instead of a pointer (see KerbInteractiveUnlockLogonPack
+// in helpers.cpp).
+//
+// The layout depends only on the pointer size, so here it's worked out from the size of
+// an integer standing in for the pointer, and packed and unpacked byte by byte with
+// explicit bounds checks. Nothing here needs the Windows headers, so the same code packs
+// for the DLL and for tests on other platforms, for either pointer size.
+
+#pragma once
+
+#include "PlatformCompat.h"
+
+// The three strings to pack, with their lengths in bytes. They needn't be
+// null-terminated.
+struct KERB_PACK_STRINGS
+{
+    DWORD       dwMessageType;
+    const BYTE  *pbDomain;
+    USHORT      cbDomain;
+    const BYTE  *pbUser;
+    USHORT      cbUser;
+    const BYTE  *pbPassword;
+    USHORT      cbPassword;
+};
+
+//
+// Points one of the strings in a KERB_PACK_STRINGS at the null-terminated pwz, measuring
+// it on the way. Fails, as UnicodeStringInitWithString does, if it's too long for a
+// UNICODE_STRING. The scan stops there, so an unterminated string isn't read past that.
+//
+inline HRESULT KerbPackSetString(const WCHAR* pwz, const BYTE** ppb, USHORT* pcb)
+{
+    if (pwz == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    const DWORD cchMax = 0xFFFF / sizeof(WCHAR);
+    DWORD cch = 0;
+    while (pwz[cch] != 0)
+    {
+        if (++cch > cchMax)
+        {
+            return HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW);
+        }
+    }
+
+    *ppb = (const BYTE*)pwz;
+    *pcb = (USHORT)(cch * sizeof(WCHAR));
+    return S_OK;
+}
+
+//
+// Packs and unpacks KERB_INTERACTIVE_UNLOCK_LOGONs for a pointer-sized TPtr, DWORD for
+// 32-bit and ULONGLONG for 64-bit. All offsets
+// are worked out at compile time from the natural alignment the Windows compilers give
+// these structures, and every integer is written little-endian.
+//
+template <typename TPtr>
+class CKerbPacker
+{
+  public:
+    static constexpr DWORD cbPointer = sizeof(TPtr);
+
+    // UNICODE_STRING: two USHORTs, then the pointer at its natural alignment.
+    static constexpr DWORD ibStringBuffer = cbPointer;
+    static constexpr DWORD cbString = ibStringBuffer + cbPointer;
+
+    // KERB_INTERACTIVE_LOGON: MessageType, then the strings at pointer alignment.
+    static constexpr DWORD ibDomain = cbPointer;
+    static constexpr DWORD ibUser = ibDomain + cbString;
+    static constexpr DWORD ibPassword = ibUser + cbString;
+    static constexpr DWORD cbLogon = ibPassword + cbString;
+
+    // KERB_INTERACTIVE_UNLOCK_LOGON: the logon, then a LUID, rounded up to pointer
+    // alignment.
+    static constexpr DWORD ibLogonId = cbLogon;
+    static constexpr DWORD cbHeader = (ibLogonId + 8 + cbPointer - 1) & ~(cbPointer - 1);
+
+    // The size of the packed structure for strings of these lengths. Can't overflow: the
+    // lengths are USHORTs.
+    static constexpr DWORD GetPackedSize(USHORT cbDomain, USHORT cbUser, USHORT cbPassword)
+    {
+        return cbHeader + (DWORD)cbDomain + (DWORD)cbUser + (DWORD)cbPassword;
+    }
+
+    //
+    // Packs ps into the cb bytes at pb, which must be at least GetPackedSize bytes.
+    // The LUID is left zeroed for WinLogon to fill in.
+    //
+    static HRESULT Pack(const KERB_PACK_STRINGS& ps, BYTE* pb, DWORD cb)
+    {
+        DWORD cbPacked = GetPackedSize(ps.cbDomain, ps.cbUser, ps.cbPassword);
+        if (pb == NULL || cb < cbPacked)
+        {
+            return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+        }
+
+        // Zero the header so the padding and the LUID don't carry whatever was there.
+        ZeroMemory(pb, cbHeader);
+        _WriteLE(pb, 0, sizeof(DWORD), ps.dwMessageType);
+
+        DWORD ibNext = cbHeader;
+        _PackString(pb, ibDomain, ps.pbDomain, ps.cbDomain, &ibNext);
+        _PackString(pb, ibUser, ps.pbUser, ps.cbUser, &ibNext);
+        _PackString(pb, ibPassword, ps.pbPassword, ps.cbPassword, &ibNext);
+        return S_OK;
+    }
+
+    //
+    // Checks that the cb bytes at pb hold a well-formed packed structure and returns its
+    // strings in *pps, pointing into pb. Every string has to lie wholly after the header
+    // and within the buffer, and be a whole number of characters long.
+    //
+    static HRESULT Unpack(const BYTE* pb, DWORD cb, KERB_PACK_STRINGS* pps)
+    {
+        if (pb == NULL || cb < cbHeader)
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+
+        pps->dwMessageType = (DWORD)_ReadLE(pb, 0, sizeof(DWORD));
+
+        HRESULT hr = _UnpackString(pb, cb, ibDomain, &pps->pbDomain, &pps->cbDomain);
+        if (SUCCEEDED(hr))
+        {
+            hr = _UnpackString(pb, cb, ibUser, &pps->pbUser, &pps->cbUser);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = _UnpackString(pb, cb, ibPassword, &pps->pbPassword, &pps->cbPassword);
+        }
+        return hr;
+    }
+
+  private:
+    static void _WriteLE(BYTE* pb, DWORD ib, DWORD cbField, ULONGLONG ull)
+    {
+        for (DWORD i = 0; i < cbField; i++)
+        {
+            pb[ib + i] = (BYTE)(ull >> (8 * i));
+        }
+    }
+
+    static ULONGLONG _ReadLE(const BYTE* pb, DWORD ib, DWORD cbField)
+    {
+        ULONGLONG ull = 0;
+        for (DWORD i = 0; i < cbField; i++)
+        {
+            ull |= (ULONGLONG)pb[ib + i] << (8 * i);
+        }
+        return ull;
+    }
+
+    static void _PackString(BYTE* pb, DWORD ibString, const BYTE* pbSource, USHORT cbSource, DWORD* pibNext)
+    {
+        _WriteLE(pb, ibString, sizeof(USHORT), cbSource);
+        _WriteLE(pb, ibString + sizeof(USHORT), sizeof(USHORT), cbSource);
+        _WriteLE(pb, ibString + ibStringBuffer, cbPointer, *pibNext);
+        if (cbSource > 0)
+        {
+            CopyMemory(pb + *pibNext, pbSource, cbSource);
+        }
+        *pibNext += cbSource;
+    }
+
+    static HRESULT _UnpackString(const BYTE* pb, DWORD cb, DWORD ibString, const BYTE** ppbString, USHORT* pcbString)
+    {
+        USHORT cbString = (USHORT)_ReadLE(pb, ibString, sizeof(USHORT));
+        USHORT cbMaximum = (USHORT)_ReadLE(pb, ibString + sizeof(USHORT), sizeof(USHORT));
+        ULONGLONG ibBuffer = _ReadLE(pb, ibString + ibStringBuffer, cbPointer);
+
+        if ((cbString & 1) != 0 || cbMaximum < cbString)
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+        if (cbString == 0)
+        {
+            // An empty string may point anywhere; it's never read.
+            *ppbString = pb + cbHeader;
+            *pcbString = 0;
+            return S_OK;
+        }
+        if (ibBuffer < cbHeader || ibBuffer > cb || cbString > cb - ibBuffer)
+        {
+            return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+
+        *ppbString = pb + ibBuffer;
+        *pcbString = cbString;
+        return S_OK;
+    }
+};
+
+typedef CKerbPacker<DWORD>      CKerbPacker32;
+typedef CKerbPacker<ULONGLONG>  CKerbPacker64;
+typedef CKerbPacker<UINT_PTR>   CKerbNativePacker;
+
+// The compile-time offsets must agree with the structures' natural layout.
+static_assert(CKerbPacker32::cbHeader == 36, "32-bit KERB_INTERACTIVE_UNLOCK_LOGON is 36 bytes");
+static_assert(CKerbPacker64::cbHeader == 64, "64-bit KERB_INTERACTIVE_UNLOCK_LOGON is 64 bytes");
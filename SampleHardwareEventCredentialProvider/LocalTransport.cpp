@@ -0,0 +1,532 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+#define WIN32_LEAN_AND_MEAN
+
+#include "LocalTransport.h"
+#include "SocketCompat.h"
+#include <new>
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#define LOCAL_MAPPING_SIZE  (sizeof(LOCAL_TRANSPORT_HEADER) + 2 * LOCAL_RING_SIZE)
+
+static_assert((LOCAL_RING_SIZE & (LOCAL_RING_SIZE - 1)) == 0, "LOCAL_RING_SIZE must be a power of two");
+static_assert(sizeof(std::atomic<DWORD>) == sizeof(DWORD), "ring indices must be plain DWORDs in shared memory");
+
+CLocalTransport::CLocalTransport()
+{
+    _pHeader = NULL;
+    _pIn = NULL;
+    _pOut = NULL;
+    _pbIn = NULL;
+    _pbOut = NULL;
+    _pdwPeerPort = NULL;
+    _fCreator = FALSE;
+    _dwSession = 0;
+    _fEstablished = FALSE;
+    _sDoorbell = INVALID_SOCKET_T;
+#ifdef _WIN32
+    _hMapping = NULL;
+#else
+    _szName[0] = '\0';
+#endif
+}
+
+CLocalTransport::~CLocalTransport()
+{
+    Close();
+}
+
+BOOL CLocalTransport::IsOpen()
+{
+    return _pHeader != NULL;
+}
+
+//
+// The listener's end. Creates the shared mapping pszName, replacing any left behind,
+// and tells agents to ring usDoorbellPort (network order, on loopback) when they
+// want us. The caller must already have called SocketStartup.
+//
+HRESULT CLocalTransport::Create(const char* pszName, USHORT usDoorbellPort)
+{
+    Close();
+
+    HRESULT hr = _Map(pszName, TRUE);
+    if (SUCCEEDED(hr))
+    {
+        _fCreator = TRUE;
+        new (_pHeader) LOCAL_TRANSPORT_HEADER();
+        _pHeader->dwMagic = LOCAL_TRANSPORT_MAGIC;
+        _pHeader->dwVersion = LOCAL_TRANSPORT_VERSION;
+        _pHeader->cbRing = LOCAL_RING_SIZE;
+        _pHeader->dwListenerPort = usDoorbellPort;
+        _pHeader->dwAgentPort = 0;
+        _pHeader->dwAgentSession = 0;
+        _pHeader->dwSession = 0;
+
+        _pIn = &_pHeader->toListener;
+        _pOut = &_pHeader->toAgent;
+        _pbIn = (BYTE*)(_pHeader + 1);
+        _pbOut = _pbIn + LOCAL_RING_SIZE;
+        _pdwPeerPort = &_pHeader->dwAgentPort;
+
+        hr = _OpenDoorbell(FALSE);
+    }
+
+    if (FAILED(hr))
+    {
+        Close();
+    }
+    return hr;
+}
+
+//
+// The agent's end. Opens the mapping a listener created, publishes a doorbell for the
+// listener to ring us on, and asks for a new session. Nothing is sent or received until
+// the listener accepts it. Poll GetDoorbell when PrepareToWait says to.
+//
+HRESULT CLocalTransport::Connect(const char* pszName)
+{
+    Close();
+
+    HRESULT hr = _Map(pszName, FALSE);
+    if (SUCCEEDED(hr) && (_pHeader->dwMagic != LOCAL_TRANSPORT_MAGIC || _pHeader->dwVersion != LOCAL_TRANSPORT_VERSION ||
+        _pHeader->cbRing != LOCAL_RING_SIZE))
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        _pIn = &_pHeader->toAgent;
+        _pOut = &_pHeader->toListener;
+        _pbOut = (BYTE*)(_pHeader + 1);
+        _pbIn = _pbOut + LOCAL_RING_SIZE;
+        _pdwPeerPort = &_pHeader->dwListenerPort;
+
+        hr = _OpenDoorbell(TRUE);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        // Our session starts with the next byte we write. 0 means no session at all.
+        _dwSession = _pHeader->dwAgentSession.load() + 1;
+        if (_dwSession == 0)
+        {
+            _dwSession = 1;
+        }
+        _pHeader->ibAgentStart.store(_pOut->ibWrite.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        _pHeader->dwAgentSession.store(_dwSession, std::memory_order_seq_cst);
+        _RingPeer();
+    }
+
+    if (FAILED(hr))
+    {
+        Close();
+    }
+    return hr;
+}
+
+//
+// The listener's end. Takes up the session an agent has asked for since we last
+// looked, if there is one, and returns S_OK: the caller must forget whatever of the
+// previous session it has half read or not yet sent. Returns S_FALSE otherwise.
+//
+HRESULT CLocalTransport::Accept()
+{
+    if (_pHeader == NULL || !_fCreator)
+    {
+        return E_UNEXPECTED;
+    }
+
+    DWORD dwSession = _pHeader->dwAgentSession.load(std::memory_order_acquire);
+    if (dwSession == _dwSession)
+    {
+        return S_FALSE;
+    }
+
+    // Everything before the agent's start is from an earlier session; everything we've
+    // written so far is for one.
+    _dwSession = dwSession;
+    _pIn->ibRead.store(_pHeader->ibAgentStart.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+    _pHeader->ibListenerStart.store(_pOut->ibWrite.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    _pHeader->dwSession.store(dwSession, std::memory_order_seq_cst);
+    _RingPeer();
+    return S_OK;
+}
+
+//
+// The listener's end. Ends the agent's session, as closing a socket would: nothing
+// more is read from or written to the rings until an agent connects again, and the
+// agent's Send and Receive fail, once it's woken, to tell it to.
+//
+void CLocalTransport::Drop()
+{
+    if (_pHeader != NULL && _fCreator)
+    {
+        _pHeader->dwSession.store(0, std::memory_order_seq_cst);
+        _RingPeer();
+    }
+}
+
+// S_OK if there's a session to carry data for, and S_FALSE if there isn't yet. On the
+// agent's end, fails once the listener has dropped our session.
+HRESULT CLocalTransport::_CheckSession()
+{
+    DWORD dwSession = _pHeader->dwSession.load(std::memory_order_acquire);
+    if (_fCreator)
+    {
+        return (dwSession != 0) ? S_OK : S_FALSE;
+    }
+    if (_fEstablished)
+    {
+        return (dwSession == _dwSession) ? S_OK : HRESULT_FROM_WIN32(ERROR_CONNECTION_ABORTED);
+    }
+    if (dwSession != _dwSession)
+    {
+        return S_FALSE;
+    }
+
+    // Just accepted. Replies before the listener's start were meant for someone else.
+    _pIn->ibRead.store(_pHeader->ibListenerStart.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+    _fEstablished = TRUE;
+    return S_OK;
+}
+
+void CLocalTransport::Close()
+{
+    if (_pHeader != NULL && !_fCreator)
+    {
+        _pHeader->dwAgentPort = 0;
+    }
+
+    if (_sDoorbell != INVALID_SOCKET_T)
+    {
+        SocketClose(_sDoorbell);
+        _sDoorbell = INVALID_SOCKET_T;
+    }
+
+#ifdef _WIN32
+    if (_pHeader != NULL)
+    {
+        UnmapViewOfFile(_pHeader);
+    }
+    if (_hMapping != NULL)
+    {
+        CloseHandle(_hMapping);
+        _hMapping = NULL;
+    }
+#else
+    if (_pHeader != NULL)
+    {
+        munmap(_pHeader, LOCAL_MAPPING_SIZE);
+    }
+    if (_fCreator && _szName[0] != '\0')
+    {
+        shm_unlink(_szName);
+    }
+    _szName[0] = '\0';
+#endif
+
+    _pHeader = NULL;
+    _pIn = NULL;
+    _pOut = NULL;
+    _pbIn = NULL;
+    _pbOut = NULL;
+    _pdwPeerPort = NULL;
+    _fCreator = FALSE;
+    _dwSession = 0;
+    _fEstablished = FALSE;
+}
+
+HRESULT CLocalTransport::_Map(const char* pszName, BOOL fCreate)
+{
+    HRESULT hr = S_OK;
+    void* pv = NULL;
+
+#ifdef _WIN32
+    if (fCreate)
+    {
+        _hMapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)LOCAL_MAPPING_SIZE, pszName);
+    }
+    else
+    {
+        _hMapping = OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, pszName);
+    }
+    if (_hMapping != NULL)
+    {
+        pv = MapViewOfFile(_hMapping, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, LOCAL_MAPPING_SIZE);
+    }
+    if (pv == NULL)
+    {
+        hr = HRESULT_FROM_WIN32(GetLastError());
+    }
+#else
+    if (strlen(pszName) >= sizeof(_szName))
+    {
+        return E_INVALIDARG;
+    }
+
+    int fd;
+    if (fCreate)
+    {
+        // Only our own user may open it: it carries passwords.
+        shm_unlink(pszName);
+        fd = shm_open(pszName, O_RDWR | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
+        if (fd >= 0 && ftruncate(fd, LOCAL_MAPPING_SIZE) != 0)
+        {
+            hr = HRESULT_FROM_WIN32(errno);
+        }
+    }
+    else
+    {
+        fd = shm_open(pszName, O_RDWR, 0);
+    }
+    if (fd < 0)
+    {
+        hr = HRESULT_FROM_WIN32(errno);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < LOCAL_MAPPING_SIZE)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+    }
+    if (SUCCEEDED(hr))
+    {
+        pv = mmap(NULL, LOCAL_MAPPING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (pv == MAP_FAILED)
+        {
+            pv = NULL;
+            hr = HRESULT_FROM_WIN32(errno);
+        }
+    }
+
+    // The mapping keeps the object alive; we don't need the descriptor.
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    if (fCreate && fd >= 0)
+    {
+        strcpy(_szName, pszName);
+    }
+#endif
+
+    _pHeader = (LOCAL_TRANSPORT_HEADER*)pv;
+    return hr;
+}
+
+// Opens the UDP socket we ring the other side's doorbell with. The agent's is also
+// bound to a loopback port of its own, published for the listener to ring.
+HRESULT CLocalTransport::_OpenDoorbell(BOOL fBind)
+{
+    _sDoorbell = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (_sDoorbell == INVALID_SOCKET_T) {
+        printf("socket failed with error: %d\n", SocketLastError());
+        return SocketLastErrorAsHResult();
+    }
+    SocketSetNonBlocking(_sDoorbell);
+
+    if (fBind)
+    {
+        struct sockaddr_in sa;
+        ZeroMemory(&sa, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sa.sin_port = 0;
+        socklen_compat_t cb = sizeof(sa);
+        if (bind(_sDoorbell, (struct sockaddr*)&sa, sizeof(sa)) == SOCKET_ERROR ||
+            getsockname(_sDoorbell, (struct sockaddr*)&sa, &cb) == SOCKET_ERROR) {
+            printf("bind failed with error: %d\n", SocketLastError());
+            return SocketLastErrorAsHResult();
+        }
+        _pHeader->dwAgentPort = sa.sin_port;
+    }
+    return S_OK;
+}
+
+// Wakes the other side, if it's listening at all.
+void CLocalTransport::_RingPeer()
+{
+    DWORD dwPort = _pdwPeerPort->load();
+    if (dwPort != 0)
+    {
+        struct sockaddr_in sa;
+        ZeroMemory(&sa, sizeof(sa));
+        sa.sin_family = AF_INET;
+        sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        sa.sin_port = (USHORT)dwPort;
+        sendto(_sDoorbell, "", 1, 0, (struct sockaddr*)&sa, sizeof(sa));
+    }
+}
+
+//
+// Copies as much of pb as there's room for into the outgoing ring, setting *pcbSent to
+// how much that was, and wakes the other side if it's waiting for data. Nothing is sent
+// outside a session.
+//
+HRESULT CLocalTransport::Send(const BYTE* pb, DWORD cb, DWORD* pcbSent)
+{
+    *pcbSent = 0;
+    if (_pHeader == NULL)
+    {
+        return E_FAIL;
+    }
+
+    HRESULT hr = _CheckSession();
+    if (hr != S_OK)
+    {
+        return FAILED(hr) ? hr : S_OK;
+    }
+
+    DWORD ibWrite = _pOut->ibWrite.load(std::memory_order_relaxed);
+    DWORD cbFree = LOCAL_RING_SIZE - (ibWrite - _pOut->ibRead.load(std::memory_order_acquire));
+    DWORD cbSend = (cb < cbFree) ? cb : cbFree;
+    if (cbSend == 0)
+    {
+        return S_OK;
+    }
+
+    DWORD ib = ibWrite & (LOCAL_RING_SIZE - 1);
+    DWORD cbFirst = (cbSend < LOCAL_RING_SIZE - ib) ? cbSend : LOCAL_RING_SIZE - ib;
+    CopyMemory(_pbOut + ib, pb, cbFirst);
+    CopyMemory(_pbOut, pb + cbFirst, cbSend - cbFirst);
+
+    // Publishing the data and then checking the reader's flag must not be reordered;
+    // the reader sets its flag and then checks for data, so one of us sees the other.
+    _pOut->ibWrite.store(ibWrite + cbSend, std::memory_order_seq_cst);
+    if (_pOut->fReaderWaiting.load(std::memory_order_seq_cst) && _pOut->fReaderWaiting.exchange(0))
+    {
+        _RingPeer();
+    }
+
+    *pcbSent = cbSend;
+    return S_OK;
+}
+
+//
+// Copies up to cbMax bytes out of the incoming ring, setting *pcbReceived to how many,
+// and wakes the other side if it was waiting for room. Nothing is received outside a
+// session, except on the agent's end what the listener sent before dropping it.
+//
+HRESULT CLocalTransport::Receive(BYTE* pb, DWORD cbMax, DWORD* pcbReceived)
+{
+    *pcbReceived = 0;
+    if (_pHeader == NULL)
+    {
+        return E_FAIL;
+    }
+
+    HRESULT hr = _CheckSession();
+    if (hr == S_FALSE)
+    {
+        return S_OK;
+    }
+
+    DWORD ibRead = _pIn->ibRead.load(std::memory_order_relaxed);
+    DWORD cbAvailable = _pIn->ibWrite.load(std::memory_order_acquire) - ibRead;
+    if (cbAvailable > LOCAL_RING_SIZE)
+    {
+        // The writer can't have got this far ahead; the mapping has been scribbled on.
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+    if (FAILED(hr) && cbAvailable == 0)
+    {
+        // Dropped, and we've had everything the listener sent before it dropped us.
+        return hr;
+    }
+
+    DWORD cbReceive = (cbMax < cbAvailable) ? cbMax : cbAvailable;
+    if (cbReceive == 0)
+    {
+        return S_OK;
+    }
+
+    DWORD ib = ibRead & (LOCAL_RING_SIZE - 1);
+    DWORD cbFirst = (cbReceive < LOCAL_RING_SIZE - ib) ? cbReceive : LOCAL_RING_SIZE - ib;
+    CopyMemory(pb, _pbIn + ib, cbFirst);
+    CopyMemory(pb + cbFirst, _pbIn, cbReceive - cbFirst);
+
+    _pIn->ibRead.store(ibRead + cbReceive, std::memory_order_seq_cst);
+    if (_pIn->fWriterWaiting.load(std::memory_order_seq_cst) && _pIn->fWriterWaiting.exchange(0))
+    {
+        _RingPeer();
+    }
+
+    *pcbReceived = cbReceive;
+    return S_OK;
+}
+
+//
+// Call before going to sleep. Asks the other side to ring us when there's data for
+// us, and, if fWantToSend, when there's room to send. Returns FALSE, meaning don't
+// sleep, if either is already true, or the session has changed.
+//
+BOOL CLocalTransport::PrepareToWait(BOOL fWantToSend)
+{
+    if (_pHeader == NULL)
+    {
+        return TRUE;
+    }
+
+    // Whoever changes the session rings the other side, so there's nothing to ask for
+    // outside one.
+    if (_fCreator && _pHeader->dwAgentSession.load(std::memory_order_seq_cst) != _dwSession)
+    {
+        return FALSE;
+    }
+    HRESULT hr = _CheckSession();
+    if (hr != S_OK)
+    {
+        return SUCCEEDED(hr);
+    }
+
+    _pIn->fReaderWaiting.store(1, std::memory_order_seq_cst);
+    if (_pIn->ibWrite.load(std::memory_order_seq_cst) != _pIn->ibRead.load(std::memory_order_relaxed))
+    {
+        return FALSE;
+    }
+
+    if (fWantToSend)
+    {
+        _pOut->fWriterWaiting.store(1, std::memory_order_seq_cst);
+        if (_pOut->ibWrite.load(std::memory_order_relaxed) - _pOut->ibRead.load(std::memory_order_seq_cst) < LOCAL_RING_SIZE)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// The agent's end polls this for POLLIN to sleep until the listener rings.
+socket_t CLocalTransport::GetDoorbell()
+{
+    return _sDoorbell;
+}
+
+// Swallows the doorbell datagrams that woke us.
+void CLocalTransport::ClearDoorbell()
+{
+    char buf[16];
+    while (recv(_sDoorbell, buf, sizeof(buf), 0) > 0)
+    {
+    }
+}
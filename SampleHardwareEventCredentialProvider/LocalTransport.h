@@ -0,0 +1,109 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// CLocalTransport lets a sender on the same machine (a badge reader's agent, say)
+// talk to the listener through shared memory instead of a loopback TCP connection.
+// It carries exactly what a TCP connection would: frames as described in
+// CredentialProtocol.h from the agent, FT_ACKs back from the listener.
+//
+// The listener creates a named mapping holding two byte rings, one each way. Each
+// ring has a single writer and a single reader, which only ever advance their own
+// index, so neither takes a lock or makes a system call to move data.
+//
+// A side that runs out of things to do says so in the ring header before it sleeps,
+// and the other side only rings its doorbell if it has. The doorbell is a one-byte
+// datagram to a loopback UDP port whose number is published in the header: for the
+// listener that's the wake socket its event loop already polls, so the transport
+// needs nothing new in the poll set, on Windows or elsewhere.
+//
+// There is one agent at a time, in a session of its own. An agent asks for a new
+// session each time it connects, noting where in its ring the session's bytes start;
+// the listener accepts it by skipping to there and noting where its own replies to the
+// session start, which the agent skips to in turn. So nothing a previous agent left
+// half written, and no reply meant for it, is seen by the next. The listener can also
+// drop the agent, after which the agent's Send and Receive fail until it connects again.
+
+#pragma once
+
+#include <atomic>
+#include "PlatformCompat.h"
+
+#define LOCAL_TRANSPORT_MAGIC       0x4C524743      // "CGRL"
+#define LOCAL_TRANSPORT_VERSION     2
+
+// Bytes in each ring. Must be a power of two.
+#define LOCAL_RING_SIZE             (64 * 1024)
+
+// One direction's indices. Each is the total number of bytes ever written or read,
+// wrapping at 2^32; the ring holds ibWrite - ibRead bytes. The writer's and the
+// reader's halves are kept on separate cache lines.
+struct LOCAL_RING_STATE
+{
+    alignas(64) std::atomic<DWORD>  ibWrite;
+    std::atomic<DWORD>              fWriterWaiting;     // The writer is asleep until there's room.
+    alignas(64) std::atomic<DWORD>  ibRead;
+    std::atomic<DWORD>              fReaderWaiting;     // The reader is asleep until there's data.
+};
+
+// The start of the shared mapping. The two rings' data follows it.
+struct LOCAL_TRANSPORT_HEADER
+{
+    DWORD               dwMagic;            // LOCAL_TRANSPORT_MAGIC
+    DWORD               dwVersion;          // LOCAL_TRANSPORT_VERSION
+    DWORD               cbRing;             // LOCAL_RING_SIZE
+    std::atomic<DWORD>  dwListenerPort;     // Where to ring the listener, network order.
+    std::atomic<DWORD>  dwAgentPort;        // Where to ring the agent, network order. 0 if none.
+    std::atomic<DWORD>  dwAgentSession;     // The session the agent last asked for. Written by the agent.
+    std::atomic<DWORD>  ibAgentStart;       // Where in toListener that session's bytes start.
+    std::atomic<DWORD>  dwSession;          // The session the listener is serving, 0 if none. Written by the listener.
+    std::atomic<DWORD>  ibListenerStart;    // Where in toAgent the replies to that session start.
+    LOCAL_RING_STATE    toListener;
+    LOCAL_RING_STATE    toAgent;
+};
+
+class CLocalTransport
+{
+  public:
+    CLocalTransport();
+    ~CLocalTransport();
+
+    HRESULT Create(const char* pszName, USHORT usDoorbellPort);
+    HRESULT Connect(const char* pszName);
+    void Close();
+    BOOL IsOpen();
+    HRESULT Accept();
+    void Drop();
+
+    HRESULT Send(const BYTE* pb, DWORD cb, DWORD* pcbSent);
+    HRESULT Receive(BYTE* pb, DWORD cbMax, DWORD* pcbReceived);
+    BOOL PrepareToWait(BOOL fWantToSend);
+    socket_t GetDoorbell();
+    void ClearDoorbell();
+
+  private:
+    HRESULT _Map(const char* pszName, BOOL fCreate);
+    HRESULT _OpenDoorbell(BOOL fBind);
+    void _RingPeer();
+    HRESULT _CheckSession();
+
+    LOCAL_TRANSPORT_HEADER  *_pHeader;      // The shared mapping.
+    LOCAL_RING_STATE        *_pIn;          // The ring we read.
+    LOCAL_RING_STATE        *_pOut;         // The ring we write.
+    BYTE                    *_pbIn;
+    BYTE                    *_pbOut;
+    std::atomic<DWORD>      *_pdwPeerPort;  // Where the other side's doorbell is.
+    BOOL                    _fCreator;      // Whether we're the listener's end.
+    DWORD                   _dwSession;     // The listener's end: the last session accepted. The agent's: the one asked for.
+    BOOL                    _fEstablished;  // The agent's end: whether the listener has accepted _dwSession.
+    socket_t                _sDoorbell;     // Sends our doorbells; on the agent's end, receives its own too.
+#ifdef _WIN32
+    HANDLE                  _hMapping;
+#else
+    char                    _szName[64];    // The shm object, which the creator removes on Close.
+#endif
+};
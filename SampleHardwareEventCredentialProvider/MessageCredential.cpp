@@ -7,8 +7,8 @@
 // Copyright (c) 2006 Microsoft Corporation. All rights reserved.
 //
 //
-#include <unknwn.h>
 #include "MessageCredential.h"
+#include "TraceLog.h"
 #include "guid.h"
 
 // CMessageCredential ////////////////////////////////////////////////////////
@@ -25,7 +25,7 @@ CMessageCredential::CMessageCredential():
 
 CMessageCredential::~CMessageCredential()
 {
-    for (int i = 0; i < ARRAYSIZE(_rgFieldStrings); i++)
+    for (DWORD i = 0; i < ARRAYSIZE(_rgFieldStrings); i++)
     {
         CoTaskMemFree(_rgFieldStrings[i]);
         CoTaskMemFree(_rgCredProvFieldDescriptors[i].pszLabel);
@@ -68,6 +68,7 @@ HRESULT CMessageCredential::Advise(
     ICredentialProviderCredentialEvents* pcpce
     )
 {
+    CTraceScope trace("message", "Advise");
     UNREFERENCED_PARAMETER(pcpce);
     return E_NOTIMPL;
 }
@@ -75,6 +76,7 @@ HRESULT CMessageCredential::Advise(
 // LogonUI calls this to tell us to release the callback.
 HRESULT CMessageCredential::UnAdvise()
 {
+    CTraceScope trace("message", "UnAdvise");
     return E_NOTIMPL;
 }
 
@@ -85,6 +87,7 @@ HRESULT CMessageCredential::UnAdvise()
 // would do it here.
 HRESULT CMessageCredential::SetSelected(BOOL* pbAutoLogon)  
 {
+    CTraceScope trace("message", "SetSelected");
     UNREFERENCED_PARAMETER(pbAutoLogon);
     return S_FALSE;
 }
@@ -93,6 +96,7 @@ HRESULT CMessageCredential::SetSelected(BOOL* pbAutoLogon)
 // and now no longer is. Since this credential is simply read-only text, we do nothing.
 HRESULT CMessageCredential::SetDeselected()
 {
+    CTraceScope trace("message", "SetDeselected");
     return S_OK;
 }
 
@@ -253,6 +257,7 @@ HRESULT CMessageCredential::GetSerialization(
     CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon
     )
 {
+    CTraceScope trace("message", "GetSerialization");
     UNREFERENCED_PARAMETER(ppwszOptionalStatusText);
     UNREFERENCED_PARAMETER(pcpsiOptionalStatusIcon);
     UNREFERENCED_PARAMETER(pcpgsr);
@@ -268,6 +273,7 @@ HRESULT CMessageCredential::ReportResult(
     CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon
     )
 {
+    CTraceScope trace("message", "ReportResult");
     UNREFERENCED_PARAMETER(ntsStatus);
     UNREFERENCED_PARAMETER(ntsStatus);
     UNREFERENCED_PARAMETER(ntsSubstatus);
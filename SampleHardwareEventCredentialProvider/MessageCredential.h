@@ -10,11 +10,9 @@
 
 #pragma once
 
-#include <windows.h>
-#include <strsafe.h>
-#include <shlguid.h>
+#include "ProviderCompat.h"
 #include "helpers.h"
-#include "dll.h"
+#include "Dll.h"
 #include "resource.h"
 #include "SocketListener.h"
 
@@ -24,12 +22,12 @@ class CMessageCredential : public ICredentialProviderCredential
     // IUnknown
     STDMETHOD_(ULONG, AddRef)()
     {
-        return _cRef++;
+        return ++_cRef;
     }
     
     STDMETHOD_(ULONG, Release)()
     {
-        LONG cRef = _cRef--;
+        LONG cRef = --_cRef;
         if (!cRef)
         {
             delete this;
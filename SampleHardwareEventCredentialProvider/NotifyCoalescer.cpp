@@ -0,0 +1,78 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+
+#include "NotifyCoalescer.h"
+
+CNotifyCoalescer::CNotifyCoalescer()
+{
+    _dwWindowMs = 0;
+    _fPending = FALSE;
+    _fConnected = FALSE;
+    _ullDue = 0;
+    ZeroMemory(&_counters, sizeof(_counters));
+}
+
+// Sets how long after the first of a burst of changes we wait before reporting it. With
+// a window of zero, only changes that arrive together are merged.
+void CNotifyCoalescer::SetWindow(DWORD dwWindowMs)
+{
+    _dwWindowMs = dwWindowMs;
+}
+
+// Records a change to fConnected. The window starts at the first change after a Flush;
+// later ones just replace the state that will be reported, they don't extend it. A
+// change to the state already reported still gets reported.
+void CNotifyCoalescer::Signal(BOOL fConnected, ULONGLONG ullNow)
+{
+    _counters.cReceived++;
+    _fConnected = fConnected;
+    if (!_fPending)
+    {
+        _fPending = TRUE;
+        _ullDue = ullNow + _dwWindowMs;
+    }
+}
+
+// Returns how many milliseconds until Flush will have something to report, or
+// COALESCE_NO_TIMEOUT if nothing is pending.
+DWORD CNotifyCoalescer::GetTimeout(ULONGLONG ullNow)
+{
+    if (!_fPending)
+    {
+        return COALESCE_NO_TIMEOUT;
+    }
+    return (ullNow >= _ullDue) ? 0 : (DWORD)(_ullDue - ullNow);
+}
+
+// If the window has closed on a pending change, returns TRUE and the final state in
+// *pfConnected. The caller should then raise exactly one notification.
+BOOL CNotifyCoalescer::Flush(ULONGLONG ullNow, BOOL* pfConnected)
+{
+    if (!_fPending || ullNow < _ullDue)
+    {
+        return FALSE;
+    }
+
+    _fPending = FALSE;
+    _counters.cEmitted++;
+    *pfConnected = _fConnected;
+    return TRUE;
+}
+
+// Returns the latest state we were told about, whether or not it has been reported yet.
+BOOL CNotifyCoalescer::GetState()
+{
+    return _fConnected;
+}
+
+void CNotifyCoalescer::GetCounters(COALESCER_COUNTERS* pCounters)
+{
+    *pCounters = _counters;
+}
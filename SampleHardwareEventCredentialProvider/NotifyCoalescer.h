@@ -0,0 +1,52 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Every CredentialsChanged we raise makes LogonUI re-enumerate our tiles and re-query
+// every field, so there's no point raising one per state change when several arrive
+// close together. The coalescer collects changes for a short window after the first
+// one and then reports a single change carrying the final state. A burst that ends
+// where it started, such as off then on again, is still reported once: LogonUI may have
+// re-read the tiles in between, and ET_REFRESH relies on a change to the same state
+// being reported.
+//
+// It has no thread or timer of its own: its owner asks how long until it's due, waits
+// at most that long, and then asks whether it has something to report. All calls must
+// come from the same thread.
+
+#pragma once
+
+#include "PlatformCompat.h"
+
+// GetTimeout's answer when nothing is pending.
+#define COALESCE_NO_TIMEOUT ((DWORD)-1)
+
+struct COALESCER_COUNTERS
+{
+    DWORD   cReceived;      // State changes passed to Signal.
+    DWORD   cEmitted;       // Changes reported by Flush.
+};
+
+class CNotifyCoalescer
+{
+  public:
+    CNotifyCoalescer();
+
+    void SetWindow(DWORD dwWindowMs);
+    void Signal(BOOL fConnected, ULONGLONG ullNow);
+    DWORD GetTimeout(ULONGLONG ullNow);
+    BOOL Flush(ULONGLONG ullNow, BOOL* pfConnected);
+    BOOL GetState();
+    void GetCounters(COALESCER_COUNTERS* pCounters);
+
+  private:
+    DWORD               _dwWindowMs;        // How long to collect changes for.
+    BOOL                _fPending;          // Whether a change is waiting to be reported.
+    BOOL                _fConnected;        // The latest state we were told about.
+    ULONGLONG           _ullDue;            // When the pending change is to be reported.
+    COALESCER_COUNTERS  _counters;
+};
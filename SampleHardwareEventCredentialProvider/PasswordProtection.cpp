@@ -0,0 +1,287 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+
+#include "PasswordProtection.h"
+#include <chrono>
+#include <new>
+
+// CProtectedPassword //////////////////////////////////////////////////////
+
+CProtectedPassword::CProtectedPassword() :
+    _dwSequence(0), _fExpected(FALSE), _fDone(FALSE), _hr(S_OK), _cch(0)
+{
+    ZeroMemory(_wsz, sizeof(_wsz));
+}
+
+CProtectedPassword::~CProtectedPassword()
+{
+    SecureZeroMemory(_wsz, sizeof(_wsz));
+}
+
+// Forgets any earlier result; from now on only one for dwSequence is wanted.
+void CProtectedPassword::Expect(DWORD dwSequence)
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        SecureZeroMemory(_wsz, sizeof(_wsz));
+        _dwSequence = dwSequence;
+        _fExpected = TRUE;
+        _fDone = FALSE;
+        _cch = 0;
+    }
+
+    // Anyone still waiting for an older push can stop.
+    _cvDone.notify_all();
+}
+
+// Whether a result for dwSequence is still wanted, so the worker can skip pushes
+// that were overtaken while they sat in its queue.
+BOOL CProtectedPassword::IsExpected(DWORD dwSequence)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    return _fExpected && _dwSequence == dwSequence;
+}
+
+// Called by the worker with the result for dwSequence. Ignored if a newer push has
+// been expected since.
+void CProtectedPassword::Complete(DWORD dwSequence, HRESULT hrProtect, const WCHAR* pwzProtected, DWORD cchProtected)
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (!_fExpected || _dwSequence != dwSequence)
+        {
+            return;
+        }
+
+        _hr = hrProtect;
+        _cch = 0;
+        if (SUCCEEDED(hrProtect))
+        {
+            if (cchProtected < ARRAYSIZE(_wsz))
+            {
+                CopyMemory(_wsz, pwzProtected, cchProtected * sizeof(WCHAR));
+                _wsz[cchProtected] = 0;
+                _cch = cchProtected;
+            }
+            else
+            {
+                _hr = HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+            }
+        }
+        _fDone = TRUE;
+    }
+    _cvDone.notify_all();
+}
+
+// Called by the worker when it drops the job for dwSequence without doing it. Unless
+// the result is already in, there's nothing left to wait for.
+void CProtectedPassword::Abandon(DWORD dwSequence)
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (!_fExpected || _dwSequence != dwSequence || _fDone)
+        {
+            return;
+        }
+        _fExpected = FALSE;
+    }
+    _cvDone.notify_all();
+}
+
+//
+// Copies the protected password for dwSequence into pwzProtected, which holds cchMax
+// characters, waiting up to dwTimeoutMs for it if it's still being worked on. Returns
+// S_FALSE if there's nothing for that push (or it doesn't arrive in time), in which case
+// the caller should protect the password itself.
+//
+HRESULT CProtectedPassword::Take(DWORD dwSequence, DWORD dwTimeoutMs, WCHAR* pwzProtected, DWORD cchMax, DWORD* pcchProtected)
+{
+    std::unique_lock<std::mutex> guard(_lock);
+    if (!_fExpected || _dwSequence != dwSequence)
+    {
+        return S_FALSE;
+    }
+
+    if (!_cvDone.wait_for(guard, std::chrono::milliseconds(dwTimeoutMs),
+            [this, dwSequence] { return _fDone || !_fExpected || _dwSequence != dwSequence; }) ||
+        !_fExpected || _dwSequence != dwSequence)
+    {
+        return S_FALSE;
+    }
+
+    if (FAILED(_hr))
+    {
+        return _hr;
+    }
+    if (_cch >= cchMax)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+    }
+
+    CopyMemory(pwzProtected, _wsz, (_cch + 1) * sizeof(WCHAR));
+    *pcchProtected = _cch;
+    return S_OK;
+}
+
+void CProtectedPassword::Clear()
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        SecureZeroMemory(_wsz, sizeof(_wsz));
+        _fExpected = FALSE;
+        _fDone = FALSE;
+        _cch = 0;
+    }
+    _cvDone.notify_all();
+}
+
+// CProtectionWorker ///////////////////////////////////////////////////////
+
+CProtectionWorker::CProtectionWorker() :
+    _pProtector(NULL), _fStopping(FALSE)
+{
+}
+
+CProtectionWorker::~CProtectionWorker()
+{
+    Stop();
+}
+
+HRESULT CProtectionWorker::Start(IPasswordProtector* pProtector)
+{
+    if (_thread.joinable())
+    {
+        return E_FAIL;
+    }
+
+    _pProtector = pProtector;
+    _fStopping = FALSE;
+    try
+    {
+        _thread = std::thread(&CProtectionWorker::_Run, this);
+    }
+    catch (...)
+    {
+        return E_OUTOFMEMORY;
+    }
+    return S_OK;
+}
+
+// Stops the thread and drops whatever it hadn't got to. Anyone waiting on those stops
+// waiting and protects the password themselves.
+void CProtectionWorker::Stop()
+{
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _fStopping = TRUE;
+    }
+    _cvWork.notify_one();
+
+    if (_thread.joinable())
+    {
+        _thread.join();
+    }
+
+    while (!_queue.empty())
+    {
+        _FreeJob(_queue.front());
+        _queue.pop_front();
+    }
+}
+
+//
+// Queues pSnapshot's password to be protected into pTarget. The caller has already
+// told pTarget to expect it. Fails, leaving the caller to protect it later itself,
+// if the worker isn't running.
+//
+HRESULT CProtectionWorker::Submit(IRosterTile* pTile, CProtectedPassword* pTarget, const CREDENTIAL_SNAPSHOT* pSnapshot)
+{
+    JOB* pJob = new (std::nothrow) JOB;
+    if (pJob == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    pTile->AddRefTile();
+    pJob->pTile = pTile;
+    pJob->pTarget = pTarget;
+    pJob->dwSequence = pSnapshot->dwSequence;
+    CopyMemory(pJob->wszPassword, pSnapshot->wszPassword, sizeof(pJob->wszPassword));
+
+    HRESULT hr = S_OK;
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        if (_fStopping || !_thread.joinable())
+        {
+            hr = E_FAIL;
+        }
+        else
+        {
+            try
+            {
+                _queue.push_back(pJob);
+            }
+            catch (...)
+            {
+                hr = E_OUTOFMEMORY;
+            }
+        }
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        _cvWork.notify_one();
+    }
+    else
+    {
+        _FreeJob(pJob);
+    }
+    return hr;
+}
+
+// Frees a job, done or not. The tile is released last, since it keeps pTarget alive.
+void CProtectionWorker::_FreeJob(JOB* pJob)
+{
+    pJob->pTarget->Abandon(pJob->dwSequence);
+    pJob->pTile->ReleaseTile();
+    SecureZeroMemory(pJob, sizeof(*pJob));
+    delete pJob;
+}
+
+void CProtectionWorker::_Run()
+{
+    WCHAR wszProtected[PROTECTED_PASSWORD_MAX];
+
+    for (;;)
+    {
+        JOB* pJob;
+        {
+            std::unique_lock<std::mutex> guard(_lock);
+            _cvWork.wait(guard, [this] { return _fStopping || !_queue.empty(); });
+            if (_fStopping)
+            {
+                break;
+            }
+            pJob = _queue.front();
+            _queue.pop_front();
+        }
+
+        // A later push for the same tile makes this one moot.
+        if (pJob->pTarget->IsExpected(pJob->dwSequence))
+        {
+            DWORD cchProtected = 0;
+            HRESULT hr = _pProtector->Protect(pJob->wszPassword, wszProtected, ARRAYSIZE(wszProtected), &cchProtected);
+            pJob->pTarget->Complete(pJob->dwSequence, hr, wszProtected, cchProtected);
+            SecureZeroMemory(wszProtected, sizeof(wszProtected));
+        }
+
+        _FreeJob(pJob);
+    }
+}
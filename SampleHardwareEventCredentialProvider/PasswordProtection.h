@@ -0,0 +1,104 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Protecting (encrypting) a password is the slowest part of packing a serialization,
+// and GetSerialization runs on LogonUI's thread, where every millisecond shows up as
+// unlock latency. So as soon as a password is pushed we hand it to a worker thread
+// to protect, and by the time LogonUI asks for the serialization the result is
+// normally waiting.
+//
+// Each tile has a CProtectedPassword that receives the result for the push it was
+// started for, identified by the credential slot's sequence number. GetSerialization
+// takes it if it's for the push it's serializing, waits a little if it's still queued
+// or being worked on, and otherwise protects the password itself as it always did. A
+// job that's dropped without being done (the worker was stopped, say) is abandoned,
+// so nobody waits for it.
+//
+// The protection itself is behind IPasswordProtector: CredProtect on Windows, anything
+// else wherever these are built without it.
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "PlatformCompat.h"
+#include "CredentialRoster.h"
+
+// Room for a protected password of the longest length we accept, and then some.
+#define PROTECTED_PASSWORD_MAX      1024
+
+// How long GetSerialization will wait for a protection that's queued or under way
+// before giving up and doing it itself.
+#define DEFAULT_PROTECTION_WAIT_MS  2000
+
+class IPasswordProtector
+{
+  public:
+    // Protects the null-terminated pwzPassword into pwzProtected, which holds cchMax
+    // characters, null-terminating it. *pcchProtected gets the length, not counting
+    // the null.
+    virtual HRESULT Protect(const WCHAR* pwzPassword, WCHAR* pwzProtected, DWORD cchMax, DWORD* pcchProtected) = 0;
+};
+
+// One tile's protected password, for the push identified by a slot sequence number.
+class CProtectedPassword
+{
+  public:
+    CProtectedPassword();
+    ~CProtectedPassword();
+
+    void Expect(DWORD dwSequence);
+    BOOL IsExpected(DWORD dwSequence);
+    void Complete(DWORD dwSequence, HRESULT hrProtect, const WCHAR* pwzProtected, DWORD cchProtected);
+    void Abandon(DWORD dwSequence);
+    HRESULT Take(DWORD dwSequence, DWORD dwTimeoutMs, WCHAR* pwzProtected, DWORD cchMax, DWORD* pcchProtected);
+    void Clear();
+
+  private:
+    std::mutex              _lock;
+    std::condition_variable _cvDone;
+    DWORD                   _dwSequence;                        // The push this is, or will be, for.
+    BOOL                    _fExpected;                         // Whether anything is on its way at all.
+    BOOL                    _fDone;                             // Whether it has arrived.
+    HRESULT                 _hr;                                // How protecting it went.
+    DWORD                   _cch;
+    WCHAR                   _wsz[PROTECTED_PASSWORD_MAX];
+};
+
+// The thread that protects pushed passwords, one at a time, in the order they arrive.
+class CProtectionWorker
+{
+  public:
+    CProtectionWorker();
+    ~CProtectionWorker();
+
+    HRESULT Start(IPasswordProtector* pProtector);
+    void Stop();
+    HRESULT Submit(IRosterTile* pTile, CProtectedPassword* pTarget, const CREDENTIAL_SNAPSHOT* pSnapshot);
+
+  private:
+    struct JOB
+    {
+        IRosterTile         *pTile;         // Referenced, to keep pTarget alive.
+        CProtectedPassword  *pTarget;
+        DWORD               dwSequence;
+        WCHAR               wszPassword[SLOT_FIELD_WORDS * 2];
+    };
+
+    void _Run();
+    static void _FreeJob(JOB* pJob);
+
+    IPasswordProtector      *_pProtector;
+    std::thread             _thread;
+    std::mutex              _lock;
+    std::condition_variable _cvWork;
+    std::deque<JOB*>        _queue;
+    BOOL                    _fStopping;
+};
@@ -0,0 +1,106 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// The handful of Win32 types and macros that the platform-neutral parts of the
+// provider (the credential listener and friends) are written against. On Windows
+// this is just windows.h; elsewhere we supply minimal equivalents so the same
+// code builds on POSIX systems.
+
+#pragma once
+
+#ifdef _WIN32
+
+#include <windows.h>
+
+// A socket handle, without having to include winsock2.h in our headers.
+typedef UINT_PTR socket_t;
+#define INVALID_SOCKET_T ((socket_t)(~0))
+
+#else
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef int32_t         HRESULT;
+typedef int             BOOL;
+typedef uint8_t         BYTE;
+typedef uint16_t        USHORT;
+typedef uint32_t        DWORD;
+typedef uint32_t        ULONG;
+typedef int32_t         LONG;
+typedef uintptr_t       UINT_PTR;
+typedef uint64_t        ULONGLONG;
+
+// Windows strings are UTF-16 whatever the compiler's wchar_t is.
+typedef char16_t        WCHAR;
+
+#define TRUE            1
+#define FALSE           0
+
+#define S_OK            ((HRESULT)0)
+#define S_FALSE         ((HRESULT)1)
+#define E_FAIL          ((HRESULT)0x80004005)
+#define E_INVALIDARG    ((HRESULT)0x80070057)
+#define E_OUTOFMEMORY   ((HRESULT)0x8007000E)
+#define E_NOTIMPL       ((HRESULT)0x80004001)
+#define E_UNEXPECTED    ((HRESULT)0x8000FFFF)
+
+#define SUCCEEDED(hr)   (((HRESULT)(hr)) >= 0)
+#define FAILED(hr)      (((HRESULT)(hr)) < 0)
+
+#define ERROR_INVALID_DATA          13L
+#define ERROR_INSUFFICIENT_BUFFER   122L
+#define ERROR_BUSY                  170L
+#define ERROR_ARITHMETIC_OVERFLOW   534L
+#define ERROR_NO_UNICODE_TRANSLATION 1113L
+#define ERROR_NOT_FOUND             1168L
+#define ERROR_CONNECTION_ABORTED    1236L
+#define ERROR_TIMEOUT               1460L
+
+#define HRESULT_FROM_WIN32(x) \
+    ((HRESULT)(x) <= 0 ? ((HRESULT)(x)) : ((HRESULT)(((x) & 0x0000FFFF) | (7 << 16) | 0x80000000)))
+
+#define MAX_PATH        260
+
+#define ARRAYSIZE(a)    (sizeof(a) / sizeof((a)[0]))
+
+#define ZeroMemory(p, cb)   memset((p), 0, (cb))
+#define CopyMemory(d, s, cb) memcpy((d), (s), (cb))
+
+// Unlike memset, writes through a volatile pointer can't be optimized away.
+inline void* SecureZeroMemory(void* pv, size_t cb)
+{
+    volatile BYTE* pb = (volatile BYTE*)pv;
+    while (cb--)
+    {
+        *pb++ = 0;
+    }
+    return pv;
+}
+
+#define UNREFERENCED_PARAMETER(p) ((void)(p))
+
+// Buffers we hand to LogonUI come from the COM allocator; elsewhere the C heap will do.
+#define CoTaskMemAlloc(cb)  malloc(cb)
+#define CoTaskMemFree(pv)   free(pv)
+
+// Milliseconds since some fixed point in the past, from a clock that never goes back.
+inline ULONGLONG GetTickCount64()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ULONGLONG)ts.tv_sec * 1000 + (ULONGLONG)ts.tv_nsec / 1000000;
+}
+
+typedef int socket_t;
+#define INVALID_SOCKET_T ((socket_t)(-1))
+
+#endif
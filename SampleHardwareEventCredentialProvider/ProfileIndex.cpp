@@ -0,0 +1,316 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+
+#include "ProfileIndex.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The table is grown whenever it would become more than half full, which keeps probe
+// sequences short.
+#define MIN_SLOTS 16
+
+// Replaced records aren't compacted away until they add up to at least this much, so
+// a small pool isn't copied over and over.
+#define MIN_COMPACT_WASTE 4096
+
+// A record's bytes in the pool.
+#define RECORD_SIZE(pSlot) ((DWORD)(pSlot)->cbId + (pSlot)->cbUser + (pSlot)->cbPassword)
+
+CProfileIndex::CProfileIndex()
+{
+    _rgSlots = NULL;
+    _cSlots = 0;
+    _cRecords = 0;
+    _pchPool = NULL;
+    _cbPool = 0;
+    _cbPoolAlloc = 0;
+    _cbWasted = 0;
+}
+
+CProfileIndex::~CProfileIndex()
+{
+    Clear();
+}
+
+DWORD CProfileIndex::GetCount()
+{
+    return _cRecords;
+}
+
+// How many bytes of the pool are in use, including any left by replaced records.
+DWORD CProfileIndex::GetPoolSize()
+{
+    return _cbPool;
+}
+
+// Frees everything. The pool holds passwords, so it's wiped first.
+void CProfileIndex::Clear()
+{
+    if (_pchPool != NULL)
+    {
+        SecureZeroMemory(_pchPool, _cbPoolAlloc);
+        free(_pchPool);
+        _pchPool = NULL;
+    }
+    _cbPool = 0;
+    _cbPoolAlloc = 0;
+    _cbWasted = 0;
+
+    free(_rgSlots);
+    _rgSlots = NULL;
+    _cSlots = 0;
+    _cRecords = 0;
+}
+
+// FNV-1a. Zero is reserved to mark empty slots, so it's remapped.
+DWORD CProfileIndex::_Hash(const char* pch, size_t cch)
+{
+    DWORD dwHash = 2166136261u;
+    for (size_t i = 0; i < cch; i++)
+    {
+        dwHash ^= (BYTE)pch[i];
+        dwHash *= 16777619u;
+    }
+    return (dwHash != 0) ? dwHash : 1;
+}
+
+// Returns the slot holding pchId, or the empty slot where it would go.
+PROFILE_INDEX_SLOT* CProfileIndex::_Find(const char* pchId, size_t cchId, DWORD dwHash)
+{
+    DWORD dwMask = _cSlots - 1;
+    for (DWORD i = dwHash & dwMask; ; i = (i + 1) & dwMask)
+    {
+        PROFILE_INDEX_SLOT* pSlot = &_rgSlots[i];
+        if (pSlot->dwHash == 0 ||
+            (pSlot->dwHash == dwHash &&
+             pSlot->cbId == cchId &&
+             memcmp(_pchPool + pSlot->ibRecord, pchId, cchId) == 0))
+        {
+            return pSlot;
+        }
+    }
+}
+
+// Rehashes into a table of cSlots slots, which must be a power of two larger than
+// twice the record count.
+HRESULT CProfileIndex::_Grow(DWORD cSlots)
+{
+    PROFILE_INDEX_SLOT* rgNew = (PROFILE_INDEX_SLOT*)calloc(cSlots, sizeof(PROFILE_INDEX_SLOT));
+    if (rgNew == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    DWORD dwMask = cSlots - 1;
+    for (DWORD i = 0; i < _cSlots; i++)
+    {
+        if (_rgSlots[i].dwHash != 0)
+        {
+            DWORD j = _rgSlots[i].dwHash & dwMask;
+            while (rgNew[j].dwHash != 0)
+            {
+                j = (j + 1) & dwMask;
+            }
+            rgNew[j] = _rgSlots[i];
+        }
+    }
+
+    free(_rgSlots);
+    _rgSlots = rgNew;
+    _cSlots = cSlots;
+    return S_OK;
+}
+
+// Sizes the table for cRecords records up front, so loading a known number of rows
+// never has to rehash.
+HRESULT CProfileIndex::Reserve(DWORD cRecords)
+{
+    DWORD cSlots = MIN_SLOTS;
+    while (cSlots < cRecords * 2)
+    {
+        if (cSlots >= 0x40000000)
+        {
+            return HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW);
+        }
+        cSlots *= 2;
+    }
+    return (cSlots > _cSlots) ? _Grow(cSlots) : S_OK;
+}
+
+HRESULT CProfileIndex::_AppendToPool(const char* pch, size_t cch)
+{
+    if (_cbPool + cch > _cbPoolAlloc)
+    {
+        size_t cbAlloc = _cbPoolAlloc ? (size_t)_cbPoolAlloc * 2 : 4096;
+        while (cbAlloc < _cbPool + cch)
+        {
+            cbAlloc *= 2;
+        }
+        if (cbAlloc > 0xFFFFFFFF)
+        {
+            return HRESULT_FROM_WIN32(ERROR_ARITHMETIC_OVERFLOW);
+        }
+
+        // realloc would leave passwords behind in the old block, so copy by hand.
+        char* pchNew = (char*)malloc(cbAlloc);
+        if (pchNew == NULL)
+        {
+            return E_OUTOFMEMORY;
+        }
+        if (_pchPool != NULL)
+        {
+            CopyMemory(pchNew, _pchPool, _cbPool);
+            SecureZeroMemory(_pchPool, _cbPoolAlloc);
+            free(_pchPool);
+        }
+        _pchPool = pchNew;
+        _cbPoolAlloc = (DWORD)cbAlloc;
+    }
+
+    CopyMemory(_pchPool + _cbPool, pch, cch);
+    _cbPool += (DWORD)cch;
+    return S_OK;
+}
+
+// Copies every live record into a pool of its own size, in slot order, dropping the
+// space left by replaced ones. Leaves things as they were if there's no memory for it.
+void CProfileIndex::_Compact()
+{
+    DWORD cbLive = _cbPool - _cbWasted;
+    char* pchNew = (char*)malloc(cbLive ? cbLive : 1);
+    if (pchNew == NULL)
+    {
+        return;
+    }
+
+    DWORD ibNext = 0;
+    for (DWORD i = 0; i < _cSlots; i++)
+    {
+        PROFILE_INDEX_SLOT* pSlot = &_rgSlots[i];
+        if (pSlot->dwHash != 0)
+        {
+            CopyMemory(pchNew + ibNext, _pchPool + pSlot->ibRecord, RECORD_SIZE(pSlot));
+            pSlot->ibRecord = ibNext;
+            ibNext += RECORD_SIZE(pSlot);
+        }
+    }
+
+    SecureZeroMemory(_pchPool, _cbPoolAlloc);
+    free(_pchPool);
+    _pchPool = pchNew;
+    _cbPool = ibNext;
+    _cbPoolAlloc = cbLive ? cbLive : 1;
+    _cbWasted = 0;
+}
+
+//
+// Adds a profile, replacing any existing one with the same id.
+//
+HRESULT CProfileIndex::Add(const char* pchId, size_t cchId, const char* pszUser, const char* pszPassword)
+{
+    size_t cbUser = strlen(pszUser);
+    size_t cbPassword = strlen(pszPassword);
+    if (cchId > 0xFFFF || cbUser > PROFILE_MAX_FIELD || cbPassword > PROFILE_MAX_FIELD)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+    }
+
+    HRESULT hr = S_OK;
+    if ((_cRecords + 1) * 2 > _cSlots)
+    {
+        hr = _Grow(_cSlots ? _cSlots * 2 : MIN_SLOTS);
+    }
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    DWORD dwHash = _Hash(pchId, cchId);
+    PROFILE_INDEX_SLOT* pSlot = _Find(pchId, cchId, dwHash);
+    DWORD cbRecord = (DWORD)(cchId + cbUser + cbPassword);
+    if (pSlot->dwHash != 0 && cbRecord <= RECORD_SIZE(pSlot))
+    {
+        // The id is already there; write the fields over the old ones and wipe what's
+        // left of them.
+        char* pch = _pchPool + pSlot->ibRecord + cchId;
+        DWORD cbOld = RECORD_SIZE(pSlot);
+        CopyMemory(pch, pszUser, cbUser);
+        CopyMemory(pch + cbUser, pszPassword, cbPassword);
+        SecureZeroMemory(pch + cbUser + cbPassword, cbOld - cbRecord);
+        _cbWasted += cbOld - cbRecord;
+    }
+    else
+    {
+        DWORD ibRecord = _cbPool;
+        hr = _AppendToPool(pchId, cchId);
+        if (SUCCEEDED(hr))
+        {
+            hr = _AppendToPool(pszUser, cbUser);
+        }
+        if (SUCCEEDED(hr))
+        {
+            hr = _AppendToPool(pszPassword, cbPassword);
+        }
+        if (FAILED(hr))
+        {
+            SecureZeroMemory(_pchPool + ibRecord, _cbPool - ibRecord);
+            _cbPool = ibRecord;
+            return hr;
+        }
+
+        if (pSlot->dwHash == 0)
+        {
+            _cRecords++;
+        }
+        else
+        {
+            SecureZeroMemory(_pchPool + pSlot->ibRecord, RECORD_SIZE(pSlot));
+            _cbWasted += RECORD_SIZE(pSlot);
+        }
+        pSlot->dwHash = dwHash;
+        pSlot->ibRecord = ibRecord;
+        pSlot->cbId = (USHORT)cchId;
+    }
+    pSlot->cbUser = (BYTE)cbUser;
+    pSlot->cbPassword = (BYTE)cbPassword;
+
+    if (_cbWasted >= MIN_COMPACT_WASTE && _cbWasted >= _cbPool - _cbWasted)
+    {
+        _Compact();
+    }
+    return S_OK;
+}
+
+//
+// Same contract as CCredentialStore::Lookup: S_OK with pRecord filled in, or
+// HRESULT_FROM_WIN32(ERROR_NOT_FOUND).
+//
+HRESULT CProfileIndex::Lookup(const char* pchId, size_t cchId, PROFILE_RECORD* pRecord)
+{
+    if (_cRecords == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+
+    PROFILE_INDEX_SLOT* pSlot = _Find(pchId, cchId, _Hash(pchId, cchId));
+    if (pSlot->dwHash == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_NOT_FOUND);
+    }
+
+    const char* pch = _pchPool + pSlot->ibRecord + pSlot->cbId;
+    CopyMemory(pRecord->szUser, pch, pSlot->cbUser);
+    pRecord->szUser[pSlot->cbUser] = '\0';
+    pch += pSlot->cbUser;
+    CopyMemory(pRecord->szPassword, pch, pSlot->cbPassword);
+    pRecord->szPassword[pSlot->cbPassword] = '\0';
+
+    return S_OK;
+}
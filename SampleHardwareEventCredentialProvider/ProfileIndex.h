@@ -0,0 +1,94 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// CProfileIndex is an in-memory copy of the profile table, keyed on id. It is
+// an open-addressing hash table with linear probing: each slot holds the key's
+// hash and the offset of its record in a single string pool, so a lookup is
+// usually one probe into a small array plus one memcmp.
+//
+// Replacing a profile wipes its old record. A new record no longer than the old one
+// is written over it; a longer one is appended, and the old bytes left as waste until
+// there's as much waste as live data, when the pool is compacted.
+
+#pragma once
+
+#include "PlatformCompat.h"
+
+// The longest username or password we'll hand back, not counting the terminator.
+#define PROFILE_MAX_FIELD 49
+
+// The result of a successful lookup. The caller owns it, and should wipe it with
+// SecureZeroMemory once the password has been used.
+struct PROFILE_RECORD
+{
+    char    szUser[PROFILE_MAX_FIELD + 1];
+    char    szPassword[PROFILE_MAX_FIELD + 1];
+};
+
+// Anything that can resolve a badge/profile id to an account. Lookup returns S_OK and
+// fills in pRecord if the id exists, or HRESULT_FROM_WIN32(ERROR_NOT_FOUND) if not.
+class IProfileSource
+{
+  public:
+    virtual ~IProfileSource() {}
+    virtual HRESULT Lookup(const char* pchId, size_t cchId, PROFILE_RECORD* pRecord) = 0;
+};
+
+// One profile to add or replace, as provisioned by a sender. None of the strings are
+// null-terminated.
+struct PROFILE_UPDATE
+{
+    const char  *pchId;
+    USHORT      cchId;
+    const char  *pchUser;
+    USHORT      cchUser;
+    const char  *pchPassword;
+    USHORT      cchPassword;
+};
+
+// Called once per profile by CCredentialStore::EnumerateProfiles. The id is not
+// null-terminated. Returning a failure stops the enumeration.
+typedef HRESULT (*PFN_PROFILE_CALLBACK)(void* pv, const char* pchId, size_t cchId, const char* pszUser, const char* pszPassword);
+
+struct PROFILE_INDEX_SLOT
+{
+    DWORD   dwHash;         // Hash of the id. Zero marks an empty slot.
+    DWORD   ibRecord;       // Offset of the record in the pool: id, username, password.
+    USHORT  cbId;           // Length of the id.
+    BYTE    cbUser;         // Length of the username.
+    BYTE    cbPassword;     // Length of the password.
+};
+
+class CProfileIndex
+{
+  public:
+    CProfileIndex();
+    ~CProfileIndex();
+
+    HRESULT Reserve(DWORD cRecords);
+    HRESULT Add(const char* pchId, size_t cchId, const char* pszUser, const char* pszPassword);
+    HRESULT Lookup(const char* pchId, size_t cchId, PROFILE_RECORD* pRecord);
+    void Clear();
+    DWORD GetCount();
+    DWORD GetPoolSize();
+
+  private:
+    static DWORD _Hash(const char* pch, size_t cch);
+    PROFILE_INDEX_SLOT* _Find(const char* pchId, size_t cchId, DWORD dwHash);
+    HRESULT _Grow(DWORD cSlots);
+    HRESULT _AppendToPool(const char* pch, size_t cch);
+    void _Compact();
+
+    PROFILE_INDEX_SLOT  *_rgSlots;      // The hash table. Its size is a power of two.
+    DWORD               _cSlots;        // Number of slots in _rgSlots.
+    DWORD               _cRecords;      // Number of occupied slots.
+    char                *_pchPool;      // Every id, username and password, back to back.
+    DWORD               _cbPool;        // Number of bytes used in _pchPool.
+    DWORD               _cbPoolAlloc;   // Size of _pchPool.
+    DWORD               _cbWasted;      // Bytes of _cbPool left behind by replaced records.
+};
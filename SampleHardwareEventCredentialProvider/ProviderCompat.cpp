@@ -0,0 +1,317 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// The functions ProviderCompat.h declares for platforms other than Windows. See there
+// for how far they go.
+
+#include "ProviderCompat.h"
+
+#ifndef _WIN32
+
+#include <new>
+#include <pthread.h>
+#include <unistd.h>
+
+// The same IIDs as the SDK's.
+const IID IID_IUnknown =
+    { 0x00000000, 0x0000, 0x0000, { 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
+const IID IID_IClassFactory =
+    { 0x00000001, 0x0000, 0x0000, { 0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46 } };
+const IID IID_ICredentialProvider =
+    { 0xd27c3481, 0x5a1c, 0x45b2, { 0x8a, 0xaa, 0xc2, 0x0e, 0xbb, 0xe8, 0x22, 0x9e } };
+const IID IID_ICredentialProviderCredential =
+    { 0x63913a93, 0x40c1, 0x481a, { 0x81, 0x8d, 0x40, 0x72, 0xff, 0x8c, 0x70, 0xcc } };
+const IID IID_ICredentialProviderEvents =
+    { 0x34201e5a, 0xa787, 0x41a3, { 0xa5, 0xa4, 0xbd, 0x6d, 0xcf, 0x2a, 0x85, 0x4e } };
+const IID IID_ICredentialProviderCredentialEvents =
+    { 0xfa6fa76b, 0x66b7, 0x4b11, { 0x95, 0xf1, 0x86, 0x17, 0x11, 0x18, 0xe8, 0x16 } };
+
+// What LsaLookupAuthenticationPackage hands out for Negotiate.
+#define NEGOTIATE_PACKAGE_ID    0x4E45474F
+
+// CredProtectW's output starts with this, as the real thing's does, followed by four
+// hex digits for each character of the input.
+static const WCHAR c_wszProtectedPrefix[] = { '@', '@', 'D', 0 };
+#define PROTECTED_PREFIX_LENGTH 3
+
+static thread_local DWORD t_dwLastError = ERROR_SUCCESS;
+
+DWORD GetLastError()
+{
+    return t_dwLastError;
+}
+
+void SetLastError(DWORD dwErrCode)
+{
+    t_dwLastError = dwErrCode;
+}
+
+HRESULT SHStrDupW(LPCWSTR pwz, LPWSTR* ppwz)
+{
+    if (ppwz == NULL)
+    {
+        return E_INVALIDARG;
+    }
+    *ppwz = NULL;
+    if (pwz == NULL)
+    {
+        return E_INVALIDARG;
+    }
+
+    size_t cb = (wcslen(pwz) + 1) * sizeof(WCHAR);
+    *ppwz = (LPWSTR)CoTaskMemAlloc(cb);
+    if (*ppwz == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    CopyMemory(*ppwz, pwz, cb);
+    return S_OK;
+}
+
+// Threads /////////////////////////////////////////////////////////////////////////////
+
+// What a HANDLE from CreateThread points to.
+struct THREAD_HANDLE
+{
+    pthread_t               thread;
+    LPTHREAD_START_ROUTINE  pfnStart;
+    LPVOID                  pvParameter;
+    BOOL                    fJoined;
+};
+
+static void* _ThreadStart(void* pv)
+{
+    THREAD_HANDLE* pth = static_cast<THREAD_HANDLE*>(pv);
+    pth->pfnStart(pth->pvParameter);
+    return NULL;
+}
+
+HANDLE CreateThread(void* lpThreadAttributes, size_t dwStackSize, LPTHREAD_START_ROUTINE lpStartAddress,
+    LPVOID lpParameter, DWORD dwCreationFlags, LPDWORD lpThreadId)
+{
+    UNREFERENCED_PARAMETER(lpThreadAttributes);
+    UNREFERENCED_PARAMETER(dwStackSize);
+
+    // Nothing we create can be started suspended.
+    if (lpStartAddress == NULL || dwCreationFlags != 0)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return NULL;
+    }
+
+    THREAD_HANDLE* pth = new (std::nothrow) THREAD_HANDLE;
+    if (pth == NULL)
+    {
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+    pth->pfnStart = lpStartAddress;
+    pth->pvParameter = lpParameter;
+    pth->fJoined = FALSE;
+
+    int err = pthread_create(&pth->thread, NULL, _ThreadStart, pth);
+    if (err != 0)
+    {
+        delete pth;
+        SetLastError(ERROR_NOT_ENOUGH_MEMORY);
+        return NULL;
+    }
+
+    if (lpThreadId != NULL)
+    {
+        *lpThreadId = 0;
+    }
+    return pth;
+}
+
+DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds)
+{
+    THREAD_HANDLE* pth = static_cast<THREAD_HANDLE*>(hHandle);
+    if (pth == NULL || dwMilliseconds != INFINITE)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return WAIT_FAILED;
+    }
+
+    if (!pth->fJoined)
+    {
+        int err = pthread_join(pth->thread, NULL);
+        if (err != 0)
+        {
+            SetLastError(ERROR_INVALID_HANDLE);
+            return WAIT_FAILED;
+        }
+        pth->fJoined = TRUE;
+    }
+    return WAIT_OBJECT_0;
+}
+
+BOOL CloseHandle(HANDLE hObject)
+{
+    THREAD_HANDLE* pth = static_cast<THREAD_HANDLE*>(hObject);
+    if (pth == NULL)
+    {
+        SetLastError(ERROR_INVALID_HANDLE);
+        return FALSE;
+    }
+
+    // A thread that's still running carries on without its handle, as on Windows.
+    if (!pth->fJoined)
+    {
+        pthread_detach(pth->thread);
+    }
+    delete pth;
+    return TRUE;
+}
+
+// The rest of the system /////////////////////////////////////////////////////////////
+
+BOOL GetComputerNameW(LPWSTR pwzBuffer, LPDWORD pnSize)
+{
+    char szHost[256];
+    if (gethostname(szHost, sizeof(szHost)) != 0)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+    szHost[sizeof(szHost) - 1] = '\0';
+
+    // NetBIOS names are upper case and at most MAX_COMPUTERNAME_LENGTH long.
+    DWORD cch = 0;
+    while (cch < MAX_COMPUTERNAME_LENGTH && szHost[cch] != '\0' && szHost[cch] != '.')
+    {
+        cch++;
+    }
+
+    if (*pnSize <= cch)
+    {
+        *pnSize = cch + 1;
+        SetLastError(ERROR_BUFFER_OVERFLOW);
+        return FALSE;
+    }
+
+    for (DWORD i = 0; i < cch; i++)
+    {
+        char ch = szHost[i];
+        pwzBuffer[i] = (WCHAR)((ch >= 'a' && ch <= 'z') ? ch - 'a' + 'A' : ch);
+    }
+    pwzBuffer[cch] = 0;
+    *pnSize = cch;
+    return TRUE;
+}
+
+HBITMAP LoadBitmap(HINSTANCE hInstance, LPCSTR pszBitmapName)
+{
+    UNREFERENCED_PARAMETER(hInstance);
+    UNREFERENCED_PARAMETER(pszBitmapName);
+    SetLastError(ERROR_RESOURCE_DATA_NOT_FOUND);
+    return NULL;
+}
+
+LSTATUS RegGetValueA(HKEY hkey, LPCSTR pszSubKey, LPCSTR pszValue, DWORD dwFlags, LPDWORD pdwType,
+    PVOID pvData, LPDWORD pcbData)
+{
+    UNREFERENCED_PARAMETER(hkey);
+    UNREFERENCED_PARAMETER(pszSubKey);
+    UNREFERENCED_PARAMETER(pszValue);
+    UNREFERENCED_PARAMETER(dwFlags);
+    UNREFERENCED_PARAMETER(pdwType);
+    UNREFERENCED_PARAMETER(pvData);
+    UNREFERENCED_PARAMETER(pcbData);
+    return ERROR_FILE_NOT_FOUND;
+}
+
+// LSA /////////////////////////////////////////////////////////////////////////////////
+
+NTSTATUS LsaConnectUntrusted(HANDLE* phLsa)
+{
+    // Anything but NULL; it's never looked at.
+    static int s_lsa;
+    *phLsa = &s_lsa;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS LsaLookupAuthenticationPackage(HANDLE hLsa, PLSA_STRING pPackageName, ULONG* pulAuthenticationPackage)
+{
+    UNREFERENCED_PARAMETER(hLsa);
+    UNREFERENCED_PARAMETER(pPackageName);
+    *pulAuthenticationPackage = NEGOTIATE_PACKAGE_ID;
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS LsaDeregisterLogonProcess(HANDLE hLsa)
+{
+    UNREFERENCED_PARAMETER(hLsa);
+    return STATUS_SUCCESS;
+}
+
+// Marks pwzCredentials as protected without actually encrypting it, so the output has
+// the length and shape callers have to cope with but can be read back in a test.
+// cchCredentials includes the null, as does what we put in *pcchMaxChars.
+BOOL CredProtectW(BOOL fAsSelf, LPWSTR pwzCredentials, DWORD cchCredentials, LPWSTR pwzProtectedCredentials,
+    DWORD* pcchMaxChars, CRED_PROTECTION_TYPE* pProtectionType)
+{
+    UNREFERENCED_PARAMETER(fAsSelf);
+    if (pwzCredentials == NULL || cchCredentials == 0 || pcchMaxChars == NULL)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    DWORD cchInput = cchCredentials - 1;
+    DWORD cchNeeded = PROTECTED_PREFIX_LENGTH + cchInput * 4 + 1;
+    if (pwzProtectedCredentials == NULL || *pcchMaxChars < cchNeeded)
+    {
+        *pcchMaxChars = cchNeeded;
+        SetLastError(ERROR_INSUFFICIENT_BUFFER);
+        return FALSE;
+    }
+
+    static const char c_szHex[] = "0123456789ABCDEF";
+    CopyMemory(pwzProtectedCredentials, c_wszProtectedPrefix, PROTECTED_PREFIX_LENGTH * sizeof(WCHAR));
+    WCHAR* pwzOut = pwzProtectedCredentials + PROTECTED_PREFIX_LENGTH;
+    for (DWORD i = 0; i < cchInput; i++)
+    {
+        WCHAR wch = pwzCredentials[i];
+        for (int iShift = 12; iShift >= 0; iShift -= 4)
+        {
+            *pwzOut++ = (WCHAR)c_szHex[(wch >> iShift) & 0xF];
+        }
+    }
+    *pwzOut = 0;
+
+    *pcchMaxChars = cchNeeded;
+    if (pProtectionType != NULL)
+    {
+        *pProtectionType = CredUserProtection;
+    }
+    return TRUE;
+}
+
+BOOL CredIsProtectedW(LPWSTR pwzProtectedCredentials, CRED_PROTECTION_TYPE* pProtectionType)
+{
+    if (pwzProtectedCredentials == NULL || pProtectionType == NULL)
+    {
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return FALSE;
+    }
+
+    BOOL fProtected = TRUE;
+    for (DWORD i = 0; i < PROTECTED_PREFIX_LENGTH; i++)
+    {
+        if (pwzProtectedCredentials[i] != c_wszProtectedPrefix[i])
+        {
+            fProtected = FALSE;
+            break;
+        }
+    }
+    *pProtectionType = fProtected ? CredUserProtection : CredUnprotected;
+    return TRUE;
+}
+
+#endif
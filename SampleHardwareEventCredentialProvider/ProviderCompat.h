@@ -0,0 +1,498 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// The COM, credential provider and Win32 declarations that the provider classes
+// themselves (CSampleProvider, CSampleCredential, CMessageCredential and the helpers)
+// are written against. On Windows these are the SDK headers. Elsewhere we declare
+// just enough of them, with the SDK's layouts, values and IIDs, for the real
+// classes to build into a test host, where they can be driven through their
+// interfaces under a profiler or the sanitizers. ProviderCompat.cpp supplies the
+// functions.
+//
+// Nothing outside the system is there to stand behind these on other platforms, so:
+//
+//  - CredProtectW only marks the password as protected; it doesn't encrypt it.
+//  - The LSA calls succeed and name a made-up Negotiate package.
+//  - There's no registry; RegGetValueA finds nothing.
+//  - There are no resources; LoadBitmap fails.
+//  - CreateThread's handles can only be waited on forever, and by one thread.
+//
+// Strings handed to LogonUI are UTF-16 whatever the compiler's wchar_t is, so wide
+// literals in the provider are written UTF16("...") rather than L"...".
+
+#pragma once
+
+#include "PlatformCompat.h"
+
+#ifdef _WIN32
+
+#include <credentialprovider.h>
+#include <ntsecapi.h>
+#define SECURITY_WIN32
+#include <security.h>
+#include <intsafe.h>
+#include <strsafe.h>
+#include <unknwn.h>
+#include <shlguid.h>
+#include <wincred.h>
+
+#pragma warning(push)
+#pragma warning(disable : 4995)
+#include <shlwapi.h>
+#pragma warning(pop)
+
+#define UTF16(s)        L##s
+
+#else
+
+#include <string.h>
+
+#define UTF16(s)        ((WCHAR*)u##s)
+
+typedef char            CHAR;
+typedef CHAR            *PCHAR, *PSTR, *LPSTR;
+typedef const CHAR      *PCSTR, *LPCSTR;
+typedef WCHAR           *PWSTR, *LPWSTR;
+typedef const WCHAR     *PCWSTR, *LPCWSTR;
+typedef void            *PVOID, *LPVOID;
+typedef DWORD           *LPDWORD;
+typedef unsigned int    UINT;
+typedef LONG            NTSTATUS;
+typedef LONG            LSTATUS;
+typedef uintptr_t       ULONG_PTR;
+
+typedef void            *HANDLE;
+typedef struct HINSTANCE__  *HINSTANCE;
+typedef struct HBITMAP__    *HBITMAP;
+typedef struct HKEY__       *HKEY;
+typedef struct HWND__       *HWND;
+
+// Calling conventions and SAL annotations mean nothing here. (The older __in and __out
+// spellings can't be defined away: the C++ library uses them as names.)
+#define WINAPI
+#define CALLBACK
+#define STDMETHODCALLTYPE
+#define _In_
+#define _Out_
+#define _Outptr_
+#define __override
+
+#define STDMETHOD(method)           virtual HRESULT STDMETHODCALLTYPE method
+#define STDMETHOD_(type, method)    virtual type STDMETHODCALLTYPE method
+#define STDMETHODIMP                HRESULT STDMETHODCALLTYPE
+#define IFACEMETHODIMP              __override STDMETHODIMP
+#define STDAPI                      extern "C" HRESULT STDMETHODCALLTYPE
+#define PURE                        = 0
+
+#define E_NOINTERFACE               ((HRESULT)0x80004002)
+#define CLASS_E_NOAGGREGATION       ((HRESULT)0x80040110)
+#define CLASS_E_CLASSNOTAVAILABLE   ((HRESULT)0x80040111)
+
+#define ERROR_SUCCESS               0L
+#define ERROR_FILE_NOT_FOUND        2L
+#define ERROR_INVALID_HANDLE        6L
+#define ERROR_NOT_ENOUGH_MEMORY     8L
+#define ERROR_INVALID_PARAMETER     87L
+#define ERROR_BUFFER_OVERFLOW       111L
+#define ERROR_RESOURCE_DATA_NOT_FOUND 1812L
+
+// NTSTATUS values, as in ntstatus.h.
+#define STATUS_SUCCESS              ((NTSTATUS)0x00000000L)
+#define STATUS_LOGON_FAILURE        ((NTSTATUS)0xC000006DL)
+#define STATUS_ACCOUNT_RESTRICTION  ((NTSTATUS)0xC000006EL)
+#define STATUS_ACCOUNT_DISABLED     ((NTSTATUS)0xC0000072L)
+
+#define FACILITY_NT_BIT             0x10000000
+#define HRESULT_FROM_NT(x)          ((HRESULT)((x) | FACILITY_NT_BIT))
+
+// GUIDs //////////////////////////////////////////////////////////////////////////////
+
+struct GUID
+{
+    DWORD   Data1;
+    USHORT  Data2;
+    USHORT  Data3;
+    BYTE    Data4[8];
+};
+
+typedef GUID IID;
+typedef GUID CLSID;
+typedef const GUID& REFGUID;
+typedef const IID& REFIID;
+typedef const CLSID& REFCLSID;
+
+inline bool operator==(REFGUID guidA, REFGUID guidB)
+{
+    return memcmp(&guidA, &guidB, sizeof(GUID)) == 0;
+}
+
+inline bool operator!=(REFGUID guidA, REFGUID guidB)
+{
+    return !(guidA == guidB);
+}
+
+// As with initguid.h, DEFINE_GUID defines the GUID in the one file that defines
+// INITGUID before including us, and only declares it everywhere else.
+#ifdef INITGUID
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    extern const GUID name = { l, w1, w2, { b1, b2, b3, b4, b5, b6, b7, b8 } }
+#else
+#define DEFINE_GUID(name, l, w1, w2, b1, b2, b3, b4, b5, b6, b7, b8) \
+    extern const GUID name
+#endif
+
+// Strings ////////////////////////////////////////////////////////////////////////////
+
+#define USHORT_MAX                      0xFFFF
+#define USHORT_ERROR                    USHORT_MAX
+#define INTSAFE_E_ARITHMETIC_OVERFLOW   ((HRESULT)0x80070216L)
+
+#define STRSAFE_MAX_CCH                 2147483647
+#define STRSAFE_E_INVALID_PARAMETER     ((HRESULT)0x80070057L)
+
+inline HRESULT SizeTToUShort(size_t cb, USHORT* pus)
+{
+    if (cb > USHORT_MAX)
+    {
+        *pus = USHORT_ERROR;
+        return INTSAFE_E_ARITHMETIC_OVERFLOW;
+    }
+    *pus = (USHORT)cb;
+    return S_OK;
+}
+
+inline HRESULT UShortMult(USHORT usMultiplicand, USHORT usMultiplier, USHORT* pusResult)
+{
+    return SizeTToUShort((size_t)usMultiplicand * usMultiplier, pusResult);
+}
+
+// Counts the characters before the null, failing if there isn't one in the first cchMax.
+template <typename TChar>
+inline HRESULT _StringCchLength(const TChar* psz, size_t cchMax, size_t* pcch)
+{
+    if (psz == NULL || cchMax > STRSAFE_MAX_CCH)
+    {
+        if (pcch != NULL)
+        {
+            *pcch = 0;
+        }
+        return STRSAFE_E_INVALID_PARAMETER;
+    }
+
+    size_t cch = 0;
+    while (cch < cchMax && psz[cch] != 0)
+    {
+        cch++;
+    }
+
+    HRESULT hr = (cch < cchMax) ? S_OK : STRSAFE_E_INVALID_PARAMETER;
+    if (pcch != NULL)
+    {
+        *pcch = SUCCEEDED(hr) ? cch : 0;
+    }
+    return hr;
+}
+
+inline HRESULT StringCchLengthA(PCSTR psz, size_t cchMax, size_t* pcch)
+{
+    return _StringCchLength(psz, cchMax, pcch);
+}
+
+inline HRESULT StringCchLengthW(PCWSTR psz, size_t cchMax, size_t* pcch)
+{
+    return _StringCchLength(psz, cchMax, pcch);
+}
+
+// We're built without UNICODE, as on Windows.
+#define StringCchLength StringCchLengthA
+
+// The C library's wcslen counts its own wchar_t, which isn't UTF-16 here. This
+// overload is the one that's picked for WCHARs.
+inline size_t wcslen(const WCHAR* pwz)
+{
+    size_t cch = 0;
+    while (pwz[cch] != 0)
+    {
+        cch++;
+    }
+    return cch;
+}
+
+// Copies pwz into a string allocated with CoTaskMemAlloc.
+HRESULT SHStrDupW(LPCWSTR pwz, LPWSTR* ppwz);
+
+// Threads and the like ///////////////////////////////////////////////////////////////
+
+#define INFINITE        0xFFFFFFFF
+#define WAIT_OBJECT_0   0x00000000L
+#define WAIT_FAILED     0xFFFFFFFF
+
+typedef DWORD (WINAPI *LPTHREAD_START_ROUTINE)(LPVOID lpThreadParameter);
+
+HANDLE CreateThread(void* lpThreadAttributes, size_t dwStackSize, LPTHREAD_START_ROUTINE lpStartAddress,
+    LPVOID lpParameter, DWORD dwCreationFlags, LPDWORD lpThreadId);
+DWORD WaitForSingleObject(HANDLE hHandle, DWORD dwMilliseconds);
+BOOL CloseHandle(HANDLE hObject);
+
+DWORD GetLastError();
+void SetLastError(DWORD dwErrCode);
+
+inline LONG InterlockedIncrement(volatile LONG* plAddend)
+{
+    return __atomic_add_fetch(plAddend, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedDecrement(volatile LONG* plAddend)
+{
+    return __atomic_sub_fetch(plAddend, 1, __ATOMIC_SEQ_CST);
+}
+
+inline LONG InterlockedExchange(volatile LONG* plTarget, LONG lValue)
+{
+    return __atomic_exchange_n(plTarget, lValue, __ATOMIC_SEQ_CST);
+}
+
+#define MAX_COMPUTERNAME_LENGTH 15
+
+// The host name, up to the first dot, as a NetBIOS name would be.
+BOOL GetComputerNameW(LPWSTR pwzBuffer, LPDWORD pnSize);
+
+#define MAKEINTRESOURCE(i)  ((LPSTR)(ULONG_PTR)(USHORT)(i))
+
+HBITMAP LoadBitmap(HINSTANCE hInstance, LPCSTR pszBitmapName);
+
+#define HKEY_LOCAL_MACHINE  ((HKEY)(ULONG_PTR)0x80000002)
+#define RRF_RT_REG_SZ       0x00000002
+
+LSTATUS RegGetValueA(HKEY hkey, LPCSTR pszSubKey, LPCSTR pszValue, DWORD dwFlags, LPDWORD pdwType,
+    PVOID pvData, LPDWORD pcbData);
+
+// LSA and Kerberos ///////////////////////////////////////////////////////////////////
+
+struct LUID
+{
+    DWORD   LowPart;
+    LONG    HighPart;
+};
+
+struct UNICODE_STRING
+{
+    USHORT  Length;
+    USHORT  MaximumLength;
+    PWSTR   Buffer;
+};
+
+struct STRING
+{
+    USHORT  Length;
+    USHORT  MaximumLength;
+    PCHAR   Buffer;
+};
+typedef STRING *PSTRING;
+typedef STRING LSA_STRING, *PLSA_STRING;
+
+#define NEGOSSP_NAME_A  "Negotiate"
+#define NEGOSSP_NAME    NEGOSSP_NAME_A
+
+NTSTATUS LsaConnectUntrusted(HANDLE* phLsa);
+NTSTATUS LsaLookupAuthenticationPackage(HANDLE hLsa, PLSA_STRING pPackageName, ULONG* pulAuthenticationPackage);
+NTSTATUS LsaDeregisterLogonProcess(HANDLE hLsa);
+
+enum KERB_LOGON_SUBMIT_TYPE
+{
+    KerbInteractiveLogon = 2,
+    KerbSmartCardLogon = 6,
+    KerbWorkstationUnlockLogon = 7,
+};
+
+struct KERB_INTERACTIVE_LOGON
+{
+    KERB_LOGON_SUBMIT_TYPE  MessageType;
+    UNICODE_STRING          LogonDomainName;
+    UNICODE_STRING          UserName;
+    UNICODE_STRING          Password;
+};
+
+struct KERB_INTERACTIVE_UNLOCK_LOGON
+{
+    KERB_INTERACTIVE_LOGON  Logon;
+    LUID                    LogonId;
+};
+
+enum CRED_PROTECTION_TYPE
+{
+    CredUnprotected,
+    CredUserProtection,
+    CredTrustedProtection,
+};
+
+BOOL CredProtectW(BOOL fAsSelf, LPWSTR pwzCredentials, DWORD cchCredentials, LPWSTR pwzProtectedCredentials,
+    DWORD* pcchMaxChars, CRED_PROTECTION_TYPE* pProtectionType);
+BOOL CredIsProtectedW(LPWSTR pwzProtectedCredentials, CRED_PROTECTION_TYPE* pProtectionType);
+
+// Credential provider types //////////////////////////////////////////////////////////
+
+enum CREDENTIAL_PROVIDER_USAGE_SCENARIO
+{
+    CPUS_INVALID = 0,
+    CPUS_LOGON,
+    CPUS_UNLOCK_WORKSTATION,
+    CPUS_CHANGE_PASSWORD,
+    CPUS_CREDUI,
+    CPUS_PLAP,
+};
+
+enum CREDENTIAL_PROVIDER_FIELD_TYPE
+{
+    CPFT_INVALID = 0,
+    CPFT_LARGE_TEXT,
+    CPFT_SMALL_TEXT,
+    CPFT_COMMAND_LINK,
+    CPFT_EDIT_TEXT,
+    CPFT_PASSWORD_TEXT,
+    CPFT_TILE_IMAGE,
+    CPFT_CHECKBOX,
+    CPFT_COMBOBOX,
+    CPFT_SUBMIT_BUTTON,
+};
+
+enum CREDENTIAL_PROVIDER_FIELD_STATE
+{
+    CPFS_HIDDEN = 0,
+    CPFS_DISPLAY_IN_SELECTED_TILE,
+    CPFS_DISPLAY_IN_DESELECTED_TILE,
+    CPFS_DISPLAY_IN_BOTH,
+};
+
+enum CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE
+{
+    CPFIS_NONE = 0,
+    CPFIS_READONLY,
+    CPFIS_DISABLED,
+    CPFIS_FOCUSED,
+};
+
+enum CREDENTIAL_PROVIDER_GET_SERIALIZATION_RESPONSE
+{
+    CPGSR_NO_CREDENTIAL_NOT_FINISHED = 0,
+    CPGSR_NO_CREDENTIAL_FINISHED,
+    CPGSR_RETURN_CREDENTIAL_FINISHED,
+    CPGSR_RETURN_NO_CREDENTIAL_FINISHED,
+};
+
+enum CREDENTIAL_PROVIDER_STATUS_ICON
+{
+    CPSI_NONE = 0,
+    CPSI_ERROR,
+    CPSI_WARNING,
+    CPSI_SUCCESS,
+};
+
+// As in the Windows Vista SDK, which is what we're written against.
+struct CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR
+{
+    DWORD                           dwFieldID;
+    CREDENTIAL_PROVIDER_FIELD_TYPE  cpft;
+    LPWSTR                          pszLabel;
+};
+
+#define CREDENTIAL_PROVIDER_NO_DEFAULT  ((DWORD)-1)
+
+struct CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION
+{
+    ULONG   ulAuthenticationPackage;
+    GUID    clsidCredentialProvider;
+    ULONG   cbSerialization;
+    BYTE    *rgbSerialization;
+};
+
+// Interfaces /////////////////////////////////////////////////////////////////////////
+
+extern const IID IID_IUnknown;
+extern const IID IID_IClassFactory;
+extern const IID IID_ICredentialProvider;
+extern const IID IID_ICredentialProviderCredential;
+extern const IID IID_ICredentialProviderEvents;
+extern const IID IID_ICredentialProviderCredentialEvents;
+
+struct IUnknown
+{
+    STDMETHOD(QueryInterface)(REFIID riid, void** ppvObject) PURE;
+    STDMETHOD_(ULONG, AddRef)() PURE;
+    STDMETHOD_(ULONG, Release)() PURE;
+};
+
+struct IClassFactory : public IUnknown
+{
+    STDMETHOD(CreateInstance)(IUnknown* pUnkOuter, REFIID riid, void** ppvObject) PURE;
+    STDMETHOD(LockServer)(BOOL fLock) PURE;
+};
+
+struct ICredentialProviderCredential;
+
+struct ICredentialProviderCredentialEvents : public IUnknown
+{
+    STDMETHOD(SetFieldState)(ICredentialProviderCredential* pcpc, DWORD dwFieldID,
+        CREDENTIAL_PROVIDER_FIELD_STATE cpfs) PURE;
+    STDMETHOD(SetFieldInteractiveState)(ICredentialProviderCredential* pcpc, DWORD dwFieldID,
+        CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE cpfis) PURE;
+    STDMETHOD(SetFieldString)(ICredentialProviderCredential* pcpc, DWORD dwFieldID, LPCWSTR psz) PURE;
+    STDMETHOD(SetFieldCheckbox)(ICredentialProviderCredential* pcpc, DWORD dwFieldID, BOOL bChecked,
+        LPCWSTR pszLabel) PURE;
+    STDMETHOD(SetFieldBitmap)(ICredentialProviderCredential* pcpc, DWORD dwFieldID, HBITMAP hbmp) PURE;
+    STDMETHOD(SetFieldComboBoxSelectedItem)(ICredentialProviderCredential* pcpc, DWORD dwFieldID,
+        DWORD dwSelectedItem) PURE;
+    STDMETHOD(DeleteFieldComboBoxItem)(ICredentialProviderCredential* pcpc, DWORD dwFieldID, DWORD dwItem) PURE;
+    STDMETHOD(AppendFieldComboBoxItem)(ICredentialProviderCredential* pcpc, DWORD dwFieldID, LPCWSTR pszItem) PURE;
+    STDMETHOD(SetFieldSubmitButton)(ICredentialProviderCredential* pcpc, DWORD dwFieldID, DWORD dwAdjacentTo) PURE;
+    STDMETHOD(OnCreatingWindow)(HWND* phwndOwner) PURE;
+};
+
+struct ICredentialProviderCredential : public IUnknown
+{
+    STDMETHOD(Advise)(ICredentialProviderCredentialEvents* pcpce) PURE;
+    STDMETHOD(UnAdvise)() PURE;
+    STDMETHOD(SetSelected)(BOOL* pbAutoLogon) PURE;
+    STDMETHOD(SetDeselected)() PURE;
+    STDMETHOD(GetFieldState)(DWORD dwFieldID, CREDENTIAL_PROVIDER_FIELD_STATE* pcpfs,
+        CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE* pcpfis) PURE;
+    STDMETHOD(GetStringValue)(DWORD dwFieldID, LPWSTR* ppsz) PURE;
+    STDMETHOD(GetBitmapValue)(DWORD dwFieldID, HBITMAP* phbmp) PURE;
+    STDMETHOD(GetCheckboxValue)(DWORD dwFieldID, BOOL* pbChecked, LPWSTR* ppszLabel) PURE;
+    STDMETHOD(GetSubmitButtonValue)(DWORD dwFieldID, DWORD* pdwAdjacentTo) PURE;
+    STDMETHOD(GetComboBoxValueCount)(DWORD dwFieldID, DWORD* pcItems, DWORD* pdwSelectedItem) PURE;
+    STDMETHOD(GetComboBoxValueAt)(DWORD dwFieldID, DWORD dwItem, LPWSTR* ppszItem) PURE;
+    STDMETHOD(SetStringValue)(DWORD dwFieldID, LPCWSTR psz) PURE;
+    STDMETHOD(SetCheckboxValue)(DWORD dwFieldID, BOOL bChecked) PURE;
+    STDMETHOD(SetComboBoxSelectedValue)(DWORD dwFieldID, DWORD dwSelectedItem) PURE;
+    STDMETHOD(CommandLinkClicked)(DWORD dwFieldID) PURE;
+    STDMETHOD(GetSerialization)(CREDENTIAL_PROVIDER_GET_SERIALIZATION_RESPONSE* pcpgsr,
+        CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs, LPWSTR* ppszOptionalStatusText,
+        CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon) PURE;
+    STDMETHOD(ReportResult)(NTSTATUS ntsStatus, NTSTATUS ntsSubstatus, LPWSTR* ppszOptionalStatusText,
+        CREDENTIAL_PROVIDER_STATUS_ICON* pcpsiOptionalStatusIcon) PURE;
+};
+
+struct ICredentialProviderEvents : public IUnknown
+{
+    STDMETHOD(CredentialsChanged)(UINT_PTR upAdviseContext) PURE;
+};
+
+struct ICredentialProvider : public IUnknown
+{
+    STDMETHOD(SetUsageScenario)(CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus, DWORD dwFlags) PURE;
+    STDMETHOD(SetSerialization)(const CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION* pcpcs) PURE;
+    STDMETHOD(Advise)(ICredentialProviderEvents* pcpe, UINT_PTR upAdviseContext) PURE;
+    STDMETHOD(UnAdvise)() PURE;
+    STDMETHOD(GetFieldDescriptorCount)(DWORD* pdwCount) PURE;
+    STDMETHOD(GetFieldDescriptorAt)(DWORD dwIndex, CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR** ppcpfd) PURE;
+    STDMETHOD(GetCredentialCount)(DWORD* pdwCount, DWORD* pdwDefault, BOOL* pbAutoLogonWithDefault) PURE;
+    STDMETHOD(GetCredentialAt)(DWORD dwIndex, ICredentialProviderCredential** ppcpc) PURE;
+};
+
+#endif
@@ -0,0 +1,117 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+
+#include "ScratchArena.h"
+#include <stdlib.h>
+
+// Every allocation is rounded up to this, so any of them can hold any of our structures.
+#define ARENA_ALIGNMENT 8
+
+CScratchArena::CScratchArena()
+{
+    _cbUsed = 0;
+    _ibLast = 0;
+    _pOverflow = NULL;
+    ZeroMemory(&_counters, sizeof(_counters));
+}
+
+CScratchArena::~CScratchArena()
+{
+    Reset();
+}
+
+//
+// Returns cb bytes of scratch memory, valid until the next Reset. Returns NULL only if
+// the request couldn't be served from the heap either.
+//
+void* CScratchArena::Alloc(size_t cb)
+{
+    size_t cbRounded = (cb + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    if (cbRounded < cb)
+    {
+        return NULL;
+    }
+
+    void* pv;
+    if (cbRounded <= sizeof(_rgb) - _cbUsed)
+    {
+        pv = _rgb + _cbUsed;
+        _ibLast = _cbUsed;
+        _cbUsed += cbRounded;
+        if (_cbUsed > _counters.cbPeak)
+        {
+            _counters.cbPeak = (DWORD)_cbUsed;
+        }
+    }
+    else
+    {
+        if (cb > (size_t)-1 - sizeof(OVERFLOW_BLOCK))
+        {
+            return NULL;
+        }
+        OVERFLOW_BLOCK* pBlock = (OVERFLOW_BLOCK*)malloc(sizeof(OVERFLOW_BLOCK) + cb);
+        if (pBlock == NULL)
+        {
+            return NULL;
+        }
+        pBlock->pNext = _pOverflow;
+        pBlock->cb = cb;
+        _pOverflow = pBlock;
+        _counters.cHeapAllocations++;
+        pv = pBlock + 1;
+    }
+
+    _counters.cAllocations++;
+    return pv;
+}
+
+// Returns how many bytes the next Alloc can have without going to the heap.
+size_t CScratchArena::GetAvailable()
+{
+    return sizeof(_rgb) - _cbUsed;
+}
+
+// Shrinks the latest allocation, pv, to cb bytes so the rest can be handed out again.
+// Does nothing if pv isn't the latest inline allocation.
+void CScratchArena::Trim(void* pv, size_t cb)
+{
+    if (pv == _rgb + _ibLast && _cbUsed > _ibLast)
+    {
+        size_t cbRounded = (cb + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+        if (cbRounded < _cbUsed - _ibLast)
+        {
+            SecureZeroMemory(_rgb + _ibLast + cbRounded, _cbUsed - _ibLast - cbRounded);
+            _cbUsed = _ibLast + cbRounded;
+        }
+    }
+}
+
+// Wipes everything handed out since the last Reset and makes it available again.
+void CScratchArena::Reset()
+{
+    SecureZeroMemory(_rgb, _cbUsed);
+    _cbUsed = 0;
+    _ibLast = 0;
+
+    while (_pOverflow != NULL)
+    {
+        OVERFLOW_BLOCK* pNext = _pOverflow->pNext;
+        SecureZeroMemory(_pOverflow + 1, _pOverflow->cb);
+        free(_pOverflow);
+        _pOverflow = pNext;
+    }
+
+    _counters.cResets++;
+}
+
+void CScratchArena::GetCounters(ARENA_COUNTERS* pCounters)
+{
+    *pCounters = _counters;
+}
@@ -0,0 +1,62 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Scratch memory for one logon attempt. GetSerialization needs a handful of short-lived
+// buffers (the protected password, copies of strings) that all die together once the
+// serialization is packed, so rather than allocating and freeing each one it carves
+// them out of a buffer the credential already owns, and Reset wipes and recycles the
+// lot in one go.
+//
+// Requests that don't fit in the inline buffer are satisfied from the heap and freed
+// (after wiping) by Reset, so the arena never fails for lack of room alone.
+
+#pragma once
+
+#include "PlatformCompat.h"
+
+// Enough for a protected password of the longest length we accept, with room to spare.
+#define SCRATCH_ARENA_SIZE  4096
+
+struct ARENA_COUNTERS
+{
+    DWORD   cAllocations;       // Requests served, in total.
+    DWORD   cHeapAllocations;   // Of those, how many didn't fit and went to the heap.
+    DWORD   cbPeak;             // The most inline bytes in use at once.
+    DWORD   cResets;            // Times the arena was wiped and recycled.
+};
+
+class CScratchArena
+{
+  public:
+    CScratchArena();
+    ~CScratchArena();
+
+    void* Alloc(size_t cb);
+    size_t GetAvailable();
+    void Trim(void* pv, size_t cb);
+    void Reset();
+    void GetCounters(ARENA_COUNTERS* pCounters);
+
+  private:
+    // A request that didn't fit inline. The block's memory follows the header.
+    struct OVERFLOW_BLOCK
+    {
+        OVERFLOW_BLOCK  *pNext;
+        size_t          cb;
+    };
+
+    union
+    {
+        BYTE            _rgb[SCRATCH_ARENA_SIZE];
+        ULONGLONG       _ullAlign;                  // Keeps _rgb 8-byte aligned.
+    };
+    size_t              _cbUsed;                    // Bytes of _rgb handed out.
+    size_t              _ibLast;                    // Offset of the latest inline allocation.
+    OVERFLOW_BLOCK      *_pOverflow;                // Most recent first.
+    ARENA_COUNTERS      _counters;
+};
@@ -0,0 +1,300 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+
+#include "SerializationCache.h"
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#define POOL_SIZE   (SERIALIZATION_CACHE_ENTRIES * sizeof(ENTRY))
+
+// Copies a null-terminated string of at most cchMax characters, plus its null, into
+// pwzDest. Returns the length copied, or (size_t)-1 if it's too long.
+static size_t _CopyBounded(WCHAR* pwzDest, const WCHAR* pwz, size_t cchMax)
+{
+    size_t cch = 0;
+    while (pwz[cch] != 0)
+    {
+        if (cch == cchMax)
+        {
+            return (size_t)-1;
+        }
+        pwzDest[cch] = pwz[cch];
+        cch++;
+    }
+    pwzDest[cch] = 0;
+    return cch;
+}
+
+static BOOL _IsSameUser(const WCHAR* pwzA, const WCHAR* pwzB)
+{
+    while (*pwzA != 0 && *pwzA == *pwzB)
+    {
+        pwzA++;
+        pwzB++;
+    }
+    return *pwzA == *pwzB;
+}
+
+// Whether pwz is the password an entry was built from. Every character of the stored
+// password is compared, whatever matched before it, so how long this takes says
+// nothing about how close pwz was; only pwz's own length can show.
+static BOOL _IsSamePassword(const WCHAR* pwzStored, const WCHAR* pwz)
+{
+    USHORT wDifference = 0;
+    BOOL fEnded = FALSE;
+    for (size_t i = 0; i <= PROFILE_MAX_FIELD; i++)
+    {
+        WCHAR ch = fEnded ? 0 : pwz[i];
+        fEnded = fEnded || ch == 0;
+        wDifference |= (USHORT)(pwzStored[i] ^ ch);
+    }
+
+    // The stored password always ends by PROFILE_MAX_FIELD, so a longer pwz differs.
+    return wDifference == 0;
+}
+
+CSerializationCache::CSerializationCache() :
+    _rgEntries(NULL), _fLocked(FALSE), _ullTtlMs(DEFAULT_SERIALIZATION_TTL_MS)
+{
+    ZeroMemory(&_counters, sizeof(_counters));
+}
+
+CSerializationCache::~CSerializationCache()
+{
+    Clear();
+    if (_rgEntries != NULL)
+    {
+#ifdef _WIN32
+        if (_fLocked)
+        {
+            VirtualUnlock(_rgEntries, POOL_SIZE);
+        }
+        VirtualFree(_rgEntries, 0, MEM_RELEASE);
+#else
+        if (_fLocked)
+        {
+            munlock(_rgEntries, POOL_SIZE);
+        }
+        munmap(_rgEntries, POOL_SIZE);
+#endif
+    }
+}
+
+// The cache every tile in this process shares. Built on first use.
+CSerializationCache* CSerializationCache::GetShared()
+{
+    static CSerializationCache s_cache;
+    return &s_cache;
+}
+
+void CSerializationCache::SetTtl(ULONGLONG ullTtlMs)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    _ullTtlMs = ullTtlMs;
+}
+
+// Allocates and locks the entries the first time something is inserted. If the memory
+// can't be locked (the working set is too small, say) we carry on without, since the
+// entries are wiped as they're dropped either way.
+HRESULT CSerializationCache::_EnsurePool()
+{
+    if (_rgEntries != NULL)
+    {
+        return S_OK;
+    }
+
+#ifdef _WIN32
+    void* pv = VirtualAlloc(NULL, POOL_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+    if (pv == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    _fLocked = VirtualLock(pv, POOL_SIZE);
+#else
+    void* pv = mmap(NULL, POOL_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (pv == MAP_FAILED)
+    {
+        return E_OUTOFMEMORY;
+    }
+    _fLocked = (mlock(pv, POOL_SIZE) == 0);
+#endif
+    if (!_fLocked)
+    {
+        printf("Couldn't lock the serialization cache in memory\n");
+    }
+
+    // Fresh pages are zeroed, so every entry starts out free.
+    _rgEntries = (ENTRY*)pv;
+    return S_OK;
+}
+
+CSerializationCache::ENTRY* CSerializationCache::_Find(const WCHAR* pwzUser, DWORD dwScenario)
+{
+    if (_rgEntries == NULL)
+    {
+        return NULL;
+    }
+    for (DWORD i = 0; i < SERIALIZATION_CACHE_ENTRIES; i++)
+    {
+        ENTRY* pEntry = &_rgEntries[i];
+        if (pEntry->cbBlob != 0 && pEntry->dwScenario == dwScenario && _IsSameUser(pEntry->wszUser, pwzUser))
+        {
+            return pEntry;
+        }
+    }
+    return NULL;
+}
+
+void CSerializationCache::_Drop(ENTRY* pEntry)
+{
+    SecureZeroMemory(pEntry, sizeof(*pEntry));
+}
+
+//
+// Looks for a serialization of pwzUser's credential for this scenario, built from
+// pwzPassword and no older than the TTL. On a hit, returns a copy in *prgb (allocated
+// with CoTaskMemAlloc, for handing straight to LogonUI) along with the authentication
+// package it was built for. Returns S_FALSE on a miss.
+//
+HRESULT CSerializationCache::Lookup(const WCHAR* pwzUser, const WCHAR* pwzPassword, DWORD dwScenario, ULONGLONG ullNow,
+                                    BYTE** prgb, DWORD* pcb, ULONG* pulAuthPackage)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+
+    ENTRY* pEntry = _Find(pwzUser, dwScenario);
+    if (pEntry != NULL && !_IsSamePassword(pEntry->wszPassword, pwzPassword))
+    {
+        _counters.cStale++;
+        _Drop(pEntry);
+        pEntry = NULL;
+    }
+    else if (pEntry != NULL && ullNow - pEntry->ullCreated >= _ullTtlMs)
+    {
+        _counters.cExpired++;
+        _Drop(pEntry);
+        pEntry = NULL;
+    }
+
+    if (pEntry == NULL)
+    {
+        _counters.cMisses++;
+        return S_FALSE;
+    }
+
+    BYTE* pb = (BYTE*)CoTaskMemAlloc(pEntry->cbBlob);
+    if (pb == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    CopyMemory(pb, pEntry->rgbBlob, pEntry->cbBlob);
+    pEntry->ullLastUsed = ullNow;
+    _counters.cHits++;
+
+    *prgb = pb;
+    *pcb = pEntry->cbBlob;
+    *pulAuthPackage = pEntry->ulAuthPackage;
+    return S_OK;
+}
+
+//
+// Remembers the serialization pb built for pwzUser from pwzPassword, replacing any
+// earlier one for the same user and scenario, or else the least recently used entry
+// if the cache is full. Returns S_FALSE if it's too big to keep.
+//
+HRESULT CSerializationCache::Insert(const WCHAR* pwzUser, const WCHAR* pwzPassword, DWORD dwScenario, ULONGLONG ullNow,
+                                    const BYTE* pb, DWORD cb, ULONG ulAuthPackage)
+{
+    if (cb == 0 || cb > SERIALIZATION_CACHE_MAX_BLOB)
+    {
+        return S_FALSE;
+    }
+
+    std::lock_guard<std::mutex> guard(_lock);
+
+    HRESULT hr = _EnsurePool();
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    ENTRY* pEntry = _Find(pwzUser, dwScenario);
+    if (pEntry == NULL)
+    {
+        // Take a free entry if there is one, otherwise the one used longest ago.
+        ENTRY* pVictim = &_rgEntries[0];
+        for (DWORD i = 0; i < SERIALIZATION_CACHE_ENTRIES && pVictim->cbBlob != 0; i++)
+        {
+            ENTRY* pCandidate = &_rgEntries[i];
+            if (pCandidate->cbBlob == 0 || pCandidate->ullLastUsed < pVictim->ullLastUsed)
+            {
+                pVictim = pCandidate;
+            }
+        }
+        if (pVictim->cbBlob != 0)
+        {
+            _counters.cEvicted++;
+        }
+        pEntry = pVictim;
+    }
+    _Drop(pEntry);
+
+    // The entry was just wiped, so the password is zero-filled after its null, as
+    // _IsSamePassword needs.
+    if (_CopyBounded(pEntry->wszUser, pwzUser, PROFILE_MAX_FIELD) == (size_t)-1 ||
+        _CopyBounded(pEntry->wszPassword, pwzPassword, PROFILE_MAX_FIELD) == (size_t)-1)
+    {
+        _Drop(pEntry);
+        return S_FALSE;
+    }
+    pEntry->ullCreated = ullNow;
+    pEntry->ullLastUsed = ullNow;
+    pEntry->dwScenario = dwScenario;
+    pEntry->ulAuthPackage = ulAuthPackage;
+    CopyMemory(pEntry->rgbBlob, pb, cb);
+    pEntry->cbBlob = cb;
+    return S_OK;
+}
+
+// Drops every serialization for pwzUser, whatever the scenario.
+void CSerializationCache::Invalidate(const WCHAR* pwzUser)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    if (_rgEntries == NULL)
+    {
+        return;
+    }
+    for (DWORD i = 0; i < SERIALIZATION_CACHE_ENTRIES; i++)
+    {
+        ENTRY* pEntry = &_rgEntries[i];
+        if (pEntry->cbBlob != 0 && _IsSameUser(pEntry->wszUser, pwzUser))
+        {
+            _counters.cInvalidated++;
+            _Drop(pEntry);
+        }
+    }
+}
+
+void CSerializationCache::Clear()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    if (_rgEntries != NULL)
+    {
+        SecureZeroMemory(_rgEntries, POOL_SIZE);
+    }
+}
+
+void CSerializationCache::GetCounters(SERIALIZATION_CACHE_COUNTERS* pCounters)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    *pCounters = _counters;
+}
@@ -0,0 +1,89 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Ready-to-submit serializations, kept for users who are pushed again and again (a
+// badge reader at a shared workstation re-locking every few minutes). The first
+// GetSerialization for a user protects the password and packs everything as usual and
+// leaves the result here; later ones for the same user, scenario and password just
+// copy it out.
+//
+// An entry is only good for the password it was built from, so each keeps that
+// password and a different one misses (and drops the entry). The comparison takes the
+// same time however much of the password matches. An entry also expires after a
+// while, and is dropped as soon as its user is revoked.
+//
+// The entries live in one block of memory that is locked, so the passwords and packed
+// credentials are never written to the page file, and every entry is wiped as it's dropped.
+// There's one cache per process, shared by every provider and tile, so it outlives
+// the LogonUI session that filled it.
+
+#pragma once
+
+#include <mutex>
+#include "PlatformCompat.h"
+#include "ProfileIndex.h"
+
+#define SERIALIZATION_CACHE_ENTRIES     16
+
+// The largest packed serialization we'll keep; anything bigger is just not cached.
+// Comfortably more than a header, a computer name, a username and a protected password
+// of the lengths we accept.
+#define SERIALIZATION_CACHE_MAX_BLOB    2048
+
+#define DEFAULT_SERIALIZATION_TTL_MS    (10 * 60 * 1000)
+
+struct SERIALIZATION_CACHE_COUNTERS
+{
+    DWORD   cHits;
+    DWORD   cMisses;        // Including the stale and expired ones below.
+    DWORD   cStale;         // Found, but built from a different password.
+    DWORD   cExpired;       // Found, but too old.
+    DWORD   cEvicted;       // Pushed out to make room for another user.
+    DWORD   cInvalidated;   // Dropped because the user was revoked.
+};
+
+class CSerializationCache
+{
+  public:
+    CSerializationCache();
+    ~CSerializationCache();
+
+    static CSerializationCache* GetShared();
+
+    void SetTtl(ULONGLONG ullTtlMs);
+    HRESULT Lookup(const WCHAR* pwzUser, const WCHAR* pwzPassword, DWORD dwScenario, ULONGLONG ullNow,
+                   BYTE** prgb, DWORD* pcb, ULONG* pulAuthPackage);
+    HRESULT Insert(const WCHAR* pwzUser, const WCHAR* pwzPassword, DWORD dwScenario, ULONGLONG ullNow,
+                   const BYTE* pb, DWORD cb, ULONG ulAuthPackage);
+    void Invalidate(const WCHAR* pwzUser);
+    void Clear();
+    void GetCounters(SERIALIZATION_CACHE_COUNTERS* pCounters);
+
+  private:
+    struct ENTRY
+    {
+        ULONGLONG   ullCreated;                                 // When it was inserted.
+        ULONGLONG   ullLastUsed;                                // For picking a victim.
+        DWORD       dwScenario;
+        ULONG       ulAuthPackage;
+        DWORD       cbBlob;                                     // Zero when the entry is free.
+        WCHAR       wszUser[PROFILE_MAX_FIELD + 1];
+        WCHAR       wszPassword[PROFILE_MAX_FIELD + 1];         // Zero-filled after the null.
+        BYTE        rgbBlob[SERIALIZATION_CACHE_MAX_BLOB];
+    };
+
+    HRESULT _EnsurePool();
+    ENTRY* _Find(const WCHAR* pwzUser, DWORD dwScenario);
+    void _Drop(ENTRY* pEntry);
+
+    std::mutex                      _lock;
+    ENTRY                           *_rgEntries;    // SERIALIZATION_CACHE_ENTRIES of them, locked.
+    BOOL                            _fLocked;       // Whether locking _rgEntries worked.
+    ULONGLONG                       _ullTtlMs;
+    SERIALIZATION_CACHE_COUNTERS    _counters;
+};
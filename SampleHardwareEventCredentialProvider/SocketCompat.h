@@ -0,0 +1,210 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// A thin shim over Winsock and BSD sockets. Only the calls whose names or
+// semantics differ between the two are wrapped; everything else (bind, listen,
+// recv, send, getaddrinfo, ...) is called directly. Include this from .cpp
+// files only, since on Windows it pulls in winsock2.h.
+
+#pragma once
+
+#include "PlatformCompat.h"
+
+#ifdef _WIN32
+
+#include <winsock2.h>
+#include <WS2tcpip.h>
+
+#pragma comment (lib, "Ws2_32.lib")
+
+typedef WSAPOLLFD   pollfd_t;
+typedef int         socklen_compat_t;
+
+#define SOCKET_EWOULDBLOCK  WSAEWOULDBLOCK
+#define SOCKET_EINTR        WSAEINTR
+#define SOCKET_SHUT_SEND    SD_SEND
+
+inline HRESULT SocketStartup()
+{
+    WSADATA wsaData;
+    int iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
+    return (iResult == 0) ? S_OK : HRESULT_FROM_WIN32(iResult);
+}
+
+inline void SocketCleanup()
+{
+    WSACleanup();
+}
+
+inline int SocketLastError()
+{
+    return WSAGetLastError();
+}
+
+inline void SocketClose(socket_t s)
+{
+    closesocket(s);
+}
+
+inline int SocketSetNonBlocking(socket_t s)
+{
+    u_long ulNonBlocking = 1;
+    return ioctlsocket(s, FIONBIO, &ulNonBlocking);
+}
+
+inline int SocketPoll(pollfd_t* rgfd, ULONG cfd, int iTimeout)
+{
+    return WSAPoll(rgfd, cfd, iTimeout);
+}
+
+#else
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+
+typedef struct pollfd   pollfd_t;
+typedef socklen_t       socklen_compat_t;
+
+#define SOCKET_ERROR        (-1)
+#define SOCKET_EWOULDBLOCK  EWOULDBLOCK
+#define SOCKET_EINTR        EINTR
+#define SOCKET_SHUT_SEND    SHUT_WR
+
+inline HRESULT SocketStartup()
+{
+    return S_OK;
+}
+
+inline void SocketCleanup()
+{
+}
+
+inline int SocketLastError()
+{
+    return errno;
+}
+
+inline void SocketClose(socket_t s)
+{
+    close(s);
+}
+
+inline int SocketSetNonBlocking(socket_t s)
+{
+    int iFlags = fcntl(s, F_GETFL, 0);
+    return (iFlags < 0) ? -1 : fcntl(s, F_SETFL, iFlags | O_NONBLOCK);
+}
+
+inline int SocketPoll(pollfd_t* rgfd, ULONG cfd, int iTimeout)
+{
+    return poll(rgfd, (nfds_t)cfd, iTimeout);
+}
+
+#endif
+
+inline HRESULT SocketLastErrorAsHResult()
+{
+    return HRESULT_FROM_WIN32(SocketLastError());
+}
+
+// The most datagrams SocketRecvBatch takes at once.
+#define SOCKET_RECV_BATCH_MAX 64
+
+// One datagram for SocketRecvBatch: where to put it, and on return how long it was
+// and who sent it.
+struct SOCKET_DATAGRAM
+{
+    char                *pb;        // Receives the datagram.
+    int                 cbMax;      // Size of pb. Longer datagrams are cut short.
+    int                 cb;         // Set to the number of bytes received.
+    struct sockaddr_in  saFrom;     // Set to the sender's address.
+};
+
+//
+// Receives up to c (at most SOCKET_RECV_BATCH_MAX) datagrams that are already waiting
+// on the non-blocking socket s. Returns how many were received, which is 0 if none
+// were waiting, or SOCKET_ERROR. Linux takes the whole batch in one recvmmsg; Winsock
+// has nothing like it short of registered I/O, so there we call recvfrom until the
+// socket is empty.
+//
+inline int SocketRecvBatch(socket_t s, SOCKET_DATAGRAM* rgDatagrams, int c)
+{
+    if (c > SOCKET_RECV_BATCH_MAX)
+    {
+        c = SOCKET_RECV_BATCH_MAX;
+    }
+
+#ifdef __linux__
+    struct mmsghdr rgmsg[SOCKET_RECV_BATCH_MAX];
+    struct iovec rgiov[SOCKET_RECV_BATCH_MAX];
+    for (int i = 0; i < c; i++)
+    {
+        rgiov[i].iov_base = rgDatagrams[i].pb;
+        rgiov[i].iov_len = rgDatagrams[i].cbMax;
+        ZeroMemory(&rgmsg[i], sizeof(rgmsg[i]));
+        rgmsg[i].msg_hdr.msg_name = &rgDatagrams[i].saFrom;
+        rgmsg[i].msg_hdr.msg_namelen = sizeof(rgDatagrams[i].saFrom);
+        rgmsg[i].msg_hdr.msg_iov = &rgiov[i];
+        rgmsg[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int cReceived = recvmmsg(s, rgmsg, c, MSG_DONTWAIT, NULL);
+    if (cReceived == SOCKET_ERROR)
+    {
+        return (errno == EWOULDBLOCK || errno == EAGAIN) ? 0 : SOCKET_ERROR;
+    }
+    for (int i = 0; i < cReceived; i++)
+    {
+        rgDatagrams[i].cb = (int)rgmsg[i].msg_len;
+    }
+    return cReceived;
+#else
+    int cReceived = 0;
+    while (cReceived < c)
+    {
+        SOCKET_DATAGRAM* pDatagram = &rgDatagrams[cReceived];
+        socklen_compat_t cbFrom = sizeof(pDatagram->saFrom);
+        int cb = (int)recvfrom(s, pDatagram->pb, pDatagram->cbMax, 0, (struct sockaddr*)&pDatagram->saFrom, &cbFrom);
+        if (cb == SOCKET_ERROR)
+        {
+            int iError = SocketLastError();
+#ifdef _WIN32
+            // Winsock fails a datagram that didn't fit rather than truncating it quietly.
+            if (iError == WSAEMSGSIZE)
+            {
+                pDatagram->cb = pDatagram->cbMax;
+                cReceived++;
+                continue;
+            }
+            // An earlier send of ours bounced; it says nothing about what's waiting.
+            if (iError == WSAECONNRESET)
+            {
+                continue;
+            }
+#endif
+            if (iError == SOCKET_EWOULDBLOCK)
+            {
+                break;
+            }
+            return (cReceived > 0) ? cReceived : SOCKET_ERROR;
+        }
+        pDatagram->cb = cb;
+        cReceived++;
+    }
+    return cReceived;
+#endif
+}
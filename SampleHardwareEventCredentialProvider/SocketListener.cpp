@@ -10,46 +10,48 @@
 #define WIN32_LEAN_AND_MEAN
 
 #include "SocketListener.h"
-#include <strsafe.h>
-#include <winsock2.h>
-#include <WS2tcpip.h>
-//#include "sqlite3.h"
+#include "SocketCompat.h"
+#include "TraceLog.h"
+#include "SerializationCache.h"
+#include <time.h>
 
-#pragma comment (lib, "Ws2_32.lib")
+#ifdef _MSC_VER
 #pragma warning(disable : 4996)
+#endif
 
-// Custom messages for managing the behavior of the window thread.
-#define WM_EXIT_THREAD              WM_USER + 1
-#define WM_TOGGLE_CONNECTED_STATUS  WM_USER + 2
-
-#define BUFLEN 1024
-#define PORT 65000
-#define DEFAULT_BUFLEN 1024
 #define DEFAULT_PORT "27015"
+#define DEFAULT_EVENT_PORT "65000"
+#define DEFAULT_LOCAL_AGENT "Global\\SampleCredentialAgent"
+#define DEFAULT_ACCOUNT_DB "D:\\5samples\\AccountDB\\accountInfo.db"
+#define DEFAULT_ACCOUNT_DIR "D:\\5samples\\AccountDB\\accountInfo.cdir"
+#define DEFAULT_COALESCE_MS 50
+#define DEFAULT_LISTENER_WORKERS 2
 
+// Naming a file in this value sends ET_DUMP_TIMINGS's report there.
+#define TIMINGS_REGISTRY_VALUE "TimingsFile"
 
 
-const TCHAR *g_wszClassName = "EventWindow";
-const TCHAR *g_wszConnected = "Connected";
-const TCHAR *g_wszDisconnected = "Disconnected";
-
 SocketListener::SocketListener(void)
 {
-    _hWnd = NULL;
-    _hInst = NULL;
     _fConnected = FALSE;
     _pProvider = NULL;
-   
+    _hThread = NULL;
+    _szTimingsFile[0] = '\0';
 }
 
 SocketListener::~SocketListener(void)
 {
-    // If we have an active window, we want to post it an exit message.
-    if (_hWnd != NULL)
+    // Ask the event loop to stop and wait for the thread to leave it.
+    if (_hThread != NULL)
     {
-        ::PostMessage(_hWnd, WM_EXIT_THREAD, 0, 0);
-        _hWnd = NULL;
+        _listener.Stop();
+        ::WaitForSingleObject(_hThread, INFINITE);
+        ::CloseHandle(_hThread);
+        _hThread = NULL;
     }
+    _listener.Close();
+    _directory.Close();
+    _store.Close();
 
     // We'll also make sure to release any reference we have to the provider.
     if (_pProvider != NULL)
@@ -59,7 +61,70 @@ SocketListener::~SocketListener(void)
     }
 }
 
-// Performs the work required to spin off our message so we can listen for events.
+// Writes the listener's and the serialization cache's counters, for ET_DUMP_TIMINGS.
+// Called with _lockCoalescer held.
+void SocketListener::_PrintCounters(FILE* pFile)
+{
+    COALESCER_COUNTERS counters;
+    _coalescer.GetCounters(&counters);
+    fprintf(pFile, "Connect status changes: %lu received, %lu reported\n", (unsigned long)counters.cReceived, (unsigned long)counters.cEmitted);
+
+    ADMISSION_COUNTERS admission;
+    _listener.GetAdmissionCounters(&admission);
+    fprintf(pFile, "Connections: %lu admitted, %lu rate limited, %lu source buckets recycled\n",
+        (unsigned long)admission.cAdmitted, (unsigned long)admission.cRateLimited, (unsigned long)admission.cRecycled);
+
+    WORKER_POOL_COUNTERS work;
+    _listener.GetWorkerCounters(&work);
+    EVENT_CHANNEL_COUNTERS events;
+    _listener.GetEventCounters(&events);
+    fprintf(pFile, "Status events: %lu datagrams in %lu batches, %lu acted on, %lu stale, %lu malformed, %lu refused\n",
+        (unsigned long)events.cDatagrams, (unsigned long)events.cBatches, (unsigned long)events.cDelivered,
+        (unsigned long)events.cStale, (unsigned long)events.cMalformed, (unsigned long)events.cRefused);
+
+    fprintf(pFile, "Reads: %lu handled by workers, %lu stolen, %lu deferred while they were busy\n",
+        (unsigned long)work.cRun, (unsigned long)work.cStolen, (unsigned long)work.cRefused);
+
+    SERIALIZATION_CACHE_COUNTERS cache;
+    CSerializationCache::GetShared()->GetCounters(&cache);
+    fprintf(pFile, "Serialization cache: %lu hits, %lu misses (%lu stale, %lu expired), %lu evicted, %lu invalidated\n",
+        (unsigned long)cache.cHits, (unsigned long)cache.cMisses, (unsigned long)cache.cStale,
+        (unsigned long)cache.cExpired, (unsigned long)cache.cEvicted, (unsigned long)cache.cInvalidated);
+}
+
+// Writes the stage timings and our counters, for ET_DUMP_TIMINGS. LogonUI has no
+// console, so they're appended, with the time, to the file named in the registry; a
+// process without that setting, such as a test host, gets them on stdout instead.
+// Called with _lockCoalescer held.
+void SocketListener::_DumpTimings()
+{
+    FILE* pFile = stdout;
+    if (_szTimingsFile[0] != '\0')
+    {
+        pFile = fopen(_szTimingsFile, "a");
+        if (pFile == NULL)
+        {
+            return;
+        }
+    }
+
+    time_t t = time(NULL);
+    fprintf(pFile, "Timings at %s", ctime(&t));
+    CStageTimings::GetShared()->Print(pFile);
+    _PrintCounters(pFile);
+    fprintf(pFile, "\n");
+
+    if (pFile != stdout)
+    {
+        fclose(pFile);
+    }
+    else
+    {
+        fflush(pFile);
+    }
+}
+
+// Performs the work required to spin off our listener thread so we can listen for events.
 HRESULT SocketListener::Initialize(CSampleProvider *pProvider)
 {
     HRESULT hr = S_OK;
@@ -72,508 +137,204 @@ HRESULT SocketListener::Initialize(CSampleProvider *pProvider)
     }
     _pProvider = pProvider;
     _pProvider->AddRef();
-    // Create and launch the window thread.
-    HANDLE hThread = ::CreateThread(NULL, 0, SocketListener::_ThreadProc, (LPVOID) this, 0, NULL);
-    if (hThread == NULL)
+
+    DWORD cbTimingsFile = sizeof(_szTimingsFile);
+    if (RegGetValueA(HKEY_LOCAL_MACHINE, PROVIDER_REGISTRY_KEY, TIMINGS_REGISTRY_VALUE, RRF_RT_REG_SZ, NULL,
+        _szTimingsFile, &cbTimingsFile) != ERROR_SUCCESS)
     {
-        hr = HRESULT_FROM_WIN32(::GetLastError());
+        _szTimingsFile[0] = '\0';
     }
 
-    return hr;
-}
-BOOL SocketListener::GetConnectedStatus()
-{
-    return _fConnected;
-}
-
-// Manages window messages on the window thread.
-LRESULT CALLBACK SocketListener::_WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
-{
-    switch (message)
+    // Prefer a compiled directory if one has been shipped to this machine: it maps in
+    // without reading anything. Otherwise open the account database once, up front.
+    // Without either we can still accept pushed usernames and passwords, just not badge
+    // lookups, so a failure here isn't fatal.
+    if (SUCCEEDED(_directory.Open(DEFAULT_ACCOUNT_DIR)))
     {
-    // Originally we were going to work with USB keys being inserted and removed, but it
-    // seems as though these events don't get to us on the secure desktop. However, you
-    // might see some messageboxi in CredUI.
-    case WM_DEVICECHANGE:
-        ::MessageBox(NULL, TEXT("Device change"), TEXT("Device change"), 0);
-        break;
-
-    // We assume this was the button being clicked.
-    case WM_COMMAND:
-        ::PostMessage(hWnd, WM_TOGGLE_CONNECTED_STATUS, 0, 0);
-        break;
-
-    // To play it safe, we hide the window when "closed" and post a message telling the 
-    // thread to exit.
-    case WM_CLOSE:
-        ::ShowWindow(hWnd, SW_HIDE);
-        ::PostMessage(hWnd, WM_EXIT_THREAD, 0, 0);
-        break;
-
-    default:
-        return DefWindowProc(hWnd, message, wParam, lParam);
+        _listener.SetProfileSource(&_directory);
     }
-    return 0;
-}
-/*
-struct uap {
-    char* u;
-    char* p;
-    bool exist;
-};
-
-static int callback(void* data, int argc, char** argv, char** azColName) {
-    uap* _data = (uap*)(data);
-    if (argc > 0) {
-        _data->exist = true;
-        if (strcmp(azColName[0], "username") == 0)
-        {
-            _data->u = new char[strlen(argv[0]) + 1];
-            strcpy(_data->u, argv[0]);
+    else if (SUCCEEDED(_store.Open(DEFAULT_ACCOUNT_DB)))
+    {
+        _listener.SetProfileSource(&_store);
 
+#ifdef PREFETCH_PROFILE_TILES
+        // Show a tile for every account up front rather than waiting for pushes.
+        if (SUCCEEDED(_store.EnumerateProfiles(_PrefetchProfile, this)))
+        {
+            ::InterlockedExchange(&_fConnected, TRUE);
         }
+#endif
+    }
 
-       if (strcmp(azColName[1], "password") == 0) {
-           _data->p = new char[strlen(argv[1]) + 1];
-           strcpy(_data->p, argv[1]);
+    _coalescer.SetWindow(DEFAULT_COALESCE_MS);
+    _listener.SetWorkerCount(DEFAULT_LISTENER_WORKERS);
 
+    // Open the listening socket once, up front, so it stays bound for our whole lifetime.
+    hr = _listener.Open(DEFAULT_PORT);
+    if (SUCCEEDED(hr))
+    {
+        // Pushes still work without status events, so this isn't fatal either.
+        if (FAILED(_listener.OpenEvents(DEFAULT_EVENT_PORT)))
+        {
+            printf("Not listening for status events on port %s\n", DEFAULT_EVENT_PORT);
         }
-        return 0;
-    }
-    else { 
-        _data->exist = false;
-        return 1; }
-}
-*/
-int SocketListener::Socket2() {
-    bool success = false;
-    
-    WSADATA wsaData;
-    int iResult;
-
-    SOCKET ListenSocket = INVALID_SOCKET;
-    SOCKET ClientSocket = INVALID_SOCKET;
-
-    struct addrinfo* result = NULL;
-    struct addrinfo hints;
-
-    int iSendResult;
-    char recvbuf[DEFAULT_BUFLEN];
-    int recvbuflen = DEFAULT_BUFLEN;
-
-    // Initialize Winsock
-    iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (iResult != 0) {
-        printf("WSAStartup failed with error: %d\n", iResult);
-        return 1;
-    }
 
-    ZeroMemory(&hints, sizeof(hints));
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
-    hints.ai_flags = AI_PASSIVE;
-
-    // Resolve the server address and port
-    iResult = getaddrinfo(NULL, DEFAULT_PORT, &hints, &result);
-    if (iResult != 0) {
-        printf("getaddrinfo failed with error: %d\n", iResult);
-        WSACleanup();
-        return 1;
-    }
+        // Nor is a local agent: it can always connect over TCP like anyone else.
+        if (FAILED(_listener.OpenLocal(DEFAULT_LOCAL_AGENT)))
+        {
+            printf("Not serving a local agent at %s\n", DEFAULT_LOCAL_AGENT);
+        }
 
-    // Create a SOCKET for connecting to server
-    ListenSocket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
-    if (ListenSocket == INVALID_SOCKET) {
-        printf("socket failed with error: %ld\n", WSAGetLastError());
-        freeaddrinfo(result);
-        WSACleanup();
-        return 1;
+        // Create and launch the listener thread.
+        _hThread = ::CreateThread(NULL, 0, SocketListener::_ThreadProc, (LPVOID) this, 0, NULL);
+        if (_hThread == NULL)
+        {
+            hr = HRESULT_FROM_WIN32(::GetLastError());
+        }
     }
 
-    // Setup the TCP listening socket
-    iResult = bind(ListenSocket, result->ai_addr, (int)result->ai_addrlen);
-    if (iResult == SOCKET_ERROR) {
-        printf("bind failed with error: %d\n", WSAGetLastError());
-        freeaddrinfo(result);
-        closesocket(ListenSocket);
-        WSACleanup();
-        return 1;
+    if (FAILED(hr))
+    {
+        _listener.Close();
     }
 
-    freeaddrinfo(result);
+    return hr;
+}
+BOOL SocketListener::GetConnectedStatus()
+{
+    return _fConnected;
+}
 
-    iResult = listen(ListenSocket, SOMAXCONN);
-    if (iResult == SOCKET_ERROR) {
-        printf("listen failed with error: %d\n", WSAGetLastError());
-        closesocket(ListenSocket);
-        WSACleanup();
-        return 1;
+// Called on one of the listener's workers each time a sender has pushed a complete
+// username and password. We hand the pair to the provider straight away, but only note
+// that our connected state changed; OnIdle tells LogonUI about it once the burst is over.
+void SocketListener::OnCredentialReceived(const char* pszUser, const char* pszPassword)
+{
+    CTraceScope trace("listener", "OnCredentialReceived");
+    HRESULT hr = _pProvider->SetCredential(pszUser, pszPassword);
+    if (FAILED(hr))
+    {
+        printf("Dropped a pushed credential: 0x%08x\n", (unsigned)hr);
+        return;
     }
 
-    // Accept a client socket
-    ClientSocket = accept(ListenSocket, NULL, NULL);
-    if (ClientSocket == INVALID_SOCKET) {
-        printf("accept failed with error: %d\n", WSAGetLastError());
-        closesocket(ListenSocket);
-        WSACleanup();
-        return 1;
-    }
+    std::lock_guard<std::mutex> guard(_lockCoalescer);
+    _coalescer.Signal(TRUE, ::GetTickCount64());
+}
 
-    // No longer need server socket
-    closesocket(ListenSocket);
-
-    // Receive until the peer shuts down the connection
-    //do {
-       
-        iResult = recv(ClientSocket, recvbuf, recvbuflen, 0);
-        if (iResult > 0) {
-            iSendResult = send(ClientSocket, "OK", 2, 0);
-            
-            if (iSendResult == SOCKET_ERROR) {
-                printf("send failed with error: %d\n", WSAGetLastError());
-                closesocket(ClientSocket);
-                WSACleanup();
-                return 1;
-            }
-            int i = 0;
-            char c = recvbuf[0];
-
-            char u[50];
-            while (c != '\0') {
-                u[i++] = c;
-                c = recvbuf[i];
-            }
-            u[i] = '\0';
-
-            iResult = recv(ClientSocket, recvbuf, recvbuflen, 0);
-            if (iResult > 0) {
-                iSendResult = send(ClientSocket, "OK", 2, 0);
-
-                if (iSendResult == SOCKET_ERROR) {
-                    printf("send failed with error: %d\n", WSAGetLastError());
-                    closesocket(ClientSocket);
-                    WSACleanup();
-                    return 1;
-                }
-                 i = 0;
-                 c = recvbuf[0];
-
-                char p[50];
-
-                while (c != '\0') {
-                    p[i++] = c;
-                    c = recvbuf[i];
-                }
-                p[i] = '\0';
-                _pProvider->_pszUserSid = new wchar_t[50];
-                _pProvider->_pszPassword = new wchar_t[50];
-                mbstowcs(_pProvider->_pszUserSid, u, strlen(u) + 1);//Plus null
-                mbstowcs(_pProvider->_pszPassword, p, strlen(p) + 1);//Plus null
-                iSendResult = send(ClientSocket, u, i, 0);
-            
-                
-                if (_fConnected) {
-                    _fConnected = !_fConnected;
-                     _pProvider->OnConnectStatusChanged();
-                }
-                _fConnected = !_fConnected;
-                _pProvider->OnConnectStatusChanged();
-                success = true;
-                //break;
-            }
-        }
-        else if (iResult == 0)
-            printf("Connection closing...\n");
-        else {
-            printf("recv failed with error: %d\n", WSAGetLastError());
-            closesocket(ClientSocket);
-            WSACleanup();
-            return 1;
-           
-        } 
-
-    //} while (iResult > 0);
-
-    // shutdown the connection since we're done
-    iResult = shutdown(ClientSocket, SD_SEND);
-    if (iResult == SOCKET_ERROR) {
-        printf("shutdown failed with error: %d\n", WSAGetLastError());
-        closesocket(ClientSocket);
-        WSACleanup();
-        return 1;
+// Called on one of the listener's workers when a sender withdraws a user. Their tile
+// goes at the next re-enumeration.
+HRESULT SocketListener::OnCredentialRevoked(const char* pszUser)
+{
+    CTraceScope trace("listener", "OnCredentialRevoked");
+    HRESULT hr = _pProvider->RemoveCredential(pszUser);
+    if (SUCCEEDED(hr))
+    {
+        std::lock_guard<std::mutex> guard(_lockCoalescer);
+        _coalescer.Signal(TRUE, ::GetTickCount64());
     }
-
-    // cleanup
-    closesocket(ClientSocket);
-    WSACleanup();
-
-
-
-    return 0;
+    return hr;
 }
 
-
-int SocketListener::Socket() {
-
-
-    SOCKET s;
-    struct sockaddr_in server, si_other;
-    int slen, recv_len;
-    char buf[BUFLEN];
-    WSADATA wsa;
-    int code = 0;
-    slen = sizeof(si_other);
-
-    //Initialise winsock
-    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0)
+// Called on one of the listener's workers with a batch of profiles from a provisioning server.
+// They go into the account database in one transaction. If we're serving lookups from
+// a compiled directory instead, the database is opened just for this, and the new
+// profiles only become findable once the directory is compiled again.
+HRESULT SocketListener::OnProfilesProvisioned(const PROFILE_UPDATE* rgUpdates, DWORD cUpdates)
+{
+    CTraceScope trace("listener", "OnProfilesProvisioned");
+    std::lock_guard<std::mutex> guard(_lockProvision);
+    HRESULT hr = S_OK;
+    if (!_store.IsOpen())
     {
-        code =  1;
-        exit(EXIT_FAILURE);
-
+        hr = _store.Open(DEFAULT_ACCOUNT_DB);
     }
-
-    //Create a socket
-    if ((s = socket(AF_INET, SOCK_DGRAM, 0)) == INVALID_SOCKET)
+    if (SUCCEEDED(hr))
     {
-        
+        hr = _store.Provision(rgUpdates, cUpdates);
     }
 
-    //Prepare the sockaddr_in structure
-    server.sin_family = AF_INET;
-    server.sin_addr.s_addr = INADDR_ANY;
-    server.sin_port = htons(PORT);
-
-    //Bind
-    if (bind(s, (struct sockaddr*)&server, sizeof(server)) == SOCKET_ERROR)
+    if (SUCCEEDED(hr) && _directory.IsOpen())
     {
-        code = 1;
-        exit(EXIT_FAILURE);
-       // exit(EXIT_FAILURE);
+        printf("Provisioned %lu profiles; recompile the directory to use them\n", (unsigned long)cUpdates);
     }
-    //puts("Bind done");
-
-    //keep listening for data
-    
-        //
-        memset(buf, '\0', BUFLEN);
-
-        if ((recv_len = recv(s, buf, BUFLEN, 0)) == SOCKET_ERROR)
-        {
-            code = 1;
-            exit(EXIT_FAILURE);
-
-        }
-        if (strcmp(buf, "ok") == 0) {
-            _fConnected = !_fConnected;
-            _pProvider->OnConnectStatusChanged();
-            closesocket(s);
-            WSACleanup();
-            code = 0; } else code = 1;
-      
-  
-
-    closesocket(s);
-    WSACleanup();
-    
-    return code;
+    else if (FAILED(hr))
+    {
+        printf("Provisioning %lu profiles failed: 0x%08x\n", (unsigned long)cUpdates, (unsigned)hr);
+    }
+    return hr;
 }
 
-/*
-int SocketListener::Socket2() {
-    bool success = false;
-
-    WSADATA wsaData;
-    int iResult;
-
-    SOCKET ListenSocket = INVALID_SOCKET;
-    SOCKET ClientSocket = INVALID_SOCKET;
-
-    struct addrinfo* result = NULL;
-    struct addrinfo hints;
-
-    int iSendResult;
-    char recvbuf[DEFAULT_BUFLEN];
-    int recvbuflen = DEFAULT_BUFLEN;
+// Called on the listener thread for each status event a sender sends us. Like pushes,
+// they only feed the coalescer; OnIdle reports the outcome once the burst is over.
+void SocketListener::OnStatusEvent(EVENT_TYPE type)
+{
+    CTraceScope trace("listener", "OnStatusEvent");
+    std::lock_guard<std::mutex> guard(_lockCoalescer);
+    ULONGLONG ullNow = ::GetTickCount64();
+    switch (type)
+    {
+    case ET_TOGGLE:
+        _coalescer.Signal(!_coalescer.GetState(), ullNow);
+        break;
 
-    // Initialize Winsock
-    iResult = WSAStartup(MAKEWORD(2, 2), &wsaData);
-    if (iResult != 0) {
-        printf("WSAStartup failed with error: %d\n", iResult);
-        return 1;
-    }
+    case ET_CONNECTED:
+        _coalescer.Signal(TRUE, ullNow);
+        break;
 
-    ZeroMemory(&hints, sizeof(hints));
-    hints.ai_family = AF_INET;
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_protocol = IPPROTO_TCP;
-    hints.ai_flags = AI_PASSIVE;
-
-    // Resolve the server address and port
-    iResult = getaddrinfo(NULL, DEFAULT_PORT, &hints, &result);
-    if (iResult != 0) {
-        printf("getaddrinfo failed with error: %d\n", iResult);
-        WSACleanup();
-        return 1;
-    }
+    case ET_DISCONNECTED:
+        _coalescer.Signal(FALSE, ullNow);
+        break;
 
-    // Create a SOCKET for connecting to server
-    ListenSocket = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
-    if (ListenSocket == INVALID_SOCKET) {
-        printf("socket failed with error: %ld\n", WSAGetLastError());
-        freeaddrinfo(result);
-        WSACleanup();
-        return 1;
-    }
+    case ET_REFRESH:
+        _coalescer.Signal(_coalescer.GetState(), ullNow);
+        break;
 
-    // Setup the TCP listening socket
-    iResult = bind(ListenSocket, result->ai_addr, (int)result->ai_addrlen);
-    if (iResult == SOCKET_ERROR) {
-        printf("bind failed with error: %d\n", WSAGetLastError());
-        freeaddrinfo(result);
-        closesocket(ListenSocket);
-        WSACleanup();
-        return 1;
+    case ET_DUMP_TIMINGS:
+        _DumpTimings();
+        if (CTraceLog::IsEnabled())
+        {
+            CTraceLog::GetShared()->Flush();
+        }
+        break;
     }
+}
 
-    freeaddrinfo(result);
+// Adds one account from the database to the provider's roster. Profiles that can't be
+// turned into a tile are skipped rather than failing the whole prefetch.
+HRESULT SocketListener::_PrefetchProfile(void* pv, const char* pchId, size_t cchId, const char* pszUser, const char* pszPassword)
+{
+    UNREFERENCED_PARAMETER(pchId);
+    UNREFERENCED_PARAMETER(cchId);
 
-    iResult = listen(ListenSocket, SOMAXCONN);
-    if (iResult == SOCKET_ERROR) {
-        printf("listen failed with error: %d\n", WSAGetLastError());
-        closesocket(ListenSocket);
-        WSACleanup();
-        return 1;
-    }
+    SocketListener* pThis = static_cast<SocketListener*>(pv);
+    HRESULT hr = pThis->_pProvider->SetCredential(pszUser, pszPassword);
+    return (hr == E_OUTOFMEMORY) ? hr : S_OK;
+}
 
-    // Accept a client socket
-    ClientSocket = accept(ListenSocket, NULL, NULL);
-    if (ClientSocket == INVALID_SOCKET) {
-        printf("accept failed with error: %d\n", WSAGetLastError());
-        closesocket(ListenSocket);
-        WSACleanup();
-        return 1;
+// Called on the listener thread between waits. If the coalescing window has closed on
+// some state changes, publishes the final state and has LogonUI re-enumerate once.
+DWORD SocketListener::OnIdle()
+{
+    ULONGLONG ullNow = ::GetTickCount64();
+    BOOL fConnected;
+    BOOL fChanged;
+    DWORD dwTimeout;
+    {
+        std::lock_guard<std::mutex> guard(_lockCoalescer);
+        fChanged = _coalescer.Flush(ullNow, &fConnected);
+        dwTimeout = _coalescer.GetTimeout(ullNow);
     }
 
-    // No longer need server socket
-    closesocket(ListenSocket);
-
-    // Receive until the peer shuts down the connection
-    do {
-
-
-        iResult = recv(ClientSocket, recvbuf, recvbuflen, 0);
-        if (iResult > 0) {
-
-            printf("Bytes received: %d\n", iResult);
-            sqlite3* db;
-            int rc;
-
-
-            rc = sqlite3_open("D:\\5samples\\AccountDB\\accountInfo.db", &db);
-
-            if (rc) {
-                fprintf(stderr, "Can't open database: %s\n", sqlite3_errmsg(db));
-            }
-            else {
-                fprintf(stderr, "Opened database successfully\n");
-
-
-            }
-            char sql[60] = "SELECT username, password FROM profile WHERE id=\"\0\0\0\0\0\0\0";
-            char* zErrMsg = 0;
-            uap data;
-
-            char c = recvbuf[0];
-            int x = 0;
-            while (c!='\0') {
-                sql[49 + x++] = c;
-                c = recvbuf[x];
-            }
-            sql[49 + x++] = '"';
-            sql[49 + x++] = ';';
-            sql[49 + x] = '\0';
-
-            rc = sqlite3_exec(db, sql, callback, &data, &zErrMsg);
-
-            if (rc != SQLITE_OK) {
-                fprintf(stderr, "SQL error: %s\n", zErrMsg);
-                sqlite3_close(db);
-
-
-            }
-            else {
-                fprintf(stdout, "Operation done successfully\n");
-                if (data.exist) {
-                    iSendResult = send(ClientSocket, "OK", iResult, 0);
-                    if (iSendResult == SOCKET_ERROR) {
-                        printf("send failed with error: %d\n", WSAGetLastError());
-                        closesocket(ClientSocket);
-                        WSACleanup();
-                        return 1;
-                    }
-                    printf("Bytes sent: %d\n", iSendResult);
-                    _pProvider->_pszUserSid = new wchar_t[50];
-                    _pProvider->_pszPassword = new wchar_t[50];
-                    mbstowcs(_pProvider->_pszUserSid, data.u, strlen(data.u) + 1);//Plus null
-                    mbstowcs(_pProvider->_pszPassword, data.p, strlen(data.p) + 1);//Plus null
-                    if (_fConnected) {
-                        _fConnected = !_fConnected;
-                        _pProvider->OnConnectStatusChanged();
-                    }
-                    _fConnected = !_fConnected;
-                    _pProvider->OnConnectStatusChanged();
-                    success = true;
-                    break;
-                }
-                else {
-                    iSendResult = send(ClientSocket, "USER NOT FOUND", 14, 0);
-                    if (iSendResult == SOCKET_ERROR) {
-                        printf("send failed with error: %d\n", WSAGetLastError());
-                        closesocket(ClientSocket);
-                        WSACleanup();
-                        return 1;
-                    }
-                    continue;
-                }
-            }
-
-
-
-            // Echo the buffer back to the sender
-
-        }
-        else if (iResult == 0)
-            printf("Connection closing...\n");
-        else {
-            printf("recv failed with error: %d\n", WSAGetLastError());
-            closesocket(ClientSocket);
-            WSACleanup();
-            return 1;
-
-        }
-
-    } while (iResult > 0);
-
-    // shutdown the connection since we're done
-    iResult = shutdown(ClientSocket, SD_SEND);
-    if (iResult == SOCKET_ERROR) {
-        printf("shutdown failed with error: %d\n", WSAGetLastError());
-        closesocket(ClientSocket);
-        WSACleanup();
-        return 1;
+    if (fChanged)
+    {
+        // LogonUI threads read this flag while we change it, so it's only ever swapped whole.
+        ::InterlockedExchange(&_fConnected, fConnected);
+        _pProvider->OnConnectStatusChanged();
     }
-
-    // cleanup
-    closesocket(ClientSocket);
-    WSACleanup();
-
-
-
-    return 0;
+    return dwTimeout;
 }
 
-*/
 DWORD WINAPI SocketListener::_ThreadProc(LPVOID lpParameter)
 {
     SocketListener *pCommandWindow = static_cast<SocketListener *>(lpParameter);
@@ -581,9 +342,7 @@ DWORD WINAPI SocketListener::_ThreadProc(LPVOID lpParameter)
     {
         return 0;
     }
-    while(true)
-        pCommandWindow->Socket2();
- 
+
+    pCommandWindow->_listener.Run(pCommandWindow);
     return 0;
 }
-
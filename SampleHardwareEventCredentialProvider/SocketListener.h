@@ -7,35 +7,48 @@
 // Copyright (c) 2006 Microsoft Corporation. All rights reserved.
 //
 // SocketListener provides a way to emulate external "connect" and "disconnect" 
-// events, which are invoked via toggle button on a window. The window is launched
-// and managed on a separate thread, which is necessary to ensure it gets pumped.
+// events, which are pushed to us over TCP, or sent as UDP status events, by a
+// trusted sender. The socket work is
+// done by a platform-neutral CCredentialListener running on a separate thread, with
+// a few workers of its own; SocketListener just hands what it receives to the provider.
 //
 
 #pragma once
 
-#include <windows.h>
+#include "ProviderCompat.h"
+#include <mutex>
 #include "CSampleProvider.h"
+#include "CredentialListener.h"
+#include "CredentialStore.h"
+#include "CredentialDirectory.h"
+#include "NotifyCoalescer.h"
 
-class SocketListener
+class SocketListener : public ICredentialSink
 {
 public:
     SocketListener(void);
     ~SocketListener(void);
     HRESULT Initialize(CSampleProvider *pProvider);
     BOOL GetConnectedStatus();
-    void ChangeState();
+    void OnCredentialReceived(const char* pszUser, const char* pszPassword);
+    HRESULT OnCredentialRevoked(const char* pszUser);
+    HRESULT OnProfilesProvisioned(const PROFILE_UPDATE* rgUpdates, DWORD cUpdates);
+    void OnStatusEvent(EVENT_TYPE type);
+    DWORD OnIdle();
 private:
-    HRESULT _MyRegisterClass(void);
-    HRESULT _InitInstance();
-    BOOL _ProcessNextMessage();
     static DWORD WINAPI _ThreadProc(LPVOID lpParameter);
-    static LRESULT CALLBACK    _WndProc(HWND, UINT, WPARAM, LPARAM);
-    int Socket();
-    int Socket2();
+    static HRESULT _PrefetchProfile(void* pv, const char* pchId, size_t cchId, const char* pszUser, const char* pszPassword);
+    void _PrintCounters(FILE* pFile);
+    void _DumpTimings();
 
     CSampleProvider                *_pProvider;        // Pointer to our owner.
-    HWND                        _hWnd;                // Handle to our window.
-    HWND                        _hWndButton;        // Handle to our window's button.
-    HINSTANCE                    _hInst;                // Current instance
-    BOOL                        _fConnected;        // Whether or not we're connected.
+    volatile LONG               _fConnected;        // Whether or not we're connected.
+    HANDLE                      _hThread;           // Our listener thread.
+    CCredentialStore            _store;             // The account database, for badge lookups.
+    CCredentialDirectory        _directory;         // A compiled copy of it, used instead if present.
+    CCredentialListener         _listener;          // Accepts and parses pushes from senders.
+    CNotifyCoalescer            _coalescer;         // Merges bursts of state changes.
+    std::mutex                  _lockCoalescer;     // Guards _coalescer, which the listener's workers signal.
+    char                        _szTimingsFile[MAX_PATH];   // Where ET_DUMP_TIMINGS writes to, if set.
+    std::mutex                  _lockProvision;     // Lets one batch of profiles at a time open and fill _store.
 };
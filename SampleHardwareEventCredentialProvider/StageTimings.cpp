@@ -0,0 +1,166 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+#include "StageTimings.h"
+#include <chrono>
+#include <stdio.h>
+
+static const char* s_rgpszStageNames[PS_COUNT] =
+{
+    "accept",
+    "recv",
+    "parse",
+    "lookup",
+    "OnConnectStatusChanged",
+    "CredentialsChanged",
+    "GetSerialization",
+    "KerbInteractiveUnlockLogonPack",
+};
+
+ULONGLONG StageClock()
+{
+    return (ULONGLONG)std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// The timings every stage in this process records into. Static storage starts out
+// zeroed, so there's nothing to set up.
+CStageTimings* CStageTimings::GetShared()
+{
+    static CStageTimings s_timings;
+    return &s_timings;
+}
+
+const char* CStageTimings::GetStageName(PIPELINE_STAGE stage)
+{
+    return (stage >= 0 && stage < PS_COUNT) ? s_rgpszStageNames[stage] : "?";
+}
+
+// Which bucket a duration is counted in. The first STAGE_SUB_BUCKETS * 2 buckets are a
+// nanosecond wide; after that each power of two is split STAGE_SUB_BUCKETS ways.
+DWORD CStageTimings::_BucketOf(ULONGLONG ullNs)
+{
+    if (ullNs < STAGE_SUB_BUCKETS * 2)
+    {
+        return (DWORD)ullNs;
+    }
+    if (ullNs >= (1ull << STAGE_MAX_BITS))
+    {
+        ullNs = (1ull << STAGE_MAX_BITS) - 1;
+    }
+
+    DWORD iTop = STAGE_SUB_BUCKET_BITS + 1;
+    while ((ullNs >> (iTop + 1)) != 0)
+    {
+        iTop++;
+    }
+    DWORD iShift = iTop - STAGE_SUB_BUCKET_BITS;
+    return (iShift + 1) * STAGE_SUB_BUCKETS + (DWORD)((ullNs >> iShift) & (STAGE_SUB_BUCKETS - 1));
+}
+
+// The longest duration counted in iBucket: what a percentile landing there reports.
+ULONGLONG CStageTimings::_HighestInBucket(DWORD iBucket)
+{
+    if (iBucket < STAGE_SUB_BUCKETS * 2)
+    {
+        return iBucket;
+    }
+    DWORD iShift = iBucket / STAGE_SUB_BUCKETS - 1;
+    ULONGLONG ullLow = (ULONGLONG)(STAGE_SUB_BUCKETS + iBucket % STAGE_SUB_BUCKETS) << iShift;
+    return ullLow + (1ull << iShift) - 1;
+}
+
+// Counts one sample of stage. Safe to call from any thread at any time.
+void CStageTimings::Record(PIPELINE_STAGE stage, ULONGLONG ullNs)
+{
+    // Threads are dealt out to shards in turn as they first record something.
+    static std::atomic<DWORD> s_iNextShard(0);
+    static thread_local DWORD t_iShard = s_iNextShard.fetch_add(1, std::memory_order_relaxed) % STAGE_SHARDS;
+
+    SHARD* pShard = &_rgShards[t_iShard];
+    pShard->rgCounts[stage][_BucketOf(ullNs)].fetch_add(1, std::memory_order_relaxed);
+    pShard->rgTotalNs[stage].fetch_add(ullNs, std::memory_order_relaxed);
+
+    ULONGLONG ullMax = pShard->rgMaxNs[stage].load(std::memory_order_relaxed);
+    while (ullNs > ullMax && !pShard->rgMaxNs[stage].compare_exchange_weak(ullMax, ullNs, std::memory_order_relaxed))
+    {
+    }
+}
+
+void CStageTimings::GetSummary(PIPELINE_STAGE stage, STAGE_SUMMARY* pSummary)
+{
+    ZeroMemory(pSummary, sizeof(*pSummary));
+
+    ULONGLONG rgCounts[STAGE_BUCKETS];
+    ULONGLONG ullTotalNs = 0;
+    for (DWORD iBucket = 0; iBucket < STAGE_BUCKETS; iBucket++)
+    {
+        rgCounts[iBucket] = 0;
+    }
+    for (DWORD iShard = 0; iShard < STAGE_SHARDS; iShard++)
+    {
+        SHARD* pShard = &_rgShards[iShard];
+        for (DWORD iBucket = 0; iBucket < STAGE_BUCKETS; iBucket++)
+        {
+            ULONGLONG c = pShard->rgCounts[stage][iBucket].load(std::memory_order_relaxed);
+            rgCounts[iBucket] += c;
+            pSummary->cSamples += c;
+        }
+        ullTotalNs += pShard->rgTotalNs[stage].load(std::memory_order_relaxed);
+        ULONGLONG ullMax = pShard->rgMaxNs[stage].load(std::memory_order_relaxed);
+        if (ullMax > pSummary->ullMaxNs)
+        {
+            pSummary->ullMaxNs = ullMax;
+        }
+    }
+    if (pSummary->cSamples == 0)
+    {
+        return;
+    }
+    pSummary->ullMeanNs = ullTotalNs / pSummary->cSamples;
+
+    // Each percentile is the highest value in the bucket holding the sample at that
+    // rank, except that nothing is reported above the longest sample actually seen.
+    struct { ULONGLONG* pullNs; ULONGLONG ullPerMille; } rgPercentiles[] =
+    {
+        { &pSummary->ullP50Ns, 500 },
+        { &pSummary->ullP99Ns, 990 },
+        { &pSummary->ullP999Ns, 999 },
+    };
+    ULONGLONG cSeen = 0;
+    DWORD iPercentile = 0;
+    for (DWORD iBucket = 0; iBucket < STAGE_BUCKETS && iPercentile < ARRAYSIZE(rgPercentiles); iBucket++)
+    {
+        cSeen += rgCounts[iBucket];
+        while (iPercentile < ARRAYSIZE(rgPercentiles) &&
+            cSeen * 1000 >= pSummary->cSamples * rgPercentiles[iPercentile].ullPerMille)
+        {
+            ULONGLONG ullNs = _HighestInBucket(iBucket);
+            *rgPercentiles[iPercentile].pullNs = (ullNs < pSummary->ullMaxNs) ? ullNs : pSummary->ullMaxNs;
+            iPercentile++;
+        }
+    }
+}
+
+// Writes a line for each stage that has been recorded, in microseconds.
+void CStageTimings::Print(FILE* pFile)
+{
+    fprintf(pFile, "%-32s %10s %10s %10s %10s %10s %10s\n", "Stage (us)", "count", "mean", "p50", "p99", "p99.9", "max");
+    for (int i = 0; i < PS_COUNT; i++)
+    {
+        STAGE_SUMMARY summary;
+        GetSummary((PIPELINE_STAGE)i, &summary);
+        if (summary.cSamples > 0)
+        {
+            fprintf(pFile, "%-32s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n", GetStageName((PIPELINE_STAGE)i),
+                (unsigned long long)summary.cSamples, summary.ullMeanNs / 1000.0, summary.ullP50Ns / 1000.0,
+                summary.ullP99Ns / 1000.0, summary.ullP999Ns / 1000.0, summary.ullMaxNs / 1000.0);
+        }
+    }
+}
@@ -0,0 +1,95 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Where the time goes between a sender pushing a credential and LogonUI submitting it.
+// Each stage of the way records how long it took into a histogram of its own, and
+// Print writes out the percentiles of each on demand.
+//
+// The histograms are log-linear, as in HdrHistogram: exact below STAGE_SUB_BUCKETS * 2
+// nanoseconds, and above that STAGE_SUB_BUCKETS buckets to each power of two, so a
+// reported value is never more than 1/STAGE_SUB_BUCKETS above the true one. Recording
+// is a couple of relaxed atomic adds to one of STAGE_SHARDS copies of the counters;
+// each thread sticks to its own copy, so threads don't fight over cache lines, and
+// nothing takes a lock. Readers add the copies up as they go, so a summary taken while
+// stages are being recorded may be a sample or two out, which is fine for this.
+
+#pragma once
+
+#include <atomic>
+#include <stdio.h>
+#include "PlatformCompat.h"
+
+enum PIPELINE_STAGE
+{
+    PS_ACCEPT               = 0,    // Accepting a connection and deciding whether to keep it.
+    PS_RECV                 = 1,    // One recv from a sender.
+    PS_PARSE                = 2,    // Picking requests out of a read, less carrying them out.
+    PS_LOOKUP               = 3,    // Resolving an FT_LOOKUP id to a profile.
+    PS_CONNECT_STATUS       = 4,    // CSampleProvider::OnConnectStatusChanged, start to finish.
+    PS_CREDENTIALS_CHANGED  = 5,    // LogonUI's CredentialsChanged, within the above.
+    PS_GET_SERIALIZATION    = 6,    // CSampleCredential::GetSerialization, start to finish.
+    PS_PACK                 = 7,    // Packing the KERB_INTERACTIVE_UNLOCK_LOGON, within the above.
+    PS_COUNT                = 8,
+};
+
+#define STAGE_SUB_BUCKET_BITS   4
+#define STAGE_SUB_BUCKETS       (1 << STAGE_SUB_BUCKET_BITS)
+#define STAGE_MAX_BITS          40      // Longer than 2^40 ns (about 18 minutes) counts as that.
+#define STAGE_BUCKETS           (STAGE_SUB_BUCKETS * (STAGE_MAX_BITS - STAGE_SUB_BUCKET_BITS + 1))
+#define STAGE_SHARDS            8
+
+struct STAGE_SUMMARY
+{
+    ULONGLONG   cSamples;
+    ULONGLONG   ullMeanNs;
+    ULONGLONG   ullP50Ns;
+    ULONGLONG   ullP99Ns;
+    ULONGLONG   ullP999Ns;
+    ULONGLONG   ullMaxNs;
+};
+
+// Nanoseconds since some fixed point in the past, for timing stages with.
+ULONGLONG StageClock();
+
+class CStageTimings
+{
+  public:
+    static CStageTimings* GetShared();
+
+    void Record(PIPELINE_STAGE stage, ULONGLONG ullNs);
+    void GetSummary(PIPELINE_STAGE stage, STAGE_SUMMARY* pSummary);
+    void Print(FILE* pFile);
+    static const char* GetStageName(PIPELINE_STAGE stage);
+
+  private:
+    CStageTimings() {}
+
+    struct alignas(64) SHARD
+    {
+        std::atomic<ULONGLONG>  rgCounts[PS_COUNT][STAGE_BUCKETS];
+        std::atomic<ULONGLONG>  rgTotalNs[PS_COUNT];
+        std::atomic<ULONGLONG>  rgMaxNs[PS_COUNT];
+    };
+
+    static DWORD _BucketOf(ULONGLONG ullNs);
+    static ULONGLONG _HighestInBucket(DWORD iBucket);
+
+    SHARD   _rgShards[STAGE_SHARDS];
+};
+
+// Times the scope it's declared in as one sample of a stage.
+class CStageTimer
+{
+  public:
+    CStageTimer(PIPELINE_STAGE stage) : _stage(stage), _ullStart(StageClock()) {}
+    ~CStageTimer() { CStageTimings::GetShared()->Record(_stage, StageClock() - _ullStart); }
+
+  private:
+    PIPELINE_STAGE  _stage;
+    ULONGLONG       _ullStart;
+};
@@ -0,0 +1,229 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+#include "TraceLog.h"
+#include "StageTimings.h"
+#include <new>
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+std::atomic<BOOL> CTraceLog::s_fEnabled(FALSE);
+
+static_assert((TRACE_RING_EVENTS & (TRACE_RING_EVENTS - 1)) == 0, "TRACE_RING_EVENTS must be a power of two");
+
+CTraceLog::CTraceLog() : _cRings(0), _cDropped(0)
+{
+    _szPath[0] = '\0';
+    ZeroMemory(_rgpRings, sizeof(_rgpRings));
+}
+
+// Only runs as the process, or the DLL, goes away, when nobody can be recording.
+CTraceLog::~CTraceLog()
+{
+    s_fEnabled = FALSE;
+    for (DWORD i = 0; i < _cRings; i++)
+    {
+        delete _rgpRings[i];
+    }
+}
+
+// The log every thread in this process records into.
+CTraceLog* CTraceLog::GetShared()
+{
+    static CTraceLog s_log;
+    return &s_log;
+}
+
+//
+// Starts recording, for Flush to write to pszPath. Whatever was recorded before is
+// kept. Calling it while already recording just changes the path.
+//
+HRESULT CTraceLog::Start(const char* pszPath)
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    if (strlen(pszPath) >= ARRAYSIZE(_szPath))
+    {
+        return E_INVALIDARG;
+    }
+    strcpy(_szPath, pszPath);
+    s_fEnabled = TRUE;
+    return S_OK;
+}
+
+// Stops recording and writes out what was recorded.
+void CTraceLog::Stop()
+{
+    if (s_fEnabled.exchange(FALSE))
+    {
+        Flush();
+    }
+}
+
+// Returns the calling thread's ring, making it one the first time. Returns NULL once
+// TRACE_MAX_THREADS threads have one.
+CTraceLog::TRACE_RING* CTraceLog::_GetRing()
+{
+    static thread_local TRACE_RING* t_pRing = NULL;
+    static thread_local BOOL t_fRingless = FALSE;
+
+    if (t_pRing == NULL && !t_fRingless)
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        DWORD cRings = _cRings.load(std::memory_order_relaxed);
+        TRACE_RING* pRing = (cRings < TRACE_MAX_THREADS) ? new (std::nothrow) TRACE_RING() : NULL;
+        if (pRing != NULL)
+        {
+#ifdef _WIN32
+            pRing->dwThread = GetCurrentThreadId();
+#else
+            pRing->dwThread = cRings + 1;
+#endif
+            _rgpRings[cRings] = pRing;
+            _cRings.store(cRings + 1, std::memory_order_release);
+            t_pRing = pRing;
+        }
+        else
+        {
+            t_fRingless = TRUE;
+        }
+    }
+    return t_pRing;
+}
+
+// Adds an event to the calling thread's ring, overwriting its oldest if it's full.
+void CTraceLog::Record(const char* pszCategory, const char* pszName, char chPhase)
+{
+    TRACE_RING* pRing = _GetRing();
+    if (pRing == NULL)
+    {
+        _cDropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    ULONGLONG iEvent = pRing->cEvents.load(std::memory_order_relaxed);
+    TRACE_EVENT* pEvent = &pRing->rgEvents[iEvent & (TRACE_RING_EVENTS - 1)];
+    pEvent->pszCategory.store(pszCategory, std::memory_order_relaxed);
+    pEvent->pszName.store(pszName, std::memory_order_relaxed);
+    pEvent->ullTimestampNs.store(StageClock(), std::memory_order_relaxed);
+    pEvent->chPhase.store(chPhase, std::memory_order_relaxed);
+    pRing->cEvents.store(iEvent + 1, std::memory_order_release);
+}
+
+//
+// Writes every event still in the rings to the file Start was given, replacing it, as
+// a Chrome trace. Recording carries on meanwhile; anything recorded after a ring has
+// been copied waits for the next Flush.
+//
+HRESULT CTraceLog::Flush()
+{
+    std::lock_guard<std::mutex> guard(_lock);
+    if (_szPath[0] == '\0')
+    {
+        return E_UNEXPECTED;
+    }
+
+    FILE* pFile = fopen(_szPath, "w");
+    if (pFile == NULL)
+    {
+        return E_FAIL;
+    }
+
+#ifdef _WIN32
+    DWORD dwProcess = GetCurrentProcessId();
+#else
+    DWORD dwProcess = (DWORD)getpid();
+#endif
+
+    TRACE_RING* pCopy = new (std::nothrow) TRACE_RING();
+    if (pCopy == NULL)
+    {
+        fclose(pFile);
+        return E_OUTOFMEMORY;
+    }
+
+    fprintf(pFile, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+    BOOL fFirst = TRUE;
+    DWORD cRings = _cRings.load(std::memory_order_acquire);
+    for (DWORD iRing = 0; iRing < cRings; iRing++)
+    {
+        TRACE_RING* pRing = _rgpRings[iRing];
+
+        // Copy the ring, then see how far its thread got meanwhile: the events it may
+        // have lapped while we were copying can't be trusted.
+        ULONGLONG cEvents = pRing->cEvents.load(std::memory_order_acquire);
+        ULONGLONG iFirst = (cEvents > TRACE_RING_EVENTS) ? cEvents - TRACE_RING_EVENTS : 0;
+        for (ULONGLONG i = iFirst; i < cEvents; i++)
+        {
+            TRACE_EVENT* pFrom = &pRing->rgEvents[i & (TRACE_RING_EVENTS - 1)];
+            TRACE_EVENT* pTo = &pCopy->rgEvents[i & (TRACE_RING_EVENTS - 1)];
+            pTo->pszCategory.store(pFrom->pszCategory.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            pTo->pszName.store(pFrom->pszName.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            pTo->ullTimestampNs.store(pFrom->ullTimestampNs.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            pTo->chPhase.store(pFrom->chPhase.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        ULONGLONG cEventsAfter = pRing->cEvents.load(std::memory_order_relaxed);
+        if (cEventsAfter > TRACE_RING_EVENTS && cEventsAfter - TRACE_RING_EVENTS > iFirst)
+        {
+            iFirst = cEventsAfter - TRACE_RING_EVENTS;
+        }
+
+        // Once a ring has wrapped, it can start partway into spans whose beginnings
+        // have been overwritten; their ends are left out, so every end has a begin.
+        DWORD cOpen = 0;
+        for (ULONGLONG i = iFirst; i < cEvents; i++)
+        {
+            TRACE_EVENT* pEvent = &pCopy->rgEvents[i & (TRACE_RING_EVENTS - 1)];
+            char chPhase = pEvent->chPhase.load(std::memory_order_relaxed);
+            if (chPhase == TRACE_PHASE_BEGIN)
+            {
+                cOpen++;
+            }
+            else if (chPhase == TRACE_PHASE_END)
+            {
+                if (cOpen == 0)
+                {
+                    continue;
+                }
+                cOpen--;
+            }
+
+            ULONGLONG ullNs = pEvent->ullTimestampNs.load(std::memory_order_relaxed);
+            fprintf(pFile, "%s{\"cat\":\"%s\",\"name\":\"%s\",\"ph\":\"%c\",%s\"ts\":%llu.%03u,\"pid\":%lu,\"tid\":%lu}",
+                fFirst ? "" : ",\n",
+                pEvent->pszCategory.load(std::memory_order_relaxed), pEvent->pszName.load(std::memory_order_relaxed),
+                chPhase, (chPhase == TRACE_PHASE_INSTANT) ? "\"s\":\"t\"," : "",
+                (unsigned long long)(ullNs / 1000), (unsigned)(ullNs % 1000),
+                (unsigned long)dwProcess, (unsigned long)pRing->dwThread);
+            fFirst = FALSE;
+        }
+    }
+    fprintf(pFile, "\n]}\n");
+    delete pCopy;
+
+    HRESULT hr = S_OK;
+    if (ferror(pFile))
+    {
+        hr = E_FAIL;
+    }
+    if (fclose(pFile) != 0)
+    {
+        hr = E_FAIL;
+    }
+
+    DWORD cDropped = _cDropped.load(std::memory_order_relaxed);
+    if (cDropped > 0)
+    {
+        printf("Trace: %lu events from threads past the first %u weren't recorded\n", (unsigned long)cDropped, TRACE_MAX_THREADS);
+    }
+    return hr;
+}
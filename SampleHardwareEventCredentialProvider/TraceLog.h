@@ -0,0 +1,112 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// An opt-in record of what the provider, its tiles and the listener were doing, and
+// when, for working out afterwards why an unlock was slow. Flush writes it out in the
+// Chrome trace event format, which chrome://tracing and Perfetto display as a timeline
+// with a row per thread.
+//
+// Each thread that records anything gets a ring of its own holding its last
+// TRACE_RING_EVENTS events, so recording takes no lock and never allocates after the
+// first event. A thread's ring is written only by that thread; Flush copies the rings
+// as they stand, and skips any event that was overwritten while it was copying, and
+// the ends of spans whose beginnings were.
+//
+// While tracing is off, a CTraceScope costs one relaxed load.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include "PlatformCompat.h"
+
+#define TRACE_RING_EVENTS   4096    // Must be a power of two.
+#define TRACE_MAX_THREADS   64      // Threads beyond this many go unrecorded.
+
+// Chrome's phases: the start and end of a span, or a moment.
+#define TRACE_PHASE_BEGIN   'B'
+#define TRACE_PHASE_END     'E'
+#define TRACE_PHASE_INSTANT 'i'
+
+class CTraceLog
+{
+  public:
+    static CTraceLog* GetShared();
+    ~CTraceLog();
+
+    HRESULT Start(const char* pszPath);
+    void Stop();
+    HRESULT Flush();
+
+    // Names and categories must be string literals, or otherwise live as long as the process.
+    void Record(const char* pszCategory, const char* pszName, char chPhase);
+    static BOOL IsEnabled() { return s_fEnabled.load(std::memory_order_relaxed); }
+
+  private:
+    CTraceLog();
+
+    struct TRACE_EVENT
+    {
+        std::atomic<const char*>    pszCategory;
+        std::atomic<const char*>    pszName;
+        std::atomic<ULONGLONG>      ullTimestampNs;
+        std::atomic<char>           chPhase;
+    };
+
+    struct TRACE_RING
+    {
+        DWORD                   dwThread;   // Shown as the thread id.
+        std::atomic<ULONGLONG>  cEvents;    // Ever recorded; the latest is at (cEvents - 1) % TRACE_RING_EVENTS.
+        TRACE_EVENT             rgEvents[TRACE_RING_EVENTS];
+    };
+
+    TRACE_RING* _GetRing();
+
+    static std::atomic<BOOL>    s_fEnabled;
+
+    std::mutex                  _lock;          // Guards everything but the rings' contents.
+    char                        _szPath[MAX_PATH];
+    TRACE_RING                  *_rgpRings[TRACE_MAX_THREADS];
+    std::atomic<DWORD>          _cRings;
+    std::atomic<DWORD>          _cDropped;      // Events from threads that didn't get a ring.
+};
+
+// Records the scope it's declared in as a span, if tracing was on when it began.
+class CTraceScope
+{
+  public:
+    CTraceScope(const char* pszCategory, const char* pszName) : _pszCategory(pszCategory), _pszName(pszName)
+    {
+        _fActive = CTraceLog::IsEnabled();
+        if (_fActive)
+        {
+            CTraceLog::GetShared()->Record(_pszCategory, _pszName, TRACE_PHASE_BEGIN);
+        }
+    }
+    ~CTraceScope()
+    {
+        if (_fActive)
+        {
+            CTraceLog::GetShared()->Record(_pszCategory, _pszName, TRACE_PHASE_END);
+        }
+    }
+
+  private:
+    const char  *_pszCategory;
+    const char  *_pszName;
+    BOOL        _fActive;
+};
+
+// Records a moment, if tracing is on.
+inline void TraceInstant(const char* pszCategory, const char* pszName)
+{
+    if (CTraceLog::IsEnabled())
+    {
+        CTraceLog::GetShared()->Record(pszCategory, pszName, TRACE_PHASE_INSTANT);
+    }
+}
@@ -0,0 +1,197 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+
+#include "Utf8.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define UTF8_USE_SSE2
+#endif
+
+//
+// Widens as many leading ASCII bytes as it can, 16 (or 8) at a time, and returns how
+// many it did. Stops at the first block holding a non-ASCII byte, or when fewer than a
+// block's worth of input or output is left; the caller finishes up one byte at a time.
+//
+static size_t _WidenAscii(const BYTE* pb, size_t cb, WCHAR* pwz)
+{
+    size_t i = 0;
+
+#ifdef UTF8_USE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= cb; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(pb + i));
+        if (_mm_movemask_epi8(bytes) != 0)
+        {
+            break;
+        }
+        _mm_storeu_si128((__m128i*)(pwz + i), _mm_unpacklo_epi8(bytes, zero));
+        _mm_storeu_si128((__m128i*)(pwz + i + 8), _mm_unpackhi_epi8(bytes, zero));
+    }
+#else
+    for (; i + 8 <= cb; i += 8)
+    {
+        ULONGLONG ull;
+        CopyMemory(&ull, pb + i, sizeof(ull));
+        if ((ull & 0x8080808080808080ull) != 0)
+        {
+            break;
+        }
+        for (size_t k = 0; k < 8; k++)
+        {
+            pwz[i + k] = (WCHAR)pb[i + k];
+        }
+    }
+#endif
+
+    return i;
+}
+
+//
+// Converts cch bytes of UTF-8 at pch into UTF-16 at pwz, which holds cchMax characters,
+// and null-terminates the result. *pcchWritten gets the length, not counting the null.
+//
+// Fails with ERROR_NO_UNICODE_TRANSLATION on anything that isn't well-formed UTF-8
+// (overlong forms, surrogates, values past U+10FFFF, truncated sequences) and with
+// ERROR_INSUFFICIENT_BUFFER if the result won't fit, whichever it runs into first. Either
+// way pwz is left as an empty string, so a partial secret is never left behind in it.
+//
+HRESULT Utf8ToUtf16(const char* pch, size_t cch, WCHAR* pwz, size_t cchMax, size_t* pcchWritten)
+{
+    if (cchMax == 0)
+    {
+        return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+    }
+
+    const BYTE* pb = (const BYTE*)pch;
+    size_t ib = 0;
+    size_t iwz = 0;
+    size_t cchRoom = cchMax - 1;        // Keep one for the null.
+    HRESULT hr = S_OK;
+
+    while (ib < cch && SUCCEEDED(hr))
+    {
+        // Most names and passwords are plain ASCII, so try the fast path first. It never
+        // reads past the input or writes past the room we have left.
+        size_t cbRun = cch - ib;
+        if (cbRun > cchRoom - iwz)
+        {
+            cbRun = cchRoom - iwz;
+        }
+        size_t cAscii = _WidenAscii(pb + ib, cbRun, pwz + iwz);
+        ib += cAscii;
+        iwz += cAscii;
+        if (ib == cch)
+        {
+            break;
+        }
+
+        // Then one sequence at a time until we're (hopefully) back into ASCII.
+        BYTE b = pb[ib];
+        DWORD dwCodePoint;
+        size_t cbSequence;
+        if (b < 0x80)
+        {
+            dwCodePoint = b;
+            cbSequence = 1;
+        }
+        else if (b >= 0xC2 && b <= 0xDF)
+        {
+            dwCodePoint = b & 0x1F;
+            cbSequence = 2;
+        }
+        else if (b >= 0xE0 && b <= 0xEF)
+        {
+            dwCodePoint = b & 0x0F;
+            cbSequence = 3;
+        }
+        else if (b >= 0xF0 && b <= 0xF4)
+        {
+            dwCodePoint = b & 0x07;
+            cbSequence = 4;
+        }
+        else
+        {
+            // A stray continuation byte, or a lead byte that can only start an overlong
+            // or out-of-range sequence.
+            hr = HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION);
+            break;
+        }
+
+        if (cbSequence > cch - ib)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION);
+            break;
+        }
+        for (size_t k = 1; k < cbSequence; k++)
+        {
+            BYTE bNext = pb[ib + k];
+            if ((bNext & 0xC0) != 0x80)
+            {
+                hr = HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION);
+                break;
+            }
+            dwCodePoint = (dwCodePoint << 6) | (bNext & 0x3F);
+        }
+        if (FAILED(hr))
+        {
+            break;
+        }
+
+        // The lead byte ruled out most bad values; these are the ones it can't.
+        if ((cbSequence == 3 && (dwCodePoint < 0x800 || (dwCodePoint >= 0xD800 && dwCodePoint <= 0xDFFF))) ||
+            (cbSequence == 4 && (dwCodePoint < 0x10000 || dwCodePoint > 0x10FFFF)))
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION);
+            break;
+        }
+
+        size_t cwch = (dwCodePoint >= 0x10000) ? 2 : 1;
+        if (cwch > cchRoom - iwz)
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+            break;
+        }
+        if (cwch == 2)
+        {
+            dwCodePoint -= 0x10000;
+            pwz[iwz++] = (WCHAR)(0xD800 | (dwCodePoint >> 10));
+            pwz[iwz++] = (WCHAR)(0xDC00 | (dwCodePoint & 0x3FF));
+        }
+        else
+        {
+            pwz[iwz++] = (WCHAR)dwCodePoint;
+        }
+        ib += cbSequence;
+    }
+
+    // The fast path stops when the room runs out, not when the input does.
+    if (SUCCEEDED(hr) && ib < cch)
+    {
+        hr = HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        pwz[iwz] = 0;
+        if (pcchWritten != NULL)
+        {
+            *pcchWritten = iwz;
+        }
+    }
+    else
+    {
+        SecureZeroMemory(pwz, iwz * sizeof(WCHAR));
+        pwz[0] = 0;
+    }
+
+    return hr;
+}
@@ -0,0 +1,17 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Senders push usernames and passwords as UTF-8; LogonUI wants UTF-16. This converts
+// between them without the C runtime's locale, and without ever writing past the
+// caller's buffer.
+
+#pragma once
+
+#include "PlatformCompat.h"
+
+HRESULT Utf8ToUtf16(const char* pch, size_t cch, WCHAR* pwz, size_t cchMax, size_t* pcchWritten);
@@ -0,0 +1,206 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+//
+#include "WorkerPool.h"
+#include <new>
+
+CWorkerPool::CWorkerPool() :
+    _rgWorkers(NULL), _cWorkers(0), _cMaxPending(0), _cPending(0), _cQueued(0), _iNext(0),
+    _fStopping(FALSE), _cRun(0), _cStolen(0), _cRefused(0)
+{
+}
+
+CWorkerPool::~CWorkerPool()
+{
+    Stop();
+}
+
+//
+// Starts cWorkers threads. At most cMaxPending items may be queued or running at once.
+//
+HRESULT CWorkerPool::Start(DWORD cWorkers, DWORD cMaxPending)
+{
+    if (_rgWorkers != NULL)
+    {
+        return E_FAIL;
+    }
+    if (cWorkers == 0 || cWorkers > WORKER_POOL_MAX_WORKERS || cMaxPending == 0)
+    {
+        return E_INVALIDARG;
+    }
+
+    _rgWorkers = new (std::nothrow) WORKER[cWorkers];
+    if (_rgWorkers == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    // Set before any worker starts, since they steal from all cWorkers queues.
+    _cWorkers = cWorkers;
+    _cMaxPending = cMaxPending;
+    _fStopping = FALSE;
+
+    HRESULT hr = S_OK;
+    for (DWORD i = 0; i < cWorkers && SUCCEEDED(hr); i++)
+    {
+        try
+        {
+            _rgWorkers[i].thread = std::thread(&CWorkerPool::_Run, this, i);
+        }
+        catch (...)
+        {
+            hr = E_OUTOFMEMORY;
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        Stop();
+    }
+    return hr;
+}
+
+//
+// Runs whatever is still queued, then stops the workers. Nothing may be submitted
+// once this has been called.
+//
+void CWorkerPool::Stop()
+{
+    if (_rgWorkers == NULL)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(_lockIdle);
+        _fStopping = TRUE;
+    }
+    _cvWork.notify_all();
+
+    for (DWORD i = 0; i < _cWorkers; i++)
+    {
+        if (_rgWorkers[i].thread.joinable())
+        {
+            _rgWorkers[i].thread.join();
+        }
+    }
+
+    delete[] _rgWorkers;
+    _rgWorkers = NULL;
+    _cWorkers = 0;
+}
+
+BOOL CWorkerPool::IsRunning()
+{
+    return _cWorkers > 0;
+}
+
+// Whether Submit would refuse an item right now. A pool that isn't running never is.
+BOOL CWorkerPool::IsSaturated()
+{
+    return _cWorkers > 0 && _cPending.load() >= _cMaxPending;
+}
+
+//
+// Queues pfn(pv) to be run on one of the workers. Fails with ERROR_BUSY, without
+// queueing it, if the pool already holds as many items as it was started with room for.
+//
+HRESULT CWorkerPool::Submit(PFN_WORK_ITEM pfn, void* pv)
+{
+    if (_cWorkers == 0)
+    {
+        return E_FAIL;
+    }
+    if (_cPending.fetch_add(1) >= _cMaxPending)
+    {
+        _cPending--;
+        _cRefused++;
+        return HRESULT_FROM_WIN32(ERROR_BUSY);
+    }
+
+    WORK_ITEM item = { pfn, pv };
+    WORKER* pWorker = &_rgWorkers[_iNext++ % _cWorkers];
+    try
+    {
+        std::lock_guard<std::mutex> guard(pWorker->lock);
+        pWorker->items.push_back(item);
+    }
+    catch (...)
+    {
+        _cPending--;
+        return E_OUTOFMEMORY;
+    }
+
+    // Taking the lock, however briefly, means a worker that has just found nothing to
+    // do is either already asleep, and gets the notification, or hasn't yet checked
+    // _cQueued, and will see this item.
+    _cQueued++;
+    {
+        std::lock_guard<std::mutex> guard(_lockIdle);
+    }
+    _cvWork.notify_one();
+    return S_OK;
+}
+
+void CWorkerPool::GetCounters(WORKER_POOL_COUNTERS* pCounters)
+{
+    pCounters->cRun = _cRun.load();
+    pCounters->cStolen = _cStolen.load();
+    pCounters->cRefused = _cRefused.load();
+}
+
+// Takes an item for worker iWorker: the newest from its own queue if it has any,
+// otherwise the oldest from the next worker along that has some.
+BOOL CWorkerPool::_Take(DWORD iWorker, WORK_ITEM* pItem)
+{
+    for (DWORD i = 0; i < _cWorkers; i++)
+    {
+        WORKER* pVictim = &_rgWorkers[(iWorker + i) % _cWorkers];
+        std::lock_guard<std::mutex> guard(pVictim->lock);
+        if (!pVictim->items.empty())
+        {
+            if (i == 0)
+            {
+                *pItem = pVictim->items.back();
+                pVictim->items.pop_back();
+            }
+            else
+            {
+                *pItem = pVictim->items.front();
+                pVictim->items.pop_front();
+                _cStolen++;
+            }
+            _cQueued--;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+void CWorkerPool::_Run(DWORD iWorker)
+{
+    for (;;)
+    {
+        WORK_ITEM item;
+        if (_Take(iWorker, &item))
+        {
+            item.pfn(item.pv);
+            _cRun++;
+            _cPending--;
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(_lockIdle);
+        _cvWork.wait(guard, [this] { return _fStopping || _cQueued.load() > 0; });
+        if (_fStopping && _cQueued.load() == 0)
+        {
+            break;
+        }
+    }
+}
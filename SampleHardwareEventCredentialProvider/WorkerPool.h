@@ -0,0 +1,85 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// A small pool of threads for the listener's per-read work: parsing, profile lookups
+// and handing credentials to the provider. Each worker has its own queue. Work is
+// dealt out to the queues in turn; a worker takes the newest item from its own queue,
+// and when that's empty steals the oldest item from somebody else's, so one slow item
+// (a sqlite fallback, a contended roster) doesn't hold up the work queued behind it.
+//
+// The pool holds a bounded number of items. Submit refuses more than that, and the
+// listener checks IsSaturated before reading, so a flood of senders is held back by
+// TCP rather than by an ever-growing queue.
+//
+// Items may run in any order and on any worker; callers that care about ordering
+// must keep dependent items from being queued together.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include "PlatformCompat.h"
+
+// The most workers a pool may have.
+#define WORKER_POOL_MAX_WORKERS 16
+
+typedef void (*PFN_WORK_ITEM)(void* pv);
+
+struct WORKER_POOL_COUNTERS
+{
+    DWORD   cRun;           // Items run.
+    DWORD   cStolen;        // Items run by a worker other than the one they were queued to.
+    DWORD   cRefused;       // Items Submit refused because the pool was full.
+};
+
+class CWorkerPool
+{
+  public:
+    CWorkerPool();
+    ~CWorkerPool();
+
+    HRESULT Start(DWORD cWorkers, DWORD cMaxPending);
+    void Stop();
+    BOOL IsRunning();
+    BOOL IsSaturated();
+    HRESULT Submit(PFN_WORK_ITEM pfn, void* pv);
+    void GetCounters(WORKER_POOL_COUNTERS* pCounters);
+
+  private:
+    struct WORK_ITEM
+    {
+        PFN_WORK_ITEM   pfn;
+        void            *pv;
+    };
+
+    struct WORKER
+    {
+        std::mutex              lock;       // Guards items.
+        std::deque<WORK_ITEM>   items;      // Owner takes from the back, thieves from the front.
+        std::thread             thread;
+    };
+
+    void _Run(DWORD iWorker);
+    BOOL _Take(DWORD iWorker, WORK_ITEM* pItem);
+
+    WORKER                  *_rgWorkers;
+    DWORD                   _cWorkers;
+    DWORD                   _cMaxPending;       // Submit refuses items past this many.
+    std::atomic<DWORD>      _cPending;          // Items submitted and not yet finished.
+    std::atomic<DWORD>      _cQueued;           // Items sitting in a queue.
+    std::atomic<DWORD>      _iNext;             // The queue the next item goes to.
+    std::mutex              _lockIdle;          // Held to sleep on, or wake, _cvWork.
+    std::condition_variable _cvWork;
+    BOOL                    _fStopping;         // Guarded by _lockIdle.
+    std::atomic<DWORD>      _cRun;
+    std::atomic<DWORD>      _cStolen;
+    std::atomic<DWORD>      _cRefused;
+};
@@ -11,11 +11,7 @@
 // and which fields show in which states of LogonUI.
 
 #pragma once
-#include <credentialprovider.h>
-#include <ntsecapi.h>
-#define SECURITY_WIN32
-#include <security.h>
-#include <intsafe.h>
+#include "ProviderCompat.h"
 
 #define MAX_ULONG  ((ULONG)(-1))
 
@@ -71,14 +67,14 @@ static const FIELD_STATE_PAIR s_rgMessageFieldStatePairs[] =
 // The third is the name of the field, NOT the value which will appear in the field.
 static const CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR s_rgCredProvFieldDescriptors[] =
 {
-    { SFI_TILEIMAGE, CPFT_TILE_IMAGE, L"Image" },
-    { SFI_USERNAME, CPFT_LARGE_TEXT, L"Username" },
-    { SFI_PASSWORD, CPFT_PASSWORD_TEXT, L"Password" },
-    { SFI_SUBMIT_BUTTON, CPFT_SUBMIT_BUTTON, L"Submit" },
+    { SFI_TILEIMAGE, CPFT_TILE_IMAGE, UTF16("Image") },
+    { SFI_USERNAME, CPFT_LARGE_TEXT, UTF16("Username") },
+    { SFI_PASSWORD, CPFT_PASSWORD_TEXT, UTF16("Password") },
+    { SFI_SUBMIT_BUTTON, CPFT_SUBMIT_BUTTON, UTF16("Submit") },
 };
 
 // Same as s_rgCredProvFieldDescriptors above, but for the CMessageCredential.
 static const CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR s_rgMessageCredProvFieldDescriptors[] =
 {
-    { SMFI_MESSAGE, CPFT_LARGE_TEXT, L"PleaseConnect" },
+    { SMFI_MESSAGE, CPFT_LARGE_TEXT, UTF16("PleaseConnect") },
 };
\ No newline at end of file
@@ -1,2 +1,7 @@
+#ifdef _WIN32
 #include <initguid.h>
+#else
+#define INITGUID
+#include "ProviderCompat.h"
+#endif
 #include "guid.h"
\ No newline at end of file
@@ -11,8 +11,17 @@
 
 
 #include "helpers.h"
-#include <intsafe.h>
-#include <wincred.h>
+#include "KerbPack.h"
+#include <stddef.h>
+
+// KerbPack.h works out the packed layout rather than taking it from the SDK headers;
+// make sure the two agree for the pointer size we're building.
+static_assert(sizeof(KERB_INTERACTIVE_UNLOCK_LOGON) == CKerbNativePacker::cbHeader, "packed header size");
+static_assert(offsetof(KERB_INTERACTIVE_LOGON, LogonDomainName) == CKerbNativePacker::ibDomain, "domain offset");
+static_assert(offsetof(KERB_INTERACTIVE_LOGON, UserName) == CKerbNativePacker::ibUser, "username offset");
+static_assert(offsetof(KERB_INTERACTIVE_LOGON, Password) == CKerbNativePacker::ibPassword, "password offset");
+static_assert(offsetof(KERB_INTERACTIVE_UNLOCK_LOGON, LogonId) == CKerbNativePacker::ibLogonId, "LUID offset");
+static_assert(offsetof(UNICODE_STRING, Buffer) == CKerbNativePacker::ibStringBuffer, "UNICODE_STRING layout");
 
 // 
 // Copies the field descriptor pointed to by rcpfd into a buffer allocated 
@@ -147,23 +156,36 @@ HRESULT UnicodeStringInitWithString(
 }
 
 //
-// The following function is intended to be used ONLY with the Kerb*Pack functions.  It does
-// no bounds-checking because its callers have precise requirements and are written to respect 
-// its limitations.
-// You can read more about the UNICODE_STRING type at:
-// http://msdn.microsoft.com/library/default.asp?url=/library/en-us/secauthn/security/unicode_string.asp
+// Picks the KERB_INTERACTIVE_LOGON MessageType for a usage scenario.
 //
-static void _UnicodeStringPackedUnicodeStringCopy(
-    const UNICODE_STRING& rus,
-    PWSTR pwzBuffer,
-    UNICODE_STRING* pus
+static HRESULT _MessageTypeFromUsageScenario(
+    CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus,
+    KERB_LOGON_SUBMIT_TYPE* pMessageType
     )
 {
-    pus->Length = rus.Length;
-    pus->MaximumLength = rus.Length;
-    pus->Buffer = pwzBuffer;
+    HRESULT hr;
+    switch (cpus)
+    {
+    case CPUS_UNLOCK_WORKSTATION:
+        *pMessageType = KerbWorkstationUnlockLogon;
+        hr = S_OK;
+        break;
+
+    case CPUS_LOGON:
+        *pMessageType = KerbInteractiveLogon;
+        hr = S_OK;
+        break;
+
+    case CPUS_CREDUI:
+        *pMessageType = (KERB_LOGON_SUBMIT_TYPE)0; // MessageType does not apply to CredUI
+        hr = S_OK;
+        break;
 
-    CopyMemory(pus->Buffer, rus.Buffer, pus->Length);
+    default:
+        hr = E_FAIL;
+        break;
+    }
+    return hr;
 }
 
 //
@@ -217,27 +239,7 @@ HRESULT KerbInteractiveUnlockLogonInit(
             if (SUCCEEDED(hr))
             {
                 // Set a MessageType based on the usage scenario.
-                switch (cpus)
-                {
-                case CPUS_UNLOCK_WORKSTATION:
-                    pkil->MessageType = KerbWorkstationUnlockLogon;
-                    hr = S_OK;
-                    break;
-
-                case CPUS_LOGON:
-                    pkil->MessageType = KerbInteractiveLogon;
-                    hr = S_OK;
-                    break;
-
-                case CPUS_CREDUI:
-                    pkil->MessageType = (KERB_LOGON_SUBMIT_TYPE)0; // MessageType does not apply to CredUI
-                    hr = S_OK;
-                    break;
-
-                default:
-                    hr = E_FAIL;
-                    break;
-                }
+                hr = _MessageTypeFromUsageScenario(cpus, &pkil->MessageType);
 
                 if (SUCCEEDED(hr))
                 {
@@ -276,58 +278,91 @@ HRESULT KerbInteractiveUnlockLogonPack(
                                        DWORD* pcb
                                        )
 {
-    HRESULT hr;
-
     const KERB_INTERACTIVE_LOGON* pkilIn = &rkiulIn.Logon;
 
-    // alloc space for struct plus extra for the three strings
-    DWORD cb = sizeof(rkiulIn) +
-        pkilIn->LogonDomainName.Length +
-        pkilIn->UserName.Length +
-        pkilIn->Password.Length;
+    KERB_PACK_STRINGS ps;
+    ps.dwMessageType = (DWORD)pkilIn->MessageType;
+    ps.pbDomain = (const BYTE*)pkilIn->LogonDomainName.Buffer;
+    ps.cbDomain = pkilIn->LogonDomainName.Length;
+    ps.pbUser = (const BYTE*)pkilIn->UserName.Buffer;
+    ps.cbUser = pkilIn->UserName.Length;
+    ps.pbPassword = (const BYTE*)pkilIn->Password.Buffer;
+    ps.cbPassword = pkilIn->Password.Length;
 
-    KERB_INTERACTIVE_UNLOCK_LOGON* pkiulOut = (KERB_INTERACTIVE_UNLOCK_LOGON*)CoTaskMemAlloc(cb);
+    // alloc space for struct plus extra for the three strings
+    DWORD cb = CKerbNativePacker::GetPackedSize(ps.cbDomain, ps.cbUser, ps.cbPassword);
 
-    if (pkiulOut)
+    HRESULT hr;
+    BYTE* pb = (BYTE*)CoTaskMemAlloc(cb);
+    if (pb)
     {
-        ZeroMemory(&pkiulOut->LogonId, sizeof(LUID));
-
-        //
-        // point pbBuffer at the beginning of the extra space
-        //
-        BYTE* pbBuffer = (BYTE*)pkiulOut + sizeof(*pkiulOut);
-
-        //
-        // set up the Logon structure within the KERB_INTERACTIVE_UNLOCK_LOGON
-        //
-        KERB_INTERACTIVE_LOGON* pkilOut = &pkiulOut->Logon;
-
-        pkilOut->MessageType = pkilIn->MessageType;
-
-        //
-        // copy each string,
-        // fix up appropriate buffer pointer to be offset,
-        // advance buffer pointer over copied characters in extra space
-        //
-        _UnicodeStringPackedUnicodeStringCopy(pkilIn->LogonDomainName, (PWSTR)pbBuffer, &pkilOut->LogonDomainName);
-        pkilOut->LogonDomainName.Buffer = (PWSTR)(pbBuffer - (BYTE*)pkiulOut);
-        pbBuffer += pkilOut->LogonDomainName.Length;
-
-        _UnicodeStringPackedUnicodeStringCopy(pkilIn->UserName, (PWSTR)pbBuffer, &pkilOut->UserName);
-        pkilOut->UserName.Buffer = (PWSTR)(pbBuffer - (BYTE*)pkiulOut);
-        pbBuffer += pkilOut->UserName.Length;
+        hr = CKerbNativePacker::Pack(ps, pb, cb);
+        if (SUCCEEDED(hr))
+        {
+            *prgb = pb;
+            *pcb = cb;
+        }
+        else
+        {
+            CoTaskMemFree(pb);
+        }
+    }
+    else
+    {
+        hr = E_OUTOFMEMORY;
+    }
 
-        _UnicodeStringPackedUnicodeStringCopy(pkilIn->Password, (PWSTR)pbBuffer, &pkilOut->Password);
-        pkilOut->Password.Buffer = (PWSTR)(pbBuffer - (BYTE*)pkiulOut);
+    return hr;
+}
 
-        *prgb = (BYTE*)pkiulOut;
-        *pcb = cb;
+//
+// Does what KerbInteractiveUnlockLogonInit followed by KerbInteractiveUnlockLogonPack does,
+// in one pass: each string is measured once, the exact buffer is allocated, and the
+// packed form is written straight into it, with no intermediate weak-reference structure.
+//
+HRESULT KerbInteractiveUnlockLogonPackStrings(
+                                              PCWSTR pwzDomain,
+                                              PCWSTR pwzUsername,
+                                              PCWSTR pwzPassword,
+                                              CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus,
+                                              BYTE** prgb,
+                                              DWORD* pcb
+                                              )
+{
+    KERB_PACK_STRINGS ps;
+    KERB_LOGON_SUBMIT_TYPE messageType;
 
-        hr = S_OK;
+    HRESULT hr = KerbPackSetString(pwzDomain, &ps.pbDomain, &ps.cbDomain);
+    if (SUCCEEDED(hr))
+    {
+        hr = KerbPackSetString(pwzUsername, &ps.pbUser, &ps.cbUser);
     }
-    else
+    if (SUCCEEDED(hr))
     {
-        hr = E_OUTOFMEMORY;
+        hr = KerbPackSetString(pwzPassword, &ps.pbPassword, &ps.cbPassword);
+    }
+    if (SUCCEEDED(hr))
+    {
+        hr = _MessageTypeFromUsageScenario(cpus, &messageType);
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        ps.dwMessageType = (DWORD)messageType;
+
+        DWORD cb = CKerbNativePacker::GetPackedSize(ps.cbDomain, ps.cbUser, ps.cbPassword);
+        BYTE* pb = (BYTE*)CoTaskMemAlloc(cb);
+        if (pb)
+        {
+            // Can't fail: the buffer is exactly the packed size.
+            CKerbNativePacker::Pack(ps, pb, cb);
+            *prgb = pb;
+            *pcb = cb;
+        }
+        else
+        {
+            hr = E_OUTOFMEMORY;
+        }
     }
 
     return hr;
@@ -396,46 +431,68 @@ HRESULT RetrieveNegotiateAuthPackage(ULONG * pulAuthPackage)
 }
 
 //
-// Return a copy of pwzToProtect encrypted with the CredProtect API.
+// Return a copy of pwz in pArena.
+//
+static HRESULT ArenaCopyString(
+                               PCWSTR pwz,
+                               CScratchArena* pArena,
+                               PWSTR* ppwzCopy
+                               )
+{
+    size_t cb = (wcslen(pwz) + 1) * sizeof(WCHAR);
+    PWSTR pwzCopy = (PWSTR)pArena->Alloc(cb);
+    if (pwzCopy == NULL)
+    {
+        return E_OUTOFMEMORY;
+    }
+    CopyMemory(pwzCopy, pwz, cb);
+    *ppwzCopy = pwzCopy;
+    return S_OK;
+}
+
+//
+// Return a copy of pwzToProtect encrypted with the CredProtect API, in pArena.
 //
 // pwzToProtect must not be NULL or the empty string.
 //
 static HRESULT ProtectAndCopyString(
                                     PWSTR pwzToProtect, 
+                                    CScratchArena* pArena,
                                     PWSTR* ppwzProtected
                                     )
 {
     *ppwzProtected = NULL;
 
-    HRESULT hr = E_FAIL;
+    HRESULT hr = S_OK;
 
-    // The first call to CredProtect determines the length of the encrypted string.
-    // Because we pass a NULL output buffer, we expect the call to fail.
+    // Rather than asking CredProtect how long the encrypted string will be and then
+    // asking again for the string itself, we offer it all the room left in the arena and
+    // only fall back to the second call if that isn't enough. The arena is sized so that
+    // it always is.
     //
     // Note that the third parameter to CredProtect, the number of characters of pwzToProtect
     // to encrypt, must include the NULL terminator!
-    DWORD cchProtected = 0;
-    if (!CredProtectW(FALSE, pwzToProtect, (DWORD)wcslen(pwzToProtect)+1, NULL, &cchProtected, NULL))
+    DWORD cchToProtect = (DWORD)wcslen(pwzToProtect) + 1;
+    DWORD cchProtected = (DWORD)(pArena->GetAvailable() / sizeof(WCHAR));
+    PWSTR pwzProtected = (PWSTR)pArena->Alloc(cchProtected * sizeof(WCHAR));
+    if (pwzProtected == NULL)
+    {
+        hr = E_OUTOFMEMORY;
+    }
+
+    if (SUCCEEDED(hr) && !CredProtectW(FALSE, pwzToProtect, cchToProtect, pwzProtected, &cchProtected, NULL))
     {
         DWORD dwErr = GetLastError();
 
         if ((ERROR_INSUFFICIENT_BUFFER == dwErr) && (0 < cchProtected))
         {
-            // Allocate a buffer long enough for the encrypted string.
-            PWSTR pwzProtected = (PWSTR)CoTaskMemAlloc(cchProtected * sizeof(WCHAR));
+            // CredProtect told us how much it really needs.
+            pwzProtected = (PWSTR)pArena->Alloc(cchProtected * sizeof(WCHAR));
 
             if (pwzProtected)
             {
-                // The second call to CredProtect actually encrypts the string.
-                if (CredProtectW(FALSE, pwzToProtect, (DWORD)wcslen(pwzToProtect)+1, pwzProtected, &cchProtected, NULL))
-                {
-                    *ppwzProtected = pwzProtected;
-                    hr = S_OK;
-                }
-                else
+                if (!CredProtectW(FALSE, pwzToProtect, cchToProtect, pwzProtected, &cchProtected, NULL))
                 {
-                    CoTaskMemFree(pwzProtected);
-
                     dwErr = GetLastError();
                     hr = HRESULT_FROM_WIN32(dwErr);
                 }
@@ -451,6 +508,13 @@ static HRESULT ProtectAndCopyString(
         }
     }
 
+    if (SUCCEEDED(hr))
+    {
+        // Give back whatever CredProtect didn't use.
+        pArena->Trim(pwzProtected, cchProtected * sizeof(WCHAR));
+        *ppwzProtected = pwzProtected;
+    }
+
     return hr;
 }
 
@@ -459,9 +523,13 @@ static HRESULT ProtectAndCopyString(
 // 
 // If not, just return a copy.
 //
+// Either way the copy is carved out of pArena, so the caller doesn't free it; it's wiped
+// along with everything else when the arena is reset.
+//
 HRESULT ProtectIfNecessaryAndCopyPassword(
                                           PWSTR pwzPassword,
                                           CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus,
+                                          CScratchArena* pArena,
                                           PWSTR* ppwzProtectedPassword
                                           )
 {
@@ -491,16 +559,61 @@ HRESULT ProtectIfNecessaryAndCopyPassword(
         // cannot know if our caller expects or can handle an encryped password.
         if (CPUS_CREDUI == cpus || bCredAlreadyEncrypted)
         {
-            hr = SHStrDupW(pwzPassword, ppwzProtectedPassword);
+            hr = ArenaCopyString(pwzPassword, pArena, ppwzProtectedPassword);
+        }
+        else
+        {
+            hr = ProtectAndCopyString(pwzPassword, pArena, ppwzProtectedPassword);
+        }
+    }
+    else
+    {
+        hr = ArenaCopyString(UTF16(""), pArena, ppwzProtectedPassword);
+    }
+
+    return hr;
+}
+
+//
+// Protects a pushed password the way ProtectIfNecessaryAndCopyPassword does for the
+// logon and unlock scenarios, but into a caller-supplied buffer, so the protection
+// worker can do it ahead of GetSerialization.
+//
+HRESULT CCredProtector::Protect(const WCHAR* pwzPassword, WCHAR* pwzProtected, DWORD cchMax, DWORD* pcchProtected)
+{
+    HRESULT hr = S_OK;
+    PWSTR pwzToProtect = const_cast<PWSTR>(pwzPassword);
+    DWORD cchToProtect = (DWORD)wcslen(pwzPassword);
+    CRED_PROTECTION_TYPE protectionType;
+
+    // Empty passwords aren't protected, and already-protected ones aren't protected again.
+    if (cchToProtect == 0 ||
+        (CredIsProtectedW(pwzToProtect, &protectionType) && CredUnprotected != protectionType))
+    {
+        if (cchToProtect < cchMax)
+        {
+            CopyMemory(pwzProtected, pwzPassword, (cchToProtect + 1) * sizeof(WCHAR));
+            *pcchProtected = cchToProtect;
         }
         else
         {
-            hr = ProtectAndCopyString(pwzPassword, ppwzProtectedPassword);
+            hr = HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
         }
     }
     else
     {
-        hr = SHStrDupW(L"", ppwzProtectedPassword);
+        // As in ProtectAndCopyString, the count passed to CredProtect includes the null,
+        // and so does the count it gives back.
+        DWORD cchProtected = cchMax;
+        if (CredProtectW(FALSE, pwzToProtect, cchToProtect + 1, pwzProtected, &cchProtected, NULL))
+        {
+            *pcchProtected = (cchProtected > 0) ? cchProtected - 1 : 0;
+        }
+        else
+        {
+            DWORD dwErr = GetLastError();
+            hr = HRESULT_FROM_WIN32(dwErr);
+        }
     }
 
     return hr;
@@ -11,13 +11,8 @@
 
 #pragma once
 #include "common.h"
-#include <windows.h>
-#include <strsafe.h>
-
-#pragma warning(push)
-#pragma warning(disable : 4995)
-#include <shlwapi.h>
-#pragma warning(pop)
+#include "ScratchArena.h"
+#include "PasswordProtection.h"
 
 
 
@@ -55,6 +50,17 @@ HRESULT KerbInteractiveUnlockLogonPack(
     DWORD* pcb
     );
 
+//measures and packs the credentials into the buffer that the system expects in one pass,
+//without building a KERB_INTERACTIVE_UNLOCK_LOGON first
+HRESULT KerbInteractiveUnlockLogonPackStrings(
+    PCWSTR pwzDomain,
+    PCWSTR pwzUsername,
+    PCWSTR pwzPassword,
+    CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus,
+    BYTE** prgb,
+    DWORD* pcb
+    );
+
 //unpackages the "packed" version of the creds in-place into the "unpacked" version
 void KerbInteractiveUnlockLogonUnpackInPlace(
     KERB_INTERACTIVE_UNLOCK_LOGON* pkiul
@@ -67,9 +73,18 @@ HRESULT RetrieveNegotiateAuthPackage(
     );
 
 
-//encrypt a password (if necessary) and copy it; if not, just copy it
+//encrypt a password (if necessary) and copy it; if not, just copy it. The copy lives in
+//pArena and is wiped when the arena is reset
 HRESULT ProtectIfNecessaryAndCopyPassword(
     PWSTR pwzPassword,
     CREDENTIAL_PROVIDER_USAGE_SCENARIO cpus,
+    CScratchArena* pArena,
     PWSTR* ppwzProtectedPassword
     );
+
+//protects passwords with CredProtect, for the protection worker
+class CCredProtector : public IPasswordProtector
+{
+  public:
+    HRESULT Protect(const WCHAR* pwzPassword, WCHAR* pwzProtected, DWORD cchMax, DWORD* pcchProtected);
+};
@@ -0,0 +1,86 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Load test for the persistent listening socket: several senders each connect, push
+// one credential, wait for its FT_ACK and hang up, over and over, against a single
+// CCredentialListener. Reports connects per second and the time each connection took,
+// first with one sender and then with all of them at once.
+//
+//   ConnectBench [connections per sender] [senders]
+
+#include "TestHarness.h"
+
+// Runs cSenders senders making cConnections connections each, and prints the results.
+static void RunSenders(const char* pszPort, DWORD cSenders, DWORD cConnections)
+{
+    std::vector<BYTE> rgbPush;
+    HarnessAppendCredential(rgbPush, 1, "alice", "secret");
+
+    std::vector<std::vector<ULONGLONG>> rgrgullNs(cSenders);
+    std::vector<std::thread> rgThreads;
+    ULONGLONG ullStart = StageClock();
+    for (DWORD iSender = 0; iSender < cSenders; iSender++)
+    {
+        rgThreads.emplace_back([&, iSender]() {
+            std::vector<ULONGLONG>& rgullNs = rgrgullNs[iSender];
+            for (DWORD i = 0; i < cConnections; i++)
+            {
+                ULONGLONG ullConnect = StageClock();
+                socket_t s = HarnessConnect(pszPort);
+                DWORD dwRequestId;
+                HRESULT hrStatus;
+                BOOL fPushed = (s != INVALID_SOCKET_T) &&
+                    HarnessSend(s, rgbPush.data(), rgbPush.size()) &&
+                    HarnessRecvAck(s, &dwRequestId, &hrStatus) && hrStatus == S_OK;
+                if (s != INVALID_SOCKET_T)
+                {
+                    SocketClose(s);
+                }
+                if (!fPushed)
+                {
+                    CHECK(!"connection failed");
+                    break;
+                }
+                rgullNs.push_back(StageClock() - ullConnect);
+            }
+        });
+    }
+    for (std::thread& thread : rgThreads)
+    {
+        thread.join();
+    }
+    ULONGLONG ullNs = StageClock() - ullStart;
+
+    std::vector<ULONGLONG> rgullNs;
+    for (std::vector<ULONGLONG>& rgullSender : rgrgullNs)
+    {
+        rgullNs.insert(rgullNs.end(), rgullSender.begin(), rgullSender.end());
+    }
+    printf("%u sender(s): %u connections in %.1f ms, %.0f connects/s, p50 %llu ns, p99 %llu ns\n",
+        (unsigned)cSenders, (unsigned)rgullNs.size(), ullNs / 1e6, HarnessRate(rgullNs.size(), ullNs),
+        (unsigned long long)HarnessPercentile(rgullNs, 50), (unsigned long long)HarnessPercentile(rgullNs, 99));
+}
+
+int main(int argc, char** argv)
+{
+    DWORD cConnections = HarnessArg(argc, argv, 1, 5000);
+    DWORD cSenders = HarnessArg(argc, argv, 2, 8);
+
+    CHarnessSink sink;
+    CHarnessListener listener;
+
+    // Every sender is on the loopback address; don't let admission control turn them away.
+    listener.Get()->SetRateLimit(1000000, 1000000);
+    CHECK(SUCCEEDED(listener.Start(&sink)));
+
+    RunSenders(listener.GetPort(), 1, cConnections);
+    RunSenders(listener.GetPort(), cSenders, cConnections);
+
+    CHECK(sink.GetReceivedCount() == cConnections * (1 + cSenders));
+    return HarnessResult();
+}
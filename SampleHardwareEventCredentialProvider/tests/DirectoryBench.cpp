@@ -0,0 +1,113 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Startup time of a compiled credential directory against the sqlite store it was
+// compiled from, for each profile count given: how long Open takes, and how long
+// until the first lookup has an answer. Then nanoseconds per lookup through each.
+//
+//   DirectoryBench [profiles ...]
+
+#include "ProfileDb.h"
+#include "CredentialStore.h"
+#include "CredentialDirectory.h"
+#include <random>
+#include <string>
+
+#define LOOKUP_IDS  4096
+#define OPEN_RUNS   5
+
+// Opens a source OPEN_RUNS times and prints the best time to open it and to answer
+// one lookup.
+template <class T>
+static void _TimeStartup(const char* pszName, T& source, const char* pszPath, const std::string& id)
+{
+    ULONGLONG ullBestOpen = ~0ull;
+    ULONGLONG ullBestFirst = ~0ull;
+    for (DWORD i = 0; i < OPEN_RUNS; i++)
+    {
+        PROFILE_RECORD record;
+        ULONGLONG ullStart = StageClock();
+        CHECK(SUCCEEDED(source.Open(pszPath)));
+        ULONGLONG ullOpened = StageClock();
+        CHECK(SUCCEEDED(source.Lookup(id.data(), id.size(), &record)));
+        ULONGLONG ullFirst = StageClock();
+        ullBestOpen = std::min(ullBestOpen, ullOpened - ullStart);
+        ullBestFirst = std::min(ullBestFirst, ullFirst - ullStart);
+        source.Close();
+    }
+    printf("  %-16s open %9.3f ms, first lookup %9.3f ms\n", pszName, ullBestOpen / 1e6, ullBestFirst / 1e6);
+}
+
+template <class T>
+static void _TimeLookups(const char* pszName, T& source, const std::vector<std::string>& rgIds, DWORD cLookups)
+{
+    DWORD cFound = 0;
+    ULONGLONG ullStart = StageClock();
+    for (DWORD i = 0; i < cLookups; i++)
+    {
+        const std::string& id = rgIds[i % rgIds.size()];
+        PROFILE_RECORD record;
+        cFound += SUCCEEDED(source.Lookup(id.data(), id.size(), &record)) ? 1 : 0;
+    }
+    ULONGLONG ullNs = StageClock() - ullStart;
+    CHECK(cFound == cLookups);
+    printf("  %-16s %9u lookups, %8.1f ns each\n", pszName, (unsigned)cLookups, (double)ullNs / cLookups);
+}
+
+static void _Bench(DWORD cProfiles)
+{
+    char szDb[MAX_PATH], szDir[MAX_PATH];
+    ProfileDbPath("DirectoryBench.db", szDb, sizeof(szDb));
+    ProfileDbPath("DirectoryBench.dir", szDir, sizeof(szDir));
+    CHECK(SUCCEEDED(ProfileDbCreate(szDb, cProfiles)));
+
+    std::mt19937 random(cProfiles);
+    std::vector<std::string> rgIds;
+    for (DWORD i = 0; i < LOOKUP_IDS; i++)
+    {
+        char szId[32];
+        ProfileDbId(random() % cProfiles, szId, sizeof(szId));
+        rgIds.push_back(szId);
+    }
+    printf("%u profiles:\n", (unsigned)cProfiles);
+
+    CCredentialStore store;
+    CHECK(SUCCEEDED(store.Open(szDb)));
+    ULONGLONG ullStart = StageClock();
+    CHECK(SUCCEEDED(CredentialDirectoryCompile(&store, szDir)));
+    printf("  %-16s %9.3f ms\n", "compile", (StageClock() - ullStart) / 1e6);
+    store.Close();
+
+    _TimeStartup("store", store, szDb, rgIds[0]);
+    CCredentialDirectory directory;
+    _TimeStartup("directory", directory, szDir, rgIds[0]);
+
+    CHECK(SUCCEEDED(store.Open(szDb)));
+    _TimeLookups("store", store, rgIds, 4000000);
+    store.Close();
+    CHECK(SUCCEEDED(directory.Open(szDir)));
+    _TimeLookups("directory", directory, rgIds, 4000000);
+    directory.Close();
+
+    ProfileDbDelete(szDb);
+    remove(szDir);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        _Bench(10000);
+        _Bench(1000000);
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        _Bench(HarnessArg(argc, argv, i, 10000));
+    }
+    return HarnessResult();
+}
@@ -0,0 +1,153 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Compiles account databases into credential directories and checks that every
+// profile comes back out, that unknown ids don't, that the slots are in id order, and
+// that a damaged file is refused rather than mapped.
+
+#include "ProfileDb.h"
+#include "CredentialStore.h"
+#include "CredentialDirectory.h"
+
+// Reads a whole file into rgb.
+static BOOL _ReadFile(const char* pszPath, std::vector<BYTE>& rgb)
+{
+    FILE* pFile = fopen(pszPath, "rb");
+    if (pFile == NULL)
+    {
+        return FALSE;
+    }
+    BYTE rgbChunk[4096];
+    size_t cb;
+    rgb.clear();
+    while ((cb = fread(rgbChunk, 1, sizeof(rgbChunk), pFile)) > 0)
+    {
+        rgb.insert(rgb.end(), rgbChunk, rgbChunk + cb);
+    }
+    fclose(pFile);
+    return TRUE;
+}
+
+static BOOL _WriteFile(const char* pszPath, const std::vector<BYTE>& rgb)
+{
+    FILE* pFile = fopen(pszPath, "wb");
+    if (pFile == NULL)
+    {
+        return FALSE;
+    }
+    BOOL fWritten = fwrite(rgb.data(), 1, rgb.size(), pFile) == rgb.size();
+    return (fclose(pFile) == 0) && fWritten;
+}
+
+static void TestRoundTrip(DWORD cProfiles)
+{
+    char szDb[MAX_PATH], szDir[MAX_PATH];
+    ProfileDbPath("DirectoryTest.db", szDb, sizeof(szDb));
+    ProfileDbPath("DirectoryTest.dir", szDir, sizeof(szDir));
+    CHECK(SUCCEEDED(ProfileDbCreate(szDb, cProfiles)));
+
+    CCredentialStore store;
+    CHECK(SUCCEEDED(store.Open(szDb)));
+    CHECK(SUCCEEDED(CredentialDirectoryCompile(&store, szDir)));
+    store.Close();
+
+    CCredentialDirectory directory;
+    CHECK(SUCCEEDED(directory.Open(szDir)));
+    PROFILE_RECORD record;
+    for (DWORD i = 0; i < cProfiles; i++)
+    {
+        char szId[32];
+        int cchId = ProfileDbId(i, szId, sizeof(szId));
+        CHECK(SUCCEEDED(directory.Lookup(szId, cchId, &record)) && ProfileDbMatches(i, &record));
+    }
+    for (DWORD i = cProfiles; i < cProfiles * 2 + 1; i++)
+    {
+        char szId[32];
+        int cchId = ProfileDbId(i, szId, sizeof(szId));
+        CHECK(directory.Lookup(szId, cchId, &record) == HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+    }
+    CHECK(directory.Lookup("badge1\0", 7, &record) == HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+    directory.Close();
+
+    // The slots, and the strings they point at, are in id order.
+    std::vector<BYTE> rgb;
+    CHECK(_ReadFile(szDir, rgb) && rgb.size() >= sizeof(DIRECTORY_HEADER));
+    const DIRECTORY_HEADER* pHeader = (const DIRECTORY_HEADER*)rgb.data();
+    CHECK(pHeader->dwVersion == DIRECTORY_VERSION && pHeader->cRecords == cProfiles);
+    const DIRECTORY_SLOT* rgSlots = (const DIRECTORY_SLOT*)(rgb.data() + pHeader->ibSlots);
+    const char* pchPool = (const char*)(rgb.data() + pHeader->ibPool);
+    DWORD ibExpected = 0;
+    for (DWORD i = 0; i < cProfiles; i++)
+    {
+        CHECK(rgSlots[i].ibRecord == ibExpected);
+        ibExpected += rgSlots[i].cbId + rgSlots[i].cbUser + rgSlots[i].cbPassword;
+        if (i > 0)
+        {
+            std::string strPrevious(pchPool + rgSlots[i - 1].ibRecord, rgSlots[i - 1].cbId);
+            std::string strId(pchPool + rgSlots[i].ibRecord, rgSlots[i].cbId);
+            CHECK(strPrevious < strId);
+        }
+    }
+
+    ProfileDbDelete(szDb);
+    remove(szDir);
+}
+
+// Every kind of damage we can cheaply make is caught by Open.
+static void TestCorruption()
+{
+    char szDb[MAX_PATH], szDir[MAX_PATH];
+    ProfileDbPath("DirectoryCorrupt.db", szDb, sizeof(szDb));
+    ProfileDbPath("DirectoryCorrupt.dir", szDir, sizeof(szDir));
+    CHECK(SUCCEEDED(ProfileDbCreate(szDb, 100)));
+
+    CCredentialStore store;
+    CHECK(SUCCEEDED(store.Open(szDb)));
+    CHECK(SUCCEEDED(CredentialDirectoryCompile(&store, szDir)));
+    store.Close();
+
+    std::vector<BYTE> rgbGood;
+    CHECK(_ReadFile(szDir, rgbGood));
+    CCredentialDirectory directory;
+
+    // A flipped byte anywhere after the header fails the checksum.
+    for (size_t ib = sizeof(DIRECTORY_HEADER); ib < rgbGood.size(); ib += 97)
+    {
+        std::vector<BYTE> rgb = rgbGood;
+        rgb[ib] ^= 0x5A;
+        CHECK(_WriteFile(szDir, rgb));
+        CHECK(directory.Open(szDir) == HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+        CHECK(!directory.IsOpen());
+    }
+
+    // So does a truncated file, and one from another version.
+    std::vector<BYTE> rgb(rgbGood.begin(), rgbGood.end() - 1);
+    CHECK(_WriteFile(szDir, rgb));
+    CHECK(FAILED(directory.Open(szDir)));
+    rgb = rgbGood;
+    ((DIRECTORY_HEADER*)rgb.data())->dwVersion = DIRECTORY_VERSION - 1;
+    CHECK(_WriteFile(szDir, rgb));
+    CHECK(FAILED(directory.Open(szDir)));
+
+    CHECK(_WriteFile(szDir, rgbGood));
+    CHECK(SUCCEEDED(directory.Open(szDir)));
+    directory.Close();
+
+    ProfileDbDelete(szDb);
+    remove(szDir);
+}
+
+int main()
+{
+    TestRoundTrip(0);
+    TestRoundTrip(1);
+    TestRoundTrip(1000);
+    TestRoundTrip(100000);
+    TestCorruption();
+    return HarnessResult();
+}
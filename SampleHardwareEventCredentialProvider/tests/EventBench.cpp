@@ -0,0 +1,62 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// How many event datagrams a second CEventChannel gets through: bursts are sent over
+// loopback UDP while nobody is reading, as when a device chatters while the listener
+// is busy, and then drained at up to 1, 8 and EVENT_BATCH_MAX events per Receive.
+//
+//   EventBench [bursts] [datagrams per burst]
+
+#include "HarnessEvents.h"
+
+int main(int argc, char** argv)
+{
+    DWORD cBursts = HarnessArg(argc, argv, 1, 1000);
+    DWORD cPerBurst = HarnessArg(argc, argv, 2, 200);
+
+    CEventChannel channel;
+    char szPort[16];
+    CHECK(SUCCEEDED(HarnessOpenEvents(&channel, szPort, sizeof(szPort))));
+    CHarnessEventSender sender;
+    CHECK(sender.Open(szPort));
+
+    static const DWORD c_rgcMax[] = { 1, 8, EVENT_BATCH_MAX };
+    DWORD dwSequence = 0;
+    printf("%u bursts of %u datagrams\n", (unsigned)cBursts, (unsigned)cPerBurst);
+    for (DWORD i = 0; i < ARRAYSIZE(c_rgcMax); i++)
+    {
+        ULONGLONG ullNs = 0;
+        DWORD cDatagrams = 0, cDelivered = 0;
+        for (DWORD n = 0; n < cBursts; n++)
+        {
+            for (DWORD k = 0; k < cPerBurst; k++)
+            {
+                CHECK(sender.Send(ET_CONNECTED, 1, ++dwSequence));
+            }
+
+            EVENT_CHANNEL_COUNTERS before, after;
+            channel.GetCounters(&before);
+            EVENT_MESSAGE rgEvents[EVENT_BATCH_MAX];
+            DWORD cEvents = 0;
+            ULONGLONG ullStart = StageClock();
+            while (channel.Receive(n, rgEvents, c_rgcMax[i], &cEvents) == S_OK)
+            {
+                cDelivered += cEvents;
+            }
+            ullNs += StageClock() - ullStart;
+            channel.GetCounters(&after);
+            cDatagrams += after.cDatagrams - before.cDatagrams;
+        }
+
+        // Loopback doesn't drop unless the socket's buffer fills.
+        printf("  up to %2u per Receive %10.0f datagrams/s (%u of %u arrived)\n", (unsigned)c_rgcMax[i],
+            HarnessRate(cDatagrams, ullNs), (unsigned)cDatagrams, (unsigned)(cBursts * cPerBurst));
+        CHECK(cDelivered == cDatagrams);
+    }
+    return HarnessResult();
+}
@@ -0,0 +1,233 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Sends CEventChannel datagrams over loopback UDP and checks which events it hands
+// on: duplicates and events overtaken by newer ones are dropped, per sender and
+// source address, with sequence numbers allowed to wrap; "ok" still works; and
+// anything malformed is counted and ignored. Then checks a long random run of
+// duplicated and reordered events from several senders against a model, and that
+// ET_DUMP_TIMINGS is only taken from a loopback address.
+
+#include "HarnessEvents.h"
+#include <ifaddrs.h>
+#include <map>
+#include <random>
+
+// Everything the channel hands on until it has nothing more for a while.
+static std::vector<EVENT_MESSAGE> _Drain(CEventChannel* pChannel, ULONGLONG ullNow = 1000)
+{
+    std::vector<EVENT_MESSAGE> rgEvents;
+    pollfd_t pfd;
+    pfd.fd = pChannel->GetSocket();
+    pfd.events = POLLIN;
+    while (pfd.revents = 0, SocketPoll(&pfd, 1, 50) > 0)
+    {
+        EVENT_MESSAGE rgBatch[EVENT_BATCH_MAX];
+        DWORD cEvents = 0;
+        CHECK(SUCCEEDED(pChannel->Receive(ullNow, rgBatch, ARRAYSIZE(rgBatch), &cEvents)));
+        rgEvents.insert(rgEvents.end(), rgBatch, rgBatch + cEvents);
+    }
+    return rgEvents;
+}
+
+static BOOL _Is(const EVENT_MESSAGE& em, EVENT_TYPE type, DWORD dwSenderId, DWORD dwSequence)
+{
+    return em.fSequenced && em.type == type && em.dwSenderId == dwSenderId && em.dwSequence == dwSequence;
+}
+
+static void TestDedupeAndReorder()
+{
+    CEventChannel channel;
+    char szPort[16];
+    CHECK(SUCCEEDED(HarnessOpenEvents(&channel, szPort, sizeof(szPort))));
+    CHarnessEventSender sender, other;
+    CHECK(sender.Open(szPort));
+    CHECK(other.Open(szPort, "127.0.0.2"));
+
+    // The original sender's "ok", with or without its NUL, and things that are neither.
+    CHECK(sender.SendRaw("ok", 2));
+    CHECK(sender.SendRaw("ok", 3));
+    CHECK(sender.SendRaw("okk", 3));
+    CHECK(sender.SendRaw("xx", 2));
+    BYTE rgbLong[EVENT_DATAGRAM_MAX * 2] = { EVENT_MAGIC, EVENT_VERSION, ET_CONNECTED };
+    CHECK(sender.SendRaw(rgbLong, sizeof(rgbLong)));
+
+    // A duplicate, and an event overtaken by a later one, are dropped.
+    CHECK(sender.Send(ET_CONNECTED, 7, 1));
+    CHECK(sender.Send(ET_CONNECTED, 7, 1));
+    CHECK(sender.Send(ET_DISCONNECTED, 7, 3));
+    CHECK(sender.Send(ET_CONNECTED, 7, 2));
+
+    // Sequence numbers wrap; a restarted sender (a new id) and the same id from another
+    // address start afresh.
+    CHECK(sender.Send(ET_REFRESH, 9, 0xFFFFFFFF));
+    CHECK(sender.Send(ET_CONNECTED, 9, 0));
+    CHECK(sender.Send(ET_CONNECTED, 8, 1));
+    CHECK(other.Send(ET_CONNECTED, 7, 1));
+
+    std::vector<EVENT_MESSAGE> rgEvents = _Drain(&channel);
+    CHECK(rgEvents.size() == 8);
+    if (rgEvents.size() == 8)
+    {
+        CHECK(!rgEvents[0].fSequenced && rgEvents[0].type == ET_TOGGLE);
+        CHECK(!rgEvents[1].fSequenced && rgEvents[1].type == ET_TOGGLE);
+        CHECK(_Is(rgEvents[2], ET_CONNECTED, 7, 1));
+        CHECK(_Is(rgEvents[3], ET_DISCONNECTED, 7, 3));
+        CHECK(_Is(rgEvents[4], ET_REFRESH, 9, 0xFFFFFFFF));
+        CHECK(_Is(rgEvents[5], ET_CONNECTED, 9, 0));
+        CHECK(_Is(rgEvents[6], ET_CONNECTED, 8, 1));
+        CHECK(_Is(rgEvents[7], ET_CONNECTED, 7, 1));
+    }
+
+    EVENT_CHANNEL_COUNTERS counters;
+    channel.GetCounters(&counters);
+    CHECK(counters.cDatagrams == 13 && counters.cMalformed == 3 && counters.cStale == 2 && counters.cDelivered == 8);
+
+    // Only the last EVENT_MAX_SENDERS senders are remembered; one forgotten starts afresh.
+    for (DWORD i = 0; i < EVENT_MAX_SENDERS; i++)
+    {
+        CHECK(sender.Send(ET_REFRESH, 100 + i, 1));
+    }
+    CHECK(_Drain(&channel, 2000).size() == EVENT_MAX_SENDERS);
+    CHECK(sender.Send(ET_CONNECTED, 7, 2));
+    CHECK(_Drain(&channel, 3000).size() == 1);
+}
+
+// Several senders' events, each sent once or twice and shuffled within a small window,
+// as a lossy network might deliver them. An event is handed on exactly when it's newer
+// than every earlier one from its sender.
+static void TestAgainstModel()
+{
+    CEventChannel channel;
+    char szPort[16];
+    CHECK(SUCCEEDED(HarnessOpenEvents(&channel, szPort, sizeof(szPort))));
+    CHarnessEventSender sender;
+    CHECK(sender.Open(szPort));
+
+    std::mt19937 random(11);
+    std::vector<EVENT_MESSAGE> rgSent;
+    std::map<DWORD, DWORD> nextSequence;
+    for (DWORD n = 0; n < 3000; n++)
+    {
+        DWORD dwSenderId = 1 + random() % 6;
+        EVENT_MESSAGE em = { (EVENT_TYPE)(ET_CONNECTED + random() % 2), TRUE, dwSenderId,
+            0xFFFFFF00 + nextSequence[dwSenderId]++ };
+        rgSent.push_back(em);
+        if (random() % 4 == 0)
+        {
+            rgSent.push_back(em);
+        }
+    }
+    for (size_t i = 0; i + 1 < rgSent.size(); i++)
+    {
+        size_t j = i + random() % std::min((size_t)8, rgSent.size() - i);
+        std::swap(rgSent[i], rgSent[j]);
+    }
+
+    std::vector<EVENT_MESSAGE> rgExpected;
+    std::map<DWORD, DWORD> newest;
+    for (const EVENT_MESSAGE& em : rgSent)
+    {
+        std::map<DWORD, DWORD>::iterator it = newest.find(em.dwSenderId);
+        if (it == newest.end() || (LONG)(em.dwSequence - it->second) > 0)
+        {
+            newest[em.dwSenderId] = em.dwSequence;
+            rgExpected.push_back(em);
+        }
+    }
+
+    // Sent in bursts small enough for the socket's buffer, drained after each.
+    std::vector<EVENT_MESSAGE> rgReceived;
+    for (size_t i = 0; i < rgSent.size(); i++)
+    {
+        CHECK(sender.Send(rgSent[i].type, rgSent[i].dwSenderId, rgSent[i].dwSequence));
+        if (i % 100 == 99 || i + 1 == rgSent.size())
+        {
+            std::vector<EVENT_MESSAGE> rgBurst = _Drain(&channel);
+            rgReceived.insert(rgReceived.end(), rgBurst.begin(), rgBurst.end());
+        }
+    }
+
+    CHECK(rgReceived.size() == rgExpected.size());
+    for (size_t i = 0; i < rgReceived.size() && i < rgExpected.size(); i++)
+    {
+        CHECK(_Is(rgReceived[i], rgExpected[i].type, rgExpected[i].dwSenderId, rgExpected[i].dwSequence));
+    }
+    EVENT_CHANNEL_COUNTERS counters;
+    channel.GetCounters(&counters);
+    CHECK(counters.cDatagrams == rgSent.size() && counters.cStale == rgSent.size() - rgExpected.size());
+}
+
+// One of this machine's IPv4 addresses that isn't a loopback one, if it has any.
+static BOOL _FindOtherAddress(char* pszAddress, size_t cchAddress)
+{
+    struct ifaddrs* pifa = NULL;
+    if (getifaddrs(&pifa) != 0)
+    {
+        return FALSE;
+    }
+
+    BOOL fFound = FALSE;
+    for (struct ifaddrs* p = pifa; p != NULL && !fFound; p = p->ifa_next)
+    {
+        if (p->ifa_addr != NULL && p->ifa_addr->sa_family == AF_INET)
+        {
+            const struct in_addr* pAddr = &((const struct sockaddr_in*)p->ifa_addr)->sin_addr;
+            fFound = (ntohl(pAddr->s_addr) >> 24) != 127 &&
+                inet_ntop(AF_INET, pAddr, pszAddress, (socklen_t)cchAddress) != NULL;
+        }
+    }
+    freeifaddrs(pifa);
+    return fFound;
+}
+
+// ET_DUMP_TIMINGS is taken from any loopback address, but refused, without touching the
+// sender's sequence, from the machine's other addresses; other events from those are
+// still taken.
+static void TestDumpTimingsFromLoopbackOnly()
+{
+    CEventChannel channel;
+    char szPort[16];
+    CHECK(SUCCEEDED(HarnessOpenEvents(&channel, szPort, sizeof(szPort))));
+    CHarnessEventSender local, other;
+    CHECK(local.Open(szPort, "127.0.0.2"));
+    CHECK(local.Send(ET_DUMP_TIMINGS, 1, 1));
+    std::vector<EVENT_MESSAGE> rgEvents = _Drain(&channel);
+    CHECK(rgEvents.size() == 1 && _Is(rgEvents[0], ET_DUMP_TIMINGS, 1, 1));
+
+    char szAddress[INET_ADDRSTRLEN];
+    if (!_FindOtherAddress(szAddress, sizeof(szAddress)))
+    {
+        printf("No address but loopback; skipping the remote ET_DUMP_TIMINGS check\n");
+        return;
+    }
+
+    CHECK(other.Open(szPort, szAddress, szAddress));
+    CHECK(other.Send(ET_DUMP_TIMINGS, 2, 5));
+    CHECK(other.Send(ET_CONNECTED, 2, 2));
+    CHECK(other.SendRaw("ok", 2));
+    rgEvents = _Drain(&channel);
+    CHECK(rgEvents.size() == 2);
+    if (rgEvents.size() == 2)
+    {
+        CHECK(_Is(rgEvents[0], ET_CONNECTED, 2, 2));
+        CHECK(!rgEvents[1].fSequenced && rgEvents[1].type == ET_TOGGLE);
+    }
+
+    EVENT_CHANNEL_COUNTERS counters;
+    channel.GetCounters(&counters);
+    CHECK(counters.cRefused == 1 && counters.cDelivered == 3);
+}
+
+int main()
+{
+    TestDedupeAndReorder();
+    TestAgainstModel();
+    TestDumpTimingsFromLoopbackOnly();
+    return HarnessResult();
+}
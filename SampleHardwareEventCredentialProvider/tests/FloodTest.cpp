@@ -0,0 +1,222 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// A sender on 127.0.0.2 pushes a credential every 50 milliseconds, first on a quiet
+// listener and then while several threads on 127.0.0.1 open and drop connections as
+// fast as they can. Every push must still be acknowledged, the storm must have been
+// rate limited, and the pushes' latency under it is printed beside the quiet one.
+// Before that, checks that connections turned away while every slot is taken don't
+// use up their source's rate limit.
+//
+//   FloodTest [pushes] [flooding threads]
+
+#include "TestHarness.h"
+#include "AdmissionControl.h"
+#include <chrono>
+
+// The legitimate sender stays within the default rate limit.
+#define PUSH_INTERVAL_MS    (1000 / DEFAULT_ADMISSION_RATE)
+
+// The token buckets on their own: a source gets its burst, then its rate, and one
+// source running dry doesn't touch another.
+static void TestBuckets()
+{
+    CAdmissionControl admission;
+    admission.SetRateLimit(1, 2);
+    CHECK(admission.Admit(1, 0));
+    CHECK(admission.Admit(1, 0));
+    CHECK(!admission.Admit(1, 0));
+    CHECK(admission.Admit(2, 0));
+    CHECK(!admission.Admit(1, 999));
+    CHECK(admission.Admit(1, 1000));
+
+    ADMISSION_COUNTERS counters;
+    admission.GetCounters(&counters);
+    CHECK(counters.cAdmitted == 4 && counters.cRateLimited == 2);
+}
+
+// Connects from pszFrom and pushes one credential, leaving the connection open. Returns
+// INVALID_SOCKET_T if the push wasn't acknowledged.
+static socket_t _PushAndHold(const char* pszPort, const char* pszFrom)
+{
+    socket_t s = HarnessConnect(pszPort, pszFrom);
+    if (s == INVALID_SOCKET_T)
+    {
+        return s;
+    }
+
+    struct timeval tv = { 2, 0 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    std::vector<BYTE> rgbPush;
+    HarnessAppendCredential(rgbPush, 1, "alice", "secret");
+    DWORD dwRequestId;
+    HRESULT hrStatus;
+    if (!HarnessSend(s, rgbPush.data(), rgbPush.size()) || !HarnessRecvAck(s, &dwRequestId, &hrStatus))
+    {
+        SocketClose(s);
+        return INVALID_SOCKET_T;
+    }
+    return s;
+}
+
+// Connections turned away because every slot is taken don't cost their source any of
+// its burst: once a slot is free, a source that kept trying meanwhile still gets in.
+static void TestFullSpendsNoTokens()
+{
+    CHarnessSink sink;
+    CHarnessListener listener;
+    listener.Get()->SetRateLimit(1, 2);
+    CHECK(SUCCEEDED(listener.Start(&sink)));
+
+    // Fill every slot, two connections from each of several sources.
+    std::vector<socket_t> rgsHeld;
+    for (DWORD i = 0; i < MAX_CLIENTS; i++)
+    {
+        char szFrom[32];
+        snprintf(szFrom, sizeof(szFrom), "127.0.1.%u", (unsigned)(1 + i / 2));
+        socket_t s = _PushAndHold(listener.GetPort(), szFrom);
+        CHECK(s != INVALID_SOCKET_T);
+        rgsHeld.push_back(s);
+    }
+
+    // More tries than the burst from a new source, all turned away.
+    for (DWORD i = 0; i < 5; i++)
+    {
+        socket_t s = HarnessConnect(listener.GetPort(), "127.0.0.2");
+        CHECK(HarnessIsClosed(s, 2000));
+        SocketClose(s);
+    }
+
+    SocketClose(rgsHeld.back());
+    rgsHeld.pop_back();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    socket_t s = _PushAndHold(listener.GetPort(), "127.0.0.2");
+    CHECK(s != INVALID_SOCKET_T);
+    rgsHeld.push_back(s);
+
+    ADMISSION_COUNTERS counters;
+    listener.Get()->GetAdmissionCounters(&counters);
+    CHECK(counters.cAdmitted == MAX_CLIENTS + 1 && counters.cRateLimited == 0);
+
+    for (socket_t sHeld : rgsHeld)
+    {
+        if (sHeld != INVALID_SOCKET_T)
+        {
+            SocketClose(sHeld);
+        }
+    }
+}
+
+// Pushes one credential on a new connection from 127.0.0.2. Returns how long it took
+// to be acknowledged, or 0 if it wasn't.
+static ULONGLONG _Push(const char* pszPort, const std::vector<BYTE>& rgbPush)
+{
+    ULONGLONG ullStart = StageClock();
+    socket_t s = HarnessConnect(pszPort, "127.0.0.2");
+    if (s == INVALID_SOCKET_T)
+    {
+        return 0;
+    }
+
+    struct timeval tv = { 2, 0 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    DWORD dwRequestId;
+    HRESULT hrStatus;
+    BOOL fPushed = HarnessSend(s, rgbPush.data(), rgbPush.size()) &&
+        HarnessRecvAck(s, &dwRequestId, &hrStatus) && hrStatus == S_OK;
+    ULONGLONG ullNs = StageClock() - ullStart;
+    SocketClose(s);
+    return fPushed ? ullNs : 0;
+}
+
+// Pushes cPushes credentials, PUSH_INTERVAL_MS apart, and returns their latencies.
+static std::vector<ULONGLONG> _PushSeveral(const char* pszPort, DWORD cPushes)
+{
+    std::vector<BYTE> rgbPush;
+    HarnessAppendCredential(rgbPush, 1, "alice", "secret");
+    std::vector<ULONGLONG> rgullNs;
+    for (DWORD i = 0; i < cPushes; i++)
+    {
+        ULONGLONG ullNs = _Push(pszPort, rgbPush);
+        CHECK(ullNs != 0);
+        if (ullNs != 0)
+        {
+            rgullNs.push_back(ullNs);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(PUSH_INTERVAL_MS));
+    }
+    return rgullNs;
+}
+
+static void _Report(const char* pszName, std::vector<ULONGLONG>& rgullNs)
+{
+    ULONGLONG ullP50 = HarnessPercentile(rgullNs, 50);
+    ULONGLONG ullP99 = HarnessPercentile(rgullNs, 99);
+    ULONGLONG ullMax = HarnessPercentile(rgullNs, 100);
+    printf("  %-8s %3u pushes: p50 %8.1f us   p99 %8.1f us   max %8.1f us\n", pszName, (unsigned)rgullNs.size(),
+        ullP50 / 1e3, ullP99 / 1e3, ullMax / 1e3);
+}
+
+int main(int argc, char** argv)
+{
+    DWORD cPushes = HarnessArg(argc, argv, 1, 40);
+    DWORD cFlooders = HarnessArg(argc, argv, 2, 8);
+
+    TestBuckets();
+    TestFullSpendsNoTokens();
+
+    CHarnessSink sink;
+    CHarnessListener listener;
+    CHECK(SUCCEEDED(listener.Start(&sink)));
+
+    std::vector<ULONGLONG> rgullQuiet = _PushSeveral(listener.GetPort(), cPushes / 2);
+
+    // The storm: connect, send a byte, and reset the connection rather than leave it
+    // in TIME_WAIT, so the flooders don't run out of ports.
+    std::atomic<BOOL> fStop(FALSE);
+    std::atomic<DWORD> cStormConnections(0);
+    std::vector<std::thread> rgFlooders;
+    for (DWORD i = 0; i < cFlooders; i++)
+    {
+        rgFlooders.emplace_back([&]() {
+            while (!fStop)
+            {
+                socket_t s = HarnessConnect(listener.GetPort(), "127.0.0.1");
+                if (s != INVALID_SOCKET_T)
+                {
+                    struct linger lg = { 1, 0 };
+                    setsockopt(s, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+                    send(s, "x", 1, MSG_NOSIGNAL);
+                    SocketClose(s);
+                    cStormConnections++;
+                }
+            }
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    std::vector<ULONGLONG> rgullFlooded = _PushSeveral(listener.GetPort(), cPushes);
+
+    // A full backlog makes the system hold back the flooders' connects, so make sure
+    // they've got through enough to use up their burst before calling it a storm.
+    CHECK(HarnessWaitFor([&]() { return cStormConnections >= DEFAULT_ADMISSION_BURST * 2; }, 10000));
+    fStop = TRUE;
+    for (std::thread& flooder : rgFlooders)
+    {
+        flooder.join();
+    }
+    listener.Stop();
+
+    ADMISSION_COUNTERS counters;
+    listener.Get()->GetAdmissionCounters(&counters);
+    CHECK(counters.cRateLimited > 0);
+    CHECK(sink.GetReceivedCount() == cPushes / 2 + cPushes);
+
+    printf("%u storm connections from %u threads; %u admitted, %u rate limited\n", (unsigned)cStormConnections.load(),
+        (unsigned)cFlooders, (unsigned)counters.cAdmitted, (unsigned)counters.cRateLimited);
+    _Report("quiet", rgullQuiet);
+    _Report("flooded", rgullFlooded);
+    return HarnessResult();
+}
@@ -0,0 +1,136 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Fuzz targets under tests/ are written for libFuzzer: each defines
+// LLVMFuzzerTestOneInput, which should abort (through FUZZ_ASSERT) on anything it
+// finds wrong, and FuzzSeeds, which supplies well-formed inputs to start from.
+//
+// Built with -DSAMPLE_LIBFUZZER=ON under clang, libFuzzer drives the target; pass it
+// a corpus directory as usual. Otherwise this supplies a main of its own that mutates
+// the seeds with a fixed-seed generator, so the same inputs are tried on every run:
+//
+//   <target> [iterations] [seed]
+
+#pragma once
+
+#include "PlatformCompat.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* pb, size_t cb);
+
+// Adds the target's well-formed inputs to rgSeeds.
+void FuzzSeeds(std::vector<std::vector<BYTE>>& rgSeeds);
+
+// Unlike assert, never compiled out.
+#define FUZZ_ASSERT(expr) \
+    do { \
+        if (!(expr)) { \
+            fprintf(stderr, "%s(%d): FUZZ_ASSERT(%s) failed\n", __FILE__, __LINE__, #expr); \
+            abort(); \
+        } \
+    } while (0)
+
+#ifndef SAMPLE_LIBFUZZER
+
+// xorshift64*: quick, and the same sequence everywhere for a given seed.
+class CFuzzRandom
+{
+  public:
+    CFuzzRandom(ULONGLONG ullSeed) : _ull(ullSeed ? ullSeed : 0x9E3779B97F4A7C15ull) {}
+
+    DWORD Next()
+    {
+        _ull ^= _ull >> 12;
+        _ull ^= _ull << 25;
+        _ull ^= _ull >> 27;
+        return (DWORD)((_ull * 0x2545F4914F6CDD1Dull) >> 32);
+    }
+
+    // A number below c, which must not be 0.
+    DWORD Below(DWORD c) { return Next() % c; }
+
+  private:
+    ULONGLONG _ull;
+};
+
+// Applies a handful of random edits to rgb: flipped bits, bytes set to interesting
+// values, bytes inserted and removed, and runs copied from elsewhere in the input.
+inline void FuzzMutate(CFuzzRandom& random, std::vector<BYTE>& rgb)
+{
+    static const BYTE c_rgbInteresting[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF, 0xCF, 0x31, 0x0C };
+
+    DWORD cEdits = 1 + random.Below(4);
+    for (DWORD iEdit = 0; iEdit < cEdits; iEdit++)
+    {
+        DWORD dwKind = random.Below(5);
+        if (rgb.empty())
+        {
+            dwKind = 2;
+        }
+
+        switch (dwKind)
+        {
+        case 0:
+            rgb[random.Below((DWORD)rgb.size())] ^= (BYTE)(1 << random.Below(8));
+            break;
+        case 1:
+            rgb[random.Below((DWORD)rgb.size())] = c_rgbInteresting[random.Below(ARRAYSIZE(c_rgbInteresting))];
+            break;
+        case 2:
+            rgb.insert(rgb.begin() + random.Below((DWORD)rgb.size() + 1), (BYTE)random.Next());
+            break;
+        case 3:
+            rgb.erase(rgb.begin() + random.Below((DWORD)rgb.size()));
+            break;
+        default:
+            {
+                DWORD ibFrom = random.Below((DWORD)rgb.size());
+                DWORD cb = 1 + random.Below((DWORD)rgb.size() - ibFrom);
+                DWORD ibTo = random.Below((DWORD)rgb.size());
+                std::vector<BYTE> rgbRun(rgb.begin() + ibFrom, rgb.begin() + ibFrom + cb);
+                rgb.insert(rgb.begin() + ibTo, rgbRun.begin(), rgbRun.end());
+            }
+            break;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    DWORD cIterations = (argc > 1) ? (DWORD)strtoul(argv[1], NULL, 10) : 100000;
+    ULONGLONG ullSeed = (argc > 2) ? strtoull(argv[2], NULL, 10) : 1;
+
+    std::vector<std::vector<BYTE>> rgSeeds;
+    FuzzSeeds(rgSeeds);
+    for (std::vector<BYTE>& rgbSeed : rgSeeds)
+    {
+        LLVMFuzzerTestOneInput(rgbSeed.data(), rgbSeed.size());
+    }
+
+    CFuzzRandom random(ullSeed);
+    std::vector<BYTE> rgb;
+    for (DWORD i = 0; i < cIterations; i++)
+    {
+        // Mostly mutate a seed afresh; sometimes keep mutating the last input, to get
+        // further from the seeds.
+        if (rgb.empty() || random.Below(4) != 0)
+        {
+            rgb = rgSeeds[random.Below((DWORD)rgSeeds.size())];
+        }
+        FuzzMutate(random, rgb);
+        LLVMFuzzerTestOneInput(rgb.data(), rgb.size());
+    }
+
+    printf("%u seeds, %u mutated inputs: no failures\n", (unsigned)rgSeeds.size(), (unsigned)cIterations);
+    return 0;
+}
+
+#endif
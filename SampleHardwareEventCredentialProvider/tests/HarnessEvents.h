@@ -0,0 +1,85 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// For the event channel's tests and benchmarks: opening a CEventChannel on a free
+// port, and a UDP sender, on any local address, that sends it events or anything
+// else.
+
+#pragma once
+
+#include "TestHarness.h"
+#include "EventChannel.h"
+
+// Opens pChannel on the first free port we try, which goes in pszPort.
+inline HRESULT HarnessOpenEvents(CEventChannel* pChannel, char* pszPort, size_t cchPort)
+{
+    HRESULT hr = E_FAIL;
+    for (int i = 0; i < 16 && FAILED(hr); i++)
+    {
+        HarnessPort(pszPort, cchPort);
+        hr = pChannel->Open(pszPort);
+    }
+    return hr;
+}
+
+class CHarnessEventSender
+{
+  public:
+    CHarnessEventSender() : _s(INVALID_SOCKET_T) {}
+    ~CHarnessEventSender()
+    {
+        if (_s != INVALID_SOCKET_T)
+        {
+            SocketClose(_s);
+        }
+    }
+
+    // Sends to pszPort on the local address pszTo, from the local address pszFrom.
+    BOOL Open(const char* pszPort, const char* pszFrom = "127.0.0.1", const char* pszTo = "127.0.0.1")
+    {
+        _s = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (_s == INVALID_SOCKET_T)
+        {
+            return FALSE;
+        }
+
+        struct sockaddr_in sa;
+        ZeroMemory(&sa, sizeof(sa));
+        sa.sin_family = AF_INET;
+        if (inet_pton(AF_INET, pszFrom, &sa.sin_addr) != 1 || bind(_s, (struct sockaddr*)&sa, sizeof(sa)) == SOCKET_ERROR)
+        {
+            return FALSE;
+        }
+
+        ZeroMemory(&_saTo, sizeof(_saTo));
+        _saTo.sin_family = AF_INET;
+        if (inet_pton(AF_INET, pszTo, &_saTo.sin_addr) != 1)
+        {
+            return FALSE;
+        }
+        _saTo.sin_port = htons((USHORT)atoi(pszPort));
+        return TRUE;
+    }
+
+    BOOL SendRaw(const void* pv, size_t cb)
+    {
+        return sendto(_s, (const char*)pv, cb, 0, (const struct sockaddr*)&_saTo, sizeof(_saTo)) == (int)cb;
+    }
+
+    BOOL Send(EVENT_TYPE type, DWORD dwSenderId, DWORD dwSequence)
+    {
+        EVENT_MESSAGE em = { type, TRUE, dwSenderId, dwSequence };
+        BYTE rgb[EVENT_DATAGRAM_SIZE];
+        EventMessageEncode(em, rgb);
+        return SendRaw(rgb, sizeof(rgb));
+    }
+
+  private:
+    socket_t            _s;
+    struct sockaddr_in  _saTo;
+};
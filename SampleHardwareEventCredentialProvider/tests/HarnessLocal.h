@@ -0,0 +1,119 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// A local agent for the tests and benchmarks of the listener's shared memory
+// transport: it sends whole buffers and reads whole FT_ACKs through a CLocalTransport,
+// sleeping on its doorbell in between as a real agent would.
+
+#pragma once
+
+#include "TestHarness.h"
+#include "LocalTransport.h"
+
+#define HARNESS_LOCAL_TIMEOUT_MS    5000
+
+// A mapping name of our own, so that tests running at the same time don't meet.
+inline void HarnessLocalName(char* pszName, size_t cchName)
+{
+    snprintf(pszName, cchName, "/SampleCredentialAgentTest.%u", (unsigned)getpid());
+}
+
+class CHarnessAgent
+{
+  public:
+    CHarnessAgent() : _hrLast(S_OK) {}
+
+    HRESULT Connect(const char* pszName)
+    {
+        _hrLast = S_OK;
+        return _transport.Connect(pszName);
+    }
+    void Close() { _transport.Close(); }
+
+    // The failure that stopped the last Send or RecvAck, if one did.
+    HRESULT GetLastResult() { return _hrLast; }
+
+    BOOL Send(const BYTE* pb, DWORD cb)
+    {
+        ULONGLONG ullDeadline = _Deadline();
+        while (cb > 0)
+        {
+            DWORD cbSent = 0;
+            _hrLast = _transport.Send(pb, cb, &cbSent);
+            if (FAILED(_hrLast))
+            {
+                return FALSE;
+            }
+            pb += cbSent;
+            cb -= cbSent;
+            if (cb > 0 && cbSent == 0 && !_Wait(TRUE, ullDeadline))
+            {
+                return FALSE;
+            }
+        }
+        return TRUE;
+    }
+
+    // Reads one FT_ACK, returning FALSE if the listener dropped us, sent something
+    // else, or sent nothing in time.
+    BOOL RecvAck(DWORD* pdwRequestId, HRESULT* phrStatus)
+    {
+        BYTE rgb[FRAME_ACK_SIZE];
+        DWORD cb = 0;
+        ULONGLONG ullDeadline = _Deadline();
+        while (cb < sizeof(rgb))
+        {
+            DWORD cbReceived = 0;
+            _hrLast = _transport.Receive(rgb + cb, sizeof(rgb) - cb, &cbReceived);
+            if (FAILED(_hrLast))
+            {
+                return FALSE;
+            }
+            cb += cbReceived;
+            if (cb < sizeof(rgb) && cbReceived == 0 && !_Wait(FALSE, ullDeadline))
+            {
+                return FALSE;
+            }
+        }
+        if (rgb[0] != FRAME_MAGIC || rgb[2] != FT_ACK)
+        {
+            return FALSE;
+        }
+        *pdwRequestId = (DWORD)rgb[4] | ((DWORD)rgb[5] << 8) | ((DWORD)rgb[6] << 16) | ((DWORD)rgb[7] << 24);
+        *phrStatus = (HRESULT)((DWORD)rgb[12] | ((DWORD)rgb[13] << 8) | ((DWORD)rgb[14] << 16) | ((DWORD)rgb[15] << 24));
+        return TRUE;
+    }
+
+  private:
+    static ULONGLONG _Deadline() { return StageClock() + HARNESS_LOCAL_TIMEOUT_MS * 1000000ULL; }
+
+    // Sleeps until the listener rings, if there's nothing to do yet. FALSE once the
+    // deadline has passed.
+    BOOL _Wait(BOOL fWantToSend, ULONGLONG ullDeadline)
+    {
+        ULONGLONG ullNow = StageClock();
+        if (ullNow >= ullDeadline)
+        {
+            _hrLast = HRESULT_FROM_WIN32(ERROR_TIMEOUT);
+            return FALSE;
+        }
+        if (_transport.PrepareToWait(fWantToSend))
+        {
+            pollfd_t pfd;
+            pfd.fd = _transport.GetDoorbell();
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            SocketPoll(&pfd, 1, (int)((ullDeadline - ullNow) / 1000000) + 1);
+        }
+        _transport.ClearDoorbell();
+        return TRUE;
+    }
+
+    CLocalTransport _transport;
+    HRESULT         _hrLast;
+};
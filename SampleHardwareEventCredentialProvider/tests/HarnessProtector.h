@@ -0,0 +1,113 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// A stand-in for CredProtect, for the protection worker's tests and benchmarks: it
+// spins for as long as it's told, to cost what CredProtect would, and then "protects"
+// the password by prefixing it with '@' and spelling each character in hex, so the
+// result is easy to check. It can also be made to hold every caller until released.
+
+#pragma once
+
+#include "TestHarness.h"
+#include "HarnessTiles.h"
+#include "PasswordProtection.h"
+#include <condition_variable>
+#include <mutex>
+
+class CHarnessProtector : public IPasswordProtector
+{
+  public:
+    CHarnessProtector(DWORD dwCostUs) : _cProtected(0), _dwCostUs(dwCostUs), _fHeld(FALSE) {}
+
+    HRESULT Protect(const WCHAR* pwzPassword, WCHAR* pwzProtected, DWORD cchMax, DWORD* pcchProtected)
+    {
+        {
+            std::unique_lock<std::mutex> guard(_lock);
+            _cvHeld.wait(guard, [this] { return !_fHeld; });
+        }
+
+        ULONGLONG ullUntil = StageClock() + (ULONGLONG)_dwCostUs * 1000;
+        while (StageClock() < ullUntil)
+        {
+        }
+
+        HRESULT hr = HarnessProtect(pwzPassword, pwzProtected, cchMax, pcchProtected);
+        _cProtected++;
+        return hr;
+    }
+
+    // While held, Protect waits before doing anything.
+    void Hold(BOOL fHeld)
+    {
+        {
+            std::lock_guard<std::mutex> guard(_lock);
+            _fHeld = fHeld;
+        }
+        _cvHeld.notify_all();
+    }
+
+    // What Protect makes of pwzPassword, without the wait.
+    static HRESULT HarnessProtect(const WCHAR* pwzPassword, WCHAR* pwzProtected, DWORD cchMax, DWORD* pcchProtected)
+    {
+        static const char c_szHex[] = "0123456789abcdef";
+        DWORD cch = 0;
+        if (cchMax < 2)
+        {
+            return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+        }
+        pwzProtected[cch++] = '@';
+        for (; *pwzPassword != 0; pwzPassword++)
+        {
+            if (cch + 4 >= cchMax)
+            {
+                return HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER);
+            }
+            for (int iShift = 12; iShift >= 0; iShift -= 4)
+            {
+                pwzProtected[cch++] = c_szHex[(*pwzPassword >> iShift) & 0xF];
+            }
+        }
+        pwzProtected[cch] = 0;
+        *pcchProtected = cch;
+        return S_OK;
+    }
+
+    std::atomic<DWORD>  _cProtected;
+
+  private:
+    DWORD                   _dwCostUs;
+    std::mutex              _lock;
+    std::condition_variable _cvHeld;
+    BOOL                    _fHeld;
+};
+
+// A tile with a CProtectedPassword, as CSampleCredential has, and what its
+// ProtectAsync does: set the slot, expect the push and queue it.
+class CHarnessProtectedTile : public CHarnessTile
+{
+  public:
+    HRESULT Push(CProtectionWorker* pWorker, const char* pszPassword, DWORD* pdwSequence)
+    {
+        HRESULT hr = GetSlot()->Set("user", pszPassword);
+        if (SUCCEEDED(hr))
+        {
+            CREDENTIAL_SNAPSHOT snapshot;
+            GetSlot()->Read(&snapshot);
+            _protected.Expect(snapshot.dwSequence);
+            hr = pWorker->Submit(this, &_protected, &snapshot);
+            if (FAILED(hr))
+            {
+                _protected.Clear();
+            }
+            *pdwSequence = snapshot.dwSequence;
+        }
+        return hr;
+    }
+
+    CProtectedPassword  _protected;
+};
@@ -0,0 +1,66 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Bare roster tiles for the roster's tests and benchmarks, standing in for
+// CSampleCredential: a reference count and a slot, and a count of how many are alive
+// so that leaks show up.
+
+#pragma once
+
+#include "TestHarness.h"
+#include "CredentialRoster.h"
+#include <string>
+
+class CHarnessTile : public IRosterTile
+{
+  public:
+    CHarnessTile() : _cRef(1) { s_cLive++; }
+
+    void AddRefTile() { _cRef++; }
+    void ReleaseTile()
+    {
+        if (--_cRef == 0)
+        {
+            s_cLive--;
+            delete this;
+        }
+    }
+    CCredentialSlot* GetSlot() { return &_slot; }
+
+    static std::atomic<LONG> s_cLive;
+
+  protected:
+    virtual ~CHarnessTile() {}
+
+  private:
+    std::atomic<LONG>   _cRef;
+    CCredentialSlot     _slot;
+};
+
+std::atomic<LONG> CHarnessTile::s_cLive(0);
+
+class CHarnessTileFactory : public IRosterTileFactory
+{
+  public:
+    HRESULT CreateTile(IRosterTile** ppTile)
+    {
+        *ppTile = new CHarnessTile();
+        return S_OK;
+    }
+};
+
+// A slot's username or password as a narrow string; only meant for ASCII.
+inline std::string HarnessNarrow(const WCHAR* pwz)
+{
+    std::string str;
+    for (; *pwz != 0; pwz++)
+    {
+        str += (char)*pwz;
+    }
+    return str;
+}
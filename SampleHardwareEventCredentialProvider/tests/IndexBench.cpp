@@ -0,0 +1,118 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Microbenchmark of CProfileIndex against sqlite's own lookup on the same profiles:
+// nanoseconds per id-to-account resolution through the bare index (hits and misses),
+// through a prepared sqlite statement, and through CCredentialStore::Lookup, which
+// puts its lock and staleness check in front of the index.
+//
+//   IndexBench [profiles ...]
+
+#include "ProfileDb.h"
+#include "CredentialStore.h"
+#include <random>
+#include <string>
+
+#define LOOKUP_IDS 4096
+
+// Calls pfnLookup cLookups times, cycling through rgIds, and prints the time each took.
+template <class F>
+static void _TimeLookups(const char* pszName, const std::vector<std::string>& rgIds, DWORD cLookups, F pfnLookup)
+{
+    DWORD cFound = 0;
+    ULONGLONG ullStart = StageClock();
+    for (DWORD i = 0; i < cLookups; i++)
+    {
+        const std::string& id = rgIds[i % rgIds.size()];
+        cFound += pfnLookup(id) ? 1 : 0;
+    }
+    ULONGLONG ullNs = StageClock() - ullStart;
+    printf("  %-16s %9u lookups, %6u found, %8.1f ns each\n", pszName, (unsigned)cLookups, (unsigned)cFound,
+        (double)ullNs / cLookups);
+}
+
+static void _Bench(DWORD cProfiles)
+{
+    char szPath[MAX_PATH];
+    ProfileDbPath("IndexBench.db", szPath, sizeof(szPath));
+    CHECK(SUCCEEDED(ProfileDbCreate(szPath, cProfiles)));
+
+    std::mt19937 random(cProfiles);
+    std::vector<std::string> rgHits;
+    std::vector<std::string> rgMisses;
+    for (DWORD i = 0; i < LOOKUP_IDS; i++)
+    {
+        char szId[32];
+        ProfileDbId(random() % cProfiles, szId, sizeof(szId));
+        rgHits.push_back(szId);
+        ProfileDbId(cProfiles + random() % cProfiles, szId, sizeof(szId));
+        rgMisses.push_back(szId);
+    }
+    printf("%u profiles:\n", (unsigned)cProfiles);
+
+    CProfileIndex index;
+    ULONGLONG ullStart = StageClock();
+    CHECK(SUCCEEDED(index.Reserve(cProfiles)));
+    for (DWORD i = 0; i < cProfiles; i++)
+    {
+        char szId[32], szUser[32], szPassword[32];
+        int cchId = ProfileDbId(i, szId, sizeof(szId));
+        ProfileDbUser(i, szUser, sizeof(szUser));
+        ProfileDbPassword(i, szPassword, sizeof(szPassword));
+        CHECK(SUCCEEDED(index.Add(szId, cchId, szUser, szPassword)));
+    }
+    printf("  %-16s %9.1f ms\n", "index load", (StageClock() - ullStart) / 1e6);
+
+    DWORD cLookups = 4000000;
+    _TimeLookups("index hit", rgHits, cLookups, [&](const std::string& id) {
+        PROFILE_RECORD record;
+        return SUCCEEDED(index.Lookup(id.data(), id.size(), &record));
+    });
+    _TimeLookups("index miss", rgMisses, cLookups, [&](const std::string& id) {
+        PROFILE_RECORD record;
+        return SUCCEEDED(index.Lookup(id.data(), id.size(), &record));
+    });
+
+    sqlite3* pDb = NULL;
+    sqlite3_stmt* pStmt = NULL;
+    CHECK(sqlite3_open_v2(szPath, &pDb, SQLITE_OPEN_READWRITE, NULL) == SQLITE_OK);
+    CHECK(sqlite3_prepare_v3(pDb, "SELECT username, password FROM profile WHERE id = ?1;", -1,
+        SQLITE_PREPARE_PERSISTENT, &pStmt, NULL) == SQLITE_OK);
+    _TimeLookups("sqlite hit", rgHits, cLookups / 20, [&](const std::string& id) {
+        sqlite3_bind_text(pStmt, 1, id.data(), (int)id.size(), SQLITE_STATIC);
+        BOOL fFound = sqlite3_step(pStmt) == SQLITE_ROW;
+        sqlite3_reset(pStmt);
+        return fFound;
+    });
+    sqlite3_finalize(pStmt);
+    sqlite3_close(pDb);
+
+    CCredentialStore store;
+    CHECK(SUCCEEDED(store.Open(szPath)));
+    _TimeLookups("store hit", rgHits, cLookups, [&](const std::string& id) {
+        PROFILE_RECORD record;
+        return SUCCEEDED(store.Lookup(id.data(), id.size(), &record));
+    });
+    store.Close();
+
+    ProfileDbDelete(szPath);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        _Bench(10000);
+        _Bench(1000000);
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        _Bench(HarnessArg(argc, argv, i, 10000));
+    }
+    return HarnessResult();
+}
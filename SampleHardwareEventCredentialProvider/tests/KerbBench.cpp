@@ -0,0 +1,126 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// How fast the KERB_INTERACTIVE_UNLOCK_LOGON packer packs and unpacks a typical
+// credential, for the native pointer size and for each size explicitly. Then, from the
+// same NUL-terminated strings GetSerialization starts with, the old two stages,
+// KerbInteractiveUnlockLogonInit and KerbInteractiveUnlockLogonPack, against
+// KerbInteractiveUnlockLogonPackStrings's single pass, allocation included.
+//
+//   KerbBench [iterations]
+
+#include "TestHarness.h"
+#include "KerbPack.h"
+#include "helpers.h"
+
+template <typename TPtr>
+static void _Bench(const char* pszName, const KERB_PACK_STRINGS& ps, DWORD cIterations)
+{
+    typedef CKerbPacker<TPtr> CPacker;
+    DWORD cbPacked = CPacker::GetPackedSize(ps.cbDomain, ps.cbUser, ps.cbPassword);
+    std::vector<BYTE> rgb(cbPacked);
+
+    ULONGLONG ullStart = StageClock();
+    for (DWORD i = 0; i < cIterations; i++)
+    {
+        CHECK(SUCCEEDED(CPacker::Pack(ps, rgb.data(), cbPacked)));
+    }
+    ULONGLONG ullPackNs = StageClock() - ullStart;
+
+    volatile DWORD dwCheck = 0;
+    KERB_PACK_STRINGS psUnpacked = {};
+    ullStart = StageClock();
+    for (DWORD i = 0; i < cIterations; i++)
+    {
+        CHECK(SUCCEEDED(CPacker::Unpack(rgb.data(), cbPacked, &psUnpacked)));
+        dwCheck = dwCheck + psUnpacked.cbPassword;
+    }
+    ULONGLONG ullUnpackNs = StageClock() - ullStart;
+
+    printf("  %-8s %4u bytes  pack %12.0f/s %8.1f ns   unpack %12.0f/s %8.1f ns\n", pszName, (unsigned)cbPacked,
+        HarnessRate(cIterations, ullPackNs), (double)ullPackNs / cIterations,
+        HarnessRate(cIterations, ullUnpackNs), (double)ullUnpackNs / cIterations);
+}
+
+static void _BenchFromStrings(PWSTR pwzDomain, PWSTR pwzUser, PWSTR pwzPassword, DWORD cIterations)
+{
+    // Both must give the same bytes.
+    KERB_INTERACTIVE_UNLOCK_LOGON kiul;
+    BYTE* pbTwoStage = NULL;
+    DWORD cbTwoStage = 0;
+    BYTE* pbOnePass = NULL;
+    DWORD cbOnePass = 0;
+    CHECK(SUCCEEDED(KerbInteractiveUnlockLogonInit(pwzDomain, pwzUser, pwzPassword, CPUS_UNLOCK_WORKSTATION, &kiul)));
+    CHECK(SUCCEEDED(KerbInteractiveUnlockLogonPack(kiul, &pbTwoStage, &cbTwoStage)));
+    CHECK(SUCCEEDED(KerbInteractiveUnlockLogonPackStrings(pwzDomain, pwzUser, pwzPassword, CPUS_UNLOCK_WORKSTATION,
+        &pbOnePass, &cbOnePass)));
+    CHECK(pbTwoStage != NULL && pbOnePass != NULL && cbTwoStage == cbOnePass &&
+        memcmp(pbTwoStage, pbOnePass, cbOnePass) == 0);
+    CoTaskMemFree(pbTwoStage);
+    CoTaskMemFree(pbOnePass);
+
+    ULONGLONG ullStart = StageClock();
+    for (DWORD i = 0; i < cIterations; i++)
+    {
+        BYTE* pb = NULL;
+        DWORD cb = 0;
+        HRESULT hr = KerbInteractiveUnlockLogonInit(pwzDomain, pwzUser, pwzPassword, CPUS_UNLOCK_WORKSTATION, &kiul);
+        if (SUCCEEDED(hr))
+        {
+            hr = KerbInteractiveUnlockLogonPack(kiul, &pb, &cb);
+        }
+        CHECK(SUCCEEDED(hr));
+        CoTaskMemFree(pb);
+    }
+    ULONGLONG ullTwoStageNs = StageClock() - ullStart;
+
+    ullStart = StageClock();
+    for (DWORD i = 0; i < cIterations; i++)
+    {
+        BYTE* pb = NULL;
+        DWORD cb = 0;
+        CHECK(SUCCEEDED(KerbInteractiveUnlockLogonPackStrings(pwzDomain, pwzUser, pwzPassword, CPUS_UNLOCK_WORKSTATION,
+            &pb, &cb)));
+        CoTaskMemFree(pb);
+    }
+    ULONGLONG ullOnePassNs = StageClock() - ullStart;
+
+    printf("From strings, %u bytes:\n", (unsigned)cbOnePass);
+    printf("  Init+Pack    %12.0f/s %8.1f ns\n", HarnessRate(cIterations, ullTwoStageNs), (double)ullTwoStageNs / cIterations);
+    printf("  PackStrings  %12.0f/s %8.1f ns   %.2fx\n", HarnessRate(cIterations, ullOnePassNs),
+        (double)ullOnePassNs / cIterations, ullOnePassNs ? (double)ullTwoStageNs / ullOnePassNs : 0.0);
+}
+
+int main(int argc, char** argv)
+{
+    DWORD cIterations = HarnessArg(argc, argv, 1, 1000000);
+
+    static const WCHAR c_wszDomain[] = { 'W', 'O', 'R', 'K', 'G', 'R', 'O', 'U', 'P', 0 };
+    static const WCHAR c_wszUser[] = { 'a', 'l', 'i', 'c', 'e', '.', 's', 'm', 'i', 't', 'h', 0 };
+    static const WCHAR c_wszPassword[] = { 'c', 'o', 'r', 'r', 'e', 'c', 't', ' ', 'h', 'o', 'r', 's', 'e', 0 };
+
+    KERB_PACK_STRINGS ps;
+    ps.dwMessageType = 7;
+    CHECK(SUCCEEDED(KerbPackSetString(c_wszDomain, &ps.pbDomain, &ps.cbDomain)));
+    CHECK(SUCCEEDED(KerbPackSetString(c_wszUser, &ps.pbUser, &ps.cbUser)));
+    CHECK(SUCCEEDED(KerbPackSetString(c_wszPassword, &ps.pbPassword, &ps.cbPassword)));
+
+    printf("%u iterations\n", (unsigned)cIterations);
+    _Bench<UINT_PTR>("native", ps, cIterations);
+    _Bench<DWORD>("32-bit", ps, cIterations);
+    _Bench<ULONGLONG>("64-bit", ps, cIterations);
+
+    WCHAR wszDomain[ARRAYSIZE(c_wszDomain)];
+    WCHAR wszUser[ARRAYSIZE(c_wszUser)];
+    WCHAR wszPassword[ARRAYSIZE(c_wszPassword)];
+    memcpy(wszDomain, c_wszDomain, sizeof(wszDomain));
+    memcpy(wszUser, c_wszUser, sizeof(wszUser));
+    memcpy(wszPassword, c_wszPassword, sizeof(wszPassword));
+    _BenchFromStrings(wszDomain, wszUser, wszPassword, cIterations);
+    return HarnessResult();
+}
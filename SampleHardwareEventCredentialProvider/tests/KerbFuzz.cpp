@@ -0,0 +1,180 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Fuzzes the KERB_INTERACTIVE_UNLOCK_LOGON packer for both pointer sizes. The first
+// byte of the input picks the pointer size; the rest is taken as a packed structure
+// from an untrusted source, and unpacked.
+//
+// Unpack must accept exactly the buffers the reference check below accepts, which is
+// what KerbInteractiveUnlockLogonUnpackInPlace in the SDK samples does (each string
+// must end within the buffer) plus the rules Unpack adds: strings start after the
+// header, are a whole number of characters, and fit their MaximumLength. The
+// reference reads the header through structs laid out the way the Windows compilers
+// lay them out, not through CKerbPacker's offsets. Whatever Unpack accepts must pack
+// back to a structure that unpacks to the same strings.
+
+#include "FuzzDriver.h"
+#include "KerbPack.h"
+#include <stddef.h>
+#include <string.h>
+
+// The structures for each pointer size, with the pointer as an integer of its size.
+template <typename TPtr>
+struct KERB_MIRROR
+{
+    struct UNICODE_STRING_MIRROR
+    {
+        USHORT  Length;
+        USHORT  MaximumLength;
+        TPtr    Buffer;
+    };
+    struct INTERACTIVE_LOGON
+    {
+        DWORD                   MessageType;
+        UNICODE_STRING_MIRROR   LogonDomainName;
+        UNICODE_STRING_MIRROR   UserName;
+        UNICODE_STRING_MIRROR   Password;
+    };
+    struct INTERACTIVE_UNLOCK_LOGON
+    {
+        INTERACTIVE_LOGON       Logon;
+        DWORD                   LogonIdLow;
+        LONG                    LogonIdHigh;
+    };
+};
+
+typedef KERB_MIRROR<DWORD>::INTERACTIVE_UNLOCK_LOGON       KERB_UNLOCK_MIRROR32;
+typedef KERB_MIRROR<ULONGLONG>::INTERACTIVE_UNLOCK_LOGON   KERB_UNLOCK_MIRROR64;
+
+static_assert(sizeof(KERB_UNLOCK_MIRROR32) == CKerbPacker32::cbHeader, "32-bit header");
+static_assert(sizeof(KERB_UNLOCK_MIRROR64) == CKerbPacker64::cbHeader, "64-bit header");
+static_assert(offsetof(KERB_UNLOCK_MIRROR32, Logon.Password) == CKerbPacker32::ibPassword, "32-bit password");
+static_assert(offsetof(KERB_UNLOCK_MIRROR64, Logon.Password) == CKerbPacker64::ibPassword, "64-bit password");
+static_assert(offsetof(KERB_UNLOCK_MIRROR64, LogonIdLow) == CKerbPacker64::ibLogonId, "64-bit LUID");
+
+// Whether one string of a packed structure of cb bytes passes the reference check.
+template <typename TString>
+static BOOL _ReferenceStringOk(const TString& us, DWORD cb, DWORD cbHeader)
+{
+    if ((us.Length & 1) != 0 || us.MaximumLength < us.Length)
+    {
+        return FALSE;
+    }
+    if (us.Length == 0)
+    {
+        return TRUE;
+    }
+    ULONGLONG ibBuffer = us.Buffer;
+    return ibBuffer >= cbHeader && ibBuffer <= cb && us.Length <= cb - ibBuffer;
+}
+
+template <typename TPtr>
+static void _CheckOne(const BYTE* pb, DWORD cb)
+{
+    typedef CKerbPacker<TPtr> CPacker;
+    typedef typename KERB_MIRROR<TPtr>::INTERACTIVE_UNLOCK_LOGON KERB_UNLOCK;
+
+    BOOL fReferenceOk = FALSE;
+    KERB_UNLOCK kiul;
+    if (cb >= sizeof(kiul))
+    {
+        memcpy(&kiul, pb, sizeof(kiul));
+        fReferenceOk = _ReferenceStringOk(kiul.Logon.LogonDomainName, cb, CPacker::cbHeader) &&
+            _ReferenceStringOk(kiul.Logon.UserName, cb, CPacker::cbHeader) &&
+            _ReferenceStringOk(kiul.Logon.Password, cb, CPacker::cbHeader);
+    }
+
+    KERB_PACK_STRINGS ps;
+    HRESULT hr = CPacker::Unpack(pb, cb, &ps);
+    FUZZ_ASSERT(SUCCEEDED(hr) == fReferenceOk);
+    if (FAILED(hr))
+    {
+        FUZZ_ASSERT(hr == HRESULT_FROM_WIN32(ERROR_INVALID_DATA));
+        return;
+    }
+
+    // The strings are where the structure says, and wholly inside it.
+    FUZZ_ASSERT(ps.dwMessageType == kiul.Logon.MessageType);
+    FUZZ_ASSERT(ps.cbDomain == kiul.Logon.LogonDomainName.Length);
+    FUZZ_ASSERT(ps.cbUser == kiul.Logon.UserName.Length);
+    FUZZ_ASSERT(ps.cbPassword == kiul.Logon.Password.Length);
+    FUZZ_ASSERT(ps.cbUser == 0 || ps.pbUser == pb + kiul.Logon.UserName.Buffer);
+    FUZZ_ASSERT(ps.cbPassword == 0 || ps.pbPassword == pb + kiul.Logon.Password.Buffer);
+    FUZZ_ASSERT(ps.pbDomain >= pb && ps.pbDomain + ps.cbDomain <= pb + cb);
+    FUZZ_ASSERT(ps.pbUser >= pb && ps.pbUser + ps.cbUser <= pb + cb);
+    FUZZ_ASSERT(ps.pbPassword >= pb && ps.pbPassword + ps.cbPassword <= pb + cb);
+
+    // Repacking what we unpacked gives a canonical structure holding the same strings.
+    DWORD cbPacked = CPacker::GetPackedSize(ps.cbDomain, ps.cbUser, ps.cbPassword);
+    std::vector<BYTE> rgbPacked(cbPacked + 1, 0xCC);
+    FUZZ_ASSERT(CPacker::Pack(ps, rgbPacked.data(), cbPacked - 1) == HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
+    FUZZ_ASSERT(SUCCEEDED(CPacker::Pack(ps, rgbPacked.data(), cbPacked)));
+    FUZZ_ASSERT(rgbPacked[cbPacked] == 0xCC);
+
+    KERB_PACK_STRINGS psAgain;
+    FUZZ_ASSERT(SUCCEEDED(CPacker::Unpack(rgbPacked.data(), cbPacked, &psAgain)));
+    FUZZ_ASSERT(psAgain.dwMessageType == ps.dwMessageType);
+    FUZZ_ASSERT(psAgain.cbDomain == ps.cbDomain && memcmp(psAgain.pbDomain, ps.pbDomain, ps.cbDomain) == 0);
+    FUZZ_ASSERT(psAgain.cbUser == ps.cbUser && memcmp(psAgain.pbUser, ps.pbUser, ps.cbUser) == 0);
+    FUZZ_ASSERT(psAgain.cbPassword == ps.cbPassword && memcmp(psAgain.pbPassword, ps.pbPassword, ps.cbPassword) == 0);
+
+    // The LUID is left for WinLogon, and the strings follow the header in order.
+    KERB_UNLOCK kiulPacked;
+    memcpy(&kiulPacked, rgbPacked.data(), sizeof(kiulPacked));
+    FUZZ_ASSERT(kiulPacked.LogonIdLow == 0 && kiulPacked.LogonIdHigh == 0);
+    FUZZ_ASSERT(kiulPacked.Logon.LogonDomainName.Buffer == CPacker::cbHeader);
+    FUZZ_ASSERT(kiulPacked.Logon.UserName.Buffer == CPacker::cbHeader + ps.cbDomain);
+    FUZZ_ASSERT(kiulPacked.Logon.Password.Buffer == CPacker::cbHeader + ps.cbDomain + ps.cbUser);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* pb, size_t cb)
+{
+    if (cb < 1 || cb > 0x10000)
+    {
+        return 0;
+    }
+
+    // Copy the structure out so that reads past the end land outside a heap block.
+    std::vector<BYTE> rgb(pb + 1, pb + cb);
+    if (pb[0] & 1)
+    {
+        _CheckOne<ULONGLONG>(rgb.data(), (DWORD)rgb.size());
+    }
+    else
+    {
+        _CheckOne<DWORD>(rgb.data(), (DWORD)rgb.size());
+    }
+    return 0;
+}
+
+// Packs a well-formed structure for each pointer size.
+template <typename TPtr>
+static void _AddSeed(std::vector<std::vector<BYTE>>& rgSeeds, BYTE bSelector)
+{
+    static const WCHAR c_wszDomain[] = { 'W', 'O', 'R', 'K', 'G', 'R', 'O', 'U', 'P', 0 };
+    static const WCHAR c_wszUser[] = { 'a', 'l', 'i', 'c', 'e', 0 };
+    static const WCHAR c_wszPassword[] = { 's', 'e', 'c', 'r', 'e', 't', 0 };
+
+    KERB_PACK_STRINGS ps;
+    ps.dwMessageType = 7;
+    FUZZ_ASSERT(SUCCEEDED(KerbPackSetString(c_wszDomain, &ps.pbDomain, &ps.cbDomain)));
+    FUZZ_ASSERT(SUCCEEDED(KerbPackSetString(c_wszUser, &ps.pbUser, &ps.cbUser)));
+    FUZZ_ASSERT(SUCCEEDED(KerbPackSetString(c_wszPassword, &ps.pbPassword, &ps.cbPassword)));
+
+    DWORD cbPacked = CKerbPacker<TPtr>::GetPackedSize(ps.cbDomain, ps.cbUser, ps.cbPassword);
+    std::vector<BYTE> rgb(1 + cbPacked);
+    rgb[0] = bSelector;
+    FUZZ_ASSERT(SUCCEEDED(CKerbPacker<TPtr>::Pack(ps, rgb.data() + 1, cbPacked)));
+    rgSeeds.push_back(rgb);
+}
+
+void FuzzSeeds(std::vector<std::vector<BYTE>>& rgSeeds)
+{
+    _AddSeed<DWORD>(rgSeeds, 0);
+    _AddSeed<ULONGLONG>(rgSeeds, 1);
+}
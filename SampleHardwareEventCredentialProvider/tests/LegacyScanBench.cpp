@@ -0,0 +1,90 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// How fast legacy fields are scanned out of what a sender sent, for a few field
+// lengths: a character-at-a-time copy like the one the old Socket2 used (bounded
+// here, which it wasn't), LegacyFieldScan with the whole field in one read, and
+// LegacyFieldScan with the field split over reads of a few bytes.
+//
+//   LegacyScanBench [fields]
+
+#include "TestHarness.h"
+#include "CredentialProtocol.h"
+#include <string>
+
+#define SPLIT_READ_SIZE 7
+
+// The old loop: copy until the NUL, now stopping at cchMax.
+static size_t _ByteLoopScan(const char* pch, size_t cch, char* pszField, size_t cchMax)
+{
+    size_t i = 0;
+    while (i < cch && i < cchMax && pch[i] != '\0')
+    {
+        pszField[i] = pch[i];
+        i++;
+    }
+    pszField[i] = '\0';
+    return i;
+}
+
+int main(int argc, char** argv)
+{
+    DWORD cFields = HarnessArg(argc, argv, 1, 1000000);
+    static const size_t c_rgcchField[] = { 8, 24, PROFILE_MAX_FIELD };
+
+    printf("%u fields of each length\n", (unsigned)cFields);
+    for (size_t cchField : c_rgcchField)
+    {
+        std::string strField(cchField, 'p');
+        const char* pch = strField.c_str();
+        size_t cb = cchField + 1;
+        char szField[PROFILE_MAX_FIELD + 1];
+        volatile size_t cchCheck = 0;
+
+        ULONGLONG ullStart = StageClock();
+        for (DWORD n = 0; n < cFields; n++)
+        {
+            cchCheck = cchCheck + _ByteLoopScan(pch, cb, szField, PROFILE_MAX_FIELD);
+        }
+        ULONGLONG ullLoopNs = StageClock() - ullStart;
+
+        ullStart = StageClock();
+        for (DWORD n = 0; n < cFields; n++)
+        {
+            size_t cchGot = 0;
+            size_t cchUsed;
+            CHECK(LegacyFieldScan(pch, cb, szField, PROFILE_MAX_FIELD, &cchGot, &cchUsed) == S_OK);
+            cchCheck = cchCheck + cchGot;
+        }
+        ULONGLONG ullWholeNs = StageClock() - ullStart;
+
+        ullStart = StageClock();
+        for (DWORD n = 0; n < cFields; n++)
+        {
+            size_t cchGot = 0;
+            HRESULT hr = S_FALSE;
+            for (size_t ib = 0; hr == S_FALSE; )
+            {
+                size_t cchRead = std::min((size_t)SPLIT_READ_SIZE, cb - ib);
+                size_t cchUsed;
+                hr = LegacyFieldScan(pch + ib, cchRead, szField, PROFILE_MAX_FIELD, &cchGot, &cchUsed);
+                ib += cchUsed;
+            }
+            CHECK(hr == S_OK);
+            cchCheck = cchCheck + cchGot;
+        }
+        ULONGLONG ullSplitNs = StageClock() - ullStart;
+        CHECK(strcmp(szField, pch) == 0);
+
+        printf("  %2u chars: byte loop %6.1f ns %7.0f MB/s   scan %6.1f ns %7.0f MB/s   scan, %u-byte reads %6.1f ns %7.0f MB/s\n",
+            (unsigned)cchField,
+            (double)ullLoopNs / cFields, HarnessRate((ULONGLONG)cFields * cb, ullLoopNs) / 1e6,
+            (double)ullWholeNs / cFields, HarnessRate((ULONGLONG)cFields * cb, ullWholeNs) / 1e6,
+            (unsigned)SPLIT_READ_SIZE,
+            (double)ullSplitNs / cFields, HarnessRate((ULONGLONG)cFields * cb, ullSplitNs) / 1e6);
+    }
+    return HarnessResult();
+}
@@ -0,0 +1,148 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Measures the credential ingest path through CCredentialListener over loopback TCP:
+// the latency of one framed push answered before the next is sent, and the throughput
+// of pushes pipelined on one connection. Then a connection for each push, as legacy
+// senders make them, both framed and through the original NUL-terminated exchange, so
+// the two latency distributions can be compared.
+//
+//   ListenerBench [pushes]
+
+#include "TestHarness.h"
+
+// Connections made for each of the one-push-a-connection legs, at most: each leaves a
+// socket in TIME_WAIT behind.
+#define LISTENER_BENCH_MAX_CONNECTIONS  10000
+
+// Connect, push one FT_CREDENTIAL, wait for its FT_ACK and hang up.
+static BOOL _PushFramed(const char* pszPort, const std::vector<BYTE>& rgbPush)
+{
+    socket_t s = HarnessConnect(pszPort);
+    if (s == INVALID_SOCKET_T)
+    {
+        return FALSE;
+    }
+    DWORD dwRequestId;
+    HRESULT hrStatus;
+    BOOL fOk = HarnessSend(s, rgbPush.data(), rgbPush.size()) && HarnessRecvAck(s, &dwRequestId, &hrStatus) &&
+        hrStatus == S_OK;
+    SocketClose(s);
+    return fOk;
+}
+
+// Connect, send the username and its NUL, wait for "OK", the same for the password, read
+// the username echoed back, and hang up.
+static BOOL _PushLegacy(const char* pszPort)
+{
+    socket_t s = HarnessConnect(pszPort);
+    if (s == INVALID_SOCKET_T)
+    {
+        return FALSE;
+    }
+    char rgch[8];
+    BOOL fOk = HarnessSend(s, "alice", 6) && HarnessRecv(s, rgch, 2) && memcmp(rgch, "OK", 2) == 0 &&
+        HarnessSend(s, "secret", 7) && HarnessRecv(s, rgch, 2) && memcmp(rgch, "OK", 2) == 0 &&
+        HarnessRecv(s, rgch, 5) && memcmp(rgch, "alice", 5) == 0;
+    shutdown(s, SOCKET_SHUT_SEND);
+    SocketClose(s);
+    return fOk;
+}
+
+// Times cConnections calls of pfnPush and prints their distribution.
+template <class F>
+static void _TimeConnections(const char* pszName, DWORD cConnections, F pfnPush)
+{
+    std::vector<ULONGLONG> rgullNs;
+    rgullNs.reserve(cConnections);
+    for (DWORD i = 0; i < cConnections; i++)
+    {
+        ULONGLONG ullStart = StageClock();
+        if (!pfnPush())
+        {
+            CHECK(!"push failed");
+            break;
+        }
+        rgullNs.push_back(StageClock() - ullStart);
+    }
+    printf("%s: %u connections, p50 %llu ns, p99 %llu ns, p99.9 %llu ns\n", pszName, (unsigned)rgullNs.size(),
+        (unsigned long long)HarnessPercentile(rgullNs, 50), (unsigned long long)HarnessPercentile(rgullNs, 99),
+        (unsigned long long)HarnessPercentile(rgullNs, 99.9));
+}
+
+int main(int argc, char** argv)
+{
+    DWORD cPushes = HarnessArg(argc, argv, 1, 100000);
+
+    CHarnessSink sink;
+    CHarnessListener listener;
+
+    // Every connection is from the loopback address; don't let admission control turn
+    // the one-push-a-connection legs away.
+    listener.Get()->SetRateLimit(1000000, 1000000);
+    CHECK(SUCCEEDED(listener.Start(&sink)));
+    socket_t s = HarnessConnect(listener.GetPort());
+    CHECK(s != INVALID_SOCKET_T);
+
+    // One at a time: each push waits for its FT_ACK.
+    std::vector<BYTE> rgbPush;
+    HarnessAppendCredential(rgbPush, 1, "alice", "secret");
+    std::vector<ULONGLONG> rgullNs;
+    rgullNs.reserve(cPushes);
+    for (DWORD i = 0; i < cPushes; i++)
+    {
+        ULONGLONG ullStart = StageClock();
+        DWORD dwRequestId;
+        HRESULT hrStatus;
+        if (!HarnessSend(s, rgbPush.data(), rgbPush.size()) || !HarnessRecvAck(s, &dwRequestId, &hrStatus))
+        {
+            CHECK(!"push failed");
+            break;
+        }
+        rgullNs.push_back(StageClock() - ullStart);
+    }
+    printf("round trip: %u pushes, p50 %llu ns, p99 %llu ns, p99.9 %llu ns\n", (unsigned)rgullNs.size(),
+        (unsigned long long)HarnessPercentile(rgullNs, 50), (unsigned long long)HarnessPercentile(rgullNs, 99),
+        (unsigned long long)HarnessPercentile(rgullNs, 99.9));
+
+    // Pipelined: everything is written before any reply is read, from another thread so
+    // neither side's socket buffer fills up and stalls the other.
+    std::vector<BYTE> rgbBatch;
+    for (DWORD i = 0; i < cPushes; i++)
+    {
+        HarnessAppendCredential(rgbBatch, i, "alice", "secret");
+    }
+    ULONGLONG ullStart = StageClock();
+    std::thread sender([&]() { CHECK(HarnessSend(s, rgbBatch.data(), rgbBatch.size())); });
+    DWORD cAcked = 0;
+    for (; cAcked < cPushes; cAcked++)
+    {
+        DWORD dwRequestId;
+        HRESULT hrStatus;
+        if (!HarnessRecvAck(s, &dwRequestId, &hrStatus) || dwRequestId != cAcked)
+        {
+            CHECK(!"pipelined push failed");
+            break;
+        }
+    }
+    sender.join();
+    ULONGLONG ullNs = StageClock() - ullStart;
+    printf("pipelined: %u pushes in %.1f ms, %.0f pushes/s\n", (unsigned)cAcked, ullNs / 1e6,
+        HarnessRate(cAcked, ullNs));
+
+    SocketClose(s);
+
+    DWORD cConnections = (cPushes < LISTENER_BENCH_MAX_CONNECTIONS) ? cPushes : LISTENER_BENCH_MAX_CONNECTIONS;
+    _TimeConnections("framed, a connection each", cConnections,
+        [&]() { return _PushFramed(listener.GetPort(), rgbPush); });
+    _TimeConnections("legacy, a connection each", cConnections,
+        [&]() { return _PushLegacy(listener.GetPort()); });
+
+    CHECK(sink.GetReceivedCount() == cPushes * 2 + cConnections * 2);
+    return HarnessResult();
+}
@@ -0,0 +1,401 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Pushes credentials through a CCredentialListener over loopback TCP, framed and
+// legacy, with and without workers, and checks what reaches the sink and what the
+// sender is told, including for frames too large for their type, legacy fields split
+// across reads or too long to take, and legacy usernames that start with the same byte
+// as a frame.
+
+#include "TestHarness.h"
+#include <chrono>
+#include <string>
+
+#define PIPELINED_PUSHES 200
+
+// Pipelines PIPELINED_PUSHES credentials on one connection, a few bytes at a time so
+// that frames straddle reads, and checks each is acknowledged in order.
+static void TestPipelinedPushes(DWORD cWorkers)
+{
+    CHarnessSink sink;
+    CHarnessListener listener;
+    listener.Get()->SetWorkerCount(cWorkers);
+    CHECK(SUCCEEDED(listener.Start(&sink)));
+
+    socket_t s = HarnessConnect(listener.GetPort());
+    CHECK(s != INVALID_SOCKET_T);
+
+    std::vector<BYTE> rgb;
+    for (DWORD i = 1; i <= PIPELINED_PUSHES; i++)
+    {
+        HarnessAppendCredential(rgb, i, "alice", "secret");
+    }
+    CHECK(HarnessSend(s, rgb.data(), rgb.size(), 7));
+
+    for (DWORD i = 1; i <= PIPELINED_PUSHES; i++)
+    {
+        DWORD dwRequestId = 0;
+        HRESULT hrStatus = E_FAIL;
+        CHECK(HarnessRecvAck(s, &dwRequestId, &hrStatus));
+        CHECK(dwRequestId == i);
+        CHECK(hrStatus == S_OK);
+    }
+    CHECK(sink.GetReceivedCount() == PIPELINED_PUSHES);
+
+    char szUser[PROFILE_MAX_FIELD + 1];
+    char szPassword[PROFILE_MAX_FIELD + 1];
+    sink.GetLast(szUser, sizeof(szUser), szPassword, sizeof(szPassword));
+    CHECK(strcmp(szUser, "alice") == 0);
+    CHECK(strcmp(szPassword, "secret") == 0);
+
+    SocketClose(s);
+}
+
+// A request type we don't know is refused, but the connection stays usable.
+static void TestUnknownRequest()
+{
+    CHarnessSink sink;
+    CHarnessListener listener;
+    CHECK(SUCCEEDED(listener.Start(&sink)));
+
+    socket_t s = HarnessConnect(listener.GetPort());
+    std::vector<BYTE> rgb;
+    HarnessAppendFrame(rgb, 0x40, 7, "?", 1);
+    HarnessAppendCredential(rgb, 8, "bob", "pw");
+    CHECK(HarnessSend(s, rgb.data(), rgb.size()));
+
+    DWORD dwRequestId = 0;
+    HRESULT hrStatus = S_OK;
+    CHECK(HarnessRecvAck(s, &dwRequestId, &hrStatus));
+    CHECK(dwRequestId == 7 && hrStatus == E_NOTIMPL);
+    CHECK(HarnessRecvAck(s, &dwRequestId, &hrStatus));
+    CHECK(dwRequestId == 8 && hrStatus == S_OK);
+    CHECK(sink.GetReceivedCount() == 1);
+
+    SocketClose(s);
+}
+
+// Usernames and passwords must fit the sink's buffers and must not contain a NUL, which
+// would cut them short. Either is refused without dropping the sender.
+static void TestCredentialBounds()
+{
+    CHarnessSink sink;
+    CHarnessListener listener;
+    CHECK(SUCCEEDED(listener.Start(&sink)));
+
+    socket_t s = HarnessConnect(listener.GetPort());
+    char szLongest[PROFILE_MAX_FIELD + 1];
+    memset(szLongest, 'x', PROFILE_MAX_FIELD);
+    szLongest[PROFILE_MAX_FIELD] = '\0';
+    char szTooLong[PROFILE_MAX_FIELD + 2];
+    memset(szTooLong, 'x', PROFILE_MAX_FIELD + 1);
+    szTooLong[PROFILE_MAX_FIELD + 1] = '\0';
+
+    std::vector<BYTE> rgb;
+    HarnessAppendCredential(rgb, 1, szLongest, szLongest);
+    HarnessAppendCredential(rgb, 2, szTooLong, "pw");
+    HarnessAppendCredential(rgb, 3, "bob", szTooLong);
+
+    std::vector<BYTE> rgbPayload;
+    HarnessAppendField(rgbPayload, "admin\0bob", 9);
+    HarnessAppendField(rgbPayload, "pw", 2);
+    HarnessAppendFrame(rgb, FT_CREDENTIAL, 4, rgbPayload.data(), (DWORD)rgbPayload.size());
+    rgbPayload.clear();
+    HarnessAppendField(rgbPayload, "bob", 3);
+    HarnessAppendField(rgbPayload, "p\0w", 3);
+    HarnessAppendFrame(rgb, FT_CREDENTIAL, 5, rgbPayload.data(), (DWORD)rgbPayload.size());
+    HarnessAppendFrame(rgb, FT_REVOKE, 6, "admin\0bob", 9);
+    CHECK(HarnessSend(s, rgb.data(), rgb.size()));
+
+    static const HRESULT c_rghrExpected[] =
+    {
+        S_OK,
+        HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+        HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+        HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+        HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+        HRESULT_FROM_WIN32(ERROR_INVALID_DATA),
+    };
+    for (DWORD i = 0; i < ARRAYSIZE(c_rghrExpected); i++)
+    {
+        DWORD dwRequestId = 0;
+        HRESULT hrStatus = S_OK;
+        CHECK(HarnessRecvAck(s, &dwRequestId, &hrStatus));
+        CHECK(dwRequestId == i + 1 && hrStatus == c_rghrExpected[i]);
+    }
+
+    char szUser[PROFILE_MAX_FIELD + 1];
+    char szPassword[PROFILE_MAX_FIELD + 1];
+    sink.GetLast(szUser, sizeof(szUser), szPassword, sizeof(szPassword));
+    CHECK(sink.GetReceivedCount() == 1);
+    CHECK(strcmp(szUser, szLongest) == 0 && strcmp(szPassword, szLongest) == 0);
+
+    SocketClose(s);
+}
+
+// A frame we can't parse gets the sender disconnected.
+static void TestBadFrame()
+{
+    CHarnessSink sink;
+    CHarnessListener listener;
+    CHECK(SUCCEEDED(listener.Start(&sink)));
+
+    socket_t s = HarnessConnect(listener.GetPort());
+    std::vector<BYTE> rgb;
+    HarnessAppendCredential(rgb, 1, "bob", "pw");
+    rgb[1] = FRAME_VERSION + 1;
+    CHECK(HarnessSend(s, rgb.data(), rgb.size()));
+    CHECK(HarnessIsClosed(s, 2000));
+    CHECK(sink.GetReceivedCount() == 0);
+
+    SocketClose(s);
+}
+
+// Only FT_PROVISION frames may carry more than FRAME_DEFAULT_MAX_PAYLOAD bytes. Any
+// other frame claiming more gets the sender dropped as soon as its header arrives,
+// before anything is allocated for it.
+static void TestPayloadCaps()
+{
+    CHarnessSink sink;
+    CHarnessListener listener;
+    CHECK(SUCCEEDED(listener.Start(&sink)));
+
+    // A large batch is read in full; this one isn't a valid batch, so it's refused, but
+    // the sender is kept. So is a credential of the largest size allowed.
+    socket_t s = HarnessConnect(listener.GetPort());
+    std::vector<BYTE> rgbPayload(FRAME_DEFAULT_MAX_PAYLOAD * 4, 0xFF);
+    std::vector<BYTE> rgb;
+    HarnessAppendFrame(rgb, FT_PROVISION, 1, rgbPayload.data(), (DWORD)rgbPayload.size());
+    HarnessAppendFrame(rgb, FT_CREDENTIAL, 2, rgbPayload.data(), FRAME_DEFAULT_MAX_PAYLOAD);
+    CHECK(HarnessSend(s, rgb.data(), rgb.size()));
+    DWORD dwRequestId = 0;
+    HRESULT hrStatus = S_OK;
+    CHECK(HarnessRecvAck(s, &dwRequestId, &hrStatus) && dwRequestId == 1 && FAILED(hrStatus));
+    CHECK(HarnessRecvAck(s, &dwRequestId, &hrStatus) && dwRequestId == 2 && FAILED(hrStatus));
+    SocketClose(s);
+
+    static const BYTE c_rgbTypes[] = { FT_CREDENTIAL, FT_LOOKUP, FT_REVOKE, 0x40 };
+    for (BYTE bType : c_rgbTypes)
+    {
+        s = HarnessConnect(listener.GetPort());
+        rgb.clear();
+        HarnessAppendFrame(rgb, bType, 3, rgbPayload.data(), FRAME_DEFAULT_MAX_PAYLOAD + 1);
+        CHECK(HarnessSend(s, rgb.data(), FRAME_HEADER_SIZE));
+        CHECK(HarnessIsClosed(s, 2000));
+        SocketClose(s);
+    }
+    CHECK(sink.GetReceivedCount() == 0);
+}
+
+// The original protocol: a NUL-terminated username and then password, each answered
+// with "OK", and finally the username echoed back before the listener hangs up.
+static void TestLegacyPush(DWORD cWorkers)
+{
+    CHarnessSink sink;
+    CHarnessListener listener;
+    listener.Get()->SetWorkerCount(cWorkers);
+    CHECK(SUCCEEDED(listener.Start(&sink)));
+
+    socket_t s = HarnessConnect(listener.GetPort());
+    char rgch[8];
+    CHECK(HarnessSend(s, "carol", 6));
+    CHECK(HarnessRecv(s, rgch, 2) && memcmp(rgch, "OK", 2) == 0);
+    CHECK(HarnessSend(s, "hunter2", 8));
+    CHECK(HarnessRecv(s, rgch, 2) && memcmp(rgch, "OK", 2) == 0);
+    CHECK(HarnessRecv(s, rgch, 5) && memcmp(rgch, "carol", 5) == 0);
+    CHECK(HarnessIsClosed(s, 2000));
+
+    char szUser[PROFILE_MAX_FIELD + 1];
+    char szPassword[PROFILE_MAX_FIELD + 1];
+    sink.GetLast(szUser, sizeof(szUser), szPassword, sizeof(szPassword));
+    CHECK(sink.GetReceivedCount() == 1);
+    CHECK(strcmp(szUser, "carol") == 0);
+    CHECK(strcmp(szPassword, "hunter2") == 0);
+
+    SocketClose(s);
+}
+
+// A password split over several reads is only complete at its NUL; if the sender
+// never sends one, it's complete when the sender closes its end. Either way it's handed
+// to the sink on a worker, if the listener has them.
+static void TestLegacySplitPassword(DWORD cWorkers)
+{
+    CHarnessSink sink;
+    CHarnessListener listener;
+    listener.Get()->SetWorkerCount(cWorkers);
+    CHECK(SUCCEEDED(listener.Start(&sink)));
+
+    socket_t s = HarnessConnect(listener.GetPort());
+    char rgch[8];
+    CHECK(HarnessSend(s, "alice", 6));
+    CHECK(HarnessRecv(s, rgch, 2) && memcmp(rgch, "OK", 2) == 0);
+    CHECK(HarnessSend(s, "pass", 4));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(HarnessSend(s, "word", 5));
+    CHECK(HarnessRecv(s, rgch, 2) && memcmp(rgch, "OK", 2) == 0);
+    CHECK(HarnessRecv(s, rgch, 5) && memcmp(rgch, "alice", 5) == 0);
+    CHECK(HarnessIsClosed(s, 2000));
+    SocketClose(s);
+
+    char szUser[PROFILE_MAX_FIELD + 1];
+    char szPassword[PROFILE_MAX_FIELD + 1];
+    sink.GetLast(szUser, sizeof(szUser), szPassword, sizeof(szPassword));
+    CHECK(sink.GetReceivedCount() == 1);
+    CHECK(strcmp(szUser, "alice") == 0);
+    CHECK(strcmp(szPassword, "password") == 0);
+
+    s = HarnessConnect(listener.GetPort());
+    CHECK(HarnessSend(s, "bob", 4));
+    CHECK(HarnessRecv(s, rgch, 2) && memcmp(rgch, "OK", 2) == 0);
+    CHECK(HarnessSend(s, "unter", 5));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(HarnessSend(s, "minated", 7));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(sink.GetReceivedCount() == 1);
+    shutdown(s, SOCKET_SHUT_SEND);
+    CHECK(HarnessRecv(s, rgch, 2) && memcmp(rgch, "OK", 2) == 0);
+    CHECK(HarnessRecv(s, rgch, 3) && memcmp(rgch, "bob", 3) == 0);
+    CHECK(HarnessIsClosed(s, 2000));
+    SocketClose(s);
+
+    sink.GetLast(szUser, sizeof(szUser), szPassword, sizeof(szPassword));
+    CHECK(sink.GetReceivedCount() == 2);
+    CHECK(strcmp(szUser, "bob") == 0);
+    CHECK(strcmp(szPassword, "unterminated") == 0);
+
+    // Even the one completed by the sender closing went through a worker, if we had any.
+    CHECK(sink.GetReceivedOnLoopCount() == ((cWorkers == 0) ? 2 : 0));
+}
+
+// Regression test for the fixed 50-byte buffers the legacy protocol was first read
+// into: a field of the longest length allowed is taken whole, however it's split, and
+// one character more gets the sender dropped without anything reaching the sink,
+// whether the field is terminated or not.
+static void TestLegacyOverflow(DWORD cWorkers)
+{
+    CHarnessSink sink;
+    CHarnessListener listener;
+    listener.Get()->SetWorkerCount(cWorkers);
+    CHECK(SUCCEEDED(listener.Start(&sink)));
+
+    std::string strLongest(PROFILE_MAX_FIELD, 'x');
+    std::string strTooLong(PROFILE_MAX_FIELD + 1, 'y');
+    std::string strFlood(4 * CLIENT_RECV_BUFLEN, 'z');
+    char rgch[PROFILE_MAX_FIELD + 2];
+
+    socket_t s = HarnessConnect(listener.GetPort());
+    CHECK(HarnessSend(s, strLongest.c_str(), strLongest.size() + 1, 7));
+    CHECK(HarnessRecv(s, rgch, 2) && memcmp(rgch, "OK", 2) == 0);
+    CHECK(HarnessSend(s, strLongest.c_str(), strLongest.size() + 1, 7));
+    CHECK(HarnessRecv(s, rgch, 2) && memcmp(rgch, "OK", 2) == 0);
+    CHECK(HarnessRecv(s, rgch, strLongest.size()) && memcmp(rgch, strLongest.data(), strLongest.size()) == 0);
+    CHECK(HarnessIsClosed(s, 2000));
+    SocketClose(s);
+    CHECK(sink.GetReceivedCount() == 1);
+
+    // Too long a username, then too long a password, terminated and not.
+    const std::string* rgpstr[] = { &strTooLong, &strFlood };
+    for (const std::string* pstr : rgpstr)
+    {
+        for (BOOL fPassword = FALSE; fPassword <= TRUE; fPassword++)
+        {
+            s = HarnessConnect(listener.GetPort());
+            if (fPassword)
+            {
+                CHECK(HarnessSend(s, "carol", 6));
+                CHECK(HarnessRecv(s, rgch, 2) && memcmp(rgch, "OK", 2) == 0);
+            }
+            HarnessSend(s, pstr->c_str(), pstr->size() + 1, 13);
+            CHECK(HarnessIsClosed(s, 2000));
+            SocketClose(s);
+        }
+    }
+    CHECK(sink.GetReceivedCount() == 1);
+}
+
+// Connects to pszPort with reads that give up after two seconds, so a listener that
+// takes a sender for the wrong protocol fails the test rather than hanging it.
+static socket_t _ConnectImpatient(const char* pszPort)
+{
+    socket_t s = HarnessConnect(pszPort);
+    struct timeval tv = { 2, 0 };
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return s;
+}
+
+// "π" is 0xCF 0x80 in UTF-8, and 0xCF is FRAME_MAGIC: a legacy username starting with
+// it must still be taken as legacy, whether the 0xCF arrives with the byte after it or
+// alone; and a framed sender whose first read is just FRAME_MAGIC is still framed.
+static void TestLegacyLeadByte(DWORD cWorkers)
+{
+    CHarnessSink sink;
+    CHarnessListener listener;
+    listener.Get()->SetWorkerCount(cWorkers);
+    CHECK(SUCCEEDED(listener.Start(&sink)));
+
+    static const char c_szUser[] = "\xCF\x80" "ete";
+    char rgch[8];
+    char szUser[PROFILE_MAX_FIELD + 1];
+    char szPassword[PROFILE_MAX_FIELD + 1];
+    for (BOOL fSplit = FALSE; fSplit <= TRUE; fSplit++)
+    {
+        socket_t s = _ConnectImpatient(listener.GetPort());
+        if (fSplit)
+        {
+            CHECK(HarnessSend(s, c_szUser, 1));
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            CHECK(HarnessSend(s, c_szUser + 1, sizeof(c_szUser) - 1));
+        }
+        else
+        {
+            CHECK(HarnessSend(s, c_szUser, sizeof(c_szUser)));
+        }
+        CHECK(HarnessRecv(s, rgch, 2) && memcmp(rgch, "OK", 2) == 0);
+        CHECK(HarnessSend(s, "hunter2", 8));
+        CHECK(HarnessRecv(s, rgch, 2) && memcmp(rgch, "OK", 2) == 0);
+        CHECK(HarnessRecv(s, rgch, 5) && memcmp(rgch, c_szUser, 5) == 0);
+        CHECK(HarnessIsClosed(s, 2000));
+        SocketClose(s);
+
+        sink.GetLast(szUser, sizeof(szUser), szPassword, sizeof(szPassword));
+        CHECK(sink.GetReceivedCount() == 1 + (DWORD)fSplit);
+        CHECK(strcmp(szUser, c_szUser) == 0);
+        CHECK(strcmp(szPassword, "hunter2") == 0);
+    }
+
+    std::vector<BYTE> rgb;
+    HarnessAppendCredential(rgb, 9, "alice", "secret");
+    socket_t s = _ConnectImpatient(listener.GetPort());
+    CHECK(HarnessSend(s, rgb.data(), 1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(HarnessSend(s, rgb.data() + 1, rgb.size() - 1));
+    DWORD dwRequestId = 0;
+    HRESULT hrStatus = E_FAIL;
+    CHECK(HarnessRecvAck(s, &dwRequestId, &hrStatus) && dwRequestId == 9 && hrStatus == S_OK);
+    SocketClose(s);
+    CHECK(sink.GetReceivedCount() == 3);
+}
+
+int main()
+{
+    TestPipelinedPushes(0);
+    TestPipelinedPushes(2);
+    TestUnknownRequest();
+    TestCredentialBounds();
+    TestBadFrame();
+    TestPayloadCaps();
+    TestLegacyPush(0);
+    TestLegacyPush(2);
+    TestLegacySplitPassword(0);
+    TestLegacySplitPassword(2);
+    TestLegacyOverflow(0);
+    TestLegacyOverflow(2);
+    TestLegacyLeadByte(0);
+    TestLegacyLeadByte(2);
+    return HarnessResult();
+}
@@ -0,0 +1,65 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// How long a local agent waits for each push to be acknowledged over the shared
+// memory transport, against a sender on a loopback TCP connection that it keeps open:
+// one credential at a time, each answered before the next is sent, so the doorbells
+// are rung every time. Reports the median and tail of the round trips.
+//
+//   LocalBench [pushes]
+
+#include "HarnessLocal.h"
+
+static void _Report(const char* pszName, std::vector<ULONGLONG>& rgullNs)
+{
+    printf("  %-22s p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", pszName, HarnessPercentile(rgullNs, 50) / 1e3,
+        HarnessPercentile(rgullNs, 99) / 1e3, HarnessPercentile(rgullNs, 100) / 1e3);
+}
+
+int main(int argc, char** argv)
+{
+    DWORD cPushes = HarnessArg(argc, argv, 1, 10000);
+
+    char szName[64];
+    HarnessLocalName(szName, sizeof(szName));
+    CHarnessSink sink;
+    CHarnessListener listener;
+    CHECK(SUCCEEDED(listener.Start(&sink, szName)));
+
+    std::vector<BYTE> rgbPush;
+    HarnessAppendCredential(rgbPush, 1, "alice", "secret");
+    std::vector<ULONGLONG> rgullNs;
+    DWORD dwRequestId;
+    HRESULT hrStatus;
+
+    CHarnessAgent agent;
+    CHECK(SUCCEEDED(agent.Connect(szName)));
+    for (DWORD i = 0; i < cPushes; i++)
+    {
+        ULONGLONG ullStart = StageClock();
+        CHECK(agent.Send(rgbPush.data(), (DWORD)rgbPush.size()));
+        CHECK(agent.RecvAck(&dwRequestId, &hrStatus) && hrStatus == S_OK);
+        rgullNs.push_back(StageClock() - ullStart);
+    }
+    printf("%u pushes, one at a time\n", (unsigned)cPushes);
+    _Report("shared memory", rgullNs);
+
+    rgullNs.clear();
+    socket_t s = HarnessConnect(listener.GetPort());
+    CHECK(s != INVALID_SOCKET_T);
+    for (DWORD i = 0; i < cPushes; i++)
+    {
+        ULONGLONG ullStart = StageClock();
+        CHECK(HarnessSend(s, rgbPush.data(), rgbPush.size()));
+        CHECK(HarnessRecvAck(s, &dwRequestId, &hrStatus) && hrStatus == S_OK);
+        rgullNs.push_back(StageClock() - ullStart);
+    }
+    _Report("loopback TCP", rgullNs);
+    SocketClose(s);
+
+    CHECK(sink.GetReceivedCount() == 2 * cPushes);
+    return HarnessResult();
+}
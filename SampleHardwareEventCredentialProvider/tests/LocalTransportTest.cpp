@@ -0,0 +1,101 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Pushes credentials through a CCredentialListener from a local agent over the shared
+// memory transport and checks the agent's sessions: frames are acknowledged in order;
+// a bad frame ends the session, so nothing after it is acted on, until the agent
+// connects again; and a new session sees nothing of the last one, neither a frame left
+// half written nor replies meant for it.
+
+#include "HarnessLocal.h"
+
+static void _PushAndCheck(CHarnessAgent* pAgent, DWORD dwFirstId, DWORD cPushes)
+{
+    std::vector<BYTE> rgb;
+    for (DWORD i = 0; i < cPushes; i++)
+    {
+        HarnessAppendCredential(rgb, dwFirstId + i, "alice", "secret");
+    }
+    CHECK(pAgent->Send(rgb.data(), (DWORD)rgb.size()));
+    for (DWORD i = 0; i < cPushes; i++)
+    {
+        DWORD dwRequestId = 0;
+        HRESULT hrStatus = E_FAIL;
+        CHECK(pAgent->RecvAck(&dwRequestId, &hrStatus));
+        CHECK(dwRequestId == dwFirstId + i && hrStatus == S_OK);
+    }
+}
+
+static void TestSessions()
+{
+    char szName[64];
+    HarnessLocalName(szName, sizeof(szName));
+    CHarnessSink sink;
+    CHarnessListener listener;
+    CHECK(SUCCEEDED(listener.Start(&sink, szName)));
+
+    // More than fits in the ring at once, so both sides have to wait for room.
+    CHarnessAgent agent;
+    CHECK(SUCCEEDED(agent.Connect(szName)));
+    _PushAndCheck(&agent, 1, 5000);
+    CHECK(sink.GetReceivedCount() == 5000);
+
+    // A bad frame drops the agent, and a good one sent after it isn't acted on.
+    std::vector<BYTE> rgb;
+    HarnessAppendCredential(rgb, 10, "bob", "pw");
+    size_t ibBad = rgb.size();
+    HarnessAppendCredential(rgb, 11, "bob", "pw");
+    rgb[ibBad] = 0x42;
+    CHECK(agent.Send(rgb.data(), (DWORD)rgb.size()));
+    DWORD dwRequestId = 0;
+    HRESULT hrStatus = E_FAIL;
+    CHECK(agent.RecvAck(&dwRequestId, &hrStatus) && dwRequestId == 10);
+    CHECK(!agent.RecvAck(&dwRequestId, &hrStatus));
+    CHECK(agent.GetLastResult() == HRESULT_FROM_WIN32(ERROR_CONNECTION_ABORTED));
+    rgb.clear();
+    HarnessAppendCredential(rgb, 12, "carol", "pw");
+    CHECK(!agent.Send(rgb.data(), (DWORD)rgb.size()));
+    CHECK(agent.GetLastResult() == HRESULT_FROM_WIN32(ERROR_CONNECTION_ABORTED));
+    CHECK(sink.GetReceivedCount() == 5001);
+
+    // Connecting again starts afresh.
+    CHECK(SUCCEEDED(agent.Connect(szName)));
+    _PushAndCheck(&agent, 20, 3);
+    CHECK(sink.GetReceivedCount() == 5004);
+
+    // An agent that goes away part way through a frame doesn't garble the next one's.
+    rgb.clear();
+    HarnessAppendCredential(rgb, 30, "dave", "pw");
+    CHECK(agent.Send(rgb.data(), (DWORD)rgb.size() - 3));
+    agent.Close();
+    CHECK(SUCCEEDED(agent.Connect(szName)));
+    _PushAndCheck(&agent, 40, 3);
+    CHECK(sink.GetReceivedCount() == 5007);
+
+    // Nor does one that goes away without reading its replies: whichever of its frames
+    // were acted on, the next agent's first reply is its own.
+    rgb.clear();
+    for (DWORD i = 0; i < 200; i++)
+    {
+        HarnessAppendCredential(rgb, 100 + i, "erin", "pw");
+    }
+    CHECK(agent.Send(rgb.data(), (DWORD)rgb.size()));
+    agent.Close();
+    CHECK(SUCCEEDED(agent.Connect(szName)));
+    _PushAndCheck(&agent, 1000, 1);
+    CHECK(sink.GetReceivedCount() >= 5008 && sink.GetReceivedCount() <= 5208);
+
+    char szUser[PROFILE_MAX_FIELD + 1];
+    char szPassword[PROFILE_MAX_FIELD + 1];
+    sink.GetLast(szUser, sizeof(szUser), szPassword, sizeof(szPassword));
+    CHECK(strcmp(szUser, "alice") == 0);
+}
+
+int main()
+{
+    TestSessions();
+    return HarnessResult();
+}
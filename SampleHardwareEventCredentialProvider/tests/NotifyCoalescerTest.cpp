@@ -0,0 +1,151 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Drives CNotifyCoalescer with made-up timestamps: a burst of changes inside the window
+// is reported once, with the final state, when the window closes and not before; a
+// burst that ends where it started is still reported once; a change after the window
+// starts a new one; and the counters agree with what was signalled and reported.
+
+#include "TestHarness.h"
+#include "NotifyCoalescer.h"
+
+#define TEST_WINDOW_MS  50
+
+// Flushes at ullNow, returning how many changes were reported (0 or 1) and the state.
+static DWORD _Flush(CNotifyCoalescer* pCoalescer, ULONGLONG ullNow, BOOL* pfConnected)
+{
+    *pfConnected = -1;
+    return pCoalescer->Flush(ullNow, pfConnected) ? 1 : 0;
+}
+
+static void TestBurst()
+{
+    CNotifyCoalescer coalescer;
+    coalescer.SetWindow(TEST_WINDOW_MS);
+    BOOL fConnected;
+    CHECK(coalescer.GetTimeout(1000) == COALESCE_NO_TIMEOUT);
+    CHECK(_Flush(&coalescer, 1000, &fConnected) == 0);
+
+    // Five changes over 40 ms; the window runs from the first, and later ones don't
+    // push it back.
+    coalescer.Signal(TRUE, 1000);
+    coalescer.Signal(FALSE, 1010);
+    coalescer.Signal(TRUE, 1020);
+    CHECK(coalescer.GetTimeout(1020) == TEST_WINDOW_MS - 20);
+    coalescer.Signal(FALSE, 1030);
+    coalescer.Signal(TRUE, 1040);
+    CHECK(coalescer.GetState() == TRUE);
+    CHECK(coalescer.GetTimeout(1040) == TEST_WINDOW_MS - 40);
+    CHECK(_Flush(&coalescer, 1049, &fConnected) == 0);
+
+    CHECK(coalescer.GetTimeout(1050) == 0);
+    CHECK(coalescer.GetTimeout(5000) == 0);
+    CHECK(_Flush(&coalescer, 1050, &fConnected) == 1 && fConnected == TRUE);
+    CHECK(_Flush(&coalescer, 1051, &fConnected) == 0);
+    CHECK(coalescer.GetTimeout(1051) == COALESCE_NO_TIMEOUT);
+
+    COALESCER_COUNTERS counters;
+    coalescer.GetCounters(&counters);
+    CHECK(counters.cReceived == 5 && counters.cEmitted == 1);
+}
+
+// Off and on again inside the window nets to no change, but is reported once, with
+// the state it ended on; so is a change to the state that was already reported.
+static void TestNoNetChange()
+{
+    CNotifyCoalescer coalescer;
+    coalescer.SetWindow(TEST_WINDOW_MS);
+    BOOL fConnected;
+    coalescer.Signal(TRUE, 0);
+    CHECK(_Flush(&coalescer, TEST_WINDOW_MS, &fConnected) == 1 && fConnected == TRUE);
+
+    coalescer.Signal(FALSE, 100);
+    coalescer.Signal(TRUE, 120);
+    CHECK(_Flush(&coalescer, 100 + TEST_WINDOW_MS, &fConnected) == 1 && fConnected == TRUE);
+
+    coalescer.Signal(TRUE, 200);
+    CHECK(_Flush(&coalescer, 200 + TEST_WINDOW_MS, &fConnected) == 1 && fConnected == TRUE);
+
+    COALESCER_COUNTERS counters;
+    coalescer.GetCounters(&counters);
+    CHECK(counters.cReceived == 4 && counters.cEmitted == 3);
+}
+
+// A change after a window has been flushed opens a new window of its own, even if the
+// flush came late; one that arrives before the late flush still belongs to the old one.
+static void TestNewBatch()
+{
+    CNotifyCoalescer coalescer;
+    coalescer.SetWindow(TEST_WINDOW_MS);
+    BOOL fConnected;
+    coalescer.Signal(TRUE, 0);
+    coalescer.Signal(FALSE, TEST_WINDOW_MS + 10);
+    CHECK(_Flush(&coalescer, TEST_WINDOW_MS + 20, &fConnected) == 1 && fConnected == FALSE);
+
+    coalescer.Signal(TRUE, 500);
+    CHECK(coalescer.GetTimeout(500) == TEST_WINDOW_MS);
+    CHECK(_Flush(&coalescer, 500 + TEST_WINDOW_MS - 1, &fConnected) == 0);
+    CHECK(_Flush(&coalescer, 500 + TEST_WINDOW_MS, &fConnected) == 1 && fConnected == TRUE);
+
+    // With no window, only changes signalled at the same moment are merged.
+    coalescer.SetWindow(0);
+    coalescer.Signal(FALSE, 1000);
+    coalescer.Signal(TRUE, 1000);
+    CHECK(coalescer.GetTimeout(1000) == 0);
+    CHECK(_Flush(&coalescer, 1000, &fConnected) == 1 && fConnected == TRUE);
+    coalescer.Signal(FALSE, 1001);
+    CHECK(_Flush(&coalescer, 1001, &fConnected) == 1 && fConnected == FALSE);
+
+    COALESCER_COUNTERS counters;
+    coalescer.GetCounters(&counters);
+    CHECK(counters.cReceived == 6 && counters.cEmitted == 4);
+}
+
+// A long run of changes at random moments, flushed whenever the owner's wait would end:
+// every change is counted, and each window reports exactly once, with its last state.
+static void TestCounters()
+{
+    CNotifyCoalescer coalescer;
+    coalescer.SetWindow(TEST_WINDOW_MS);
+    ULONGLONG ullNow = 0;
+    DWORD cSignalled = 0;
+    DWORD cReported = 0;
+    BOOL fLast = FALSE;
+    DWORD dwSeed = 7;
+    for (DWORD i = 0; i < 10000; i++)
+    {
+        dwSeed = dwSeed * 1103515245 + 12345;
+        ULONGLONG ullNext = ullNow + (dwSeed >> 16) % 40;
+        DWORD dwTimeout = coalescer.GetTimeout(ullNow);
+        if (dwTimeout != COALESCE_NO_TIMEOUT && ullNow + dwTimeout <= ullNext)
+        {
+            BOOL fConnected;
+            CHECK(_Flush(&coalescer, ullNow + dwTimeout, &fConnected) == 1 && fConnected == fLast);
+            cReported++;
+        }
+        ullNow = ullNext;
+        fLast = (dwSeed >> 8) & 1;
+        coalescer.Signal(fLast, ullNow);
+        cSignalled++;
+    }
+    BOOL fConnected;
+    CHECK(_Flush(&coalescer, ullNow + TEST_WINDOW_MS, &fConnected) == 1 && fConnected == fLast);
+    cReported++;
+
+    COALESCER_COUNTERS counters;
+    coalescer.GetCounters(&counters);
+    CHECK(counters.cReceived == cSignalled && counters.cEmitted == cReported);
+    CHECK(cReported < cSignalled);
+}
+
+int main()
+{
+    TestBurst();
+    TestNoNetChange();
+    TestNewBatch();
+    TestCounters();
+    return HarnessResult();
+}
@@ -0,0 +1,86 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Builds throwaway account databases for the store, index and directory tests and
+// benchmarks. Profile i has the id "badge<i>", the username "user<i>" and the
+// password "pw<i>".
+
+#pragma once
+
+#include "TestHarness.h"
+#include "sqlite3.h"
+
+// Formats profile i's id, username or password into psz.
+inline int ProfileDbId(DWORD i, char* psz, size_t cch) { return snprintf(psz, cch, "badge%u", (unsigned)i); }
+inline int ProfileDbUser(DWORD i, char* psz, size_t cch) { return snprintf(psz, cch, "user%u", (unsigned)i); }
+inline int ProfileDbPassword(DWORD i, char* psz, size_t cch) { return snprintf(psz, cch, "pw%u", (unsigned)i); }
+
+// A path in the temporary directory for a file named after pszName and this process.
+inline void ProfileDbPath(const char* pszName, char* pszPath, size_t cchPath)
+{
+    const char* pszDir = getenv("TMPDIR");
+    snprintf(pszPath, cchPath, "%s/%s-%u", pszDir ? pszDir : "/tmp", pszName, (unsigned)getpid());
+}
+
+// Deletes a database and the files sqlite keeps beside it in WAL mode.
+inline void ProfileDbDelete(const char* pszPath)
+{
+    char szPath[MAX_PATH + 8];
+    remove(pszPath);
+    snprintf(szPath, sizeof(szPath), "%s-wal", pszPath);
+    remove(szPath);
+    snprintf(szPath, sizeof(szPath), "%s-shm", pszPath);
+    remove(szPath);
+}
+
+// Creates a fresh database at pszPath holding profiles 0 to cProfiles - 1.
+inline HRESULT ProfileDbCreate(const char* pszPath, DWORD cProfiles)
+{
+    ProfileDbDelete(pszPath);
+
+    sqlite3* pDb = NULL;
+    int rc = sqlite3_open(pszPath, &pDb);
+    if (rc == SQLITE_OK)
+    {
+        rc = sqlite3_exec(pDb, "CREATE TABLE profile (id TEXT PRIMARY KEY, username TEXT, password TEXT);"
+            "BEGIN;", NULL, NULL, NULL);
+    }
+
+    sqlite3_stmt* pStmt = NULL;
+    if (rc == SQLITE_OK)
+    {
+        rc = sqlite3_prepare_v2(pDb, "INSERT INTO profile VALUES (?1, ?2, ?3);", -1, &pStmt, NULL);
+    }
+    for (DWORD i = 0; rc == SQLITE_OK && i < cProfiles; i++)
+    {
+        char szId[32], szUser[32], szPassword[32];
+        sqlite3_bind_text(pStmt, 1, szId, ProfileDbId(i, szId, sizeof(szId)), SQLITE_STATIC);
+        sqlite3_bind_text(pStmt, 2, szUser, ProfileDbUser(i, szUser, sizeof(szUser)), SQLITE_STATIC);
+        sqlite3_bind_text(pStmt, 3, szPassword, ProfileDbPassword(i, szPassword, sizeof(szPassword)), SQLITE_STATIC);
+        rc = sqlite3_step(pStmt);
+        rc = (rc == SQLITE_DONE) ? SQLITE_OK : rc;
+        sqlite3_reset(pStmt);
+    }
+    sqlite3_finalize(pStmt);
+
+    if (rc == SQLITE_OK)
+    {
+        rc = sqlite3_exec(pDb, "COMMIT;", NULL, NULL, NULL);
+    }
+    sqlite3_close(pDb);
+    return (rc == SQLITE_OK) ? S_OK : E_FAIL;
+}
+
+// Whether pRecord is profile i.
+inline BOOL ProfileDbMatches(DWORD i, const PROFILE_RECORD* pRecord)
+{
+    char szUser[32], szPassword[32];
+    ProfileDbUser(i, szUser, sizeof(szUser));
+    ProfileDbPassword(i, szPassword, sizeof(szPassword));
+    return strcmp(pRecord->szUser, szUser) == 0 && strcmp(pRecord->szPassword, szPassword) == 0;
+}
@@ -0,0 +1,138 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Checks CProfileIndex on its own, including that replacing profiles over and over
+// doesn't grow its pool without bound, and that CCredentialStore keeps it coherent with
+// the database: after its own provisioning straight away, and after another
+// connection's writes once it next checks data_version.
+
+#include "ProfileDb.h"
+#include "CredentialStore.h"
+#include <map>
+#include <random>
+#include <string>
+
+static void TestIndex()
+{
+    CProfileIndex index;
+    PROFILE_RECORD record;
+    CHECK(index.Lookup("a", 1, &record) == HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+
+    // Enough to make the table grow a few times.
+    for (DWORD i = 0; i < 1000; i++)
+    {
+        char szId[32], szUser[32], szPassword[32];
+        int cchId = ProfileDbId(i, szId, sizeof(szId));
+        ProfileDbUser(i, szUser, sizeof(szUser));
+        ProfileDbPassword(i, szPassword, sizeof(szPassword));
+        CHECK(SUCCEEDED(index.Add(szId, cchId, szUser, szPassword)));
+    }
+    CHECK(index.GetCount() == 1000);
+    for (DWORD i = 0; i < 1000; i++)
+    {
+        char szId[32];
+        int cchId = ProfileDbId(i, szId, sizeof(szId));
+        CHECK(SUCCEEDED(index.Lookup(szId, cchId, &record)) && ProfileDbMatches(i, &record));
+    }
+
+    // Ids are compared by length as well as content, and may hold any bytes.
+    CHECK(index.Lookup("badge1\0", 7, &record) == HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+    CHECK(index.Lookup("badge", 5, &record) == HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+    CHECK(SUCCEEDED(index.Add("\0\xFF", 2, "binary", "")));
+    CHECK(SUCCEEDED(index.Lookup("\0\xFF", 2, &record)) && strcmp(record.szUser, "binary") == 0);
+
+    // Adding an id again replaces it.
+    CHECK(SUCCEEDED(index.Add("badge7", 6, "someone", "else")));
+    CHECK(index.GetCount() == 1001);
+    CHECK(SUCCEEDED(index.Lookup("badge7", 6, &record)) && strcmp(record.szPassword, "else") == 0);
+
+    // Overlong fields are refused.
+    char szLong[PROFILE_MAX_FIELD + 2];
+    memset(szLong, 'x', sizeof(szLong) - 1);
+    szLong[sizeof(szLong) - 1] = '\0';
+    CHECK(FAILED(index.Add("x", 1, szLong, "")));
+    CHECK(FAILED(index.Add("x", 1, "", szLong)));
+
+    index.Clear();
+    CHECK(index.GetCount() == 0);
+    CHECK(index.Lookup("badge7", 6, &record) == HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+}
+
+// Reprovisions the same profiles with passwords of every length, checking them all
+// against a map as it goes, and that the pool stays within a small multiple of what
+// the live records need.
+static void TestReplace()
+{
+    CProfileIndex index;
+    std::map<std::string, std::pair<std::string, std::string>> model;
+    std::mt19937 random(5);
+    DWORD cbPeak = 0;
+
+    for (DWORD n = 0; n < 100000; n++)
+    {
+        char szId[16];
+        int cchId = snprintf(szId, sizeof(szId), "badge%u", (unsigned)(random() % 200));
+        std::string strUser(1 + random() % PROFILE_MAX_FIELD, 'u');
+        std::string strPassword(random() % (PROFILE_MAX_FIELD + 1), (char)('a' + n % 26));
+        CHECK(SUCCEEDED(index.Add(szId, cchId, strUser.c_str(), strPassword.c_str())));
+        model[szId] = std::make_pair(strUser, strPassword);
+        cbPeak = std::max(cbPeak, index.GetPoolSize());
+    }
+
+    DWORD cbLive = 0;
+    PROFILE_RECORD record;
+    for (const auto& entry : model)
+    {
+        cbLive += (DWORD)(entry.first.size() + entry.second.first.size() + entry.second.second.size());
+        CHECK(SUCCEEDED(index.Lookup(entry.first.data(), entry.first.size(), &record)) &&
+            entry.second.first == record.szUser && entry.second.second == record.szPassword);
+    }
+    CHECK(index.GetCount() == model.size());
+    CHECK(cbPeak <= cbLive * 2 + 8192);
+}
+
+static void TestStoreCoherence()
+{
+    char szPath[MAX_PATH];
+    ProfileDbPath("ProfileIndexTest.db", szPath, sizeof(szPath));
+    CHECK(SUCCEEDED(ProfileDbCreate(szPath, 100)));
+
+    CCredentialStore store;
+    CHECK(SUCCEEDED(store.Open(szPath)));
+    PROFILE_RECORD record;
+    CHECK(SUCCEEDED(store.Lookup("badge42", 7, &record)) && ProfileDbMatches(42, &record));
+    CHECK(store.Lookup("badge100", 8, &record) == HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+
+    // Our own writes show up straight away.
+    PROFILE_UPDATE update = { "badge100", 8, "user100", 7, "pw100", 5 };
+    CHECK(SUCCEEDED(store.Provision(&update, 1)));
+    CHECK(SUCCEEDED(store.Lookup("badge100", 8, &record)) && ProfileDbMatches(100, &record));
+
+    // Someone else's show up once the store next looks at data_version.
+    sqlite3* pDb = NULL;
+    CHECK(sqlite3_open(szPath, &pDb) == SQLITE_OK);
+    CHECK(sqlite3_exec(pDb, "UPDATE profile SET password = 'changed' WHERE id = 'badge42';"
+        "DELETE FROM profile WHERE id = 'badge43';", NULL, NULL, NULL) == SQLITE_OK);
+    sqlite3_close(pDb);
+
+    CHECK(HarnessWaitFor([&]() {
+        return SUCCEEDED(store.Lookup("badge42", 7, &record)) && strcmp(record.szPassword, "changed") == 0;
+    }, PROFILE_INDEX_RECHECK_MS * 3));
+    CHECK(store.Lookup("badge43", 7, &record) == HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+
+    store.Close();
+    ProfileDbDelete(szPath);
+}
+
+int main()
+{
+    TestIndex();
+    TestReplace();
+    TestStoreCoherence();
+    return HarnessResult();
+}
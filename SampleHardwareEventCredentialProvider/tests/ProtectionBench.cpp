@@ -0,0 +1,69 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// How long GetSerialization spends getting a protected password, with a stand-in for
+// CredProtect that costs a set time: protecting it there and then, as it used to;
+// taking the worker's result when LogonUI asks a little after the push, as it
+// normally does; and taking it when LogonUI asks straight after the push, so it has
+// to wait for the worker.
+//
+//   ProtectionBench [pushes] [protection cost in us]
+
+#include "HarnessProtector.h"
+#include <chrono>
+
+static void _Report(const char* pszName, std::vector<ULONGLONG>& rgullNs)
+{
+    ULONGLONG ullP50 = HarnessPercentile(rgullNs, 50);
+    ULONGLONG ullP99 = HarnessPercentile(rgullNs, 99);
+    ULONGLONG ullMax = HarnessPercentile(rgullNs, 100);
+    printf("  %-18s p50 %8.1f us   p99 %8.1f us   max %8.1f us\n", pszName, ullP50 / 1e3, ullP99 / 1e3, ullMax / 1e3);
+}
+
+int main(int argc, char** argv)
+{
+    DWORD cPushes = HarnessArg(argc, argv, 1, 1000);
+    DWORD dwCostUs = HarnessArg(argc, argv, 2, 200);
+
+    CHarnessProtector protector(dwCostUs);
+    CProtectionWorker worker;
+    CHECK(worker.Start(&protector) == S_OK);
+    CHarnessProtectedTile* pTile = new CHarnessProtectedTile();
+
+    static const WCHAR c_wszPassword[] = { 'c', 'o', 'r', 'r', 'e', 'c', 't', ' ', 'h', 'o', 'r', 's', 'e', 0 };
+    WCHAR wsz[PROTECTED_PASSWORD_MAX];
+    DWORD cch = 0;
+    DWORD dwSequence = 0;
+    std::vector<ULONGLONG> rgullSync, rgullAhead, rgullRace;
+
+    for (DWORD i = 0; i < cPushes; i++)
+    {
+        ULONGLONG ullStart = StageClock();
+        CHECK(protector.Protect(c_wszPassword, wsz, ARRAYSIZE(wsz), &cch) == S_OK);
+        rgullSync.push_back(StageClock() - ullStart);
+
+        CHECK(pTile->Push(&worker, "correct horse", &dwSequence) == S_OK);
+        std::this_thread::sleep_for(std::chrono::microseconds(dwCostUs * 2 + 100));
+        ullStart = StageClock();
+        CHECK(pTile->_protected.Take(dwSequence, DEFAULT_PROTECTION_WAIT_MS, wsz, ARRAYSIZE(wsz), &cch) == S_OK);
+        rgullAhead.push_back(StageClock() - ullStart);
+
+        CHECK(pTile->Push(&worker, "correct horse", &dwSequence) == S_OK);
+        ullStart = StageClock();
+        CHECK(pTile->_protected.Take(dwSequence, DEFAULT_PROTECTION_WAIT_MS, wsz, ARRAYSIZE(wsz), &cch) == S_OK);
+        rgullRace.push_back(StageClock() - ullStart);
+    }
+
+    printf("%u pushes, protection costs %u us\n", (unsigned)cPushes, (unsigned)dwCostUs);
+    _Report("protect inline", rgullSync);
+    _Report("take, ready", rgullAhead);
+    _Report("take, racing", rgullRace);
+
+    worker.Stop();
+    pTile->ReleaseTile();
+    CHECK(CHarnessTile::s_cLive == 0);
+    return HarnessResult();
+}
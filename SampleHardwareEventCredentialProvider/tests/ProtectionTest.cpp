@@ -0,0 +1,143 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Checks the protection worker against what GetSerialization relies on: it takes the
+// result for the push it's serializing, waiting for it if need be; never one for an
+// earlier push; and doesn't wait at all for a job that was dropped. Then checks that
+// the scratch arena gives back the room GetSerialization reserved for a result it
+// didn't get, so the fallback protection isn't pushed out to the heap.
+
+#include "HarnessProtector.h"
+#include "ScratchArena.h"
+#include <chrono>
+
+// Whether pwzProtected is what the stand-in makes of pszPassword.
+static BOOL _IsProtected(const WCHAR* pwzProtected, const char* pszPassword)
+{
+    WCHAR wszPassword[64];
+    WCHAR wszExpected[PROTECTED_PASSWORD_MAX];
+    DWORD cch = 0;
+    for (; pszPassword[cch] != 0; cch++)
+    {
+        wszPassword[cch] = (WCHAR)pszPassword[cch];
+    }
+    wszPassword[cch] = 0;
+    CHECK(SUCCEEDED(CHarnessProtector::HarnessProtect(wszPassword, wszExpected, ARRAYSIZE(wszExpected), &cch)));
+    return memcmp(pwzProtected, wszExpected, (cch + 1) * sizeof(WCHAR)) == 0;
+}
+
+// A result that's still being worked on is waited for; a later push's result is never
+// handed out for an earlier one.
+static void TestTakeWaits()
+{
+    CHarnessProtector protector(0);
+    CProtectionWorker worker;
+    CHECK(worker.Start(&protector) == S_OK);
+    CHarnessProtectedTile* pTile = new CHarnessProtectedTile();
+
+    WCHAR wsz[PROTECTED_PASSWORD_MAX];
+    DWORD cch = 0;
+    DWORD dwFirst, dwSecond;
+    protector.Hold(TRUE);
+    CHECK(pTile->Push(&worker, "first", &dwFirst) == S_OK);
+    std::thread release([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        protector.Hold(FALSE);
+    });
+    CHECK(pTile->_protected.Take(dwFirst, DEFAULT_PROTECTION_WAIT_MS, wsz, ARRAYSIZE(wsz), &cch) == S_OK);
+    CHECK(_IsProtected(wsz, "first"));
+    release.join();
+
+    CHECK(pTile->Push(&worker, "second", &dwSecond) == S_OK);
+    CHECK(pTile->_protected.Take(dwFirst, DEFAULT_PROTECTION_WAIT_MS, wsz, ARRAYSIZE(wsz), &cch) == S_FALSE);
+    CHECK(pTile->_protected.Take(dwSecond, DEFAULT_PROTECTION_WAIT_MS, wsz, ARRAYSIZE(wsz), &cch) == S_OK);
+    CHECK(_IsProtected(wsz, "second"));
+
+    // Too small a buffer is an error, not a wait.
+    CHECK(pTile->_protected.Take(dwSecond, DEFAULT_PROTECTION_WAIT_MS, wsz, 3, &cch) ==
+        HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
+
+    worker.Stop();
+    pTile->ReleaseTile();
+    CHECK(CHarnessTile::s_cLive == 0);
+}
+
+// Stopping the worker with a job still queued releases anyone waiting for it straight
+// away, instead of leaving them for the whole wait.
+static void TestDroppedJobIsNotWaitedFor()
+{
+    CHarnessProtector protector(0);
+    CProtectionWorker worker;
+    CHECK(worker.Start(&protector) == S_OK);
+    CHarnessProtectedTile* pBusy = new CHarnessProtectedTile();
+    CHarnessProtectedTile* pQueued = new CHarnessProtectedTile();
+
+    DWORD dwBusy, dwQueued;
+    protector.Hold(TRUE);
+    CHECK(pBusy->Push(&worker, "busy", &dwBusy) == S_OK);
+    CHECK(pQueued->Push(&worker, "queued", &dwQueued) == S_OK);
+
+    HRESULT hrTake = E_FAIL;
+    ULONGLONG ullTakeNs = 0;
+    std::thread waiter([&]() {
+        WCHAR wsz[PROTECTED_PASSWORD_MAX];
+        DWORD cch = 0;
+        ULONGLONG ullStart = StageClock();
+        hrTake = pQueued->_protected.Take(dwQueued, DEFAULT_PROTECTION_WAIT_MS, wsz, ARRAYSIZE(wsz), &cch);
+        ullTakeNs = StageClock() - ullStart;
+    });
+
+    // Stop waits for the job in hand, so let that finish once Stop has been asked.
+    std::thread release([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        protector.Hold(FALSE);
+    });
+    worker.Stop();
+    waiter.join();
+    release.join();
+
+    CHECK(hrTake == S_FALSE);
+    CHECK(ullTakeNs < (ULONGLONG)DEFAULT_PROTECTION_WAIT_MS * 1000000 / 2);
+    CHECK(protector._cProtected <= 1);
+
+    // And nothing is waited for once the worker's gone.
+    DWORD dwLate;
+    CHECK(FAILED(pQueued->Push(&worker, "late", &dwLate)));
+    WCHAR wsz[PROTECTED_PASSWORD_MAX];
+    DWORD cch = 0;
+    ULONGLONG ullStart = StageClock();
+    CHECK(pQueued->_protected.Take(dwLate, DEFAULT_PROTECTION_WAIT_MS, wsz, ARRAYSIZE(wsz), &cch) == S_FALSE);
+    CHECK(StageClock() - ullStart < (ULONGLONG)DEFAULT_PROTECTION_WAIT_MS * 1000000 / 2);
+
+    pBusy->ReleaseTile();
+    pQueued->ReleaseTile();
+    CHECK(CHarnessTile::s_cLive == 0);
+}
+
+// GetSerialization reserves all of the arena for the result it hopes to take. When it
+// doesn't get one, giving it back leaves the whole arena for the fallback.
+static void TestArenaRewind()
+{
+    CScratchArena arena;
+    void* pvReserved = arena.Alloc(arena.GetAvailable());
+    CHECK(pvReserved != NULL && arena.GetAvailable() == 0);
+    arena.Trim(pvReserved, 0);
+    CHECK(arena.GetAvailable() == SCRATCH_ARENA_SIZE);
+
+    void* pvFallback = arena.Alloc(PROTECTED_PASSWORD_MAX * sizeof(WCHAR));
+    CHECK(pvFallback == pvReserved);
+    ARENA_COUNTERS counters;
+    arena.GetCounters(&counters);
+    CHECK(counters.cHeapAllocations == 0);
+}
+
+int main()
+{
+    TestTakeWaits();
+    TestDroppedJobIsNotWaitedFor();
+    TestArenaRewind();
+    return HarnessResult();
+}
@@ -0,0 +1,79 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Measures CFrameParser alone: frames and megabytes a second for a stream of
+// pipelined FT_CREDENTIAL frames, decoded as the listener decodes them, when the
+// stream arrives whole, in reads the size of the listener's, and in reads so small
+// that every frame straddles several.
+//
+//   ProtocolBench [frames]
+
+#include "TestHarness.h"
+
+// Decodes each frame's credential, as _OnClientFrame would, and counts them.
+class CCountingHandler : public IFrameHandler
+{
+  public:
+    CCountingHandler() : cFrames(0), cbUsers(0) {}
+
+    HRESULT OnFrame(const FRAME_HEADER& fh, const BYTE* pbPayload)
+    {
+        CREDENTIAL_MESSAGE cm;
+        HRESULT hr = CredentialMessageDecode(pbPayload, fh.cbPayload, &cm);
+        if (SUCCEEDED(hr))
+        {
+            cFrames++;
+            cbUsers += cm.cbUser;
+        }
+        return hr;
+    }
+
+    DWORD       cFrames;
+    ULONGLONG   cbUsers;
+};
+
+int main(int argc, char** argv)
+{
+    DWORD cFrames = HarnessArg(argc, argv, 1, 1000000);
+
+    std::vector<BYTE> rgb;
+    for (DWORD i = 0; i < cFrames; i++)
+    {
+        HarnessAppendCredential(rgb, i, "alice", "correct horse battery staple");
+    }
+
+    static const size_t c_rgcbRead[] = { 0, CLIENT_RECV_BUFLEN, 7 };
+    for (size_t cbRead : c_rgcbRead)
+    {
+        if (cbRead == 0)
+        {
+            cbRead = rgb.size();
+        }
+
+        CFrameParser parser;
+        CCountingHandler handler;
+        ULONGLONG ullStart = StageClock();
+        for (size_t ib = 0; ib < rgb.size(); ib += cbRead)
+        {
+            HRESULT hr = parser.Feed(&rgb[ib], (rgb.size() - ib < cbRead) ? rgb.size() - ib : cbRead, &handler);
+            if (FAILED(hr))
+            {
+                CHECK(!"parse failed");
+                break;
+            }
+        }
+        ULONGLONG ullNs = StageClock() - ullStart;
+
+        CHECK(handler.cFrames == cFrames);
+        printf("%7u-byte reads: %u frames in %.1f ms, %.1f M frames/s, %.0f MB/s\n",
+            (unsigned)cbRead, (unsigned)handler.cFrames, ullNs / 1e6, HarnessRate(handler.cFrames, ullNs) / 1e6,
+            HarnessRate(rgb.size(), ullNs) / 1e6);
+    }
+
+    return HarnessResult();
+}
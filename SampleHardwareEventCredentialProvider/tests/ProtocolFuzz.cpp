@@ -0,0 +1,201 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Fuzzes CFrameParser, the payload decoders and LegacyFieldScan. The first byte of
+// the input picks how the rest is cut into reads; the rest is the stream a sender
+// wrote. The parser must find the same frames, and stop at the same error, however
+// the stream is cut up, and every frame it finds must be one the decoders either
+// reject or decode into strings that are in bounds and NUL-free.
+
+#include "FuzzDriver.h"
+#include "CredentialProtocol.h"
+#include <string.h>
+
+// Records every frame it's handed, payload included.
+class CRecordingHandler : public IFrameHandler
+{
+  public:
+    HRESULT OnFrame(const FRAME_HEADER& fh, const BYTE* pbPayload)
+    {
+        FUZZ_ASSERT(fh.bMagic == FRAME_MAGIC && fh.bVersion == FRAME_VERSION && fh.bFlags == 0);
+        FUZZ_ASSERT(fh.cbPayload == 0 || pbPayload != NULL);
+
+        rgbFrames.push_back(fh.bType);
+        rgbFrames.insert(rgbFrames.end(), (const BYTE*)&fh.dwRequestId, (const BYTE*)&fh.dwRequestId + sizeof(DWORD));
+        rgbFrames.insert(rgbFrames.end(), (const BYTE*)&fh.cbPayload, (const BYTE*)&fh.cbPayload + sizeof(DWORD));
+        if (fh.cbPayload != 0)
+        {
+            rgbFrames.insert(rgbFrames.end(), pbPayload, pbPayload + fh.cbPayload);
+        }
+        _CheckDecoders(pbPayload, fh.cbPayload);
+        return S_OK;
+    }
+
+    std::vector<BYTE> rgbFrames;
+
+  private:
+    static void _CheckDecoders(const BYTE* pbPayload, DWORD cbPayload)
+    {
+        CREDENTIAL_MESSAGE cm;
+        if (SUCCEEDED(CredentialMessageDecode(pbPayload, cbPayload, &cm)))
+        {
+            FUZZ_ASSERT(2u + cm.cbUser + 2u + cm.cbPassword == cbPayload);
+            FUZZ_ASSERT(memchr(cm.pchUser, 0, cm.cbUser) == NULL);
+            FUZZ_ASSERT(memchr(cm.pchPassword, 0, cm.cbPassword) == NULL);
+        }
+
+        DWORD cUpdates;
+        if (SUCCEEDED(ProvisionMessageDecode(pbPayload, cbPayload, NULL, 0, &cUpdates)))
+        {
+            std::vector<PROFILE_UPDATE> rgUpdates(cUpdates);
+            FUZZ_ASSERT(SUCCEEDED(ProvisionMessageDecode(pbPayload, cbPayload, rgUpdates.data(), cUpdates, &cUpdates)));
+            for (const PROFILE_UPDATE& update : rgUpdates)
+            {
+                FUZZ_ASSERT((const BYTE*)update.pchId >= pbPayload && (const BYTE*)update.pchPassword + update.cchPassword <= pbPayload + cbPayload);
+                FUZZ_ASSERT(update.cchId > 0 && update.cchUser > 0);
+                FUZZ_ASSERT(update.cchUser <= PROFILE_MAX_FIELD && update.cchPassword <= PROFILE_MAX_FIELD);
+                FUZZ_ASSERT(memchr(update.pchUser, 0, update.cchUser) == NULL);
+                FUZZ_ASSERT(memchr(update.pchPassword, 0, update.cchPassword) == NULL);
+            }
+        }
+
+        EVENT_MESSAGE em;
+        if (SUCCEEDED(EventMessageDecode(pbPayload, cbPayload, &em)))
+        {
+            FUZZ_ASSERT(em.type >= ET_TOGGLE && em.type <= ET_DUMP_TIMINGS);
+        }
+    }
+};
+
+// Feeds pb to a fresh parser cbRead bytes at a time, as recv might hand it over.
+static HRESULT _ParseInReads(const BYTE* pb, size_t cb, size_t cbRead, CRecordingHandler* pHandler)
+{
+    CFrameParser parser;
+    parser.SetMaxPayload(FRAME_DEFAULT_MAX_PAYLOAD);
+    HRESULT hr = S_OK;
+    for (size_t ib = 0; ib < cb && SUCCEEDED(hr); ib += cbRead)
+    {
+        hr = parser.Feed(pb + ib, (cb - ib < cbRead) ? cb - ib : cbRead, pHandler);
+    }
+    return hr;
+}
+
+// Scans pb as a legacy sender's fields, cbRead bytes at a time, and checks each field
+// against what a byte-at-a-time scan finds.
+static void _CheckLegacyScan(const BYTE* pb, size_t cb, size_t cbRead)
+{
+    const size_t cchMax = PROFILE_MAX_FIELD;
+    char szField[PROFILE_MAX_FIELD + 1];
+    size_t cchField = 0;
+    size_t ibField = 0;     // Where the field in progress started.
+
+    for (size_t ib = 0; ib < cb; )
+    {
+        size_t cchUsed;
+        size_t cch = (cb - ib < cbRead) ? cb - ib : cbRead;
+        HRESULT hr = LegacyFieldScan((const char*)pb + ib, cch, szField, cchMax, &cchField, &cchUsed);
+
+        const BYTE* pbNul = (const BYTE*)memchr(pb + ibField, 0, cb - ibField);
+        size_t cchExpected = (pbNul != NULL) ? (size_t)(pbNul - (pb + ibField)) : cb - ibField;
+        if (FAILED(hr))
+        {
+            // Only a field that really is too long may be refused.
+            FUZZ_ASSERT(cchExpected > cchMax);
+            return;
+        }
+
+        FUZZ_ASSERT(cchField <= cchMax && szField[cchField] == '\0');
+        FUZZ_ASSERT(memcmp(szField, pb + ibField, cchField) == 0);
+        ib += cchUsed;
+        if (hr == S_OK)
+        {
+            FUZZ_ASSERT(cchField == cchExpected);
+            cchField = 0;
+            ibField = ib;
+        }
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* pbData, size_t cbData)
+{
+    if (cbData == 0)
+    {
+        return 0;
+    }
+    size_t cbRead = 1 + pbData[0] % 29;
+    const BYTE* pb = pbData + 1;
+    size_t cb = cbData - 1;
+
+    CRecordingHandler whole;
+    HRESULT hrWhole = _ParseInReads(pb, cb, cb ? cb : 1, &whole);
+    CRecordingHandler pieces;
+    HRESULT hrPieces = _ParseInReads(pb, cb, cbRead, &pieces);
+    FUZZ_ASSERT(hrWhole == hrPieces);
+    FUZZ_ASSERT(whole.rgbFrames == pieces.rgbFrames);
+
+    _CheckLegacyScan(pb, cb, cbRead);
+    return 0;
+}
+
+static void _AppendDword(std::vector<BYTE>& rgb, DWORD dw)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        rgb.push_back((BYTE)(dw >> (8 * i)));
+    }
+}
+
+static void _AppendField(std::vector<BYTE>& rgb, const char* psz)
+{
+    USHORT cb = (USHORT)strlen(psz);
+    rgb.push_back((BYTE)cb);
+    rgb.push_back((BYTE)(cb >> 8));
+    rgb.insert(rgb.end(), psz, psz + cb);
+}
+
+static void _AppendFrame(std::vector<BYTE>& rgb, BYTE bType, DWORD dwRequestId, const std::vector<BYTE>& rgbPayload)
+{
+    BYTE rgbHeader[FRAME_HEADER_SIZE];
+    FRAME_HEADER fh = { FRAME_MAGIC, FRAME_VERSION, bType, 0, dwRequestId, (DWORD)rgbPayload.size() };
+    FrameHeaderEncode(fh, rgbHeader);
+    rgb.insert(rgb.end(), rgbHeader, rgbHeader + sizeof(rgbHeader));
+    rgb.insert(rgb.end(), rgbPayload.begin(), rgbPayload.end());
+}
+
+void FuzzSeeds(std::vector<std::vector<BYTE>>& rgSeeds)
+{
+    std::vector<BYTE> rgbCredential;
+    _AppendField(rgbCredential, "alice");
+    _AppendField(rgbCredential, "secret");
+
+    std::vector<BYTE> rgbProvision;
+    _AppendDword(rgbProvision, 2);
+    _AppendField(rgbProvision, "badge-1");
+    _AppendField(rgbProvision, "alice");
+    _AppendField(rgbProvision, "secret");
+    _AppendField(rgbProvision, "badge-2");
+    _AppendField(rgbProvision, "bob");
+    _AppendField(rgbProvision, "");
+
+    BYTE rgbEvent[EVENT_DATAGRAM_SIZE];
+    EVENT_MESSAGE em = { ET_CONNECTED, TRUE, 7, 1 };
+    EventMessageEncode(em, rgbEvent);
+
+    // A pipelined stream of every request type, cut into 7-byte reads.
+    std::vector<BYTE> rgb(1, 6);
+    _AppendFrame(rgb, FT_CREDENTIAL, 1, rgbCredential);
+    _AppendFrame(rgb, FT_LOOKUP, 2, std::vector<BYTE>(rgbEvent, rgbEvent + sizeof(rgbEvent)));
+    _AppendFrame(rgb, FT_REVOKE, 3, std::vector<BYTE>(rgbCredential.begin() + 2, rgbCredential.begin() + 7));
+    _AppendFrame(rgb, FT_PROVISION, 4, rgbProvision);
+    _AppendFrame(rgb, 0x40, 5, std::vector<BYTE>());
+    rgSeeds.push_back(rgb);
+
+    // A legacy push.
+    static const char c_rgchLegacy[] = "\x03" "alice\0secret";
+    rgSeeds.push_back(std::vector<BYTE>(c_rgchLegacy, c_rgchLegacy + sizeof(c_rgchLegacy)));
+}
@@ -0,0 +1,253 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Plays LogonUI to the provider itself, built against ProviderCompat.h: gets it through
+// DllGetClassObject, advises it for logon, and checks what it shows while disconnected,
+// once a status event says the device is connected but nobody has been pushed, and
+// once a credential arrives. Each time, the tiles must know exactly the fields the
+// provider described. Then serializes the pushed credential, reports a failed logon,
+// and checks that everything is freed once released.
+//
+// The provider listens on its usual ports, so only one of these can run at a time.
+
+#include "HarnessEvents.h"
+#include "CSampleCredential.h"
+#include "SocketListener.h"
+#include "KerbPack.h"
+#include "guid.h"
+#include <chrono>
+
+#define PROVIDER_PORT           "27015"
+#define PROVIDER_EVENT_PORT     "65000"
+
+STDAPI DllCanUnloadNow();
+STDAPI DllGetClassObject(REFCLSID rclsid, REFIID riid, void** ppv);
+
+class CHarnessProviderEvents : public ICredentialProviderEvents
+{
+  public:
+    CHarnessProviderEvents() : _cChanged(0) {}
+
+    STDMETHOD(QueryInterface)(REFIID, void**) { return E_NOINTERFACE; }
+    STDMETHOD_(ULONG, AddRef)() { return 1; }
+    STDMETHOD_(ULONG, Release)() { return 1; }
+    STDMETHOD(CredentialsChanged)(UINT_PTR upAdviseContext)
+    {
+        CHECK(upAdviseContext == 42);
+        _cChanged++;
+        return S_OK;
+    }
+
+    // Waits for LogonUI to be told to re-enumerate cChanged times in all.
+    BOOL WaitForChanges(LONG cChanged)
+    {
+        for (int i = 0; i < 500 && _cChanged < cChanged; i++)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return _cChanged >= cChanged;
+    }
+
+  private:
+    std::atomic<LONG>   _cChanged;
+};
+
+class CHarnessCredentialEvents : public ICredentialProviderCredentialEvents
+{
+  public:
+    CHarnessCredentialEvents() : cSetString(0) {}
+
+    STDMETHOD(QueryInterface)(REFIID, void**) { return E_NOINTERFACE; }
+    STDMETHOD_(ULONG, AddRef)() { return 1; }
+    STDMETHOD_(ULONG, Release)() { return 1; }
+    STDMETHOD(SetFieldState)(ICredentialProviderCredential*, DWORD, CREDENTIAL_PROVIDER_FIELD_STATE) { return S_OK; }
+    STDMETHOD(SetFieldInteractiveState)(ICredentialProviderCredential*, DWORD, CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE) { return S_OK; }
+    STDMETHOD(SetFieldString)(ICredentialProviderCredential*, DWORD, LPCWSTR) { cSetString++; return S_OK; }
+    STDMETHOD(SetFieldCheckbox)(ICredentialProviderCredential*, DWORD, BOOL, LPCWSTR) { return S_OK; }
+    STDMETHOD(SetFieldBitmap)(ICredentialProviderCredential*, DWORD, HBITMAP) { return S_OK; }
+    STDMETHOD(SetFieldComboBoxSelectedItem)(ICredentialProviderCredential*, DWORD, DWORD) { return S_OK; }
+    STDMETHOD(DeleteFieldComboBoxItem)(ICredentialProviderCredential*, DWORD, DWORD) { return S_OK; }
+    STDMETHOD(AppendFieldComboBoxItem)(ICredentialProviderCredential*, DWORD, LPCWSTR) { return S_OK; }
+    STDMETHOD(SetFieldSubmitButton)(ICredentialProviderCredential*, DWORD, DWORD) { return S_OK; }
+    STDMETHOD(OnCreatingWindow)(HWND*) { return E_NOTIMPL; }
+
+    int cSetString;
+};
+
+// Whether cch characters of pwz are the ASCII string psz, and all of it.
+static BOOL _IsString(const WCHAR* pwz, size_t cch, const char* psz)
+{
+    for (size_t i = 0; i < cch; i++)
+    {
+        if (pwz[i] != (WCHAR)(BYTE)psz[i] || psz[i] == '\0')
+        {
+            return FALSE;
+        }
+    }
+    return psz[cch] == '\0';
+}
+
+// Enumerates as LogonUI does: the field count, then the tiles, asking each tile about
+// every field it was told of. Each must know exactly those fields.
+static void _CheckEnumeration(ICredentialProvider* pcp, DWORD cFieldsExpected, DWORD cTilesExpected)
+{
+    DWORD cFields = 0;
+    CHECK(SUCCEEDED(pcp->GetFieldDescriptorCount(&cFields)) && cFields == cFieldsExpected);
+    CREDENTIAL_PROVIDER_FIELD_DESCRIPTOR* pcpfd = NULL;
+    for (DWORD i = 0; i < cFields; i++)
+    {
+        CHECK(SUCCEEDED(pcp->GetFieldDescriptorAt(i, &pcpfd)));
+        if (pcpfd != NULL)
+        {
+            CHECK(pcpfd->dwFieldID == i);
+            CoTaskMemFree(pcpfd->pszLabel);
+            CoTaskMemFree(pcpfd);
+            pcpfd = NULL;
+        }
+    }
+    CHECK(pcp->GetFieldDescriptorAt(cFields, &pcpfd) == E_INVALIDARG);
+
+    DWORD cTiles = 0, iDefault = 0;
+    BOOL fAutoLogon = TRUE;
+    CHECK(SUCCEEDED(pcp->GetCredentialCount(&cTiles, &iDefault, &fAutoLogon)));
+    CHECK(cTiles == cTilesExpected && iDefault < cTiles && !fAutoLogon);
+    for (DWORD i = 0; i < cTiles; i++)
+    {
+        ICredentialProviderCredential* pcpc = NULL;
+        CHECK(SUCCEEDED(pcp->GetCredentialAt(i, &pcpc)));
+        if (pcpc == NULL)
+        {
+            continue;
+        }
+        CREDENTIAL_PROVIDER_FIELD_STATE cpfs;
+        CREDENTIAL_PROVIDER_FIELD_INTERACTIVE_STATE cpfis;
+        for (DWORD iField = 0; iField < cFields; iField++)
+        {
+            CHECK(SUCCEEDED(pcpc->GetFieldState(iField, &cpfs, &cpfis)));
+        }
+        CHECK(pcpc->GetFieldState(cFields, &cpfs, &cpfis) == E_INVALIDARG);
+        pcpc->Release();
+    }
+}
+
+static void _Push(DWORD dwRequestId, const char* pszUser, const char* pszPassword)
+{
+    socket_t s = HarnessConnect(PROVIDER_PORT);
+    CHECK(s != INVALID_SOCKET_T);
+    std::vector<BYTE> rgb;
+    HarnessAppendCredential(rgb, dwRequestId, pszUser, pszPassword);
+    CHECK(HarnessSend(s, rgb.data(), rgb.size()));
+    DWORD dwAcked = 0;
+    HRESULT hrStatus = E_FAIL;
+    CHECK(HarnessRecvAck(s, &dwAcked, &hrStatus) && dwAcked == dwRequestId && hrStatus == S_OK);
+    SocketClose(s);
+}
+
+// GetSerialization hands back an interactive logon for the user with their password
+// protected.
+static void _CheckSerialization(ICredentialProviderCredential* pcpc, const char* pszUser)
+{
+    CREDENTIAL_PROVIDER_GET_SERIALIZATION_RESPONSE cpgsr;
+    CREDENTIAL_PROVIDER_CREDENTIAL_SERIALIZATION cpcs = {};
+    PWSTR pwzStatus = NULL;
+    CREDENTIAL_PROVIDER_STATUS_ICON cpsi;
+    CHECK(SUCCEEDED(pcpc->GetSerialization(&cpgsr, &cpcs, &pwzStatus, &cpsi)));
+    CHECK(cpgsr == CPGSR_RETURN_CREDENTIAL_FINISHED);
+    CHECK(cpcs.clsidCredentialProvider == CLSID_CSampleProvider);
+
+    KERB_PACK_STRINGS ps = {};
+    HRESULT hr = CKerbNativePacker::Unpack(cpcs.rgbSerialization, cpcs.cbSerialization, &ps);
+    CHECK(SUCCEEDED(hr));
+    if (SUCCEEDED(hr))
+    {
+        CHECK(ps.dwMessageType == KerbInteractiveLogon);
+        CHECK(_IsString((const WCHAR*)ps.pbUser, ps.cbUser / sizeof(WCHAR), pszUser));
+        CHECK(ps.cbDomain > 0);
+        std::vector<WCHAR> rgwchPassword((const WCHAR*)ps.pbPassword, (const WCHAR*)(ps.pbPassword + ps.cbPassword));
+        rgwchPassword.push_back(0);
+        CRED_PROTECTION_TYPE protectionType = CredUnprotected;
+        CHECK(CredIsProtectedW(rgwchPassword.data(), &protectionType) && protectionType != CredUnprotected);
+    }
+
+    CoTaskMemFree(cpcs.rgbSerialization);
+    CoTaskMemFree(pwzStatus);
+}
+
+int main()
+{
+    IClassFactory* pcf = NULL;
+    CHECK(SUCCEEDED(DllGetClassObject(CLSID_CSampleProvider, IID_IClassFactory, (void**)&pcf)));
+    ICredentialProvider* pcp = NULL;
+    CHECK(SUCCEEDED(pcf->CreateInstance(NULL, IID_ICredentialProvider, (void**)&pcp)));
+    CHECK(pcf->Release() == 0);
+    if (pcp == NULL)
+    {
+        return HarnessResult();
+    }
+    CHECK(DllCanUnloadNow() == S_FALSE);
+
+    CHarnessProviderEvents events;
+    CHECK(SUCCEEDED(pcp->Advise(&events, 42)));
+    CHECK(SUCCEEDED(pcp->SetUsageScenario(CPUS_LOGON, 0)));
+
+    // Disconnected: the message tile.
+    _CheckEnumeration(pcp, SMFI_NUM_FIELDS, 1);
+
+    // Connected, but there's nobody to show yet: still the message tile.
+    CHarnessEventSender sender;
+    CHECK(sender.Open(PROVIDER_EVENT_PORT));
+    CHECK(sender.Send(ET_CONNECTED, 1, 1));
+    CHECK(events.WaitForChanges(1));
+    _CheckEnumeration(pcp, SMFI_NUM_FIELDS, 1);
+
+    // A pushed credential gets a tile of its own.
+    _Push(7, "alice", "s3cret!");
+    CHECK(events.WaitForChanges(2));
+    _CheckEnumeration(pcp, SFI_NUM_FIELDS, 1);
+
+    DWORD cTiles, iDefault;
+    BOOL fAutoLogon;
+    CHECK(SUCCEEDED(pcp->GetFieldDescriptorCount(&cTiles)));
+    CHECK(SUCCEEDED(pcp->GetCredentialCount(&cTiles, &iDefault, &fAutoLogon)));
+    ICredentialProviderCredential* pcpc = NULL;
+    CHECK(SUCCEEDED(pcp->GetCredentialAt(iDefault, &pcpc)));
+    if (pcpc != NULL)
+    {
+        CHarnessCredentialEvents credentialEvents;
+        CHECK(SUCCEEDED(pcpc->Advise(&credentialEvents)));
+        CHECK(SUCCEEDED(pcpc->SetSelected(&fAutoLogon)));
+        PWSTR pwzUser = NULL;
+        CHECK(SUCCEEDED(pcpc->GetStringValue(SFI_USERNAME, &pwzUser)));
+        CHECK(pwzUser != NULL && _IsString(pwzUser, wcslen(pwzUser), "alice"));
+        CoTaskMemFree(pwzUser);
+
+        _CheckSerialization(pcpc, "alice");
+        _CheckSerialization(pcpc, "alice");
+
+        // A failed logon is explained, and the password field emptied.
+        PWSTR pwzStatus = NULL;
+        CREDENTIAL_PROVIDER_STATUS_ICON cpsi;
+        CHECK(SUCCEEDED(pcpc->ReportResult(STATUS_LOGON_FAILURE, STATUS_SUCCESS, &pwzStatus, &cpsi)));
+        CHECK(pwzStatus != NULL && cpsi == CPSI_ERROR && credentialEvents.cSetString == 1);
+        CoTaskMemFree(pwzStatus);
+
+        CHECK(SUCCEEDED(pcpc->SetDeselected()));
+        CHECK(SUCCEEDED(pcpc->UnAdvise()));
+        pcpc->Release();
+    }
+    CHECK(SUCCEEDED(pcp->UnAdvise()));
+
+    // The provider's Release only frees it once the count has gone below zero, so it
+    // takes one more than the references outstanding: ours and the listener's, which
+    // the listener gives back as the provider goes.
+    CHECK(pcp->Release() == 2);
+    CHECK(pcp->Release() == 1);
+    pcp->Release();
+    CHECK(DllCanUnloadNow() == S_OK);
+    return HarnessResult();
+}
@@ -0,0 +1,78 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Profiles provisioned a second through CCredentialStore::Provision, in batches of
+// 1, 100 and 10000 records (one transaction per batch), first adding the profiles and
+// then replacing them all with new passwords, as a provisioning server would.
+//
+//   ProvisionBench [records per pass]
+
+#include "ProfileDb.h"
+#include "CredentialStore.h"
+#include <string>
+
+// Provisions profiles 0 to cRecords - 1 in batches of cBatch, with passwords made
+// from pszTag, and returns how long it took.
+static ULONGLONG _Provision(CCredentialStore* pStore, DWORD cRecords, DWORD cBatch, const char* pszTag)
+{
+    std::vector<std::string> rgIds(cBatch), rgUsers(cBatch), rgPasswords(cBatch);
+    std::vector<PROFILE_UPDATE> rgUpdates(cBatch);
+    ULONGLONG ullNs = 0;
+
+    for (DWORD iFirst = 0; iFirst < cRecords; iFirst += cBatch)
+    {
+        DWORD cUpdates = std::min(cBatch, cRecords - iFirst);
+        for (DWORD i = 0; i < cUpdates; i++)
+        {
+            char sz[32];
+            ProfileDbId(iFirst + i, sz, sizeof(sz));
+            rgIds[i] = sz;
+            ProfileDbUser(iFirst + i, sz, sizeof(sz));
+            rgUsers[i] = sz;
+            rgPasswords[i] = std::string(pszTag) + sz;
+            PROFILE_UPDATE update = { rgIds[i].data(), (USHORT)rgIds[i].size(), rgUsers[i].data(),
+                (USHORT)rgUsers[i].size(), rgPasswords[i].data(), (USHORT)rgPasswords[i].size() };
+            rgUpdates[i] = update;
+        }
+
+        ULONGLONG ullStart = StageClock();
+        CHECK(SUCCEEDED(pStore->Provision(rgUpdates.data(), cUpdates)));
+        ullNs += StageClock() - ullStart;
+    }
+    return ullNs;
+}
+
+int main(int argc, char** argv)
+{
+    DWORD cRecords = HarnessArg(argc, argv, 1, 10000);
+    static const DWORD c_rgcBatches[] = { 1, 100, 10000 };
+
+    printf("%u records per pass\n", (unsigned)cRecords);
+    for (DWORD cBatch : c_rgcBatches)
+    {
+        char szPath[MAX_PATH];
+        ProfileDbPath("ProvisionBench.db", szPath, sizeof(szPath));
+        CHECK(SUCCEEDED(ProfileDbCreate(szPath, 0)));
+
+        CCredentialStore store;
+        CHECK(SUCCEEDED(store.Open(szPath)));
+        ULONGLONG ullAddNs = _Provision(&store, cRecords, cBatch, "first");
+        ULONGLONG ullReplaceNs = _Provision(&store, cRecords, cBatch, "second-");
+
+        // Everything landed, the replacements included.
+        PROFILE_RECORD record;
+        char szId[32];
+        int cchId = ProfileDbId(cRecords - 1, szId, sizeof(szId));
+        CHECK(SUCCEEDED(store.Lookup(szId, cchId, &record)) && strncmp(record.szPassword, "second-", 7) == 0);
+        SecureZeroMemory(&record, sizeof(record));
+
+        printf("  batches of %-6u add %10.0f records/s   replace %10.0f records/s\n", (unsigned)cBatch,
+            HarnessRate(cRecords, ullAddNs), HarnessRate(cRecords, ullReplaceNs));
+        store.Close();
+        ProfileDbDelete(szPath);
+    }
+    return HarnessResult();
+}
@@ -0,0 +1,87 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// How long the roster takes with many tiles, as a shared floor machine might have:
+// pushing each user once, taking LogonUI's view of them, enumerating that view the way
+// GetCredentialAt does, and then the cost of one more push or removal followed by the
+// view refresh it causes.
+//
+//   RosterBench [tiles]
+
+#include "HarnessTiles.h"
+
+#define ENUMERATIONS    100
+
+int main(int argc, char** argv)
+{
+    DWORD cTiles = HarnessArg(argc, argv, 1, 10000);
+    CHarnessTileFactory factory;
+    {
+        CCredentialRoster roster;
+        roster.SetFactory(&factory);
+        ROSTER_VIEW view = {};
+        char szUser[16];
+
+        ULONGLONG ullStart = StageClock();
+        for (DWORD i = 0; i < cTiles; i++)
+        {
+            snprintf(szUser, sizeof(szUser), "user%u", (unsigned)i);
+            CHECK(roster.Upsert(szUser, "pw") == S_OK);
+        }
+        ULONGLONG ullNs = StageClock() - ullStart;
+        printf("%u tiles\n", (unsigned)cTiles);
+        printf("  %-22s %10.1f ns each\n", "first push", (double)ullNs / cTiles);
+
+        ullStart = StageClock();
+        CHECK(roster.Refresh(&view) == S_OK);
+        printf("  %-22s %10.1f us\n", "view refresh", (StageClock() - ullStart) / 1e3);
+
+        // GetCredentialAt: index the view, then read the tile's slot as serializing does.
+        volatile DWORD dwCheck = 0;
+        ullStart = StageClock();
+        for (DWORD n = 0; n < ENUMERATIONS; n++)
+        {
+            for (DWORD i = 0; i < view.cTiles; i++)
+            {
+                dwCheck = dwCheck + view.rgpTiles[i]->GetSlot()->GetSequence();
+            }
+        }
+        ullNs = StageClock() - ullStart;
+        printf("  %-22s %10.1f ns per tile, %8.1f us per enumeration\n", "enumerate", (double)ullNs / ((double)ENUMERATIONS * cTiles),
+            ullNs / 1e3 / ENUMERATIONS);
+
+        CREDENTIAL_SNAPSHOT snapshot;
+        ullStart = StageClock();
+        for (DWORD i = 0; i < view.cTiles; i++)
+        {
+            view.rgpTiles[i]->GetSlot()->Read(&snapshot);
+            dwCheck = dwCheck + snapshot.wszUser[0];
+        }
+        ullNs = StageClock() - ullStart;
+        printf("  %-22s %10.1f ns per tile\n", "read every slot", (double)ullNs / cTiles);
+
+        // One more change and the refresh it causes; nothing is rebuilt but the view.
+        ullStart = StageClock();
+        CHECK(roster.Upsert("user5", "new") == S_OK);
+        ULONGLONG ullPush = StageClock() - ullStart;
+        CHECK(roster.Refresh(&view) == S_OK);
+        ULONGLONG ullPushRefresh = StageClock() - ullStart;
+        ullStart = StageClock();
+        CHECK(roster.Remove("user7") == S_OK);
+        ULONGLONG ullRemove = StageClock() - ullStart;
+        CHECK(roster.Refresh(&view) == S_OK);
+        ULONGLONG ullRemoveRefresh = StageClock() - ullStart;
+        printf("  %-22s %10.1f us, %8.1f us with the refresh\n", "repush", ullPush / 1e3, ullPushRefresh / 1e3);
+        printf("  %-22s %10.1f us, %8.1f us with the refresh\n", "remove", ullRemove / 1e3, ullRemoveRefresh / 1e3);
+        CHECK(view.cTiles == cTiles - 1);
+
+        CCredentialRoster::FreeView(&view);
+    }
+    CHECK(CHarnessTile::s_cLive == 0);
+    return HarnessResult();
+}
@@ -0,0 +1,124 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Drives CCredentialRoster with random upserts and removals against a std::map of
+// what it should hold, checking every view against the map; then checks that a push
+// that can't be converted leaves the user's tile as it was, and that no tile outlives
+// the roster and its views.
+
+#include "HarnessTiles.h"
+#include <map>
+#include <random>
+
+// The view holds exactly the users in model, each with their latest password.
+static BOOL _ViewMatches(const ROSTER_VIEW* pView, const std::map<std::string, std::string>& model)
+{
+    if (pView->cTiles != model.size())
+    {
+        return FALSE;
+    }
+    for (DWORD i = 0; i < pView->cTiles; i++)
+    {
+        CREDENTIAL_SNAPSHOT snapshot;
+        pView->rgpTiles[i]->GetSlot()->Read(&snapshot);
+        std::map<std::string, std::string>::const_iterator it = model.find(HarnessNarrow(snapshot.wszUser));
+        if (it == model.end() || it->second != HarnessNarrow(snapshot.wszPassword))
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static void TestAgainstModel()
+{
+    CHarnessTileFactory factory;
+    {
+        CCredentialRoster roster;
+        roster.SetFactory(&factory);
+        std::map<std::string, std::string> model;
+        ROSTER_VIEW view = {};
+        std::mt19937 random(3);
+
+        for (DWORD n = 0; n < 30000; n++)
+        {
+            char szUser[16], szPassword[16];
+            snprintf(szUser, sizeof(szUser), "u%u", (unsigned)(random() % 1000));
+            snprintf(szPassword, sizeof(szPassword), "p%u", (unsigned)random());
+            DWORD dwOp = random() % 10;
+            if (dwOp < 6)
+            {
+                CHECK(roster.Upsert(szUser, szPassword) == S_OK);
+                model[szUser] = szPassword;
+            }
+            else if (dwOp < 9)
+            {
+                HRESULT hr = roster.Remove(szUser);
+                CHECK((hr == S_OK) == (model.erase(szUser) == 1));
+            }
+            else
+            {
+                CHECK(SUCCEEDED(roster.Refresh(&view)));
+                CHECK(_ViewMatches(&view, model));
+                CHECK(roster.GetCount() == model.size());
+            }
+        }
+
+        // Once the view is current, it isn't recopied until something changes.
+        CHECK(SUCCEEDED(roster.Refresh(&view)));
+        CHECK(roster.Refresh(&view) == S_FALSE);
+        CCredentialRoster::FreeView(&view);
+    }
+    CHECK(CHarnessTile::s_cLive == 0);
+}
+
+// A push whose password won't convert fails without touching the user's tile, and the
+// most recent good push is still the default.
+static void TestFailedPush()
+{
+    CHarnessTileFactory factory;
+    {
+        CCredentialRoster roster;
+        roster.SetFactory(&factory);
+        ROSTER_VIEW view = {};
+
+        CHECK(roster.Upsert("alice", "first") == S_OK);
+        CHECK(roster.Upsert("bob", "second") == S_OK);
+        CHECK(roster.Upsert("alice", "bad\xC0\x80") == HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION));
+        CHECK(roster.Upsert("carol", "\xFF") == HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION));
+        CHECK(roster.GetCount() == 2);
+
+        CHECK(SUCCEEDED(roster.Refresh(&view)));
+        std::map<std::string, std::string> model;
+        model["alice"] = "first";
+        model["bob"] = "second";
+        CHECK(_ViewMatches(&view, model));
+        CREDENTIAL_SNAPSHOT snapshot;
+        view.rgpTiles[view.iDefault]->GetSlot()->Read(&snapshot);
+        CHECK(HarnessNarrow(snapshot.wszUser) == "bob");
+
+        // If a tile has somehow been emptied, a failed push takes it away rather than
+        // leaving a blank tile behind.
+        view.rgpTiles[0]->GetSlot()->Read(&snapshot);
+        std::string strEmptied = HarnessNarrow(snapshot.wszUser);
+        view.rgpTiles[0]->GetSlot()->Clear();
+        CHECK(roster.Upsert(strEmptied.c_str(), "\xFF") == HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION));
+        CHECK(roster.GetCount() == 1);
+        CHECK(roster.Remove(strEmptied.c_str()) == HRESULT_FROM_WIN32(ERROR_NOT_FOUND));
+
+        CCredentialRoster::FreeView(&view);
+    }
+    CHECK(CHarnessTile::s_cLive == 0);
+}
+
+int main()
+{
+    TestAgainstModel();
+    TestFailedPush();
+    return HarnessResult();
+}
@@ -0,0 +1,136 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Checks that CSerializationCache only hands back a serialization for exactly the
+// password it was built from: not a prefix of it, not a longer one, not one that
+// differs in its last character; and that entries expire, are dropped when their
+// user is revoked, and give way to a new user when the cache is full.
+
+#include "TestHarness.h"
+#include "SerializationCache.h"
+#include <string>
+
+static std::basic_string<WCHAR> _Wide(const char* psz)
+{
+    std::basic_string<WCHAR> str;
+    for (; *psz != 0; psz++)
+    {
+        str += (WCHAR)*psz;
+    }
+    return str;
+}
+
+// Looks pszUser up with pszPassword; returns whether it hit, and if it did, that the
+// serialization handed back is the one inserted.
+static BOOL _Hits(CSerializationCache* pCache, const char* pszUser, const char* pszPassword, DWORD dwScenario,
+                  ULONGLONG ullNow, const BYTE* pbExpected, DWORD cbExpected)
+{
+    BYTE* pb = NULL;
+    DWORD cb = 0;
+    ULONG ulAuthPackage = 0;
+    HRESULT hr = pCache->Lookup(_Wide(pszUser).c_str(), _Wide(pszPassword).c_str(), dwScenario, ullNow,
+        &pb, &cb, &ulAuthPackage);
+    if (hr != S_OK)
+    {
+        CHECK(hr == S_FALSE);
+        return FALSE;
+    }
+    CHECK(cb == cbExpected && memcmp(pb, pbExpected, cb) == 0);
+    CHECK(ulAuthPackage == 42);
+    CoTaskMemFree(pb);
+    return TRUE;
+}
+
+static HRESULT _Insert(CSerializationCache* pCache, const char* pszUser, const char* pszPassword, DWORD dwScenario,
+                       ULONGLONG ullNow, const BYTE* pb, DWORD cb)
+{
+    return pCache->Insert(_Wide(pszUser).c_str(), _Wide(pszPassword).c_str(), dwScenario, ullNow, pb, cb, 42);
+}
+
+static void TestPasswordMatch()
+{
+    static const BYTE c_rgb[] = { 1, 2, 3, 4, 5 };
+    CSerializationCache cache;
+
+    // Each wrong password drops the entry, so even the right one misses afterwards.
+    const char* rgpszWrong[] = { "", "secre", "secret!", "secreT", "Secret", "secret\x7F" };
+    for (const char* pszWrong : rgpszWrong)
+    {
+        CHECK(_Insert(&cache, "alice", "secret", 1, 0, c_rgb, sizeof(c_rgb)) == S_OK);
+        CHECK(!_Hits(&cache, "alice", pszWrong, 1, 0, c_rgb, sizeof(c_rgb)));
+        CHECK(!_Hits(&cache, "alice", "secret", 1, 0, c_rgb, sizeof(c_rgb)));
+    }
+
+    CHECK(_Insert(&cache, "alice", "secret", 1, 0, c_rgb, sizeof(c_rgb)) == S_OK);
+    CHECK(_Hits(&cache, "alice", "secret", 1, 0, c_rgb, sizeof(c_rgb)));
+    CHECK(_Hits(&cache, "alice", "secret", 1, 0, c_rgb, sizeof(c_rgb)));
+    CHECK(!_Hits(&cache, "alice", "secret", 2, 0, c_rgb, sizeof(c_rgb)));
+    CHECK(!_Hits(&cache, "bob", "secret", 1, 0, c_rgb, sizeof(c_rgb)));
+
+    // Passwords of the longest length we accept work; longer ones aren't kept, and
+    // never match one that was.
+    std::string strLongest(PROFILE_MAX_FIELD, 'x');
+    std::string strTooLong(PROFILE_MAX_FIELD + 1, 'x');
+    CHECK(_Insert(&cache, "carol", strLongest.c_str(), 1, 0, c_rgb, sizeof(c_rgb)) == S_OK);
+    CHECK(!_Hits(&cache, "carol", strTooLong.c_str(), 1, 0, c_rgb, sizeof(c_rgb)));
+    CHECK(_Insert(&cache, "carol", strLongest.c_str(), 1, 0, c_rgb, sizeof(c_rgb)) == S_OK);
+    CHECK(_Hits(&cache, "carol", strLongest.c_str(), 1, 0, c_rgb, sizeof(c_rgb)));
+    CHECK(_Insert(&cache, "dave", strTooLong.c_str(), 1, 0, c_rgb, sizeof(c_rgb)) == S_FALSE);
+    CHECK(!_Hits(&cache, "dave", strTooLong.c_str(), 1, 0, c_rgb, sizeof(c_rgb)));
+
+    // A later push with a different password replaces the entry.
+    static const BYTE c_rgbOther[] = { 9, 8, 7 };
+    CHECK(_Insert(&cache, "alice", "changed", 1, 0, c_rgbOther, sizeof(c_rgbOther)) == S_OK);
+    CHECK(!_Hits(&cache, "alice", "secret", 1, 0, c_rgb, sizeof(c_rgb)));
+    CHECK(!_Hits(&cache, "alice", "changed", 1, 0, c_rgbOther, sizeof(c_rgbOther)));
+
+    SERIALIZATION_CACHE_COUNTERS counters;
+    cache.GetCounters(&counters);
+    CHECK(counters.cStale == ARRAYSIZE(rgpszWrong) + 2);
+}
+
+static void TestLifetime()
+{
+    static const BYTE c_rgb[] = { 1, 2, 3 };
+    CSerializationCache cache;
+    cache.SetTtl(1000);
+
+    CHECK(_Insert(&cache, "alice", "pw", 1, 5000, c_rgb, sizeof(c_rgb)) == S_OK);
+    CHECK(_Hits(&cache, "alice", "pw", 1, 5999, c_rgb, sizeof(c_rgb)));
+    CHECK(!_Hits(&cache, "alice", "pw", 1, 6000, c_rgb, sizeof(c_rgb)));
+
+    CHECK(_Insert(&cache, "alice", "pw", 1, 0, c_rgb, sizeof(c_rgb)) == S_OK);
+    CHECK(_Insert(&cache, "alice", "pw", 2, 0, c_rgb, sizeof(c_rgb)) == S_OK);
+    cache.Invalidate(_Wide("alice").c_str());
+    CHECK(!_Hits(&cache, "alice", "pw", 1, 0, c_rgb, sizeof(c_rgb)));
+    CHECK(!_Hits(&cache, "alice", "pw", 2, 0, c_rgb, sizeof(c_rgb)));
+
+    // When full, the user looked up longest ago makes way.
+    char szUser[16];
+    for (DWORD i = 0; i < SERIALIZATION_CACHE_ENTRIES; i++)
+    {
+        snprintf(szUser, sizeof(szUser), "user%u", (unsigned)i);
+        CHECK(_Insert(&cache, szUser, "pw", 1, 100 + i, c_rgb, sizeof(c_rgb)) == S_OK);
+    }
+    CHECK(_Hits(&cache, "user0", "pw", 1, 500, c_rgb, sizeof(c_rgb)));
+    CHECK(_Insert(&cache, "newcomer", "pw", 1, 501, c_rgb, sizeof(c_rgb)) == S_OK);
+    CHECK(_Hits(&cache, "user0", "pw", 1, 502, c_rgb, sizeof(c_rgb)));
+    CHECK(!_Hits(&cache, "user1", "pw", 1, 502, c_rgb, sizeof(c_rgb)));
+    CHECK(_Hits(&cache, "newcomer", "pw", 1, 502, c_rgb, sizeof(c_rgb)));
+
+    SERIALIZATION_CACHE_COUNTERS counters;
+    cache.GetCounters(&counters);
+    CHECK(counters.cExpired == 1 && counters.cInvalidated == 2 && counters.cEvicted == 1);
+}
+
+int main()
+{
+    TestPasswordMatch();
+    TestLifetime();
+    return HarnessResult();
+}
@@ -0,0 +1,139 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// One writer sets a CCredentialSlot as fast as it can while many readers read it, as
+// the listener and LogonUI's threads do. Every push puts the same number in the
+// username and the password, at a length that changes with the number, so a reader
+// that saw half of one push and half of another would notice. Fails if any reader
+// does, or sees the sequence go backwards; prints how long reads took.
+//
+//   SlotStressTest [readers] [reads per reader]
+
+#include "TestHarness.h"
+#include "CredentialSlot.h"
+#include <atomic>
+
+// The fields for push n: "u" or "p", then n, padded with '.' to a length set by n.
+static void _FormatField(char chPrefix, DWORD n, char* psz, size_t cch)
+{
+    int cchNumber = snprintf(psz, cch, "%c%u", chPrefix, (unsigned)n);
+    size_t cchPadded = (size_t)cchNumber + n % (PROFILE_MAX_FIELD - 12);
+    for (size_t i = (size_t)cchNumber; i < cchPadded && i + 1 < cch; i++)
+    {
+        psz[i] = '.';
+        psz[i + 1] = '\0';
+    }
+}
+
+// Parses a field written by _FormatField back into its number, checking the padding.
+static BOOL _ParseField(WCHAR chPrefix, const WCHAR* pwz, DWORD* pn)
+{
+    if (pwz[0] != chPrefix)
+    {
+        return FALSE;
+    }
+    DWORD n = 0;
+    size_t i = 1;
+    for (; pwz[i] >= '0' && pwz[i] <= '9'; i++)
+    {
+        n = n * 10 + (pwz[i] - '0');
+    }
+    size_t cchPadding = 0;
+    for (; pwz[i] == '.'; i++)
+    {
+        cchPadding++;
+    }
+    *pn = n;
+    return pwz[i] == 0 && cchPadding == n % (PROFILE_MAX_FIELD - 12);
+}
+
+int main(int argc, char** argv)
+{
+    DWORD cReaders = HarnessArg(argc, argv, 1, 8);
+    DWORD cReads = HarnessArg(argc, argv, 2, 100000);
+
+    CCredentialSlot slot;
+    CHECK(slot.Set("u0", "p0") == S_OK);
+
+    std::atomic<BOOL> fStop(FALSE);
+    std::atomic<DWORD> cPushes(0);
+    std::thread writer([&]() {
+        char szUser[PROFILE_MAX_FIELD + 1];
+        char szPassword[PROFILE_MAX_FIELD + 1];
+        for (DWORD n = 1; !fStop.load(std::memory_order_relaxed); n++)
+        {
+            _FormatField('u', n, szUser, sizeof(szUser));
+            _FormatField('p', n, szPassword, sizeof(szPassword));
+            CHECK(slot.Set(szUser, szPassword) == S_OK);
+            cPushes.store(n, std::memory_order_relaxed);
+        }
+    });
+
+    std::atomic<DWORD> cTorn(0);
+    std::atomic<DWORD> cBackwards(0);
+    std::vector<std::vector<ULONGLONG>> rgrgullNs(cReaders);
+    std::vector<std::thread> rgReaders;
+    ULONGLONG ullStart = StageClock();
+    for (DWORD r = 0; r < cReaders; r++)
+    {
+        rgReaders.emplace_back([&, r]() {
+            std::vector<ULONGLONG>& rgullNs = rgrgullNs[r];
+            rgullNs.reserve(cReads);
+            DWORD dwLastSequence = 0;
+            DWORD nLast = 0;
+            for (DWORD i = 0; i < cReads; i++)
+            {
+                CREDENTIAL_SNAPSHOT snapshot;
+                ULONGLONG ullBefore = StageClock();
+                slot.Read(&snapshot);
+                rgullNs.push_back(StageClock() - ullBefore);
+
+                DWORD nUser = 0;
+                DWORD nPassword = 0;
+                if (!_ParseField('u', snapshot.wszUser, &nUser) ||
+                    !_ParseField('p', snapshot.wszPassword, &nPassword) ||
+                    nUser != nPassword)
+                {
+                    cTorn++;
+                }
+                if ((snapshot.dwSequence & 1) != 0 || snapshot.dwSequence < dwLastSequence || nUser < nLast)
+                {
+                    cBackwards++;
+                }
+                dwLastSequence = snapshot.dwSequence;
+                nLast = nUser;
+            }
+        });
+    }
+    for (std::thread& reader : rgReaders)
+    {
+        reader.join();
+    }
+    ULONGLONG ullNs = StageClock() - ullStart;
+    fStop = TRUE;
+    writer.join();
+
+    CHECK(cTorn == 0);
+    CHECK(cBackwards == 0);
+
+    std::vector<ULONGLONG> rgullAll;
+    for (const std::vector<ULONGLONG>& rgullNs : rgrgullNs)
+    {
+        rgullAll.insert(rgullAll.end(), rgullNs.begin(), rgullNs.end());
+    }
+    printf("%u readers, %u reads, %u pushes meanwhile, %u torn, %u out of order\n", (unsigned)cReaders,
+        (unsigned)rgullAll.size(), (unsigned)cPushes.load(), (unsigned)cTorn.load(), (unsigned)cBackwards.load());
+    ULONGLONG ullP50 = HarnessPercentile(rgullAll, 50);
+    ULONGLONG ullP99 = HarnessPercentile(rgullAll, 99);
+    ULONGLONG ullP999 = HarnessPercentile(rgullAll, 99.9);
+    ULONGLONG ullMax = HarnessPercentile(rgullAll, 100);
+    printf("%.0f reads/s; read latency p50 %llu ns, p99 %llu ns, p99.9 %llu ns, max %llu ns\n",
+        HarnessRate(rgullAll.size(), ullNs), (unsigned long long)ullP50, (unsigned long long)ullP99,
+        (unsigned long long)ullP999, (unsigned long long)ullMax);
+    return HarnessResult();
+}
@@ -0,0 +1,169 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Records known durations into CStageTimings and checks the count, mean, p50, p99,
+// p99.9 and max it reports: each percentile no lower than the true one and no more
+// than 1/STAGE_SUB_BUCKETS above it, exact for short durations, and capped at 2^40 ns
+// while the max stays exact. Each case has a stage of the shared timings to itself.
+
+#include "TestHarness.h"
+
+// Whether a reported percentile is within the histogram's resolution of the true one.
+static BOOL _Near(ULONGLONG ullReported, ULONGLONG ullTrue)
+{
+    return ullReported >= ullTrue && ullReported <= ullTrue + ullTrue / STAGE_SUB_BUCKETS;
+}
+
+// 1, 2, ... 1000 ns, shuffled: the true p50 is 500, p99 990 and p99.9 999.
+static void TestUniform()
+{
+    CStageTimings* pTimings = CStageTimings::GetShared();
+    for (ULONGLONG i = 0; i < 1000; i++)
+    {
+        pTimings->Record(PS_ACCEPT, 1 + (i * 379) % 1000);
+    }
+
+    STAGE_SUMMARY summary;
+    pTimings->GetSummary(PS_ACCEPT, &summary);
+    CHECK(summary.cSamples == 1000 && summary.ullMeanNs == 500);
+    CHECK(_Near(summary.ullP50Ns, 500));
+    CHECK(_Near(summary.ullP99Ns, 990));
+    CHECK(_Near(summary.ullP999Ns, 999));
+    CHECK(summary.ullMaxNs == 1000);
+}
+
+// A stage that is usually quick with a long tail: 990 pushes of 10us, 9 of 1ms and
+// one of a second. The tail shows in p99.9 and max, but not in p50 or p99.
+static void TestTail()
+{
+    CStageTimings* pTimings = CStageTimings::GetShared();
+    for (DWORD i = 0; i < 990; i++)
+    {
+        pTimings->Record(PS_RECV, 10000);
+    }
+    for (DWORD i = 0; i < 9; i++)
+    {
+        pTimings->Record(PS_RECV, 1000000);
+    }
+    pTimings->Record(PS_RECV, 1000000000);
+
+    STAGE_SUMMARY summary;
+    pTimings->GetSummary(PS_RECV, &summary);
+    CHECK(summary.cSamples == 1000 && summary.ullMeanNs == (990ull * 10000 + 9ull * 1000000 + 1000000000) / 1000);
+    CHECK(_Near(summary.ullP50Ns, 10000));
+    CHECK(_Near(summary.ullP99Ns, 10000));
+    CHECK(_Near(summary.ullP999Ns, 1000000));
+    CHECK(summary.ullMaxNs == 1000000000);
+}
+
+// Below STAGE_SUB_BUCKETS * 2 ns every value has a bucket of its own.
+static void TestExact()
+{
+    CStageTimings* pTimings = CStageTimings::GetShared();
+    for (ULONGLONG i = 0; i < STAGE_SUB_BUCKETS * 2; i++)
+    {
+        pTimings->Record(PS_PARSE, i);
+    }
+
+    STAGE_SUMMARY summary;
+    pTimings->GetSummary(PS_PARSE, &summary);
+    CHECK(summary.cSamples == STAGE_SUB_BUCKETS * 2);
+    CHECK(summary.ullP50Ns == STAGE_SUB_BUCKETS - 1);
+    CHECK(summary.ullP99Ns == STAGE_SUB_BUCKETS * 2 - 1);
+    CHECK(summary.ullP999Ns == STAGE_SUB_BUCKETS * 2 - 1);
+    CHECK(summary.ullMaxNs == STAGE_SUB_BUCKETS * 2 - 1);
+
+    // A stage nothing has recorded reports nothing.
+    pTimings->GetSummary(PS_PACK, &summary);
+    CHECK(summary.cSamples == 0 && summary.ullP50Ns == 0 && summary.ullMaxNs == 0);
+}
+
+// Anything past 2^40 ns is counted as 2^40, but the max is still the real one.
+static void TestClamp()
+{
+    CStageTimings* pTimings = CStageTimings::GetShared();
+    pTimings->Record(PS_LOOKUP, 1ull << (STAGE_MAX_BITS + 1));
+
+    STAGE_SUMMARY summary;
+    pTimings->GetSummary(PS_LOOKUP, &summary);
+    CHECK(summary.cSamples == 1);
+    CHECK(summary.ullP50Ns == (1ull << STAGE_MAX_BITS) - 1);
+    CHECK(summary.ullP999Ns == (1ull << STAGE_MAX_BITS) - 1);
+    CHECK(summary.ullMaxNs == 1ull << (STAGE_MAX_BITS + 1));
+}
+
+// More threads than shards, all recording at once; nothing is lost.
+static void TestThreads()
+{
+    const DWORD c_cThreads = STAGE_SHARDS + 4;
+    const DWORD c_cPerThread = 10000;
+    std::vector<std::thread> rgThreads;
+    for (DWORD iThread = 0; iThread < c_cThreads; iThread++)
+    {
+        rgThreads.push_back(std::thread([=]()
+        {
+            for (DWORD i = 0; i < c_cPerThread; i++)
+            {
+                CStageTimings::GetShared()->Record(PS_CONNECT_STATUS, 100 + iThread);
+            }
+        }));
+    }
+    for (std::thread& thread : rgThreads)
+    {
+        thread.join();
+    }
+
+    STAGE_SUMMARY summary;
+    CStageTimings::GetShared()->GetSummary(PS_CONNECT_STATUS, &summary);
+    CHECK(summary.cSamples == c_cThreads * c_cPerThread);
+    CHECK(summary.ullMaxNs == 100 + c_cThreads - 1);
+    CHECK(_Near(summary.ullP999Ns, 100 + c_cThreads - 1));
+}
+
+// Print writes a line for each recorded stage, in microseconds, and none for the rest.
+static void TestPrint()
+{
+    FILE* pFile = tmpfile();
+    CHECK(pFile != NULL);
+    if (pFile == NULL)
+    {
+        return;
+    }
+    CStageTimings::GetShared()->Print(pFile);
+    rewind(pFile);
+
+    char szLine[256];
+    BOOL fAccept = FALSE;
+    BOOL fPack = FALSE;
+    while (fgets(szLine, sizeof(szLine), pFile) != NULL)
+    {
+        char szStage[64];
+        unsigned long long cSamples = 0;
+        double dMean = 0, dP50 = 0, dP99 = 0, dP999 = 0, dMax = 0;
+        if (sscanf(szLine, "%63s %llu %lf %lf %lf %lf %lf", szStage, &cSamples, &dMean, &dP50, &dP99, &dP999, &dMax) == 7)
+        {
+            if (strcmp(szStage, "accept") == 0)
+            {
+                fAccept = TRUE;
+                CHECK(cSamples == 1000 && dP50 >= 0.5 && dP50 < 0.6 && dMax == 1.0);
+            }
+            fPack = fPack || strcmp(szStage, CStageTimings::GetStageName(PS_PACK)) == 0;
+        }
+    }
+    CHECK(fAccept && !fPack);
+    fclose(pFile);
+}
+
+int main()
+{
+    TestUniform();
+    TestTail();
+    TestExact();
+    TestClamp();
+    TestThreads();
+    TestPrint();
+    return HarnessResult();
+}
@@ -0,0 +1,137 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Lookups a second against the account database, for each profile count given:
+//
+//   per-push open   what the old Socket2 did for every push: open the database, run
+//                   a SELECT built into a string, and close it again
+//   prepared        one connection, and the store's cached lookup statement with the
+//                   id bound as a parameter
+//   store           CCredentialStore::Lookup, as the listener calls it
+//
+//   StoreBench [profiles ...]
+
+#include "ProfileDb.h"
+#include "CredentialStore.h"
+#include <random>
+#include <string>
+
+#define LOOKUP_IDS 4096
+
+// Runs pfnLookup over the ids until cLookups have been done or a second has passed,
+// and prints the rate.
+template <class F>
+static void _TimeLookups(const char* pszName, const std::vector<std::string>& rgIds, DWORD cLookups, F pfnLookup)
+{
+    ULONGLONG ullStart = StageClock();
+    ULONGLONG ullNs = 0;
+    DWORD i = 0;
+    while (i < cLookups && ullNs < 1000000000ull)
+    {
+        const std::string& id = rgIds[i % rgIds.size()];
+        if (!pfnLookup(id))
+        {
+            CHECK(!"lookup failed");
+            break;
+        }
+        if (++i % 64 == 0)
+        {
+            ullNs = StageClock() - ullStart;
+        }
+    }
+    ullNs = StageClock() - ullStart;
+    printf("  %-15s %8u lookups, %10.0f lookups/s, %8.0f ns each\n", pszName, (unsigned)i,
+        HarnessRate(i, ullNs), i ? (double)ullNs / i : 0.0);
+}
+
+// The database's row for an id, as the old code read it: one exec per lookup.
+static int _ExecCallback(void* pv, int cColumns, char** rgpszValues, char** rgpszNames)
+{
+    UNREFERENCED_PARAMETER(rgpszNames);
+    PROFILE_RECORD* pRecord = static_cast<PROFILE_RECORD*>(pv);
+    if (cColumns == 2 && rgpszValues[0] != NULL && rgpszValues[1] != NULL)
+    {
+        snprintf(pRecord->szUser, sizeof(pRecord->szUser), "%s", rgpszValues[0]);
+        snprintf(pRecord->szPassword, sizeof(pRecord->szPassword), "%s", rgpszValues[1]);
+    }
+    return 0;
+}
+
+static void _Bench(DWORD cProfiles)
+{
+    char szPath[MAX_PATH];
+    ProfileDbPath("StoreBench.db", szPath, sizeof(szPath));
+    CHECK(SUCCEEDED(ProfileDbCreate(szPath, cProfiles)));
+
+    std::mt19937 random(cProfiles);
+    std::vector<std::string> rgIds;
+    std::vector<DWORD> rgiProfiles;
+    for (DWORD i = 0; i < LOOKUP_IDS; i++)
+    {
+        char szId[32];
+        DWORD iProfile = random() % cProfiles;
+        ProfileDbId(iProfile, szId, sizeof(szId));
+        rgIds.push_back(szId);
+        rgiProfiles.push_back(iProfile);
+    }
+    printf("%u profiles:\n", (unsigned)cProfiles);
+
+    _TimeLookups("per-push open", rgIds, 2000, [&](const std::string& id) {
+        sqlite3* pDb = NULL;
+        PROFILE_RECORD record = {};
+        std::string sql = "SELECT username, password FROM profile WHERE id=\"" + id + "\";";
+        BOOL fFound = sqlite3_open(szPath, &pDb) == SQLITE_OK &&
+            sqlite3_exec(pDb, sql.c_str(), _ExecCallback, &record, NULL) == SQLITE_OK &&
+            record.szUser[0] != '\0';
+        sqlite3_close(pDb);
+        return fFound;
+    });
+
+    sqlite3* pDb = NULL;
+    sqlite3_stmt* pStmt = NULL;
+    CHECK(sqlite3_open_v2(szPath, &pDb, SQLITE_OPEN_READWRITE | SQLITE_OPEN_FULLMUTEX, NULL) == SQLITE_OK);
+    CHECK(sqlite3_prepare_v3(pDb, "SELECT username, password FROM profile WHERE id = ?1;", -1,
+        SQLITE_PREPARE_PERSISTENT, &pStmt, NULL) == SQLITE_OK);
+    _TimeLookups("prepared", rgIds, 1000000, [&](const std::string& id) {
+        sqlite3_bind_text(pStmt, 1, id.data(), (int)id.size(), SQLITE_STATIC);
+        BOOL fFound = sqlite3_step(pStmt) == SQLITE_ROW && sqlite3_column_text(pStmt, 0) != NULL;
+        sqlite3_reset(pStmt);
+        return fFound;
+    });
+    sqlite3_finalize(pStmt);
+    sqlite3_close(pDb);
+
+    CCredentialStore store;
+    ULONGLONG ullStart = StageClock();
+    CHECK(SUCCEEDED(store.Open(szPath)));
+    printf("  %-15s %8.1f ms\n", "store open", (StageClock() - ullStart) / 1e6);
+    DWORD iId = 0;
+    _TimeLookups("store", rgIds, 10000000, [&](const std::string& id) {
+        PROFILE_RECORD record;
+        BOOL fFound = SUCCEEDED(store.Lookup(id.data(), id.size(), &record)) &&
+            ProfileDbMatches(rgiProfiles[iId++ % rgIds.size()], &record);
+        return fFound;
+    });
+    store.Close();
+
+    ProfileDbDelete(szPath);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        _Bench(10000);
+        _Bench(1000000);
+    }
+    for (int i = 1; i < argc; i++)
+    {
+        _Bench(HarnessArg(argc, argv, i, 10000));
+    }
+    return HarnessResult();
+}
@@ -0,0 +1,349 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// What the tests and benchmarks under tests/ share: a CHECK macro, a listener
+// running on a thread of its own on a free port, and a blocking sender that speaks
+// both the framed and the legacy protocols to it. POSIX only, like the CMake build.
+
+#pragma once
+
+#include "CredentialListener.h"
+#include "SocketCompat.h"
+#include "StageTimings.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+// Atomic, since tests CHECK from their own threads too.
+static std::atomic<int> g_cHarnessFailures(0);
+
+// Reports a failed expectation and carries on, so one run shows every failure.
+#define CHECK(expr) \
+    do { \
+        if (!(expr)) { \
+            printf("%s(%d): CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+            g_cHarnessFailures++; \
+        } \
+    } while (0)
+
+// What main returns: 0 if every CHECK passed.
+inline int HarnessResult()
+{
+    if (g_cHarnessFailures != 0)
+    {
+        printf("%d check(s) failed\n", g_cHarnessFailures.load());
+    }
+    return g_cHarnessFailures == 0 ? 0 : 1;
+}
+
+// Reads an unsigned count from argv[i], or returns dwDefault if there isn't one.
+inline DWORD HarnessArg(int argc, char** argv, int i, DWORD dwDefault)
+{
+    return (i < argc) ? (DWORD)strtoul(argv[i], NULL, 10) : dwDefault;
+}
+
+// Operations per second, given how many took how many nanoseconds.
+inline double HarnessRate(ULONGLONG cOps, ULONGLONG ullNs)
+{
+    return ullNs ? (double)cOps * 1e9 / (double)ullNs : 0.0;
+}
+
+// The dPercentile'th percentile of rgullNs, which is sorted in place.
+inline ULONGLONG HarnessPercentile(std::vector<ULONGLONG>& rgullNs, double dPercentile)
+{
+    if (rgullNs.empty())
+    {
+        return 0;
+    }
+    std::sort(rgullNs.begin(), rgullNs.end());
+    size_t i = (size_t)(dPercentile / 100.0 * (double)(rgullNs.size() - 1));
+    return rgullNs[i];
+}
+
+// A port number, as a string, that nothing else in this run is likely to be using.
+// Each call returns a different one.
+inline void HarnessPort(char* pszPort, size_t cchPort)
+{
+    static DWORD s_dwNext = 0;
+    if (s_dwNext == 0)
+    {
+        s_dwNext = 20000 + (DWORD)(getpid() % 2000) * 16;
+    }
+    snprintf(pszPort, cchPort, "%u", (unsigned)s_dwNext++);
+}
+
+// Counts what the listener hands its sink, and keeps the last credential. Safe to use
+// with workers. Also counts the credentials handed over on the event loop's thread,
+// which is the one that calls OnIdle.
+class CHarnessSink : public ICredentialSink
+{
+  public:
+    CHarnessSink() : _cReceived(0), _cReceivedOnLoop(0) { _szUser[0] = _szPassword[0] = '\0'; }
+
+    void OnCredentialReceived(const char* pszUser, const char* pszPassword)
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _cReceived++;
+        if (std::this_thread::get_id() == _idLoop)
+        {
+            _cReceivedOnLoop++;
+        }
+        snprintf(_szUser, sizeof(_szUser), "%s", pszUser);
+        snprintf(_szPassword, sizeof(_szPassword), "%s", pszPassword);
+    }
+
+    DWORD OnIdle()
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        _idLoop = std::this_thread::get_id();
+        return SINK_WAIT_FOREVER;
+    }
+
+    DWORD GetReceivedCount()
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _cReceived;
+    }
+
+    DWORD GetReceivedOnLoopCount()
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        return _cReceivedOnLoop;
+    }
+
+    // Copies out the last credential received.
+    void GetLast(char* pszUser, size_t cchUser, char* pszPassword, size_t cchPassword)
+    {
+        std::lock_guard<std::mutex> guard(_lock);
+        snprintf(pszUser, cchUser, "%s", _szUser);
+        snprintf(pszPassword, cchPassword, "%s", _szPassword);
+    }
+
+  private:
+    std::mutex      _lock;
+    DWORD           _cReceived;
+    DWORD           _cReceivedOnLoop;
+    std::thread::id _idLoop;
+    char            _szUser[PROFILE_MAX_FIELD + 1];
+    char            _szPassword[PROFILE_MAX_FIELD + 1];
+};
+
+// A CCredentialListener running on a thread of its own. Configure the listener
+// through Get before Start.
+class CHarnessListener
+{
+  public:
+    CHarnessListener() { _szPort[0] = '\0'; }
+    ~CHarnessListener() { Stop(); }
+
+    CCredentialListener* Get() { return &_listener; }
+    const char* GetPort() { return _szPort; }
+
+    // Opens the listener on the first free port we try, and for a local agent at pszLocal
+    // if one is given, and starts it running.
+    HRESULT Start(ICredentialSink* pSink, const char* pszLocal = NULL)
+    {
+        HRESULT hr = E_FAIL;
+        for (int i = 0; i < 16 && FAILED(hr); i++)
+        {
+            HarnessPort(_szPort, sizeof(_szPort));
+            hr = _listener.Open(_szPort);
+            if (FAILED(hr))
+            {
+                _listener.Close();
+            }
+        }
+        if (SUCCEEDED(hr) && pszLocal != NULL)
+        {
+            hr = _listener.OpenLocal(pszLocal);
+            if (FAILED(hr))
+            {
+                _listener.Close();
+            }
+        }
+        if (SUCCEEDED(hr))
+        {
+            _thread = std::thread([this, pSink]() { _listener.Run(pSink); });
+        }
+        return hr;
+    }
+
+    void Stop()
+    {
+        if (_thread.joinable())
+        {
+            _listener.Stop();
+            _thread.join();
+            _listener.Close();
+        }
+    }
+
+  private:
+    CCredentialListener _listener;
+    std::thread         _thread;
+    char                _szPort[16];
+};
+
+// Connects a blocking TCP socket to pszPort on the loopback address, from the loopback
+// address pszFrom (such as "127.0.0.2") if one is given, so that tests can play
+// senders on different hosts.
+inline socket_t HarnessConnect(const char* pszPort, const char* pszFrom = NULL)
+{
+    socket_t s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == INVALID_SOCKET_T)
+    {
+        return s;
+    }
+
+    struct sockaddr_in sa;
+    if (pszFrom != NULL)
+    {
+        ZeroMemory(&sa, sizeof(sa));
+        sa.sin_family = AF_INET;
+        if (inet_pton(AF_INET, pszFrom, &sa.sin_addr) != 1 ||
+            bind(s, (struct sockaddr*)&sa, sizeof(sa)) == SOCKET_ERROR)
+        {
+            SocketClose(s);
+            return INVALID_SOCKET_T;
+        }
+    }
+
+    ZeroMemory(&sa, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    sa.sin_port = htons((USHORT)atoi(pszPort));
+    if (connect(s, (struct sockaddr*)&sa, sizeof(sa)) == SOCKET_ERROR)
+    {
+        SocketClose(s);
+        return INVALID_SOCKET_T;
+    }
+
+    int iNoDelay = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &iNoDelay, sizeof(iNoDelay));
+    return s;
+}
+
+// Sends all cb bytes of pb, in pieces of at most cbPiece if that's given.
+inline BOOL HarnessSend(socket_t s, const void* pv, size_t cb, size_t cbPiece = 0)
+{
+    const char* pb = (const char*)pv;
+    while (cb > 0)
+    {
+        size_t cbSend = (cbPiece != 0 && cbPiece < cb) ? cbPiece : cb;
+        int iResult = (int)send(s, pb, cbSend, MSG_NOSIGNAL);
+        if (iResult <= 0)
+        {
+            return FALSE;
+        }
+        pb += iResult;
+        cb -= iResult;
+    }
+    return TRUE;
+}
+
+// Receives exactly cb bytes into pv. Fails if the connection closes first.
+inline BOOL HarnessRecv(socket_t s, void* pv, size_t cb)
+{
+    char* pb = (char*)pv;
+    while (cb > 0)
+    {
+        int iResult = (int)recv(s, pb, cb, 0);
+        if (iResult <= 0)
+        {
+            return FALSE;
+        }
+        pb += iResult;
+        cb -= iResult;
+    }
+    return TRUE;
+}
+
+// Appends a frame of type bType carrying cbPayload bytes of pbPayload to rgb.
+inline void HarnessAppendFrame(std::vector<BYTE>& rgb, BYTE bType, DWORD dwRequestId, const void* pvPayload, DWORD cbPayload)
+{
+    FRAME_HEADER fh;
+    fh.bMagic = FRAME_MAGIC;
+    fh.bVersion = FRAME_VERSION;
+    fh.bType = bType;
+    fh.bFlags = 0;
+    fh.dwRequestId = dwRequestId;
+    fh.cbPayload = cbPayload;
+
+    size_t ib = rgb.size();
+    rgb.resize(ib + FRAME_HEADER_SIZE + cbPayload);
+    FrameHeaderEncode(fh, &rgb[ib]);
+    if (cbPayload != 0)
+    {
+        CopyMemory(&rgb[ib + FRAME_HEADER_SIZE], pvPayload, cbPayload);
+    }
+}
+
+// Appends a length-prefixed field, as FT_CREDENTIAL and FT_PROVISION payloads hold them.
+inline void HarnessAppendField(std::vector<BYTE>& rgb, const void* pv, USHORT cb)
+{
+    rgb.push_back((BYTE)cb);
+    rgb.push_back((BYTE)(cb >> 8));
+    rgb.insert(rgb.end(), (const BYTE*)pv, (const BYTE*)pv + cb);
+}
+
+// Appends an FT_CREDENTIAL frame for pszUser and pszPassword to rgb.
+inline void HarnessAppendCredential(std::vector<BYTE>& rgb, DWORD dwRequestId, const char* pszUser, const char* pszPassword)
+{
+    std::vector<BYTE> rgbPayload;
+    HarnessAppendField(rgbPayload, pszUser, (USHORT)strlen(pszUser));
+    HarnessAppendField(rgbPayload, pszPassword, (USHORT)strlen(pszPassword));
+    HarnessAppendFrame(rgb, FT_CREDENTIAL, dwRequestId, rgbPayload.data(), (DWORD)rgbPayload.size());
+}
+
+// Reads one FT_ACK, returning FALSE if the connection closed or sent something else.
+inline BOOL HarnessRecvAck(socket_t s, DWORD* pdwRequestId, HRESULT* phrStatus)
+{
+    BYTE rgb[FRAME_ACK_SIZE];
+    if (!HarnessRecv(s, rgb, sizeof(rgb)) || rgb[0] != FRAME_MAGIC || rgb[2] != FT_ACK)
+    {
+        return FALSE;
+    }
+    *pdwRequestId = (DWORD)rgb[4] | ((DWORD)rgb[5] << 8) | ((DWORD)rgb[6] << 16) | ((DWORD)rgb[7] << 24);
+    *phrStatus = (HRESULT)((DWORD)rgb[12] | ((DWORD)rgb[13] << 8) | ((DWORD)rgb[14] << 16) | ((DWORD)rgb[15] << 24));
+    return TRUE;
+}
+
+// Whether the listener has closed s: a read returns end of file, or the connection was
+// reset, within dwTimeoutMs.
+inline BOOL HarnessIsClosed(socket_t s, DWORD dwTimeoutMs)
+{
+    pollfd_t pfd;
+    pfd.fd = s;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (SocketPoll(&pfd, 1, (int)dwTimeoutMs) <= 0)
+    {
+        return FALSE;
+    }
+    char ch;
+    return recv(s, &ch, 1, 0) <= 0;
+}
+
+// Waits up to dwTimeoutMs for pfn to return TRUE.
+template <class F>
+inline BOOL HarnessWaitFor(F pfn, DWORD dwTimeoutMs)
+{
+    ULONGLONG ullDeadline = GetTickCount64() + dwTimeoutMs;
+    while (!pfn())
+    {
+        if (GetTickCount64() > ullDeadline)
+        {
+            return FALSE;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return TRUE;
+}
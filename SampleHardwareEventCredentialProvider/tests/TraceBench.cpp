@@ -0,0 +1,60 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Measures what CTraceScope costs the code it's in: nanoseconds for each span's begin
+// and end events with tracing on, where each should take well under 100 ns, and with
+// it off, where a span should cost next to nothing. Then how long a Flush of a full
+// ring takes.
+//
+//   TraceBench [spans]
+
+#include "TestHarness.h"
+#include "TraceLog.h"
+#include <unistd.h>
+
+#define TRACE_EVENT_BUDGET_NS   100
+
+// Nanoseconds for cSpans spans, one after another.
+static ULONGLONG _TimeSpans(DWORD cSpans)
+{
+    ULONGLONG ullStart = StageClock();
+    for (DWORD i = 0; i < cSpans; i++)
+    {
+        CTraceScope trace("bench", "span");
+    }
+    return StageClock() - ullStart;
+}
+
+int main(int argc, char** argv)
+{
+    DWORD cSpans = HarnessArg(argc, argv, 1, 10000000);
+    const char* pszDir = getenv("TMPDIR");
+    char szPath[MAX_PATH];
+    snprintf(szPath, sizeof(szPath), "%s/TraceBench-%u.json", pszDir ? pszDir : "/tmp", (unsigned)getpid());
+    CTraceLog* pLog = CTraceLog::GetShared();
+
+    ULONGLONG ullOffNs = _TimeSpans(cSpans);
+    printf("Tracing off: %u spans in %.1f ms, %.2f ns a span\n", (unsigned)cSpans, ullOffNs / 1e6,
+        (double)ullOffNs / cSpans);
+
+    CHECK(SUCCEEDED(pLog->Start(szPath)));
+    ULONGLONG ullOnNs = _TimeSpans(cSpans);
+    double dEventNs = (double)ullOnNs / cSpans / 2;
+    printf("Tracing on:  %u spans in %.1f ms, %.2f ns a span, %.2f ns an event%s\n", (unsigned)cSpans,
+        ullOnNs / 1e6, (double)ullOnNs / cSpans, dEventNs,
+        (dEventNs < TRACE_EVENT_BUDGET_NS) ? "" : " (over budget)");
+
+    ULONGLONG ullStart = StageClock();
+    CHECK(SUCCEEDED(pLog->Flush()));
+    printf("Flush of %u events: %.2f ms\n", (unsigned)((cSpans * 2 < TRACE_RING_EVENTS) ? cSpans * 2 : TRACE_RING_EVENTS),
+        (StageClock() - ullStart) / 1e6);
+
+    pLog->Stop();
+    remove(szPath);
+    return HarnessResult();
+}
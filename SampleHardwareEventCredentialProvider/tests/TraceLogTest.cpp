@@ -0,0 +1,405 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Records nested spans and instants into CTraceLog from threads of their own, flushes
+// them and reads the file back as JSON: it must be a well-formed Chrome trace, and on
+// each thread every end must close the span most recently begun, in time order. That
+// must still hold once a thread's ring has wrapped and lost the beginnings of some of
+// its spans; and nothing is recorded while tracing is off.
+
+#include "TestHarness.h"
+#include "TraceLog.h"
+#include <map>
+#include <string>
+#include <unistd.h>
+
+// Just enough of JSON to check a trace with.
+struct JSON_VALUE
+{
+    char                                            chType;     // One of "{[snbz": object, array, string, number, bool, null.
+    std::string                                     str;
+    double                                          d;
+    std::vector<JSON_VALUE>                         rgItems;
+    std::vector<std::pair<std::string, JSON_VALUE>> rgMembers;
+
+    const JSON_VALUE* Find(const char* pszName) const
+    {
+        for (const std::pair<std::string, JSON_VALUE>& member : rgMembers)
+        {
+            if (member.first == pszName)
+            {
+                return &member.second;
+            }
+        }
+        return NULL;
+    }
+};
+
+class CJsonReader
+{
+  public:
+    CJsonReader(const std::string& str) : _pch(str.c_str()), _pchEnd(str.c_str() + str.size()) {}
+
+    // Reads the whole text as a single value, with nothing but whitespace after it.
+    BOOL Read(JSON_VALUE* pValue)
+    {
+        BOOL fOk = _ReadValue(pValue);
+        _SkipSpace();
+        return fOk && _pch == _pchEnd;
+    }
+
+  private:
+    void _SkipSpace()
+    {
+        while (_pch < _pchEnd && (*_pch == ' ' || *_pch == '\t' || *_pch == '\n' || *_pch == '\r'))
+        {
+            _pch++;
+        }
+    }
+
+    BOOL _Take(char ch)
+    {
+        _SkipSpace();
+        if (_pch < _pchEnd && *_pch == ch)
+        {
+            _pch++;
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    BOOL _TakeWord(const char* pszWord)
+    {
+        size_t cch = strlen(pszWord);
+        if ((size_t)(_pchEnd - _pch) >= cch && memcmp(_pch, pszWord, cch) == 0)
+        {
+            _pch += cch;
+            return TRUE;
+        }
+        return FALSE;
+    }
+
+    BOOL _ReadString(std::string* pstr)
+    {
+        if (!_Take('"'))
+        {
+            return FALSE;
+        }
+        while (_pch < _pchEnd && *_pch != '"')
+        {
+            if ((BYTE)*_pch < 0x20)
+            {
+                return FALSE;
+            }
+            if (*_pch == '\\')
+            {
+                if (++_pch == _pchEnd || strchr("\"\\/bfnrtu", *_pch) == NULL)
+                {
+                    return FALSE;
+                }
+                if (*_pch == 'u')
+                {
+                    for (int i = 0; i < 4; i++)
+                    {
+                        if (++_pch == _pchEnd || !isxdigit((BYTE)*_pch))
+                        {
+                            return FALSE;
+                        }
+                    }
+                }
+            }
+            *pstr += *_pch++;
+        }
+        return _pch++ < _pchEnd;
+    }
+
+    BOOL _ReadDigits()
+    {
+        const char* pchStart = _pch;
+        while (_pch < _pchEnd && *_pch >= '0' && *_pch <= '9')
+        {
+            _pch++;
+        }
+        return _pch > pchStart;
+    }
+
+    BOOL _ReadNumber(double* pd)
+    {
+        const char* pchStart = _pch;
+        if (_pch < _pchEnd && *_pch == '-')
+        {
+            _pch++;
+        }
+        // No leading zeroes.
+        const char* pchDigits = _pch;
+        if (!_ReadDigits() || (*pchDigits == '0' && _pch - pchDigits > 1))
+        {
+            return FALSE;
+        }
+        if (_pch < _pchEnd && *_pch == '.')
+        {
+            _pch++;
+            if (!_ReadDigits())
+            {
+                return FALSE;
+            }
+        }
+        if (_pch < _pchEnd && (*_pch == 'e' || *_pch == 'E'))
+        {
+            _pch++;
+            if (_pch < _pchEnd && (*_pch == '+' || *_pch == '-'))
+            {
+                _pch++;
+            }
+            if (!_ReadDigits())
+            {
+                return FALSE;
+            }
+        }
+        *pd = strtod(std::string(pchStart, _pch).c_str(), NULL);
+        return TRUE;
+    }
+
+    BOOL _ReadValue(JSON_VALUE* pValue)
+    {
+        _SkipSpace();
+        if (_pch == _pchEnd)
+        {
+            return FALSE;
+        }
+
+        pValue->chType = *_pch;
+        if (_Take('{'))
+        {
+            if (_Take('}'))
+            {
+                return TRUE;
+            }
+            do
+            {
+                std::pair<std::string, JSON_VALUE> member;
+                if (!_ReadString(&member.first) || !_Take(':') || !_ReadValue(&member.second))
+                {
+                    return FALSE;
+                }
+                pValue->rgMembers.push_back(member);
+            } while (_Take(','));
+            return _Take('}');
+        }
+        if (_Take('['))
+        {
+            if (_Take(']'))
+            {
+                return TRUE;
+            }
+            do
+            {
+                pValue->rgItems.push_back(JSON_VALUE());
+                if (!_ReadValue(&pValue->rgItems.back()))
+                {
+                    return FALSE;
+                }
+            } while (_Take(','));
+            return _Take(']');
+        }
+        if (*_pch == '"')
+        {
+            pValue->chType = 's';
+            return _ReadString(&pValue->str);
+        }
+        if (_TakeWord("true") || _TakeWord("false"))
+        {
+            pValue->chType = 'b';
+            return TRUE;
+        }
+        if (_TakeWord("null"))
+        {
+            pValue->chType = 'z';
+            return TRUE;
+        }
+        pValue->chType = 'n';
+        return _ReadNumber(&pValue->d);
+    }
+
+    const char  *_pch;
+    const char  *_pchEnd;
+};
+
+struct THREAD_EVENTS
+{
+    DWORD   cBegin;
+    DWORD   cEnd;
+    DWORD   cInstant;
+    DWORD   cOpen;      // Spans begun but not ended when the trace was written.
+};
+
+// Reads the trace at pszPath, checking it as it goes, and counts each thread's events.
+static BOOL _ReadTrace(const char* pszPath, std::map<DWORD, THREAD_EVENTS>* pThreads)
+{
+    std::string strText;
+    FILE* pFile = fopen(pszPath, "r");
+    CHECK(pFile != NULL);
+    if (pFile == NULL)
+    {
+        return FALSE;
+    }
+    char rgch[4096];
+    size_t cch;
+    while ((cch = fread(rgch, 1, sizeof(rgch), pFile)) > 0)
+    {
+        strText.append(rgch, cch);
+    }
+    fclose(pFile);
+
+    JSON_VALUE trace;
+    CJsonReader reader(strText);
+    CHECK(reader.Read(&trace) && trace.chType == '{');
+    const JSON_VALUE* pEvents = trace.Find("traceEvents");
+    CHECK(pEvents != NULL && pEvents->chType == '[');
+    if (pEvents == NULL || pEvents->chType != '[')
+    {
+        return FALSE;
+    }
+
+    // Each thread's open spans, innermost last, and its latest timestamp.
+    std::map<DWORD, std::vector<std::string>> stacks;
+    std::map<DWORD, double> latest;
+    pThreads->clear();
+    BOOL fOk = TRUE;
+    for (const JSON_VALUE& event : pEvents->rgItems)
+    {
+        const JSON_VALUE* pCat = event.Find("cat");
+        const JSON_VALUE* pName = event.Find("name");
+        const JSON_VALUE* pPhase = event.Find("ph");
+        const JSON_VALUE* pTs = event.Find("ts");
+        const JSON_VALUE* pPid = event.Find("pid");
+        const JSON_VALUE* pTid = event.Find("tid");
+        if (pCat == NULL || pCat->chType != 's' || pName == NULL || pName->chType != 's' ||
+            pPhase == NULL || pPhase->chType != 's' || pPhase->str.size() != 1 ||
+            pTs == NULL || pTs->chType != 'n' || pPid == NULL || pPid->d != getpid() ||
+            pTid == NULL || pTid->chType != 'n')
+        {
+            fOk = FALSE;
+            continue;
+        }
+
+        DWORD dwThread = (DWORD)pTid->d;
+        THREAD_EVENTS& counts = (*pThreads)[dwThread];
+        std::vector<std::string>& stack = stacks[dwThread];
+        fOk = fOk && (latest.count(dwThread) == 0 || pTs->d >= latest[dwThread]);
+        latest[dwThread] = pTs->d;
+        switch (pPhase->str[0])
+        {
+        case TRACE_PHASE_BEGIN:
+            counts.cBegin++;
+            stack.push_back(pName->str);
+            break;
+        case TRACE_PHASE_END:
+            counts.cEnd++;
+            fOk = fOk && !stack.empty() && stack.back() == pName->str;
+            if (!stack.empty())
+            {
+                stack.pop_back();
+            }
+            break;
+        case TRACE_PHASE_INSTANT:
+            counts.cInstant++;
+            fOk = fOk && event.Find("s") != NULL;
+            break;
+        default:
+            fOk = FALSE;
+        }
+    }
+    for (std::pair<const DWORD, THREAD_EVENTS>& thread : *pThreads)
+    {
+        thread.second.cOpen = (DWORD)stacks[thread.first].size();
+    }
+    CHECK(fOk);
+    return fOk;
+}
+
+// An outer span holding cInner inner spans, each with an instant in it.
+static void _RecordSpans(DWORD cOuter, DWORD cInner)
+{
+    for (DWORD i = 0; i < cOuter; i++)
+    {
+        CTraceScope outer("test", "outer");
+        for (DWORD j = 0; j < cInner; j++)
+        {
+            CTraceScope inner("test", "inner");
+            TraceInstant("test", "tick");
+        }
+    }
+}
+
+// The thread we haven't seen before, which must be the only new one.
+static DWORD _NewThread(const std::map<DWORD, THREAD_EVENTS>& before, const std::map<DWORD, THREAD_EVENTS>& after)
+{
+    CHECK(after.size() == before.size() + 1);
+    for (const std::pair<const DWORD, THREAD_EVENTS>& thread : after)
+    {
+        if (before.count(thread.first) == 0)
+        {
+            return thread.first;
+        }
+    }
+    return 0;
+}
+
+int main()
+{
+    const char* pszDir = getenv("TMPDIR");
+    char szPath[MAX_PATH];
+    snprintf(szPath, sizeof(szPath), "%s/TraceLogTest-%u.json", pszDir ? pszDir : "/tmp", (unsigned)getpid());
+    CTraceLog* pLog = CTraceLog::GetShared();
+    CHECK(SUCCEEDED(pLog->Start(szPath)));
+
+    // Nothing recorded yet is still a valid trace.
+    std::map<DWORD, THREAD_EVENTS> empty;
+    CHECK(SUCCEEDED(pLog->Flush()));
+    CHECK(_ReadTrace(szPath, &empty) && empty.empty());
+
+    // A few spans, well short of filling a ring, and a span still open as we flush.
+    std::map<DWORD, THREAD_EVENTS> first;
+    std::thread([&]()
+    {
+        _RecordSpans(10, 2);
+        CTraceScope open("test", "open");
+        CHECK(SUCCEEDED(pLog->Flush()));
+    }).join();
+    CHECK(_ReadTrace(szPath, &first) && first.size() == 1);
+    if (first.size() == 1)
+    {
+        const THREAD_EVENTS& counts = first.begin()->second;
+        CHECK(counts.cBegin == 31 && counts.cEnd == 30 && counts.cInstant == 20 && counts.cOpen == 1);
+    }
+
+    // Thousands of spans, so the ring wraps. Each outer span is 14 events, and 4096 is
+    // 8 more than a multiple of 14, so what's left starts with the end of an inner span
+    // and, three inner spans later, the end of the outer one. Those two are dropped;
+    // everything else pairs up.
+    std::thread([]() { _RecordSpans(1000, 4); }).join();
+    std::map<DWORD, THREAD_EVENTS> second;
+    CHECK(SUCCEEDED(pLog->Flush()));
+    CHECK(_ReadTrace(szPath, &second));
+    DWORD dwWrapped = _NewThread(first, second);
+    const THREAD_EVENTS& wrapped = second[dwWrapped];
+    CHECK(wrapped.cBegin == wrapped.cEnd && wrapped.cOpen == 0);
+    CHECK(wrapped.cBegin + wrapped.cEnd + wrapped.cInstant == TRACE_RING_EVENTS - 2);
+    CHECK(second[first.begin()->first].cBegin == 31);
+
+    // Stop writes the trace one last time; spans recorded after it aren't.
+    pLog->Stop();
+    std::thread([]() { _RecordSpans(10, 2); }).join();
+    CHECK(SUCCEEDED(pLog->Start(szPath)));
+    std::map<DWORD, THREAD_EVENTS> third;
+    CHECK(SUCCEEDED(pLog->Flush()));
+    CHECK(_ReadTrace(szPath, &third) && third.size() == second.size());
+    pLog->Stop();
+
+    remove(szPath);
+    return HarnessResult();
+}
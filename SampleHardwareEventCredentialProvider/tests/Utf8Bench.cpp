@@ -0,0 +1,127 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Conversions a second and megabytes a second through Utf8ToUtf16, for credential-
+// sized strings of plain ASCII, Latin, CJK and emoji, against the C runtime's
+// mbstowcs in a UTF-8 locale, which is what the old Socket2 used. Then sets a second
+// through CCredentialSlot, which converts both fields and publishes them.
+//
+//   Utf8Bench [conversions]
+
+#include "TestHarness.h"
+#include "Utf8.h"
+#include "CredentialSlot.h"
+#include <locale.h>
+#include <stdlib.h>
+#include <wchar.h>
+#include <string>
+
+// Builds a string of cCodePoints characters starting at dwFirst, as UTF-8.
+static std::string _MakeSample(DWORD dwFirst, DWORD cCodePoints)
+{
+    std::string str;
+    for (DWORD i = 0; i < cCodePoints; i++)
+    {
+        DWORD dwCodePoint = dwFirst + i % 26;
+        if (dwCodePoint < 0x80)
+        {
+            str += (char)dwCodePoint;
+        }
+        else if (dwCodePoint < 0x800)
+        {
+            str += (char)(0xC0 | (dwCodePoint >> 6));
+            str += (char)(0x80 | (dwCodePoint & 0x3F));
+        }
+        else if (dwCodePoint < 0x10000)
+        {
+            str += (char)(0xE0 | (dwCodePoint >> 12));
+            str += (char)(0x80 | ((dwCodePoint >> 6) & 0x3F));
+            str += (char)(0x80 | (dwCodePoint & 0x3F));
+        }
+        else
+        {
+            str += (char)(0xF0 | (dwCodePoint >> 18));
+            str += (char)(0x80 | ((dwCodePoint >> 12) & 0x3F));
+            str += (char)(0x80 | ((dwCodePoint >> 6) & 0x3F));
+            str += (char)(0x80 | (dwCodePoint & 0x3F));
+        }
+    }
+    return str;
+}
+
+// Runs pfnConvert cConversions times and prints the rate.
+template <class F>
+static void _Time(const char* pszName, const std::string& str, DWORD cConversions, F pfnConvert)
+{
+    DWORD cFailed = 0;
+    ULONGLONG ullStart = StageClock();
+    for (DWORD i = 0; i < cConversions; i++)
+    {
+        cFailed += pfnConvert(str) ? 0 : 1;
+    }
+    ULONGLONG ullNs = StageClock() - ullStart;
+    CHECK(cFailed == 0);
+    printf("  %-10s %10.0f conversions/s, %8.1f MB/s, %6.1f ns each\n", pszName, HarnessRate(cConversions, ullNs),
+        HarnessRate(cConversions, ullNs) * str.size() / 1e6, (double)ullNs / cConversions);
+}
+
+int main(int argc, char** argv)
+{
+    DWORD cConversions = HarnessArg(argc, argv, 1, 2000000);
+    BOOL fHaveLocale = setlocale(LC_CTYPE, "C.UTF-8") != NULL || setlocale(LC_CTYPE, "en_US.UTF-8") != NULL;
+
+    static const struct
+    {
+        const char* pszName;
+        DWORD dwFirst;
+        DWORD cCodePoints;
+    } c_rgSamples[] =
+    {
+        { "ascii 8", 'a', 8 },
+        { "ascii 49", 'a', 49 },
+        { "latin 49", 0xE0, 49 },
+        { "cjk 49", 0x4E00, 49 },
+        { "emoji 24", 0x1F600, 24 },
+    };
+
+    for (size_t s = 0; s < ARRAYSIZE(c_rgSamples); s++)
+    {
+        std::string str = _MakeSample(c_rgSamples[s].dwFirst, c_rgSamples[s].cCodePoints);
+        printf("%s (%u bytes):\n", c_rgSamples[s].pszName, (unsigned)str.size());
+
+        WCHAR wsz[PROFILE_MAX_FIELD + 1];
+        volatile WCHAR wchSink = 0;
+        _Time("Utf8", str, cConversions, [&](const std::string& strIn) {
+            BOOL fOk = SUCCEEDED(Utf8ToUtf16(strIn.data(), strIn.size(), wsz, ARRAYSIZE(wsz), NULL));
+            wchSink = wsz[0];
+            return fOk;
+        });
+
+        if (fHaveLocale)
+        {
+            wchar_t wszRuntime[PROFILE_MAX_FIELD + 1];
+            _Time("mbstowcs", str, cConversions, [&](const std::string& strIn) {
+                BOOL fOk = mbstowcs(wszRuntime, strIn.c_str(), ARRAYSIZE(wszRuntime)) != (size_t)-1;
+                wchSink = (WCHAR)wszRuntime[0];
+                return fOk;
+            });
+        }
+
+        CCredentialSlot slot;
+        _Time("slot Set", str, cConversions / 2, [&](const std::string& strIn) {
+            return SUCCEEDED(slot.Set(strIn.c_str(), strIn.c_str()));
+        });
+        (void)wchSink;
+    }
+
+    if (!fHaveLocale)
+    {
+        printf("no UTF-8 locale, so mbstowcs wasn't measured\n");
+    }
+    return HarnessResult();
+}
@@ -0,0 +1,328 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// Copyright (c) 2006 Microsoft Corporation. All rights reserved.
+//
+// Checks Utf8ToUtf16 against a plain reference decoder written straight from the
+// Unicode standard's table of well-formed byte sequences: every one- and two-byte
+// input, every code point, and random mixes of both good and bad input, at every
+// buffer size that matters. Then checks that CCredentialSlot stores what it's given.
+//
+//   Utf8Test [random inputs] [seed]
+
+#include "TestHarness.h"
+#include "Utf8.h"
+#include "CredentialSlot.h"
+#include <random>
+#include <string>
+
+// What the reference decoder makes of an input.
+struct UTF8_REFERENCE
+{
+    BOOL                fWellFormed;
+    std::vector<WCHAR>  rgwch;
+};
+
+//
+// Decodes pb the slow, obvious way: each sequence is matched against the well-formed
+// byte ranges of the Unicode standard's Table 3-7, then encoded as UTF-16.
+//
+static UTF8_REFERENCE _ReferenceDecode(const BYTE* pb, size_t cb)
+{
+    static const struct
+    {
+        BYTE rgbLow[4];
+        BYTE rgbHigh[4];
+        size_t cb;
+    } c_rgRanges[] =
+    {
+        { { 0x00 },                   { 0x7F },                   1 },
+        { { 0xC2, 0x80 },             { 0xDF, 0xBF },             2 },
+        { { 0xE0, 0xA0, 0x80 },       { 0xE0, 0xBF, 0xBF },       3 },
+        { { 0xE1, 0x80, 0x80 },       { 0xEC, 0xBF, 0xBF },       3 },
+        { { 0xED, 0x80, 0x80 },       { 0xED, 0x9F, 0xBF },       3 },
+        { { 0xEE, 0x80, 0x80 },       { 0xEF, 0xBF, 0xBF },       3 },
+        { { 0xF0, 0x90, 0x80, 0x80 }, { 0xF0, 0xBF, 0xBF, 0xBF }, 4 },
+        { { 0xF1, 0x80, 0x80, 0x80 }, { 0xF3, 0xBF, 0xBF, 0xBF }, 4 },
+        { { 0xF4, 0x80, 0x80, 0x80 }, { 0xF4, 0x8F, 0xBF, 0xBF }, 4 },
+    };
+
+    UTF8_REFERENCE result;
+    result.fWellFormed = TRUE;
+    size_t ib = 0;
+    while (ib < cb)
+    {
+        size_t cbMatch = 0;
+        for (size_t r = 0; r < ARRAYSIZE(c_rgRanges) && cbMatch == 0; r++)
+        {
+            size_t k = 0;
+            while (k < c_rgRanges[r].cb && ib + k < cb &&
+                pb[ib + k] >= c_rgRanges[r].rgbLow[k] && pb[ib + k] <= c_rgRanges[r].rgbHigh[k])
+            {
+                k++;
+            }
+            if (k == c_rgRanges[r].cb)
+            {
+                cbMatch = k;
+            }
+        }
+        if (cbMatch == 0)
+        {
+            result.fWellFormed = FALSE;
+            result.rgwch.clear();
+            break;
+        }
+
+        static const BYTE c_rgbLeadMask[] = { 0, 0x7F, 0x1F, 0x0F, 0x07 };
+        DWORD dwCodePoint = pb[ib] & c_rgbLeadMask[cbMatch];
+        for (size_t k = 1; k < cbMatch; k++)
+        {
+            dwCodePoint = (dwCodePoint << 6) | (pb[ib + k] & 0x3F);
+        }
+        if (dwCodePoint >= 0x10000)
+        {
+            result.rgwch.push_back((WCHAR)(0xD800 + ((dwCodePoint - 0x10000) >> 10)));
+            result.rgwch.push_back((WCHAR)(0xDC00 + ((dwCodePoint - 0x10000) & 0x3FF)));
+        }
+        else
+        {
+            result.rgwch.push_back((WCHAR)dwCodePoint);
+        }
+        ib += cbMatch;
+    }
+    return result;
+}
+
+// Encodes a code point as UTF-8, surrogates included, so that bad input can be made too.
+static void _AppendUtf8(std::vector<BYTE>& rgb, DWORD dwCodePoint)
+{
+    if (dwCodePoint < 0x80)
+    {
+        rgb.push_back((BYTE)dwCodePoint);
+    }
+    else if (dwCodePoint < 0x800)
+    {
+        rgb.push_back((BYTE)(0xC0 | (dwCodePoint >> 6)));
+        rgb.push_back((BYTE)(0x80 | (dwCodePoint & 0x3F)));
+    }
+    else if (dwCodePoint < 0x10000)
+    {
+        rgb.push_back((BYTE)(0xE0 | (dwCodePoint >> 12)));
+        rgb.push_back((BYTE)(0x80 | ((dwCodePoint >> 6) & 0x3F)));
+        rgb.push_back((BYTE)(0x80 | (dwCodePoint & 0x3F)));
+    }
+    else
+    {
+        rgb.push_back((BYTE)(0xF0 | (dwCodePoint >> 18)));
+        rgb.push_back((BYTE)(0x80 | ((dwCodePoint >> 12) & 0x3F)));
+        rgb.push_back((BYTE)(0x80 | ((dwCodePoint >> 6) & 0x3F)));
+        rgb.push_back((BYTE)(0x80 | (dwCodePoint & 0x3F)));
+    }
+}
+
+//
+// Converts rgb into buffers of every size from too small to more than enough, and
+// checks each result against the reference: the same characters when they fit, the
+// right error when they don't, and never a write past the end of the buffer.
+//
+static DWORD g_cCompared = 0;
+static void _Compare(const std::vector<BYTE>& rgb)
+{
+    UTF8_REFERENCE reference = _ReferenceDecode(rgb.data(), rgb.size());
+    size_t cchNeeded = reference.rgwch.size() + 1;
+
+    for (size_t cchMax = 0; cchMax <= cchNeeded + 17; cchMax++)
+    {
+        // A guard after the buffer catches an overrun.
+        std::vector<WCHAR> rgwz(cchMax + 8, 0xCCCC);
+        size_t cchWritten = (size_t)-1;
+        HRESULT hr = Utf8ToUtf16((const char*)rgb.data(), rgb.size(), rgwz.data(), cchMax, &cchWritten);
+        g_cCompared++;
+
+        for (size_t i = cchMax; i < rgwz.size(); i++)
+        {
+            CHECK(rgwz[i] == 0xCCCC);
+        }
+
+        if (!reference.fWellFormed)
+        {
+            // Bad input may run out of room before the decoder reaches the bad part.
+            CHECK(hr == HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION) ||
+                hr == HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
+        }
+        else if (cchMax < cchNeeded)
+        {
+            CHECK(hr == HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
+        }
+        else
+        {
+            CHECK(hr == S_OK);
+            CHECK(cchWritten == reference.rgwch.size());
+            CHECK(memcmp(rgwz.data(), reference.rgwch.data(), reference.rgwch.size() * sizeof(WCHAR)) == 0);
+            CHECK(rgwz[reference.rgwch.size()] == 0);
+        }
+
+        // A failure leaves an empty string, not part of a secret.
+        if (FAILED(hr) && cchMax > 0)
+        {
+            CHECK(rgwz[0] == 0);
+        }
+    }
+
+    if (!reference.fWellFormed)
+    {
+        // With room for every byte the only possible failure is the bad input itself.
+        std::vector<WCHAR> rgwz(rgb.size() + 1);
+        CHECK(Utf8ToUtf16((const char*)rgb.data(), rgb.size(), rgwz.data(), rgwz.size(), NULL) ==
+            HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION));
+    }
+}
+
+// Every input of one and two bytes.
+static void TestShortInputs()
+{
+    for (DWORD b0 = 0; b0 < 256; b0++)
+    {
+        _Compare(std::vector<BYTE>(1, (BYTE)b0));
+        for (DWORD b1 = 0; b1 < 256; b1++)
+        {
+            std::vector<BYTE> rgb;
+            rgb.push_back((BYTE)b0);
+            rgb.push_back((BYTE)b1);
+            _Compare(rgb);
+        }
+    }
+}
+
+// Every code point, surrogates included, on its own and after a run of ASCII long
+// enough that it lands just past the decoder's fast path.
+static void TestEveryCodePoint()
+{
+    for (DWORD dwCodePoint = 0; dwCodePoint <= 0x10FFFF; dwCodePoint++)
+    {
+        std::vector<BYTE> rgb;
+        _AppendUtf8(rgb, dwCodePoint);
+        UTF8_REFERENCE reference = _ReferenceDecode(rgb.data(), rgb.size());
+        WCHAR wsz[4];
+        size_t cchWritten = 0;
+        HRESULT hr = Utf8ToUtf16((const char*)rgb.data(), rgb.size(), wsz, ARRAYSIZE(wsz), &cchWritten);
+        if (reference.fWellFormed)
+        {
+            CHECK(hr == S_OK && cchWritten == reference.rgwch.size() &&
+                memcmp(wsz, reference.rgwch.data(), cchWritten * sizeof(WCHAR)) == 0);
+        }
+        else
+        {
+            CHECK(hr == HRESULT_FROM_WIN32(ERROR_NO_UNICODE_TRANSLATION));
+        }
+
+        if (dwCodePoint % 251 == 0 || (dwCodePoint >= 0xD7F0 && dwCodePoint <= 0xE010))
+        {
+            std::vector<BYTE> rgbLong(17, 'a');
+            _AppendUtf8(rgbLong, dwCodePoint);
+            _Compare(rgbLong);
+        }
+    }
+
+    // The classic overlong and out-of-range forms.
+    static const char* c_rgpszBad[] =
+    {
+        "\xC0\x80", "\xC1\xBF", "\xE0\x80\x80", "\xE0\x9F\xBF", "\xF0\x80\x80\x80", "\xF0\x8F\xBF\xBF",
+        "\xF4\x90\x80\x80", "\xF5\x80\x80\x80", "\xFF", "\xED\xA0\x80", "\xED\xBF\xBF", "\x80", "\xE2\x82",
+    };
+    for (size_t i = 0; i < ARRAYSIZE(c_rgpszBad); i++)
+    {
+        std::vector<BYTE> rgb(c_rgpszBad[i], c_rgpszBad[i] + strlen(c_rgpszBad[i]));
+        CHECK(!_ReferenceDecode(rgb.data(), rgb.size()).fWellFormed);
+        _Compare(rgb);
+    }
+}
+
+// Random strings of code points, some damaged, of the lengths credentials come in.
+static void TestRandomInputs(DWORD cInputs, DWORD dwSeed)
+{
+    std::mt19937 random(dwSeed);
+    for (DWORD n = 0; n < cInputs; n++)
+    {
+        std::vector<BYTE> rgb;
+        size_t cCodePoints = random() % 70;
+        DWORD dwMix = random() % 4;
+        for (size_t i = 0; i < cCodePoints; i++)
+        {
+            DWORD dwCodePoint;
+            switch ((dwMix == 0) ? 0 : random() % (dwMix + 2))
+            {
+            case 0:
+            case 1:
+                dwCodePoint = 0x20 + random() % 0x5F;
+                break;
+            case 2:
+                dwCodePoint = 0x80 + random() % 0x780;
+                break;
+            case 3:
+                dwCodePoint = 0x800 + random() % 0xF800;
+                break;
+            default:
+                dwCodePoint = 0x10000 + random() % 0x100000;
+                break;
+            }
+            _AppendUtf8(rgb, dwCodePoint);
+        }
+        if (!rgb.empty() && random() % 4 == 0)
+        {
+            // Damage a byte, or cut the string short.
+            if (random() % 2)
+            {
+                rgb[random() % rgb.size()] = (BYTE)random();
+            }
+            else
+            {
+                rgb.resize(random() % rgb.size());
+            }
+        }
+        _Compare(rgb);
+    }
+}
+
+// The slot keeps whatever fits in a field, surrogate pairs included, and refuses
+// anything longer.
+static void TestSlot()
+{
+    CCredentialSlot slot;
+    CREDENTIAL_SNAPSHOT snapshot;
+
+    // A username made entirely of characters outside the BMP.
+    std::vector<BYTE> rgb;
+    for (DWORD i = 0; i < PROFILE_MAX_FIELD / 4; i++)
+    {
+        _AppendUtf8(rgb, 0x1F600 + i);
+    }
+    rgb.push_back(0);
+    UTF8_REFERENCE reference = _ReferenceDecode(rgb.data(), rgb.size() - 1);
+    CHECK(reference.rgwch.size() <= PROFILE_MAX_FIELD);
+
+    CHECK(slot.Set((const char*)rgb.data(), "p\xC3\xA4ss") == S_OK);
+    slot.Read(&snapshot);
+    CHECK(memcmp(snapshot.wszUser, reference.rgwch.data(), reference.rgwch.size() * sizeof(WCHAR)) == 0);
+    CHECK(snapshot.wszUser[reference.rgwch.size()] == 0);
+    CHECK(snapshot.wszPassword[0] == 'p' && snapshot.wszPassword[1] == 0xE4 && snapshot.wszPassword[4] == 0);
+
+    // PROFILE_MAX_FIELD UTF-16 characters fit; one more doesn't.
+    std::string strLong(PROFILE_MAX_FIELD, 'x');
+    CHECK(slot.Set(strLong.c_str(), strLong.c_str()) == S_OK);
+    strLong += "x";
+    CHECK(slot.Set(strLong.c_str(), "pw") == HRESULT_FROM_WIN32(ERROR_INSUFFICIENT_BUFFER));
+}
+
+int main(int argc, char** argv)
+{
+    TestShortInputs();
+    TestEveryCodePoint();
+    TestRandomInputs(HarnessArg(argc, argv, 1, 20000), HarnessArg(argc, argv, 2, 1));
+    TestSlot();
+    printf("%u conversions compared\n", (unsigned)g_cCompared);
+    return HarnessResult();
+}
@@ -0,0 +1,122 @@
+//
+// THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF
+// ANY KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO
+// THE IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A
+// PARTICULAR PURPOSE.
+//
+// How the listener's throughput scales with its worker count. Several senders each
+// keep a window of credential pushes in flight on one connection, against a sink
+// that takes a set time per credential, as a profile lookup and the provider's
+// update would; the run is repeated with no workers (everything on the event loop)
+// and then with 1, 2, 4 ... up to the most asked for.
+//
+//   WorkerBench [pushes per sender] [sink cost in us] [most workers]
+
+#include "TestHarness.h"
+#include <chrono>
+
+#define SENDERS 8
+#define WINDOW  16
+
+class CSlowSink : public CHarnessSink
+{
+  public:
+    CSlowSink(DWORD dwCostUs) : _dwCostUs(dwCostUs) {}
+
+    void OnCredentialReceived(const char* pszUser, const char* pszPassword)
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(_dwCostUs));
+        CHarnessSink::OnCredentialReceived(pszUser, pszPassword);
+    }
+
+  private:
+    DWORD   _dwCostUs;
+};
+
+// One sender: cPushes pushes on a single connection, at most WINDOW unacknowledged,
+// checking that each is acknowledged in order.
+static void _Sender(const char* pszPort, DWORD cPushes)
+{
+    socket_t s = HarnessConnect(pszPort);
+    CHECK(s != INVALID_SOCKET_T);
+    if (s == INVALID_SOCKET_T)
+    {
+        return;
+    }
+
+    DWORD iNext = 0;
+    for (DWORD iAcked = 0; iAcked < cPushes; iAcked++)
+    {
+        std::vector<BYTE> rgb;
+        while (iNext < cPushes && iNext - iAcked < WINDOW)
+        {
+            HarnessAppendCredential(rgb, iNext++, "alice", "secret");
+        }
+        if (!rgb.empty() && !HarnessSend(s, rgb.data(), rgb.size()))
+        {
+            CHECK(!"send failed");
+            break;
+        }
+
+        DWORD dwRequestId;
+        HRESULT hrStatus;
+        if (!HarnessRecvAck(s, &dwRequestId, &hrStatus))
+        {
+            CHECK(!"connection closed");
+            break;
+        }
+        CHECK(dwRequestId == iAcked && hrStatus == S_OK);
+    }
+    SocketClose(s);
+}
+
+// Runs the senders against a listener with cWorkers workers; returns credentials/s.
+static double _Run(DWORD cWorkers, DWORD cPushes, DWORD dwCostUs)
+{
+    CSlowSink sink(dwCostUs);
+    CHarnessListener listener;
+    listener.Get()->SetWorkerCount(cWorkers);
+    listener.Get()->SetRateLimit(100000, 100000);
+    CHECK(SUCCEEDED(listener.Start(&sink)));
+
+    ULONGLONG ullStart = StageClock();
+    std::vector<std::thread> rgSenders;
+    for (DWORD i = 0; i < SENDERS; i++)
+    {
+        rgSenders.emplace_back(_Sender, listener.GetPort(), cPushes);
+    }
+    for (std::thread& sender : rgSenders)
+    {
+        sender.join();
+    }
+    ULONGLONG ullNs = StageClock() - ullStart;
+    listener.Stop();
+
+    CHECK(sink.GetReceivedCount() == SENDERS * cPushes);
+    return HarnessRate((ULONGLONG)SENDERS * cPushes, ullNs);
+}
+
+int main(int argc, char** argv)
+{
+    DWORD cPushes = HarnessArg(argc, argv, 1, 400);
+    DWORD dwCostUs = HarnessArg(argc, argv, 2, 200);
+    DWORD cMaxWorkers = HarnessArg(argc, argv, 3, 8);
+
+    printf("%u senders x %u pushes, window %u, sink costs %u us\n", SENDERS, (unsigned)cPushes, WINDOW, (unsigned)dwCostUs);
+    double dOne = 0;
+    for (DWORD cWorkers = 0; cWorkers <= cMaxWorkers; cWorkers = cWorkers ? cWorkers * 2 : 1)
+    {
+        double dRate = _Run(cWorkers, cPushes, dwCostUs);
+        if (cWorkers == 1)
+        {
+            dOne = dRate;
+        }
+        printf("  %2u workers %10.0f credentials/s", (unsigned)cWorkers, dRate);
+        if (cWorkers >= 1 && dOne > 0)
+        {
+            printf("   %5.2fx one worker", dRate / dOne);
+        }
+        printf("\n");
+    }
+    return HarnessResult();
+}